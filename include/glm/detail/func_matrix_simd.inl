@@ -44,7 +44,11 @@ namespace detail
 	{
 		GLM_FUNC_QUALIFIER static float call(tmat4x4<float, P> const& m)
 		{
-			return _mm_cvtss_f32(glm_mat4_determinant(*reinterpret_cast<__m128 const(*)[4]>(&m[0].data)));
+#			if GLM_HAS_FMA
+				return _mm_cvtss_f32(glm_mat4_determinant_fma(*reinterpret_cast<__m128 const(*)[4]>(&m[0].data)));
+#			else
+				return _mm_cvtss_f32(glm_mat4_determinant(*reinterpret_cast<__m128 const(*)[4]>(&m[0].data)));
+#			endif
 		}
 	};
 
@@ -54,7 +58,11 @@ namespace detail
 		GLM_FUNC_QUALIFIER static tmat4x4<float, P> call(tmat4x4<float, P> const& m)
 		{
 			tmat4x4<float, P> Result(uninitialize);
-			glm_mat4_inverse(*reinterpret_cast<__m128 const(*)[4]>(&m[0].data), *reinterpret_cast<__m128(*)[4]>(&Result[0].data));
+#			if GLM_HAS_FMA
+				glm_mat4_inverse_fma(*reinterpret_cast<__m128 const(*)[4]>(&m[0].data), *reinterpret_cast<__m128(*)[4]>(&Result[0].data));
+#			else
+				glm_mat4_inverse(*reinterpret_cast<__m128 const(*)[4]>(&m[0].data), *reinterpret_cast<__m128(*)[4]>(&Result[0].data));
+#			endif
 			return Result;
 		}
 	};
@@ -591,25 +591,37 @@ namespace glm
 			m1[0][3] * m2[2][0] + m1[1][3] * m2[2][1] + m1[2][3] * m2[2][2] + m1[3][3] * m2[2][3]);
 	}
 
+	namespace detail
+	{
+		template <typename T, precision P, bool Aligned>
+		struct compute_mat4_mul
+		{
+			GLM_FUNC_QUALIFIER static tmat4x4<T, P> call(tmat4x4<T, P> const & m1, tmat4x4<T, P> const & m2)
+			{
+				typename tmat4x4<T, P>::col_type const SrcA0 = m1[0];
+				typename tmat4x4<T, P>::col_type const SrcA1 = m1[1];
+				typename tmat4x4<T, P>::col_type const SrcA2 = m1[2];
+				typename tmat4x4<T, P>::col_type const SrcA3 = m1[3];
+
+				typename tmat4x4<T, P>::col_type const SrcB0 = m2[0];
+				typename tmat4x4<T, P>::col_type const SrcB1 = m2[1];
+				typename tmat4x4<T, P>::col_type const SrcB2 = m2[2];
+				typename tmat4x4<T, P>::col_type const SrcB3 = m2[3];
+
+				tmat4x4<T, P> Result(uninitialize);
+				Result[0] = SrcA0 * SrcB0[0] + SrcA1 * SrcB0[1] + SrcA2 * SrcB0[2] + SrcA3 * SrcB0[3];
+				Result[1] = SrcA0 * SrcB1[0] + SrcA1 * SrcB1[1] + SrcA2 * SrcB1[2] + SrcA3 * SrcB1[3];
+				Result[2] = SrcA0 * SrcB2[0] + SrcA1 * SrcB2[1] + SrcA2 * SrcB2[2] + SrcA3 * SrcB2[3];
+				Result[3] = SrcA0 * SrcB3[0] + SrcA1 * SrcB3[1] + SrcA2 * SrcB3[2] + SrcA3 * SrcB3[3];
+				return Result;
+			}
+		};
+	}//namespace detail
+
 	template <typename T, precision P>
 	GLM_FUNC_QUALIFIER tmat4x4<T, P> operator*(tmat4x4<T, P> const & m1, tmat4x4<T, P> const & m2)
 	{
-		typename tmat4x4<T, P>::col_type const SrcA0 = m1[0];
-		typename tmat4x4<T, P>::col_type const SrcA1 = m1[1];
-		typename tmat4x4<T, P>::col_type const SrcA2 = m1[2];
-		typename tmat4x4<T, P>::col_type const SrcA3 = m1[3];
-
-		typename tmat4x4<T, P>::col_type const SrcB0 = m2[0];
-		typename tmat4x4<T, P>::col_type const SrcB1 = m2[1];
-		typename tmat4x4<T, P>::col_type const SrcB2 = m2[2];
-		typename tmat4x4<T, P>::col_type const SrcB3 = m2[3];
-
-		tmat4x4<T, P> Result(uninitialize);
-		Result[0] = SrcA0 * SrcB0[0] + SrcA1 * SrcB0[1] + SrcA2 * SrcB0[2] + SrcA3 * SrcB0[3];
-		Result[1] = SrcA0 * SrcB1[0] + SrcA1 * SrcB1[1] + SrcA2 * SrcB1[2] + SrcA3 * SrcB1[3];
-		Result[2] = SrcA0 * SrcB2[0] + SrcA1 * SrcB2[1] + SrcA2 * SrcB2[2] + SrcA3 * SrcB2[3];
-		Result[3] = SrcA0 * SrcB3[0] + SrcA1 * SrcB3[1] + SrcA2 * SrcB3[2] + SrcA3 * SrcB3[3];
-		return Result;
+		return detail::compute_mat4_mul<T, P, detail::is_aligned<P>::value>::call(m1, m2);
 	}
 
 	template <typename T, precision P>
@@ -1,7 +1,34 @@
 /// @ref core
 /// @file glm/detail/type_mat4x4_sse2.inl
 
-namespace glm
-{
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT && GLM_HAS_UNRESTRICTED_UNIONS
+
+#include "../simd/matrix.h"
 
+namespace glm{
+namespace detail
+{
+	template <precision P>
+	struct compute_mat4_mul<float, P, true>
+	{
+		GLM_FUNC_QUALIFIER static tmat4x4<float, P> call(tmat4x4<float, P> const & m1, tmat4x4<float, P> const & m2)
+		{
+			tmat4x4<float, P> Result(uninitialize);
+#			if GLM_ARCH & GLM_ARCH_AVX_BIT
+				glm_mat4_mul_avx(
+					*reinterpret_cast<__m128 const(*)[4]>(&m1[0].data),
+					*reinterpret_cast<__m128 const(*)[4]>(&m2[0].data),
+					*reinterpret_cast<__m128(*)[4]>(&Result[0].data));
+#			else
+				glm_mat4_mul(
+					*reinterpret_cast<__m128 const(*)[4]>(&m1[0].data),
+					*reinterpret_cast<__m128 const(*)[4]>(&m2[0].data),
+					*reinterpret_cast<__m128(*)[4]>(&Result[0].data));
+#			endif
+			return Result;
+		}
+	};
+}//namespace detail
 }//namespace glm
+
+#endif
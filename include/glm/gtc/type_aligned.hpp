@@ -21,6 +21,7 @@
 #include "../vec2.hpp"
 #include "../vec3.hpp"
 #include "../vec4.hpp"
+#include "../mat4x4.hpp"
 #include "../gtc/vec1.hpp"
 
 namespace glm
@@ -358,5 +359,17 @@ namespace glm
 	typedef aligned_highp_bvec4			aligned_bvec4;
 #endif//GLM_PRECISION
 
+	// -- *mat4 --
+
+	/// 4 by 4 matrix of high single-precision floating-point numbers, its columns are aligned vectors.
+	/// Products, inverse and determinant use the SIMD code paths of glm/simd/matrix.h.
+	typedef tmat4x4<float, aligned_highp>		aligned_highp_mat4;
+
+	/// 4 by 4 matrix of medium single-precision floating-point numbers, its columns are aligned vectors.
+	typedef tmat4x4<float, aligned_mediump>		aligned_mediump_mat4;
+
+	/// 4 by 4 matrix of low single-precision floating-point numbers, its columns are aligned vectors.
+	typedef tmat4x4<float, aligned_lowp>		aligned_lowp_mat4;
+
 	/// @}
 }//namespace glm
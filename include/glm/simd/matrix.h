@@ -153,6 +153,39 @@ GLM_FUNC_QUALIFIER void glm_mat4_mul(glm_vec4 const in1[4], glm_vec4 const in2[4
 	}
 }
 
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+// glm_mat4_mul with two columns of the product in each 256-bit register
+// With FMA each pair of products is one multiply and one fused multiply-add, without it the sums and the result are glm_mat4_mul's
+GLM_FUNC_QUALIFIER void glm_mat4_mul_avx(glm_vec4 const in1[4], glm_vec4 const in2[4], glm_vec4 out[4])
+{
+	__m256 a0 = _mm256_broadcast_ps(&in1[0]);
+	__m256 a1 = _mm256_broadcast_ps(&in1[1]);
+	__m256 a2 = _mm256_broadcast_ps(&in1[2]);
+	__m256 a3 = _mm256_broadcast_ps(&in1[3]);
+
+	for(int i = 0; i < 4; i += 2)
+	{
+		__m256 b = _mm256_insertf128_ps(_mm256_castps128_ps256(in2[i]), in2[i + 1], 1);
+		__m256 e0 = _mm256_permute_ps(b, _MM_SHUFFLE(0, 0, 0, 0));
+		__m256 e1 = _mm256_permute_ps(b, _MM_SHUFFLE(1, 1, 1, 1));
+		__m256 e2 = _mm256_permute_ps(b, _MM_SHUFFLE(2, 2, 2, 2));
+		__m256 e3 = _mm256_permute_ps(b, _MM_SHUFFLE(3, 3, 3, 3));
+
+#		if GLM_HAS_FMA
+			__m256 a01 = _mm256_fmadd_ps(a1, e1, _mm256_mul_ps(a0, e0));
+			__m256 a23 = _mm256_fmadd_ps(a3, e3, _mm256_mul_ps(a2, e2));
+#		else
+			__m256 a01 = _mm256_add_ps(_mm256_mul_ps(a0, e0), _mm256_mul_ps(a1, e1));
+			__m256 a23 = _mm256_add_ps(_mm256_mul_ps(a2, e2), _mm256_mul_ps(a3, e3));
+#		endif
+		__m256 sum = _mm256_add_ps(a01, a23);
+
+		out[i] = _mm256_castps256_ps128(sum);
+		out[i + 1] = _mm256_extractf128_ps(sum, 1);
+	}
+}
+#endif//GLM_ARCH & GLM_ARCH_AVX_BIT
+
 GLM_FUNC_QUALIFIER void glm_mat4_transpose(glm_vec4 const in[4], glm_vec4 out[4])
 {
 	__m128 tmp0 = _mm_shuffle_ps(in[0], in[1], 0x44);
@@ -506,6 +539,41 @@ GLM_FUNC_QUALIFIER glm_vec4 glm_mat4_determinant(glm_vec4 const m[4])
 	return glm_vec4_dot(m[0], DetCof);
 }
 
+#if GLM_HAS_FMA
+// glm_mat4_determinant with each difference and sum of products as one multiply and one fused multiply-add
+GLM_FUNC_QUALIFIER glm_vec4 glm_mat4_determinant_fma(glm_vec4 const m[4])
+{
+	__m128 Swp2A = _mm_permute_ps(m[2], _MM_SHUFFLE(0, 1, 1, 2));
+	__m128 Swp3A = _mm_permute_ps(m[3], _MM_SHUFFLE(3, 2, 3, 3));
+	__m128 Swp2B = _mm_permute_ps(m[2], _MM_SHUFFLE(3, 2, 3, 3));
+	__m128 Swp3B = _mm_permute_ps(m[3], _MM_SHUFFLE(0, 1, 1, 2));
+	__m128 SubE = _mm_fmsub_ps(Swp2A, Swp3A, _mm_mul_ps(Swp2B, Swp3B));
+
+	// SubF[0] = MulC[2] - MulC[0], SubF[1] = MulC[3] - MulC[1]
+	__m128 Swp2C = _mm_permute_ps(m[2], _MM_SHUFFLE(0, 0, 1, 2));
+	__m128 Swp3C = _mm_permute_ps(m[3], _MM_SHUFFLE(1, 2, 0, 0));
+	__m128 SubF = _mm_fmsub_ps(_mm_movehl_ps(Swp2C, Swp2C), _mm_movehl_ps(Swp3C, Swp3C), _mm_mul_ps(Swp2C, Swp3C));
+
+	__m128 SubFacA = _mm_permute_ps(SubE, _MM_SHUFFLE(2, 1, 0, 0));
+	__m128 SwpFacA = _mm_permute_ps(m[1], _MM_SHUFFLE(0, 0, 0, 1));
+
+	__m128 SubTmpB = _mm_shuffle_ps(SubE, SubF, _MM_SHUFFLE(0, 0, 3, 1));
+	__m128 SubFacB = _mm_permute_ps(SubTmpB, _MM_SHUFFLE(3, 1, 1, 0));
+	__m128 SwpFacB = _mm_permute_ps(m[1], _MM_SHUFFLE(1, 1, 2, 2));
+
+	__m128 SubRes = _mm_fmsub_ps(SwpFacA, SubFacA, _mm_mul_ps(SwpFacB, SubFacB));
+
+	__m128 SubTmpC = _mm_shuffle_ps(SubE, SubF, _MM_SHUFFLE(1, 0, 2, 2));
+	__m128 SubFacC = _mm_permute_ps(SubTmpC, _MM_SHUFFLE(3, 3, 2, 0));
+	__m128 SwpFacC = _mm_permute_ps(m[1], _MM_SHUFFLE(2, 3, 3, 3));
+
+	__m128 AddRes = _mm_fmadd_ps(SwpFacC, SubFacC, SubRes);
+	__m128 DetCof = _mm_mul_ps(AddRes, _mm_setr_ps( 1.0f,-1.0f, 1.0f,-1.0f));
+
+	return glm_vec4_dot(m[0], DetCof);
+}
+#endif//GLM_HAS_FMA
+
 GLM_FUNC_QUALIFIER void glm_mat4_inverse(glm_vec4 const in[4], glm_vec4 out[4])
 {
 	__m128 Fac0;
@@ -727,6 +795,62 @@ GLM_FUNC_QUALIFIER void glm_mat4_inverse(glm_vec4 const in[4], glm_vec4 out[4])
 	out[3] = _mm_mul_ps(Inv3, Rcp0);
 }
 
+#if GLM_HAS_FMA
+// One of the six factor vectors of glm_mat4_inverse: Fac0 is glm_mat4_inverse_factor_fma<3, 2>, Fac1 <3, 1>, Fac2 <2, 1>,
+// Fac3 <3, 0>, Fac4 <2, 0> and Fac5 <1, 0>
+template <int A, int B>
+GLM_FUNC_QUALIFIER __m128 glm_mat4_inverse_factor_fma(glm_vec4 const in[4])
+{
+	__m128 Swp0a = _mm_shuffle_ps(in[3], in[2], _MM_SHUFFLE(A, A, A, A));
+	__m128 Swp0b = _mm_shuffle_ps(in[3], in[2], _MM_SHUFFLE(B, B, B, B));
+
+	__m128 Swp00 = _mm_shuffle_ps(in[2], in[1], _MM_SHUFFLE(B, B, B, B));
+	__m128 Swp01 = _mm_permute_ps(Swp0a, _MM_SHUFFLE(2, 0, 0, 0));
+	__m128 Swp02 = _mm_permute_ps(Swp0b, _MM_SHUFFLE(2, 0, 0, 0));
+	__m128 Swp03 = _mm_shuffle_ps(in[2], in[1], _MM_SHUFFLE(A, A, A, A));
+
+	return _mm_fmsub_ps(Swp00, Swp01, _mm_mul_ps(Swp02, Swp03));
+}
+
+// glm_mat4_inverse with each difference and sum of products as one multiply and fused multiply-adds
+GLM_FUNC_QUALIFIER void glm_mat4_inverse_fma(glm_vec4 const in[4], glm_vec4 out[4])
+{
+	__m128 Fac0 = glm_mat4_inverse_factor_fma<3, 2>(in);
+	__m128 Fac1 = glm_mat4_inverse_factor_fma<3, 1>(in);
+	__m128 Fac2 = glm_mat4_inverse_factor_fma<2, 1>(in);
+	__m128 Fac3 = glm_mat4_inverse_factor_fma<3, 0>(in);
+	__m128 Fac4 = glm_mat4_inverse_factor_fma<2, 0>(in);
+	__m128 Fac5 = glm_mat4_inverse_factor_fma<1, 0>(in);
+
+	__m128 SignA = _mm_set_ps( 1.0f,-1.0f, 1.0f,-1.0f);
+	__m128 SignB = _mm_set_ps(-1.0f, 1.0f,-1.0f, 1.0f);
+
+	// m[1][i], m[0][i], m[0][i], m[0][i]
+	__m128 Vec0 = _mm_permute_ps(_mm_shuffle_ps(in[1], in[0], _MM_SHUFFLE(0, 0, 0, 0)), _MM_SHUFFLE(2, 2, 2, 0));
+	__m128 Vec1 = _mm_permute_ps(_mm_shuffle_ps(in[1], in[0], _MM_SHUFFLE(1, 1, 1, 1)), _MM_SHUFFLE(2, 2, 2, 0));
+	__m128 Vec2 = _mm_permute_ps(_mm_shuffle_ps(in[1], in[0], _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 2, 2, 0));
+	__m128 Vec3 = _mm_permute_ps(_mm_shuffle_ps(in[1], in[0], _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 2, 2, 0));
+
+	// Vec1 * Fac0 - Vec2 * Fac1 + Vec3 * Fac2 and so on, as in glm_mat4_inverse
+	__m128 Inv0 = _mm_mul_ps(SignB, _mm_fmadd_ps(Vec3, Fac2, _mm_fmsub_ps(Vec1, Fac0, _mm_mul_ps(Vec2, Fac1))));
+	__m128 Inv1 = _mm_mul_ps(SignA, _mm_fmadd_ps(Vec3, Fac4, _mm_fmsub_ps(Vec0, Fac0, _mm_mul_ps(Vec2, Fac3))));
+	__m128 Inv2 = _mm_mul_ps(SignB, _mm_fmadd_ps(Vec3, Fac5, _mm_fmsub_ps(Vec0, Fac1, _mm_mul_ps(Vec1, Fac3))));
+	__m128 Inv3 = _mm_mul_ps(SignA, _mm_fmadd_ps(Vec2, Fac5, _mm_fmsub_ps(Vec0, Fac2, _mm_mul_ps(Vec1, Fac4))));
+
+	__m128 Row0 = _mm_shuffle_ps(Inv0, Inv1, _MM_SHUFFLE(0, 0, 0, 0));
+	__m128 Row1 = _mm_shuffle_ps(Inv2, Inv3, _MM_SHUFFLE(0, 0, 0, 0));
+	__m128 Row2 = _mm_shuffle_ps(Row0, Row1, _MM_SHUFFLE(2, 0, 2, 0));
+
+	__m128 Det0 = glm_vec4_dot(in[0], Row2);
+	__m128 Rcp0 = _mm_div_ps(_mm_set1_ps(1.0f), Det0);
+
+	out[0] = _mm_mul_ps(Inv0, Rcp0);
+	out[1] = _mm_mul_ps(Inv1, Rcp0);
+	out[2] = _mm_mul_ps(Inv2, Rcp0);
+	out[3] = _mm_mul_ps(Inv3, Rcp0);
+}
+#endif//GLM_HAS_FMA
+
 GLM_FUNC_QUALIFIER void glm_mat4_inverse_lowp(glm_vec4 const in[4], glm_vec4 out[4])
 {
 	__m128 Fac0;
@@ -436,6 +436,14 @@
 #	include <emmintrin.h>
 #endif//GLM_ARCH
 
+// FMA3 came with AVX2 on every x86 CPU but GCC and Clang only enable it on request (-mfma, -march=haswell),
+// Visual C++ has no macro for it and allows it with /arch:AVX2
+#if ((GLM_ARCH & GLM_ARCH_AVX_BIT) && defined(__FMA__)) || ((GLM_ARCH & GLM_ARCH_AVX2_BIT) && (GLM_COMPILER & GLM_COMPILER_VC))
+#	define GLM_HAS_FMA 1
+#else
+#	define GLM_HAS_FMA 0
+#endif
+
 #if GLM_ARCH & GLM_ARCH_SSE2_BIT
 	typedef __m128		glm_vec4;
 	typedef __m128i		glm_ivec4;
@@ -32,8 +32,11 @@
       PIC (Softimage PIC)
       PNM (PPM and PGM binary only)
 
-      Animated GIF still needs a proper API, but here's one way to do it:
-          http://gist.github.com/urraka/685d9a6340b26b830d49
+      Animated GIFs: all frames at once with stbi_load_gif_from_memory, or
+          one at a time with stbi_gif_frames_open_memory
+
+      16 bits or half floats per channel (e.g. for GL_R16 or GL_RGBA16F
+          textures) with stbi_load_16 and stbi_load_half
 
       - decode from memory or through FILE (define STBI_NO_STDIO to remove code)
       - decode from arbitrary I/O callbacks
@@ -190,6 +193,14 @@ RECENT REVISION HISTORY:
 //   // returns ok=1 and sets x, y, n if image is a supported format,
 //   // 0 otherwise.
 //
+// stbi_probe does the same in one pass and also tells which format the file
+// is and how many bits per channel it stores (8, 16, or 32 for float HDR),
+// which stbi_info plus stbi_is_16_bit would parse the header twice for:
+//
+//   stbi_probe_info info;
+//   ok = stbi_probe(filename, &info);
+//   // info.format is one of STBI_FORMAT_JPEG, STBI_FORMAT_PNG, ...
+//
 // Note that stb_image pervasively uses ints in its public API for sizes,
 // including sizes of memory buffers. This is now part of the API and thus
 // hard to change without causing breakage. As a result, the various image
@@ -265,17 +276,176 @@ RECENT REVISION HISTORY:
 // code.)
 //
 // On x86, SSE2 will automatically be used when available based on a run-time
-// test; if not, the generic C versions are used as a fall-back. On ARM targets,
+// test; if not, the generic C versions are used as a fall-back. The JPEG IDCT,
+// 2x2 chroma upsampling and YCbCr->RGB(A) conversion also have AVX2 versions
+// that are picked by a run-time CPU check. On ARM targets,
 // the typical path is to have separate builds for NEON and non-NEON devices
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
 //
+// The PNG decoder undoes the row filters with SSE2 on x86 (plus SSSE3 and
+// AVX2 kernels picked by a run-time CPU check) and with NEON when STBI_NEON
+// is defined. Define STBI_NO_PNG_SIMD to keep only the C loops for PNG.
+//
 // If for some reason you do not want to use any of SIMD code, or if
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
 //
 // ===========================================================================
 //
+// Multithreaded decoding
+//
+// stb_image does not create threads. Instead you can hand it a parallel-for
+// that runs tasks on your own threads:
+//
+//     stbi_set_parallel_for(my_parallel_for, my_pool);
+//
+// my_parallel_for(my_pool, count, task, task_data) must call
+// task(task_data, i) once for every i in [0, count), in any order and on any
+// threads (including the calling one), and return once all calls are done.
+// Tasks never call back into the parallel-for, but threads that decode at
+// the same time call it concurrently.
+//
+// The setting is a plain global that decoders read without locking: call
+// stbi_set_parallel_for before any thread starts decoding, and only change
+// or clear it while no thread is decoding.
+//
+// It is used for large baseline JPEGs that were decoded from memory: the
+// entropy-coded data is split at the restart markers (DRI) and the segments
+// are decoded concurrently, then upsampling and color conversion run in row
+// bands. Progressive JPEGs, JPEGs without restart markers and images read
+// through callbacks or FILE* are decoded on the calling thread as before.
+// The result is identical either way.
+//
+// ===========================================================================
+//
+// Memory-mapped loading   (not available with STBI_NO_STDIO)
+//
+// stbi_load reads the file through a 128 byte buffer. stbi_load_mapped maps
+// the file instead and decodes it straight out of the mapping, the same way
+// stbi_load_from_memory does (so large JPEGs can also be split over the
+// parallel-for above):
+//
+//     stbi_uc *data = stbi_load_mapped(filename, &x, &y, &n, 4, STBI_MAP_SEQUENTIAL);
+//
+// STBI_MAP_SEQUENTIAL tells the OS the file is read front to back (more read
+// ahead, pages dropped behind), STBI_MAP_WILLNEED starts reading it all in.
+//
+// stbi_load_mapped_into is the mapped version of stbi_load_from_memory_into,
+// see "Decoding into your own buffer" below.
+//
+// Mapping uses mmap on POSIX systems and file mappings on Windows. Elsewhere,
+// with STBI_WINDOWS_UTF8, for files over 2GB or if STBI_NO_MMAP is defined,
+// these functions read the file through FILE* like stbi_load.
+//
+// ===========================================================================
+//
+// Decoding into your own buffer
+//
+// stbi_load_from_memory_into and stbi_load_mapped_into write the image into
+// a buffer you provide, e.g. a mapped pixel buffer object, instead of
+// returning a new allocation:
+//
+//     stbi_info_from_memory(buffer, len, &x, &y, &n);
+//     ... get at least (y-1)*stride + x*4 bytes at dest ...
+//     ok = stbi_load_from_memory_into(buffer, len, dest, dest_size, stride, &x, &y, &n, 4, &allocator);
+//
+// desired_channels must be 1..4. A stride of 0 means rows are packed. They
+// return 1 on success and 0 on failure, including when the buffer is too
+// small. JPEG (any stride) and 8-bit PNG (packed rows) write their output
+// there directly; other images are decoded as usual and copied in.
+//
+// allocator, if not NULL, serves every allocation the decoder makes for the
+// duration of the call instead of STBI_MALLOC and friends, so with a bump
+// arena that is reset between images a batch of decodes does no heap
+// allocation at all. Nothing it allocates outlives the call. realloc and free
+// may be NULL; free is then skipped. All of it is allocated on the calling
+// thread, also when tasks run through the parallel-for above, so an arena
+// needs no locking. Without thread-local storage (STBI_NO_THREAD_LOCALS) the
+// allocator is a global for the duration of the call, and such calls must not
+// overlap.
+//
+// stbi_set_allocator_thread(&allocator) does the same for every call on the
+// calling thread until it is called with NULL. That includes the images and
+// other blocks the stbi_load* functions return meanwhile: they come from
+// allocator->alloc, so release them through your allocator, not with
+// stbi_image_free, which always uses STBI_FREE. A stbi_load_*_into call with
+// its own allocator uses that one.
+//
+// ===========================================================================
+//
+// Row-by-row decoding
+//
+// stbi_load_rows and friends hand the image to callbacks a row at a time
+// instead of returning it, e.g. to upload it to a texture in strips:
+//
+//     stbi_row_callbacks rows = { my_begin, my_row, my_data };
+//     ok = stbi_load_rows(filename, &rows, &x, &y, &n, 4);
+//
+// begin(user, x, y, channels_in_file, channels) is called once before the
+// first row and may be NULL; row(user, y, pixels) once per row, with
+// x*channels bytes that are only valid during the call. y is where the row
+// goes in the image: the rows of a PNG come in file order, which is bottom
+// to top with stbi_set_flip_vertically_on_load. Either callback can return 0
+// to stop, the call then fails. They return 1 on success and 0 on failure.
+//
+// Non-interlaced PNGs are inflated, unfiltered and converted as the rows
+// are handed out, so no buffer is the size of the image: a few rows and
+// about 400KB, and stbi_load_rows reads the file as it goes. 16-bit PNGs
+// come out as 8 bits per channel, like from stbi_load. Any other image
+// (including interlaced and iPhone PNGs) is decoded whole first.
+//
+// ===========================================================================
+//
+// Animated GIF frames   (not available with STBI_NO_GIF)
+//
+// stbi_load_gif_from_memory returns every frame of an animated GIF in one
+// allocation. stbi_gif_frames_open_memory instead decodes one frame per
+// stbi_gif_frames_next call, into the same RGBA buffer each time:
+//
+//     stbi_gif_frames *frames = stbi_gif_frames_open_memory(buffer, len, &x, &y, &count);
+//     stbi_gif_frame frame;
+//     while (stbi_gif_frames_next(frames, &frame) > 0)
+//        ... upload frame.x0,y0 .. x1,y1 of frame.pixels (row stride x*4) ...
+//     stbi_gif_frames_close(frames);
+//
+// frame.pixels holds the whole frame until the next call. x0,y0 .. x1,y1 is
+// the rectangle that differs from the previous frame (the whole image for
+// the first frame, empty if nothing changed), so it is all that needs to be
+// copied to a texture that holds the previous frame. next returns 1 for a
+// frame, 0 after the last one and -1 if the file is corrupt.
+//
+// frame_count (may be NULL) is read by skipping over the compressed data,
+// without decoding it, so the destination can be sized before the first
+// frame. The buffer has to stay valid until stbi_gif_frames_close. Frames
+// are always top row first, whatever stbi_set_flip_vertically_on_load says.
+//
+// Both functions undo a frame's disposal (methods 2 and 3, which both put
+// back what was under the frame) only in its rectangle, and keep only that
+// rectangle around for it.
+//
+// ===========================================================================
+//
+// 16-bit and half-float output
+//
+// stbi_load_16 returns 16 bits per channel, e.g. for GL_R16/GL_RG16 height
+// and normal maps. 16-bit PNGs are put in native byte order (with SSE2, eight
+// samples at a time) and converted to desired_channels as the rows are
+// unfiltered, 8-bit and smaller PNGs that aren't paletted are written out as
+// 16 bits right there, so neither is copied again afterwards. Other images
+// are widened in their own allocation, which is grown rather than copied.
+//
+// stbi_load_half returns IEEE half floats for GL_RGBA16F and friends:
+//
+//     stbi_us *data = stbi_load_half(filename, &x, &y, &n, 4);
+//
+// Radiance HDR images keep their values, everything else is loaded with
+// stbi_load_16 and scaled to 0..1 without any gamma. The halves are what
+// glm::packHalf1x16 gives (of glm::unpackUnorm1x16 for 16-bit values), bit
+// for bit, and they're converted in place, eight at a time with SSE2.
+//
+// ===========================================================================
+//
 // HDR image support   (disable by defining STBI_NO_HDR)
 //
 // stb_image supports loading HDR images in general, and currently the Radiance
@@ -288,7 +458,9 @@ RECENT REVISION HISTORY:
 //     stbi_hdr_to_ldr_scale(1.0f);
 //
 // (note, do not use _inverse_ constants; stbi_image will invert them
-// appropriately).
+// appropriately). the remapping uses a polynomial approximation of pow, vectorized
+// with SSE2, so a byte may be one off from what pow would round to (about 1 in
+// 10000 of them); the RGBE decoding itself is exact.
 //
 // Additionally, there is a new, parallel interface for loading files as
 // (linear) floats to preserve the full dynamic range:
@@ -296,8 +468,9 @@ RECENT REVISION HISTORY:
 //    float *data = stbi_loadf(filename, &x, &y, &n, 0);
 //
 // If you load LDR images through this interface, those images will
-// be promoted to floating point values, run through the inverse of
-// constants corresponding to the above:
+// be promoted to floating point values (from a table of the 256 values
+// a byte can map to), run through the inverse of constants corresponding
+// to the above:
 //
 //     stbi_ldr_to_hdr_scale(1.0f);
 //     stbi_ldr_to_hdr_gamma(2.2f);
@@ -423,14 +596,64 @@ typedef struct
 STBIDEF stbi_uc *stbi_load_from_memory   (stbi_uc           const *buffer, int len   , int *x, int *y, int *channels_in_file, int desired_channels);
 STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk  , void *user, int *x, int *y, int *channels_in_file, int desired_channels);
 
+// decode into your own buffer, see "Decoding into your own buffer" above
+typedef struct
+{
+   void *(*alloc)  (void *user, size_t size);                                  // required
+   void *(*realloc)(void *user, void *p, size_t old_size, size_t new_size);    // optional, else alloc + copy + free
+   void  (*free)   (void *user, void *p);                                      // optional, e.g. for arenas
+   void *user;
+} stbi_allocator;
+
+STBIDEF int stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *dest, size_t dest_size, int dest_stride, int *x, int *y, int *channels_in_file, int desired_channels, stbi_allocator const *allocator);
+STBIDEF void stbi_set_allocator_thread(stbi_allocator const *allocator);
+
+// see "Row-by-row decoding" above
+typedef struct
+{
+   int  (*begin)(void *user, int x, int y, int channels_in_file, int channels);  // optional
+   int  (*row)  (void *user, int y, stbi_uc const *pixels);                      // required
+   void *user;
+} stbi_row_callbacks;
+
+STBIDEF int stbi_load_rows_from_memory   (stbi_uc const *buffer, int len, stbi_row_callbacks const *rows, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF int stbi_load_rows_from_callbacks(stbi_io_callbacks const *clbk, void *user, stbi_row_callbacks const *rows, int *x, int *y, int *channels_in_file, int desired_channels);
+
 #ifndef STBI_NO_STDIO
 STBIDEF stbi_uc *stbi_load            (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
 STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in_file, int desired_channels);
 // for stbi_load_from_file, file pointer is left pointing immediately after image
+
+// map_flags for the mapped loaders, see "Memory-mapped loading" above
+enum
+{
+   STBI_MAP_SEQUENTIAL = 1,
+   STBI_MAP_WILLNEED   = 2
+};
+
+STBIDEF stbi_uc *stbi_load_mapped     (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels, int map_flags);
+STBIDEF int      stbi_load_mapped_into(char const *filename, stbi_uc *dest, size_t dest_size, int dest_stride, int *x, int *y, int *channels_in_file, int desired_channels, int map_flags, stbi_allocator const *allocator);
+
+STBIDEF int      stbi_load_rows          (char const *filename, stbi_row_callbacks const *rows, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF int      stbi_load_rows_from_file(FILE *f, stbi_row_callbacks const *rows, int *x, int *y, int *channels_in_file, int desired_channels);
 #endif
 
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
+
+// see "Animated GIF frames" above
+typedef struct stbi__gif_frames stbi_gif_frames;
+
+typedef struct
+{
+   stbi_uc const *pixels;  // the whole frame, x*y*4 bytes
+   int x0, y0, x1, y1;     // the pixels that changed since the previous frame, x1/y1 exclusive
+   int delay;              // milliseconds
+} stbi_gif_frame;
+
+STBIDEF stbi_gif_frames *stbi_gif_frames_open_memory(stbi_uc const *buffer, int len, int *x, int *y, int *frame_count);
+STBIDEF int              stbi_gif_frames_next       (stbi_gif_frames *frames, stbi_gif_frame *frame);
+STBIDEF void             stbi_gif_frames_close      (stbi_gif_frames *frames);
 #endif
 
 #ifdef STBI_WINDOWS_UTF8
@@ -450,6 +673,19 @@ STBIDEF stbi_us *stbi_load_16          (char const *filename, int *x, int *y, in
 STBIDEF stbi_us *stbi_load_from_file_16(FILE *f, int *x, int *y, int *channels_in_file, int desired_channels);
 #endif
 
+////////////////////////////////////
+//
+// half-float-per-channel interface, see "16-bit and half-float output" above
+//
+
+STBIDEF stbi_us *stbi_load_half_from_memory   (stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF stbi_us *stbi_load_half_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *channels_in_file, int desired_channels);
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_us *stbi_load_half          (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF stbi_us *stbi_load_from_file_half(FILE *f, int *x, int *y, int *channels_in_file, int desired_channels);
+#endif
+
 ////////////////////////////////////
 //
 // float-per-channel interface
@@ -503,6 +739,37 @@ STBIDEF int      stbi_is_16_bit          (char const *filename);
 STBIDEF int      stbi_is_16_bit_from_file(FILE *f);
 #endif
 
+// which decoder recognized an image, see stbi_probe
+enum
+{
+   STBI_FORMAT_UNKNOWN,
+   STBI_FORMAT_JPEG,
+   STBI_FORMAT_PNG,
+   STBI_FORMAT_GIF,
+   STBI_FORMAT_BMP,
+   STBI_FORMAT_PSD,
+   STBI_FORMAT_PIC,
+   STBI_FORMAT_PNM,
+   STBI_FORMAT_HDR,
+   STBI_FORMAT_TGA
+};
+
+typedef struct
+{
+   int x, y, comp;
+   int bits_per_channel; // 8, 16 for 16-bit PNG/PSD/PNM, 32 for HDR
+   int format;           // STBI_FORMAT_*
+} stbi_probe_info;
+
+// image dimensions, components, bit depth and format without decoding
+STBIDEF int      stbi_probe_from_memory   (stbi_uc const *buffer, int len, stbi_probe_info *info);
+STBIDEF int      stbi_probe_from_callbacks(stbi_io_callbacks const *clbk, void *user, stbi_probe_info *info);
+
+#ifndef STBI_NO_STDIO
+STBIDEF int      stbi_probe               (char const *filename, stbi_probe_info *info);
+STBIDEF int      stbi_probe_from_file     (FILE *f,              stbi_probe_info *info);
+#endif
+
 
 
 // for image formats that explicitly notate that they have premultiplied alpha,
@@ -514,7 +781,9 @@ STBIDEF void stbi_set_unpremultiply_on_load(int flag_true_if_should_unpremultipl
 // or just pass them through "as-is"
 STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 
-// flip the image vertically, so the first pixel in the output array is the bottom left
+// flip the image vertically, so the first pixel in the output array is the bottom left.
+// the PNG, JPEG, BMP and TGA decoders write the rows bottom-up as they go (along with the
+// conversion to req_comp channels), the other formats are flipped in a pass afterwards
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
 // as above, but only applies to images loaded on the thread that calls the function
@@ -524,6 +793,16 @@ STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpre
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// use the SSE2/SSSE3/AVX2 or NEON kernels to undo PNG row filters (on by default where available);
+// turning it off gives the plain C loops, e.g. to compare results or speed
+STBIDEF void stbi_set_png_simd(int flag_true_if_should_use_simd);
+
+// run large decodes on your own threads, see "Multithreaded decoding" above; NULL turns it off again.
+// call it before any thread decodes, it is read without locking
+typedef void stbi_parallel_task(void *task_data, int index);
+typedef void stbi_parallel_for_func(void *user, int count, stbi_parallel_task *task, void *task_data);
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for_func *parallel_for, void *user);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -591,7 +870,7 @@ STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const ch
 #include <limits.h>
 
 #if !defined(STBI_NO_LINEAR) || !defined(STBI_NO_HDR)
-#include <math.h>  // ldexp, pow
+#include <math.h>  // pow
 #endif
 
 #ifndef STBI_NO_STDIO
@@ -643,12 +922,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned long long stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -772,6 +1053,56 @@ static int stbi__sse2_available(void)
 #endif
 
 #endif
+
+// SSSE3 and AVX2 kernels are compiled with target attributes and only called after a
+// run-time check, so the rest of the file does not need -mavx2
+#if defined(__GNUC__) || defined(__clang__)
+#include <tmmintrin.h>
+#include <immintrin.h>
+#define STBI__TARGET_SSSE3 __attribute__((target("ssse3")))
+#define STBI__TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#include <intrin.h>
+#define STBI__TARGET_SSSE3
+#define STBI__TARGET_AVX2
+#endif
+
+// bit 0: SSSE3, bit 1: AVX2 (including OS support for the wider registers)
+static int stbi__detect_cpu_features(void)
+{
+   int features = 0;
+#if defined(__GNUC__) || defined(__clang__)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("ssse3")) features |= 1;
+   if (__builtin_cpu_supports("avx2"))  features |= 2;
+#elif defined(_MSC_VER) && _MSC_VER >= 1600
+   int info[4];
+   __cpuid(info, 1);
+   if (info[2] & (1 << 9)) features |= 1;
+   // OSXSAVE + AVX, and the OS saves the YMM registers
+   if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6) {
+      __cpuidex(info, 7, 0);
+      if (info[1] & (1 << 5)) features |= 2;
+   }
+#endif
+   return features;
+}
+
+// stbi__detect_cpu_features once, not for every PNG and JPEG
+static int stbi__cpu_features(void)
+{
+#ifdef __cplusplus
+   static const int features = stbi__detect_cpu_features();
+   return features;
+#elif defined(STBI_THREAD_LOCAL)
+   // C has no thread safe initialization of statics, each thread detects once instead
+   static STBI_THREAD_LOCAL int features = -1;
+   if (features < 0) features = stbi__detect_cpu_features();
+   return features;
+#else
+   return stbi__detect_cpu_features();
+#endif
+}
 #endif
 
 // ARM NEON
@@ -817,6 +1148,15 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   // caller's buffer for the 8-bit result with out_dest_comp channels, see stbi__result_dest
+   stbi_uc *out_dest;
+   size_t out_dest_size;
+   int out_dest_stride; // 0: rows are packed
+   int out_dest_comp;
+
+   // the caller flips the result unless the decoder already wrote it bottom-up, see stbi__result_info
+   int flip_rows;
 } stbi__context;
 
 
@@ -830,6 +1170,8 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
    s->callback_already_read = 0;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
    s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
+   s->out_dest = NULL;
+   s->flip_rows = 0;
 }
 
 // initialize a callback-based context
@@ -843,6 +1185,8 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
    s->img_buffer = s->img_buffer_original = s->buffer_start;
    stbi__refill_buffer(s);
    s->img_buffer_original_end = s->img_buffer_end;
+   s->out_dest = NULL;
+   s->flip_rows = 0;
 }
 
 #ifndef STBI_NO_STDIO
@@ -903,6 +1247,7 @@ typedef struct
    int bits_per_channel;
    int num_channels;
    int channel_order;
+   int flipped; // the decoder honored s->flip_rows, so the rows are already bottom-up
 } stbi__result_info;
 
 #ifndef STBI_NO_JPEG
@@ -913,9 +1258,10 @@ static int      stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp);
 
 #ifndef STBI_NO_PNG
 static int      stbi__png_test(stbi__context *s);
-static void    *stbi__png_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri);
+static void    *stbi__png_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc);
 static int      stbi__png_info(stbi__context *s, int *x, int *y, int *comp);
 static int      stbi__png_is16(stbi__context *s);
+static int      stbi__png_load_rows(stbi__context *s, stbi_row_callbacks const *rows, int *x, int *y, int *comp, int req_comp);
 #endif
 
 #ifndef STBI_NO_BMP
@@ -982,9 +1328,43 @@ static int stbi__err(const char *str)
 }
 #endif
 
+// the allocator of the stbi_load_*_into call running on this thread, else the one
+// stbi_set_allocator_thread set, if any
+#ifdef STBI_THREAD_LOCAL
+static STBI_THREAD_LOCAL
+#else
+static
+#endif
+stbi_allocator const *stbi__allocator;
+
+STBIDEF void stbi_set_allocator_thread(stbi_allocator const *allocator)
+{
+   stbi__allocator = allocator;
+}
+
 static void *stbi__malloc(size_t size)
 {
-    return STBI_MALLOC(size);
+   if (stbi__allocator) return stbi__allocator->alloc(stbi__allocator->user, size);
+   return STBI_MALLOC(size);
+}
+
+static void stbi__free(void *p)
+{
+   if (!stbi__allocator) { STBI_FREE(p); return; }
+   if (p && stbi__allocator->free) stbi__allocator->free(stbi__allocator->user, p);
+}
+
+static void *stbi__realloc_sized(void *p, size_t old_size, size_t new_size)
+{
+   void *q;
+   if (!stbi__allocator) return STBI_REALLOC_SIZED(p, old_size, new_size);
+   if (stbi__allocator->realloc) return stbi__allocator->realloc(stbi__allocator->user, p, old_size, new_size);
+   q = stbi__allocator->alloc(stbi__allocator->user, new_size);
+   if (q && p) {
+      memcpy(q, p, old_size < new_size ? old_size : new_size);
+      stbi__free(p);
+   }
+   return q;
 }
 
 // stb_image uses ints pervasively, including for offset calculations.
@@ -1058,6 +1438,34 @@ static void *stbi__malloc_mad3(int a, int b, int c, int add)
    return stbi__malloc(a*b*c + add);
 }
 
+#if !defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)
+// the caller's buffer, if a stbi_load_*_into call gave one that fits an 8-bit image with comp
+// channels and asked for that many. strided is 0 for decoders that can only write packed rows
+static stbi_uc *stbi__result_dest(stbi__context *s, int comp, int x, int y, int strided)
+{
+   size_t row = (size_t) comp * x;
+   size_t stride = s->out_dest_stride ? (size_t) s->out_dest_stride : row;
+   if (!s->out_dest || comp != s->out_dest_comp || !stbi__mad3sizes_valid(comp, x, y, 0)) return NULL;
+   if (stride < row || (!strided && stride != row)) return NULL;
+   if (stride * (y - 1) + row > s->out_dest_size) return NULL;
+   return s->out_dest;
+}
+
+// the final 8-bit image of a decoder that writes packed rows: the caller's buffer (see above)
+// or else a new block with add spare bytes (the caller's buffer has none). anything that may
+// have come from here is freed with stbi__free_result
+static void *stbi__malloc_result(stbi__context *s, int comp, int x, int y, int add)
+{
+   void *dest = stbi__result_dest(s, comp, x, y, 0);
+   return dest ? dest : stbi__malloc_mad3(comp, x, y, add);
+}
+
+static void stbi__free_result(stbi__context *s, void *p)
+{
+   if (p != s->out_dest) stbi__free(p);
+}
+#endif
+
 #if !defined(STBI_NO_LINEAR) || !defined(STBI_NO_HDR) || !defined(STBI_NO_PNM)
 static void *stbi__malloc_mad4(int a, int b, int c, int d, int add)
 {
@@ -1134,6 +1542,31 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+// not thread safe, see "Multithreaded decoding": set before any decode starts
+static stbi_parallel_for_func *stbi__parallel_for_global = NULL;
+static void *stbi__parallel_for_user = NULL;
+
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for_func *parallel_for, void *user)
+{
+   stbi__parallel_for_global = parallel_for;
+   stbi__parallel_for_user = user;
+}
+
+#ifndef STBI_NO_JPEG
+// most tasks one stage of a decode is split into, enough to balance the load over many cores
+#define STBI__PARALLEL_TASKS       64
+// images smaller than this are decoded on the calling thread, waking other threads costs more
+#define STBI__PARALLEL_MIN_PIXELS  (512*512)
+
+// runs task for every index in [0, count) through the user's parallel-for, returns 0 if there is none
+static int stbi__parallel_for(int count, stbi_parallel_task *task, void *task_data)
+{
+   if (!stbi__parallel_for_global) return 0;
+   stbi__parallel_for_global(stbi__parallel_for_user, count, task, task_data);
+   return 1;
+}
+#endif
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1144,7 +1577,7 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
    // test the formats with a very explicit header first (at least a FOURCC
    // or distinctive magic number first)
    #ifndef STBI_NO_PNG
-   if (stbi__png_test(s))  return stbi__png_load(s,x,y,comp,req_comp, ri);
+   if (stbi__png_test(s))  return stbi__png_load(s,x,y,comp,req_comp, ri, bpc);
    #endif
    #ifndef STBI_NO_BMP
    if (stbi__bmp_test(s))  return stbi__bmp_load(s,x,y,comp,req_comp, ri);
@@ -1154,9 +1587,8 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
    #endif
    #ifndef STBI_NO_PSD
    if (stbi__psd_test(s))  return stbi__psd_load(s,x,y,comp,req_comp, ri, bpc);
-   #else
-   STBI_NOTUSED(bpc);
    #endif
+   STBI_NOTUSED(bpc);
    #ifndef STBI_NO_PIC
    if (stbi__pic_test(s))  return stbi__pic_load(s,x,y,comp,req_comp, ri);
    #endif
@@ -1199,26 +1631,149 @@ static stbi_uc *stbi__convert_16_to_8(stbi__uint16 *orig, int w, int h, int chan
    for (i = 0; i < img_len; ++i)
       reduced[i] = (stbi_uc)((orig[i] >> 8) & 0xFF); // top half of each byte is sufficient approx of 16->8 bit scaling
 
-   STBI_FREE(orig);
+   stbi__free(orig);
    return reduced;
 }
 
+// replicates each byte to the high and low byte, maps 0->0, 255->0xffff. dest may be src itself: the
+// samples are widened from the end, and each group is read before its wider copy is stored over it
+static void stbi__widen_8_to_16(stbi__uint16 *dest, stbi_uc const *src, size_t n)
+{
+   size_t i = n;
+#ifdef STBI_SSE2
+   while (i >= 16) {
+      __m128i v;
+      i -= 16;
+      v = _mm_loadu_si128((__m128i const *) (src + i));
+      _mm_storeu_si128((__m128i *) (dest + i + 8), _mm_unpackhi_epi8(v, v));
+      _mm_storeu_si128((__m128i *) (dest + i), _mm_unpacklo_epi8(v, v));
+   }
+#endif
+   while (i > 0) {
+      --i;
+      dest[i] = (stbi__uint16) (src[i] * 257);
+   }
+}
+
 static stbi__uint16 *stbi__convert_8_to_16(stbi_uc *orig, int w, int h, int channels)
 {
-   int i;
-   int img_len = w * h * channels;
+   size_t img_len = (size_t) w * h * channels;
    stbi__uint16 *enlarged;
 
-   enlarged = (stbi__uint16 *) stbi__malloc(img_len*2);
-   if (enlarged == NULL) return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
-
-   for (i = 0; i < img_len; ++i)
-      enlarged[i] = (stbi__uint16)((orig[i] << 8) + orig[i]); // replicate to high and low byte, maps 0->0, 255->0xffff
+   // growing the allocation usually extends or remaps it rather than copying, and the samples are
+   // then widened where they are
+   enlarged = (stbi__uint16 *) stbi__realloc_sized(orig, img_len, img_len*2);
+   if (enlarged == NULL) {
+      stbi__free(orig);
+      return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
+   }
 
-   STBI_FREE(orig);
+   stbi__widen_8_to_16(enlarged, (stbi_uc *) enlarged, img_len);
    return enlarged;
 }
 
+// float to IEEE half the way glm::packHalf1x16 (glm::detail::toFloat16) does it, so the halves match
+// what the application packs itself: round to nearest with halfway cases away from zero, too large
+// values become infinity, NaN stays NaN
+static stbi__uint16 stbi__float_to_half(float f)
+{
+   stbi__uint32 i;
+   int s, e, m;
+   memcpy(&i, &f, 4);
+   s = (int) ((i >> 16) & 0x8000);
+   e = (int) ((i >> 23) & 0xff) - (127 - 15);
+   m = (int) (i & 0x7fffff);
+
+   if (e <= 0) {
+      // a half denormal, or zero if it's below half of the smallest one
+      if (e < -10) return (stbi__uint16) s;
+      m = (m | 0x800000) >> (1 - e);
+      if (m & 0x1000) m += 0x2000; // may round up to the smallest normal, which the bits get right
+      return (stbi__uint16) (s | (m >> 13));
+   } else if (e == 0xff - (127 - 15)) {
+      if (m == 0) return (stbi__uint16) (s | 0x7c00);
+      // NaN keeps the top of its significand, with at least one bit set so it doesn't become infinity
+      m >>= 13;
+      return (stbi__uint16) (s | 0x7c00 | m | (m == 0));
+   } else {
+      if (m & 0x1000) {
+         m += 0x2000;
+         if (m & 0x800000) { m = 0; ++e; }
+      }
+      if (e > 30) return (stbi__uint16) (s | 0x7c00);
+      return (stbi__uint16) (s | (e << 10) | (m >> 13));
+   }
+}
+
+#ifdef STBI_SSE2
+// stbi__float_to_half on four floats, without branches. the halves are in the low 16 bits of the
+// lanes, sign extended so two results pack with _mm_packs_epi32.
+// normal halves are the float's bits plus half a step of the half's significand, shifted down and
+// rebiased; a carry out of the significand bumps the exponent, as in the scalar version. denormal
+// halves take the float times 2^37, truncated: that is the significand with its implicit bit,
+// shifted right by 1-e, and it is rounded the same way (and comes out 0 below e = -10)
+static __m128i stbi__float_to_half_sse2(__m128 f)
+{
+   __m128i i = _mm_castps_si128(f);
+   __m128i a = _mm_and_si128(i, _mm_set1_epi32(0x7fffffff));
+   __m128i round = _mm_set1_epi32(0x1000);
+   __m128i infinity = _mm_set1_epi32(0x7c00);
+   __m128i normal = _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(a, round), 13), _mm_set1_epi32((127 - 15) << 10));
+   __m128i scaled = _mm_cvttps_epi32(_mm_mul_ps(_mm_castsi128_ps(a), _mm_set1_ps(137438953472.0f)));
+   __m128i denormal = _mm_srli_epi32(_mm_add_epi32(scaled, round), 13);
+   __m128i nan = _mm_srli_epi32(_mm_and_si128(a, _mm_set1_epi32(0x7fffff)), 13);
+   __m128i is_big = _mm_cmpgt_epi32(normal, _mm_set1_epi32(0x7bff));
+   __m128i is_denormal = _mm_cmplt_epi32(a, _mm_set1_epi32(0x38800000));
+   __m128i is_nan = _mm_cmpgt_epi32(a, _mm_set1_epi32(0x7f800000));
+   __m128i h;
+   nan = _mm_or_si128(_mm_or_si128(nan, infinity), _mm_srli_epi32(_mm_cmpeq_epi32(nan, _mm_setzero_si128()), 31));
+   h = _mm_or_si128(_mm_andnot_si128(is_big, normal), _mm_and_si128(is_big, infinity));
+   h = _mm_or_si128(_mm_andnot_si128(is_denormal, h), _mm_and_si128(is_denormal, denormal));
+   h = _mm_or_si128(_mm_andnot_si128(is_nan, h), _mm_and_si128(is_nan, nan));
+   return _mm_or_si128(h, _mm_and_si128(_mm_srai_epi32(i, 31), _mm_set1_epi32((int) 0xffff8000)));
+}
+#endif
+
+#ifndef STBI_NO_HDR
+// n floats to halves. dest may be src itself: each half is stored after its float was read, and
+// below the floats still to be read
+static void stbi__float_to_half_n(stbi_uc *dest, stbi_uc const *src, size_t n)
+{
+   size_t i = 0;
+#ifdef STBI_SSE2
+   for (; i + 8 <= n; i += 8) {
+      __m128 lo = _mm_loadu_ps((float const *) (src + i*4));
+      __m128 hi = _mm_loadu_ps((float const *) (src + i*4 + 16));
+      _mm_storeu_si128((__m128i *) (dest + i*2), _mm_packs_epi32(stbi__float_to_half_sse2(lo), stbi__float_to_half_sse2(hi)));
+   }
+#endif
+   for (; i < n; ++i) {
+      float f;
+      stbi__uint16 h;
+      memcpy(&f, src + i*4, 4);
+      h = stbi__float_to_half(f);
+      memcpy(dest + i*2, &h, 2);
+   }
+}
+#endif
+
+// 16-bit samples to halves of 0..1 in place, through the float glm::unpackUnorm1x16 gives
+static void stbi__unorm16_to_half(stbi__uint16 *data, size_t n)
+{
+   float const scale = 1.5259021896696421759365224689097e-5f; // 1.0 / 65535.0
+   size_t i = 0;
+#ifdef STBI_SSE2
+   for (; i + 8 <= n; i += 8) {
+      __m128i v = _mm_loadu_si128((__m128i const *) (data + i));
+      __m128 lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128())), _mm_set1_ps(scale));
+      __m128 hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, _mm_setzero_si128())), _mm_set1_ps(scale));
+      _mm_storeu_si128((__m128i *) (data + i), _mm_packs_epi32(stbi__float_to_half_sse2(lo), stbi__float_to_half_sse2(hi)));
+   }
+#endif
+   for (; i < n; ++i)
+      data[i] = stbi__float_to_half((float) data[i] * scale);
+}
+
 static void stbi__vertical_flip(void *image, int w, int h, int bytes_per_pixel)
 {
    int row;
@@ -1260,8 +1815,10 @@ static void stbi__vertical_flip_slices(void *image, int w, int h, int z, int byt
 static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    stbi__result_info ri;
-   void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
+   void *result;
 
+   s->flip_rows = stbi__vertically_flip_on_load;
+   result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
    if (result == NULL)
       return NULL;
 
@@ -1275,7 +1832,7 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
 
    // @TODO: move stbi__convert_format to here
 
-   if (stbi__vertically_flip_on_load) {
+   if (stbi__vertically_flip_on_load && !ri.flipped) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
    }
@@ -1286,8 +1843,10 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
 static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    stbi__result_info ri;
-   void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 16);
+   void *result;
 
+   s->flip_rows = stbi__vertically_flip_on_load;
+   result = stbi__load_main(s, x, y, comp, req_comp, &ri, 16);
    if (result == NULL)
       return NULL;
 
@@ -1302,7 +1861,7 @@ static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x,
    // @TODO: move stbi__convert_format16 to here
    // @TODO: special case RGB-to-Y (and RGBA-to-YA) for 8-bit-to-16-bit case to keep more precision
 
-   if (stbi__vertically_flip_on_load) {
+   if (stbi__vertically_flip_on_load && !ri.flipped) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi__uint16));
    }
@@ -1320,6 +1879,135 @@ static void stbi__float_postprocess(float *result, int *x, int *y, int *comp, in
 }
 #endif
 
+// HDR images keep their values, everything else is loaded as 16 bits and scaled to 0..1 (no gamma).
+// both are converted where they were decoded
+static stbi__uint16 *stbi__load_and_postprocess_half(stbi__context *s, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__uint16 *result;
+   size_t count;
+
+   #ifndef STBI_NO_HDR
+   if (stbi__hdr_test(s)) {
+      stbi__result_info ri;
+      float *hdr_data = stbi__hdr_load(s, x, y, comp, req_comp, &ri);
+      if (hdr_data == NULL)
+         return NULL;
+      count = (size_t) *x * *y * (req_comp ? req_comp : *comp);
+      stbi__float_to_half_n((stbi_uc *) hdr_data, (stbi_uc *) hdr_data, count);
+      // give back the second half, keep the allocation if that fails
+      result = (stbi__uint16 *) stbi__realloc_sized(hdr_data, count*4, count*2);
+      if (result == NULL) result = (stbi__uint16 *) hdr_data;
+      if (stbi__vertically_flip_on_load)
+         stbi__vertical_flip(result, *x, *y, (req_comp ? req_comp : *comp) * sizeof(stbi__uint16));
+      return result;
+   }
+   #endif
+
+   result = stbi__load_and_postprocess_16bit(s, x, y, comp, req_comp);
+   if (result == NULL)
+      return NULL;
+   count = (size_t) *x * *y * (req_comp ? req_comp : *comp);
+   stbi__unorm16_to_half(result, count);
+   return result;
+}
+
+// decodes s into the caller's buffer dest, with allocator (if any, else the thread's) serving
+// every allocation made on this thread meanwhile. decoders that can write there directly (see
+// stbi__result_dest) do, anything else is moved there afterwards, flipped on the way
+static int stbi__load_into(stbi__context *s, stbi_uc *dest, size_t dest_size, int dest_stride, int *x, int *y, int *comp, int req_comp, stbi_allocator const *allocator)
+{
+   stbi__result_info ri;
+   stbi_allocator const *previous = stbi__allocator;
+   void *result;
+   size_t row, needed;
+   int flip = stbi__vertically_flip_on_load;
+   int j;
+
+   if (req_comp < 1 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+   if (dest_stride < 0) return stbi__err("bad stride", "Destination row stride is negative");
+
+   s->out_dest = dest;
+   s->out_dest_size = dest_size;
+   s->out_dest_stride = dest_stride;
+   s->out_dest_comp = req_comp;
+   s->flip_rows = flip;
+   if (allocator) stbi__allocator = allocator;
+   result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
+   if (result == NULL) {
+      stbi__allocator = previous;
+      return 0;
+   }
+   if (ri.flipped) flip = 0;
+
+   // every loader converts to req_comp channels itself
+   row = (size_t) *x * req_comp;
+   if (dest_stride == 0) dest_stride = (int) row;
+   needed = (size_t) dest_stride * (*y - 1) + row;
+   if (result == dest) {
+      if (flip) {
+         // swap rows through a small buffer, like stbi__vertical_flip
+         stbi_uc temp[2048];
+         for (j = 0; j < (*y >> 1); ++j) {
+            stbi_uc *row0 = dest + (size_t) j * dest_stride;
+            stbi_uc *row1 = dest + (size_t) (*y - 1 - j) * dest_stride;
+            size_t done, chunk;
+            for (done = 0; done < row; done += chunk) {
+               chunk = row - done < sizeof(temp) ? row - done : sizeof(temp);
+               memcpy(temp, row0 + done, chunk);
+               memcpy(row0 + done, row1 + done, chunk);
+               memcpy(row1 + done, temp, chunk);
+            }
+         }
+      }
+   } else if ((size_t) dest_stride < row || needed > dest_size) {
+      stbi__free(result);
+      stbi__allocator = previous;
+      return stbi__err("buffer too small", "Destination buffer is smaller than the image");
+   } else {
+      for (j = 0; j < *y; ++j) {
+         stbi_uc *out = dest + (size_t) (flip ? *y - 1 - j : j) * dest_stride;
+         if (ri.bits_per_channel != 8) {
+            stbi__uint16 *wide = (stbi__uint16 *) result + row * j;
+            size_t i;
+            for (i = 0; i < row; ++i)
+               out[i] = (stbi_uc) (wide[i] >> 8);
+         } else {
+            memcpy(out, (stbi_uc *) result + row * j, row);
+         }
+      }
+      stbi__free(result);
+   }
+
+   stbi__allocator = previous;
+   return 1;
+}
+
+// hands the image to rows a row at a time. PNGs are streamed (see stbi__png_stream_rows),
+// everything else is decoded whole first
+static int stbi__load_rows(stbi__context *s, stbi_row_callbacks const *rows, int *x, int *y, int *comp, int req_comp)
+{
+   stbi_uc *data;
+   int j, n, ok, channels;
+   if (req_comp < 0 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+   if (!comp) comp = &channels;
+   s->flip_rows = stbi__vertically_flip_on_load;
+
+   #ifndef STBI_NO_PNG
+   ok = stbi__png_load_rows(s, rows, x, y, comp, req_comp);
+   if (ok >= 0) return ok;
+   #endif
+
+   data = stbi__load_and_postprocess_8bit(s, x, y, comp, req_comp);
+   if (data == NULL) return 0;
+   n = req_comp ? req_comp : *comp;
+   ok = !rows->begin || rows->begin(rows->user, *x, *y, *comp, n);
+   for (j=0; ok && j < *y; ++j)
+      ok = rows->row(rows->user, j, data + (size_t) j * *x * n);
+   stbi__free(data);
+   if (!ok) return stbi__err("stopped", "Row callback stopped decoding");
+   return 1;
+}
+
 #ifndef STBI_NO_STDIO
 
 #if defined(_WIN32) && defined(STBI_WINDOWS_UTF8)
@@ -1409,37 +2097,229 @@ STBIDEF stbi_us *stbi_load_16(char const *filename, int *x, int *y, int *comp, i
    return result;
 }
 
-
-#endif //!STBI_NO_STDIO
-
-STBIDEF stbi_us *stbi_load_16_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels)
+STBIDEF stbi_us *stbi_load_from_file_half(FILE *f, int *x, int *y, int *comp, int req_comp)
 {
+   stbi__uint16 *result;
    stbi__context s;
-   stbi__start_mem(&s,buffer,len);
-   return stbi__load_and_postprocess_16bit(&s,x,y,channels_in_file,desired_channels);
+   stbi__start_file(&s,f);
+   result = stbi__load_and_postprocess_half(&s,x,y,comp,req_comp);
+   if (result) {
+      // need to 'unget' all the characters in the IO buffer
+      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   }
+   return result;
 }
 
-STBIDEF stbi_us *stbi_load_16_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *channels_in_file, int desired_channels)
+STBIDEF stbi_us *stbi_load_half(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
-   stbi__context s;
-   stbi__start_callbacks(&s, (stbi_io_callbacks *)clbk, user);
-   return stbi__load_and_postprocess_16bit(&s,x,y,channels_in_file,desired_channels);
+   FILE *f = stbi__fopen(filename, "rb");
+   stbi__uint16 *result;
+   if (!f) return (stbi_us *) stbi__errpuc("can't fopen", "Unable to open file");
+   result = stbi_load_from_file_half(f,x,y,comp,req_comp);
+   fclose(f);
+   return result;
 }
 
-STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
-{
-   stbi__context s;
-   stbi__start_mem(&s,buffer,len);
-   return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
-}
+#if !defined(STBI_NO_MMAP) && !(defined(_WIN32) && defined(STBI_WINDOWS_UTF8)) && (defined(_WIN32) || defined(__unix__) || defined(__APPLE__))
+#define STBI__MMAP
 
-STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
-{
-   stbi__context s;
-   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+#ifdef _WIN32
+// declared here instead of including windows.h, with the same types
+struct _SECURITY_ATTRIBUTES;
+STBI_EXTERN __declspec(dllimport) void * __stdcall CreateFileA(const char *name, unsigned long access, unsigned long share_mode, struct _SECURITY_ATTRIBUTES *security, unsigned long creation, unsigned long flags, void *template_file);
+STBI_EXTERN __declspec(dllimport) unsigned long __stdcall GetFileSize(void *file, unsigned long *size_high);
+STBI_EXTERN __declspec(dllimport) void * __stdcall CreateFileMappingA(void *file, struct _SECURITY_ATTRIBUTES *security, unsigned long protect, unsigned long size_high, unsigned long size_low, const char *name);
+STBI_EXTERN __declspec(dllimport) void * __stdcall MapViewOfFile(void *mapping, unsigned long access, unsigned long offset_high, unsigned long offset_low, size_t size);
+STBI_EXTERN __declspec(dllimport) int __stdcall UnmapViewOfFile(const void *address);
+STBI_EXTERN __declspec(dllimport) int __stdcall CloseHandle(void *handle);
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+typedef struct
+{
+   stbi_uc *data;
+   size_t size;
+} stbi__mapped_file;
+
+// returns 0 if the file can't be mapped, the caller then falls back to stdio; files of 2GB and
+// more are left to stdio too, the memory path counts bytes in an int
+static int stbi__map_file(char const *filename, stbi__mapped_file *m, int map_flags)
+{
+#ifdef _WIN32
+   // GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, PAGE_READONLY, FILE_MAP_READ
+   void *file = CreateFileA(filename, 0x80000000u, 1, NULL, 3, (map_flags & STBI_MAP_SEQUENTIAL) ? 0x08000000u : 0, NULL);
+   void *mapping;
+   unsigned long high = 0, low;
+   if (file == (void *) (ptrdiff_t) -1) return 0;
+   low = GetFileSize(file, &high);
+   if (high != 0 || low == 0 || low > INT_MAX) { CloseHandle(file); return 0; }
+   mapping = CreateFileMappingA(file, NULL, 2, 0, 0, NULL);
+   m->data = mapping ? (stbi_uc *) MapViewOfFile(mapping, 4, 0, 0, 0) : NULL;
+   m->size = low;
+   // the view keeps the file open
+   if (mapping) CloseHandle(mapping);
+   CloseHandle(file);
+   // there is no cheap equivalent of MADV_WILLNEED before Windows 8
+   STBI_NOTUSED(map_flags);
+   return m->data != NULL;
+#else
+   struct stat status;
+   void *data;
+   int fd = open(filename, O_RDONLY);
+   if (fd < 0) return 0;
+   if (fstat(fd, &status) != 0 || status.st_size <= 0 || status.st_size > INT_MAX) { close(fd); return 0; }
+   data = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (data == MAP_FAILED) return 0;
+   // the hints are BSD/POSIX extensions that strict ISO C modes hide
+#if defined(MADV_SEQUENTIAL) && defined(MADV_WILLNEED)
+   if (map_flags & STBI_MAP_SEQUENTIAL) madvise(data, (size_t) status.st_size, MADV_SEQUENTIAL);
+   if (map_flags & STBI_MAP_WILLNEED)   madvise(data, (size_t) status.st_size, MADV_WILLNEED);
+#else
+   STBI_NOTUSED(map_flags);
+#endif
+   m->data = (stbi_uc *) data;
+   m->size = (size_t) status.st_size;
+   return 1;
+#endif
+}
+
+static void stbi__unmap_file(stbi__mapped_file *m)
+{
+#ifdef _WIN32
+   UnmapViewOfFile(m->data);
+#else
+   munmap(m->data, m->size);
+#endif
+}
+#endif // STBI__MMAP
+
+STBIDEF stbi_uc *stbi_load_mapped(char const *filename, int *x, int *y, int *comp, int req_comp, int map_flags)
+{
+#ifdef STBI__MMAP
+   stbi__mapped_file m;
+   if (stbi__map_file(filename, &m, map_flags)) {
+      stbi_uc *result = stbi_load_from_memory(m.data, (int) m.size, x, y, comp, req_comp);
+      stbi__unmap_file(&m);
+      return result;
+   }
+#else
+   STBI_NOTUSED(map_flags);
+#endif
+   return stbi_load(filename, x, y, comp, req_comp);
+}
+
+STBIDEF int stbi_load_mapped_into(char const *filename, stbi_uc *dest, size_t dest_size, int dest_stride, int *x, int *y, int *comp, int req_comp, int map_flags, stbi_allocator const *allocator)
+{
+   stbi__context s;
+   FILE *f;
+   int result;
+#ifdef STBI__MMAP
+   stbi__mapped_file m;
+   if (stbi__map_file(filename, &m, map_flags)) {
+      stbi__start_mem(&s, m.data, (int) m.size);
+      result = stbi__load_into(&s, dest, dest_size, dest_stride, x, y, comp, req_comp, allocator);
+      stbi__unmap_file(&m);
+      return result;
+   }
+#else
+   STBI_NOTUSED(map_flags);
+#endif
+   f = stbi__fopen(filename, "rb");
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   stbi__start_file(&s, f);
+   result = stbi__load_into(&s, dest, dest_size, dest_stride, x, y, comp, req_comp, allocator);
+   fclose(f);
+   return result;
+}
+
+STBIDEF int stbi_load_rows(char const *filename, stbi_row_callbacks const *rows, int *x, int *y, int *comp, int req_comp)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   int result;
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   result = stbi_load_rows_from_file(f, rows, x, y, comp, req_comp);
+   fclose(f);
+   return result;
+}
+
+STBIDEF int stbi_load_rows_from_file(FILE *f, stbi_row_callbacks const *rows, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_file(&s,f);
+   return stbi__load_rows(&s, rows, x, y, comp, req_comp);
+}
+
+
+#endif //!STBI_NO_STDIO
+
+STBIDEF stbi_us *stbi_load_16_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_and_postprocess_16bit(&s,x,y,channels_in_file,desired_channels);
+}
+
+STBIDEF stbi_us *stbi_load_16_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *channels_in_file, int desired_channels)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *)clbk, user);
+   return stbi__load_and_postprocess_16bit(&s,x,y,channels_in_file,desired_channels);
+}
+
+STBIDEF stbi_us *stbi_load_half_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_and_postprocess_half(&s,x,y,channels_in_file,desired_channels);
+}
+
+STBIDEF stbi_us *stbi_load_half_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *channels_in_file, int desired_channels)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *)clbk, user);
+   return stbi__load_and_postprocess_half(&s,x,y,channels_in_file,desired_channels);
+}
+
+STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF int stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *dest, size_t dest_size, int dest_stride, int *x, int *y, int *comp, int req_comp, stbi_allocator const *allocator)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_into(&s, dest, dest_size, dest_stride, x, y, comp, req_comp, allocator);
+}
+
+STBIDEF int stbi_load_rows_from_memory(stbi_uc const *buffer, int len, stbi_row_callbacks const *rows, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_rows(&s, rows, x, y, comp, req_comp);
+}
+
+STBIDEF int stbi_load_rows_from_callbacks(stbi_io_callbacks const *clbk, void *user, stbi_row_callbacks const *rows, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__load_rows(&s, rows, x, y, comp, req_comp);
+}
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -1752,9 +2632,38 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 #if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
 // nothing
 #else
+// converts one row of x pixels, dest must not overlap src. returns 0 for an unsupported combination
+static int stbi__convert_row(stbi_uc const *src, int img_n, stbi_uc *dest, int req_comp, unsigned int x)
+{
+   int i;
+
+   #define STBI__COMBO(a,b)  ((a)*8+(b))
+   #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+   // convert source image with img_n components to one with req_comp components;
+   // avoid switch per pixel, so use switch per scanline and massive macros
+   switch (STBI__COMBO(img_n, req_comp)) {
+      STBI__CASE(1,2) { dest[0]=src[0]; dest[1]=255;                                     } break;
+      STBI__CASE(1,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
+      STBI__CASE(1,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=255;                     } break;
+      STBI__CASE(2,1) { dest[0]=src[0];                                                  } break;
+      STBI__CASE(2,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
+      STBI__CASE(2,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=src[1];                  } break;
+      STBI__CASE(3,4) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];dest[3]=255;        } break;
+      STBI__CASE(3,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
+      STBI__CASE(3,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = 255;    } break;
+      STBI__CASE(4,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
+      STBI__CASE(4,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = src[3]; } break;
+      STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                    } break;
+      default: STBI_ASSERT(0); return 0;
+   }
+   #undef STBI__CASE
+   #undef STBI__COMBO
+   return 1;
+}
+
 static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
-   int i,j;
+   int j;
    unsigned char *good;
 
    if (req_comp == img_n) return data;
@@ -1762,37 +2671,17 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
 
    good = (unsigned char *) stbi__malloc_mad3(req_comp, x, y, 0);
    if (good == NULL) {
-      STBI_FREE(data);
+      stbi__free(data);
       return stbi__errpuc("outofmem", "Out of memory");
    }
 
    for (j=0; j < (int) y; ++j) {
-      unsigned char *src  = data + j * x * img_n   ;
-      unsigned char *dest = good + j * x * req_comp;
-
-      #define STBI__COMBO(a,b)  ((a)*8+(b))
-      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
-      // convert source image with img_n components to one with req_comp components;
-      // avoid switch per pixel, so use switch per scanline and massive macros
-      switch (STBI__COMBO(img_n, req_comp)) {
-         STBI__CASE(1,2) { dest[0]=src[0]; dest[1]=255;                                     } break;
-         STBI__CASE(1,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
-         STBI__CASE(1,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=255;                     } break;
-         STBI__CASE(2,1) { dest[0]=src[0];                                                  } break;
-         STBI__CASE(2,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
-         STBI__CASE(2,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=src[1];                  } break;
-         STBI__CASE(3,4) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];dest[3]=255;        } break;
-         STBI__CASE(3,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
-         STBI__CASE(3,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = 255;    } break;
-         STBI__CASE(4,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
-         STBI__CASE(4,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = src[3]; } break;
-         STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                    } break;
-         default: STBI_ASSERT(0); STBI_FREE(data); STBI_FREE(good); return stbi__errpuc("unsupported", "Unsupported format conversion");
+      if (!stbi__convert_row(data + j * x * img_n, img_n, good + j * x * req_comp, req_comp, x)) {
+         stbi__free(data); stbi__free(good); return stbi__errpuc("unsupported", "Unsupported format conversion");
       }
-      #undef STBI__CASE
    }
 
-   STBI_FREE(data);
+   stbi__free(data);
    return good;
 }
 #endif
@@ -1809,9 +2698,38 @@ static stbi__uint16 stbi__compute_y_16(int r, int g, int b)
 #if defined(STBI_NO_PNG) && defined(STBI_NO_PSD)
 // nothing
 #else
+// stbi__convert_row on 16-bit samples
+static int stbi__convert_row16(stbi__uint16 const *src, int img_n, stbi__uint16 *dest, int req_comp, unsigned int x)
+{
+   int i;
+
+   #define STBI__COMBO(a,b)  ((a)*8+(b))
+   #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+   // convert source image with img_n components to one with req_comp components;
+   // avoid switch per pixel, so use switch per scanline and massive macros
+   switch (STBI__COMBO(img_n, req_comp)) {
+      STBI__CASE(1,2) { dest[0]=src[0]; dest[1]=0xffff;                                     } break;
+      STBI__CASE(1,3) { dest[0]=dest[1]=dest[2]=src[0];                                     } break;
+      STBI__CASE(1,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=0xffff;                     } break;
+      STBI__CASE(2,1) { dest[0]=src[0];                                                     } break;
+      STBI__CASE(2,3) { dest[0]=dest[1]=dest[2]=src[0];                                     } break;
+      STBI__CASE(2,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=src[1];                     } break;
+      STBI__CASE(3,4) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];dest[3]=0xffff;        } break;
+      STBI__CASE(3,1) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]);                   } break;
+      STBI__CASE(3,2) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]); dest[1] = 0xffff; } break;
+      STBI__CASE(4,1) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]);                   } break;
+      STBI__CASE(4,2) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]); dest[1] = src[3]; } break;
+      STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                       } break;
+      default: STBI_ASSERT(0); return 0;
+   }
+   #undef STBI__CASE
+   #undef STBI__COMBO
+   return 1;
+}
+
 static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
-   int i,j;
+   int j;
    stbi__uint16 *good;
 
    if (req_comp == img_n) return data;
@@ -1819,37 +2737,17 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
 
    good = (stbi__uint16 *) stbi__malloc(req_comp * x * y * 2);
    if (good == NULL) {
-      STBI_FREE(data);
+      stbi__free(data);
       return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
    }
 
    for (j=0; j < (int) y; ++j) {
-      stbi__uint16 *src  = data + j * x * img_n   ;
-      stbi__uint16 *dest = good + j * x * req_comp;
-
-      #define STBI__COMBO(a,b)  ((a)*8+(b))
-      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
-      // convert source image with img_n components to one with req_comp components;
-      // avoid switch per pixel, so use switch per scanline and massive macros
-      switch (STBI__COMBO(img_n, req_comp)) {
-         STBI__CASE(1,2) { dest[0]=src[0]; dest[1]=0xffff;                                     } break;
-         STBI__CASE(1,3) { dest[0]=dest[1]=dest[2]=src[0];                                     } break;
-         STBI__CASE(1,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=0xffff;                     } break;
-         STBI__CASE(2,1) { dest[0]=src[0];                                                     } break;
-         STBI__CASE(2,3) { dest[0]=dest[1]=dest[2]=src[0];                                     } break;
-         STBI__CASE(2,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=src[1];                     } break;
-         STBI__CASE(3,4) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];dest[3]=0xffff;        } break;
-         STBI__CASE(3,1) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]);                   } break;
-         STBI__CASE(3,2) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]); dest[1] = 0xffff; } break;
-         STBI__CASE(4,1) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]);                   } break;
-         STBI__CASE(4,2) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]); dest[1] = src[3]; } break;
-         STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                       } break;
-         default: STBI_ASSERT(0); STBI_FREE(data); STBI_FREE(good); return (stbi__uint16*) stbi__errpuc("unsupported", "Unsupported format conversion");
+      if (!stbi__convert_row16(data + j * x * img_n, img_n, good + j * x * req_comp, req_comp, x)) {
+         stbi__free(data); stbi__free(good); return (stbi__uint16*) stbi__errpuc("unsupported", "Unsupported format conversion");
       }
-      #undef STBI__CASE
    }
 
-   STBI_FREE(data);
+   stbi__free(data);
    return good;
 }
 #endif
@@ -1857,54 +2755,158 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
 #ifndef STBI_NO_LINEAR
 static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 {
-   int i,k,n;
+   size_t i, count;
+   int k,n;
    float *output;
+   float gamma[256], linear[256];
    if (!data) return NULL;
    output = (float *) stbi__malloc_mad4(x, y, comp, sizeof(float), 0);
-   if (output == NULL) { STBI_FREE(data); return stbi__errpf("outofmem", "Out of memory"); }
+   if (output == NULL) { stbi__free(data); return stbi__errpf("outofmem", "Out of memory"); }
+   // there are only 256 inputs, so pow runs once per input value rather than per sample
+   for (k=0; k < 256; ++k) {
+      gamma[k] = (float) (pow(k/255.0f, stbi__l2h_gamma) * stbi__l2h_scale);
+      linear[k] = k/255.0f;
+   }
    // compute number of non-alpha components
    if (comp & 1) n = comp; else n = comp-1;
-   for (i=0; i < x*y; ++i) {
-      for (k=0; k < n; ++k) {
-         output[i*comp + k] = (float) (pow(data[i*comp+k]/255.0f, stbi__l2h_gamma) * stbi__l2h_scale);
-      }
-   }
-   if (n < comp) {
-      for (i=0; i < x*y; ++i) {
-         output[i*comp + n] = data[i*comp + n]/255.0f;
+   count = (size_t) x * y;
+   if (n == comp) {
+      for (i=0; i < count * comp; ++i)
+         output[i] = gamma[data[i]];
+   } else {
+      for (i=0; i < count; ++i) {
+         for (k=0; k < n; ++k)
+            output[i*comp + k] = gamma[data[i*comp + k]];
+         output[i*comp + n] = linear[data[i*comp + n]];
       }
    }
-   STBI_FREE(data);
+   stbi__free(data);
    return output;
 }
 #endif
 
 #ifndef STBI_NO_HDR
+// pow(x, y) for x >= 0, as exp2(y * log2(x)) with polynomials for log2 of the mantissa and
+// exp2 of the fraction. both are within 4e-6, so the result is within about 1e-5 relative:
+// a few thousandths of a step of stbi__hdr_to_ldr's output, which rounds to the same byte as
+// pow except within that distance of a rounding boundary, where it can be one off
+#define STBI__LOG2_C1   1.4425348f
+#define STBI__LOG2_C2  -0.718033612f
+#define STBI__LOG2_C3   0.457158118f
+#define STBI__LOG2_C4  -0.277341634f
+#define STBI__LOG2_C5   0.121472947f
+#define STBI__LOG2_C6  -0.0257923454f
+#define STBI__EXP2_C0   1.00000358f
+#define STBI__EXP2_C1   0.692969561f
+#define STBI__EXP2_C2   0.241621315f
+#define STBI__EXP2_C3   0.0517177358f
+#define STBI__EXP2_C4   0.0136839831f
+
+static float stbi__fast_pow(float x, float y)
+{
+   stbi__uint32 bits;
+   float m, t, l, f, r;
+   int e, i;
+   if (!(x > 0)) x = 0; // negative and NaN too, where pow is NaN and the byte was 0
+   memcpy(&bits, &x, 4);
+   e = (int) (bits >> 23) - 127;
+   bits = (bits & 0x7fffff) | 0x3f800000;
+   memcpy(&m, &bits, 4);
+   t = m - 1;
+   l = e + t*(STBI__LOG2_C1 + t*(STBI__LOG2_C2 + t*(STBI__LOG2_C3 + t*(STBI__LOG2_C4 + t*(STBI__LOG2_C5 + t*STBI__LOG2_C6)))));
+   l *= y;
+   // far outside what can round to anything but 0 or 255, and keeps the exponent normal
+   if (l < -126) l = -126;
+   if (l > 126) l = 126;
+   i = (int) l;
+   if ((float) i > l) --i;
+   f = l - i;
+   bits = (stbi__uint32) (i + 127) << 23;
+   memcpy(&r, &bits, 4);
+   return r * (STBI__EXP2_C0 + f*(STBI__EXP2_C1 + f*(STBI__EXP2_C2 + f*(STBI__EXP2_C3 + f*STBI__EXP2_C4))));
+}
+
+#ifdef STBI_SSE2
+// stbi__fast_pow on four values, with the same operations
+static __m128 stbi__fast_pow_sse2(__m128 x, __m128 y)
+{
+   __m128i bits, e, i;
+   __m128 m, t, l, f, r, p;
+   x = _mm_max_ps(x, _mm_setzero_ps()); // NaN is replaced by 0 too
+   bits = _mm_castps_si128(x);
+   e = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+   m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x7fffff)), _mm_set1_epi32(0x3f800000)));
+   t = _mm_sub_ps(m, _mm_set1_ps(1.0f));
+   p = _mm_add_ps(_mm_set1_ps(STBI__LOG2_C5), _mm_mul_ps(t, _mm_set1_ps(STBI__LOG2_C6)));
+   p = _mm_add_ps(_mm_set1_ps(STBI__LOG2_C4), _mm_mul_ps(t, p));
+   p = _mm_add_ps(_mm_set1_ps(STBI__LOG2_C3), _mm_mul_ps(t, p));
+   p = _mm_add_ps(_mm_set1_ps(STBI__LOG2_C2), _mm_mul_ps(t, p));
+   p = _mm_add_ps(_mm_set1_ps(STBI__LOG2_C1), _mm_mul_ps(t, p));
+   l = _mm_add_ps(_mm_cvtepi32_ps(e), _mm_mul_ps(t, p));
+   l = _mm_mul_ps(l, y);
+   l = _mm_min_ps(_mm_max_ps(l, _mm_set1_ps(-126.0f)), _mm_set1_ps(126.0f));
+   // floor: truncation rounds negative values up, take one off where it did
+   i = _mm_cvttps_epi32(l);
+   i = _mm_add_epi32(i, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(i), l)));
+   f = _mm_sub_ps(l, _mm_cvtepi32_ps(i));
+   r = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(i, _mm_set1_epi32(127)), 23));
+   p = _mm_add_ps(_mm_set1_ps(STBI__EXP2_C3), _mm_mul_ps(f, _mm_set1_ps(STBI__EXP2_C4)));
+   p = _mm_add_ps(_mm_set1_ps(STBI__EXP2_C2), _mm_mul_ps(f, p));
+   p = _mm_add_ps(_mm_set1_ps(STBI__EXP2_C1), _mm_mul_ps(f, p));
+   p = _mm_add_ps(_mm_set1_ps(STBI__EXP2_C0), _mm_mul_ps(f, p));
+   return _mm_mul_ps(r, p);
+}
+#endif
+
 #define stbi__float2int(x)   ((int) (x))
 static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 {
-   int i,k,n;
+   size_t i, count;
    stbi_uc *output;
+   // pow(x, 1) is x, and the polynomial pow is not, so gamma 1 skips it and stays exact
+   int linear = stbi__h2l_gamma_i == 1.0f;
    if (!data) return NULL;
    output = (stbi_uc *) stbi__malloc_mad3(x, y, comp, 0);
-   if (output == NULL) { STBI_FREE(data); return stbi__errpuc("outofmem", "Out of memory"); }
-   // compute number of non-alpha components
-   if (comp & 1) n = comp; else n = comp-1;
-   for (i=0; i < x*y; ++i) {
-      for (k=0; k < n; ++k) {
-         float z = (float) pow(data[i*comp+k]*stbi__h2l_scale_i, stbi__h2l_gamma_i) * 255 + 0.5f;
-         if (z < 0) z = 0;
-         if (z > 255) z = 255;
-         output[i*comp + k] = (stbi_uc) stbi__float2int(z);
-      }
-      if (k < comp) {
-         float z = data[i*comp+k] * 255 + 0.5f;
-         if (z < 0) z = 0;
-         if (z > 255) z = 255;
-         output[i*comp + k] = (stbi_uc) stbi__float2int(z);
+   if (output == NULL) { stbi__free(data); return stbi__errpuc("outofmem", "Out of memory"); }
+   // the samples are handled as one flat array, four at a time; with 2 or 4 components every
+   // group of four starts a pixel, so the alpha channel is in the same lanes of every group
+   count = (size_t) x * y * comp;
+   i = 0;
+#ifdef STBI_SSE2
+   {
+      __m128 gamma = _mm_set1_ps(stbi__h2l_gamma_i);
+      __m128 scale = _mm_set1_ps(stbi__h2l_scale_i);
+      __m128 alpha = _mm_castsi128_ps(comp == 4 ? _mm_setr_epi32(0, 0, 0, -1) :
+                                      comp == 2 ? _mm_setr_epi32(0, -1, 0, -1) : _mm_setzero_si128());
+      for (; i + 4 <= count; i += 4) {
+         __m128 v = _mm_loadu_ps(data + i);
+         __m128 c = linear ? _mm_mul_ps(v, scale) : stbi__fast_pow_sse2(_mm_mul_ps(v, scale), gamma);
+         __m128 z = _mm_or_ps(_mm_andnot_ps(alpha, c), _mm_and_ps(alpha, v));
+         __m128i b;
+         int packed;
+         z = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f));
+         z = _mm_min_ps(_mm_max_ps(z, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+         b = _mm_cvttps_epi32(z);
+         b = _mm_packs_epi32(b, b);
+         packed = _mm_cvtsi128_si32(_mm_packus_epi16(b, b));
+         memcpy(output + i, &packed, 4);
       }
    }
-   STBI_FREE(data);
+#endif
+   for (; i < count; ++i) {
+      // every second sample of 2 components and every fourth of 4 is alpha, stored linear
+      float z;
+      if ((comp & 1) == 0 && (int) (i % comp) == comp-1)
+         z = data[i] * 255 + 0.5f;
+      else if (linear)
+         z = data[i]*stbi__h2l_scale_i * 255 + 0.5f;
+      else
+         z = stbi__fast_pow(data[i]*stbi__h2l_scale_i, stbi__h2l_gamma_i) * 255 + 0.5f;
+      if (z < 0) z = 0;
+      if (z > 255) z = 255;
+      output[i] = (stbi_uc) stbi__float2int(z);
+   }
+   stbi__free(data);
    return output;
 }
 #endif
@@ -2702,6 +3704,157 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 #undef dct_pass
 }
 
+// AVX2 version of the IDCT above. each pass keeps a row of 8 coefficients in a 128-bit
+// register as before, but the 32-bit intermediates of a row fit in a single 256-bit
+// register instead of a lo/hi pair, which halves the multiply-add and butterfly work.
+// the arithmetic is the same, so the results are still bit-identical to stbi__idct_block.
+STBI__TARGET_AVX2 static void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64])
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m128i tmp;
+
+   // dot product constant: even elems=x, odd elems=y
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+   // out0 = c0[even]*x + c0[odd]*y, out1 = c1[even]*x + c1[odd]*y  (x, y 16-bit, out 32-bit)
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##xy = _mm256_set_m128i(_mm_unpackhi_epi16((x),(y)), _mm_unpacklo_epi16((x),(y))); \
+      __m256i out0 = _mm256_madd_epi16(c0##xy, c0); \
+      __m256i out1 = _mm256_madd_epi16(c0##xy, c1)
+
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out = _mm256_slli_epi32(_mm256_cvtepi16_epi32(in), 12)
+
+   // butterfly a/b, add bias, then shift by "s" and pack
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased = _mm256_add_epi32(a, bias); \
+         __m256i sum = _mm256_srai_epi32(_mm256_add_epi32(abiased, b), s); \
+         __m256i dif = _mm256_srai_epi32(_mm256_sub_epi32(abiased, b), s); \
+         out0 = _mm_packs_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)); \
+         out1 = _mm_packs_epi32(_mm256_castsi256_si128(dif), _mm256_extracti128_si256(dif, 1)); \
+      }
+
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
+
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         dct_widen(t0e, _mm_add_epi16(row0, row4)); \
+         dct_widen(t1e, _mm_sub_epi16(row0, row4)); \
+         __m256i x0 = _mm256_add_epi32(t0e, t3e); \
+         __m256i x3 = _mm256_sub_epi32(t0e, t3e); \
+         __m256i x1 = _mm256_add_epi32(t1e, t2e); \
+         __m256i x2 = _mm256_sub_epi32(t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m128i sum17 = _mm_add_epi16(row1, row7); \
+         __m128i sum35 = _mm_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         __m256i x4 = _mm256_add_epi32(y0o, y4o); \
+         __m256i x5 = _mm256_add_epi32(y1o, y5o); \
+         __m256i x6 = _mm256_add_epi32(y2o, y5o); \
+         __m256i x7 = _mm256_add_epi32(y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   // rounding biases in column/row passes, see stbi__idct_block for explanation.
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   row0 = _mm_load_si128((const __m128i *) (data + 0*8));
+   row1 = _mm_load_si128((const __m128i *) (data + 1*8));
+   row2 = _mm_load_si128((const __m128i *) (data + 2*8));
+   row3 = _mm_load_si128((const __m128i *) (data + 3*8));
+   row4 = _mm_load_si128((const __m128i *) (data + 4*8));
+   row5 = _mm_load_si128((const __m128i *) (data + 5*8));
+   row6 = _mm_load_si128((const __m128i *) (data + 6*8));
+   row7 = _mm_load_si128((const __m128i *) (data + 7*8));
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack and 8bit 8x8 transpose, same as the SSE2 version
+      __m128i p0 = _mm_packus_epi16(row0, row1);
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      // store
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+
 #endif // STBI_SSE2
 
 #ifdef STBI_NEON
@@ -2946,67 +4099,168 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
-static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+// decodes the MCUs [first, last) of a baseline scan, restarting the entropy decoder at every
+// restart marker on the way; the bitstream has to be at MCU first, right after a reset
+static int stbi__jpeg_decode_baseline_mcus(stbi__jpeg *z, int first, int last)
 {
-   stbi__jpeg_reset(z);
-   if (!z->progressive) {
-      if (z->scan_n == 1) {
-         int i,j;
-         STBI_SIMD_ALIGN(short, data[64]);
-         int n = z->order[0];
-         // non-interleaved data, we just need to process one block at a time,
-         // in trivial scanline order
-         // number of blocks to do just depends on how many actual "pixels" this
-         // component has, independent of interleaved MCU blocking and such
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-               // every data block is an MCU, so countdown the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  // if it's NOT a restart, then just bail, so we get corrupt data
-                  // rather than no data
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
-            }
+   int m;
+   STBI_SIMD_ALIGN(short, data[64]);
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      // non-interleaved data, we just need to process one block at a time,
+      // in trivial scanline order
+      // number of blocks to do just depends on how many actual "pixels" this
+      // component has, independent of interleaved MCU blocking and such
+      int w = (z->img_comp[n].x+7) >> 3;
+      for (m=first; m < last; ++m) {
+         int i = m % w, j = m / w;
+         int ha = z->img_comp[n].ha;
+         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+         z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+         // every data block is an MCU, so countdown the restart interval
+         if (--z->todo <= 0) {
+            if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+            // if it's NOT a restart, then just bail, so we get corrupt data
+            // rather than no data
+            if (!STBI__RESTART(z->marker)) return 1;
+            stbi__jpeg_reset(z);
          }
-         return 1;
-      } else { // interleaved
-         int i,j,k,x,y;
-         STBI_SIMD_ALIGN(short, data[64]);
-         for (j=0; j < z->img_mcu_y; ++j) {
-            for (i=0; i < z->img_mcu_x; ++i) {
-               // scan an interleaved mcu... process scan_n components in order
-               for (k=0; k < z->scan_n; ++k) {
-                  int n = z->order[k];
-                  // scan out an mcu's worth of this component; that's just determined
-                  // by the basic H and V specified for the component
-                  for (y=0; y < z->img_comp[n].v; ++y) {
-                     for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
-                        int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
-                     }
-                  }
-               }
-               // after all interleaved components, that's an interleaved MCU,
-               // so now count down the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
+      }
+   } else { // interleaved
+      int k,x,y;
+      for (m=first; m < last; ++m) {
+         int i = m % z->img_mcu_x, j = m / z->img_mcu_x;
+         // scan an interleaved mcu... process scan_n components in order
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            // scan out an mcu's worth of this component; that's just determined
+            // by the basic H and V specified for the component
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int x2 = (i*z->img_comp[n].h + x)*8;
+                  int y2 = (j*z->img_comp[n].v + y)*8;
+                  int ha = z->img_comp[n].ha;
+                  if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                  z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
                }
             }
          }
-         return 1;
+         // after all interleaved components, that's an interleaved MCU,
+         // so now count down the restart interval
+         if (--z->todo <= 0) {
+            if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+            if (!STBI__RESTART(z->marker)) return 1;
+            stbi__jpeg_reset(z);
+         }
       }
+   }
+   return 1;
+}
+
+static int stbi__jpeg_baseline_mcu_count(stbi__jpeg *z)
+{
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      return ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   }
+   return z->img_mcu_x * z->img_mcu_y;
+}
+
+// restart intervals are decodable on their own (the DC predictions reset and the
+// bitstream restarts byte aligned), so a baseline scan with restart markers is split
+// into groups of consecutive intervals that decode on the user's threads, each with
+// its own copy of the decoder state. the IDCT writes every block to its own place in
+// the component planes, so the groups do not touch each other's output. the copies are
+// allocated here, so a stbi_load_*_into allocator serves them too
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi__jpeg *copies; // one per task
+   stbi_uc *start[STBI__PARALLEL_TASKS]; // entropy data of each group's first interval
+   stbi_uc *end;
+   int mcu_count, segment_count, task_count;
+   int failed[STBI__PARALLEL_TASKS];
+   const char *failure[STBI__PARALLEL_TASKS];
+} stbi__jpeg_parallel_scan;
+
+static void stbi__jpeg_decode_segments(void *task_data, int index)
+{
+   stbi__jpeg_parallel_scan *p = (stbi__jpeg_parallel_scan *) task_data;
+   int first = index * p->segment_count / p->task_count;
+   int last = (index + 1) * p->segment_count / p->task_count;
+   int interval = p->z->restart_interval;
+   stbi__context s;
+   stbi__jpeg *j = &p->copies[index];
+   memcpy(j, p->z, sizeof(stbi__jpeg));
+   stbi__start_mem(&s, p->start[index], (int) (p->end - p->start[index]));
+   j->s = &s;
+   stbi__jpeg_reset(j);
+   last = last * interval < p->mcu_count ? last * interval : p->mcu_count;
+   p->failed[index] = !stbi__jpeg_decode_baseline_mcus(j, first * interval, last);
+   // failure reasons are per thread when STBI_THREAD_LOCAL is available, pass it to the caller's
+   p->failure[index] = stbi__g_failure_reason;
+}
+
+// returns -1 if the scan is not split, so it has to be decoded on this thread
+static int stbi__jpeg_parallel_baseline(stbi__jpeg *z)
+{
+   stbi__jpeg_parallel_scan p;
+   stbi__context *s = z->s;
+   stbi_uc *in = s->img_buffer;
+   int segment = 1, group = 1, i;
+
+   if (!stbi__parallel_for_global || !z->restart_interval || s->read_from_callbacks) return -1;
+   if (s->img_x * s->img_y < STBI__PARALLEL_MIN_PIXELS) return -1;
+   p.mcu_count = stbi__jpeg_baseline_mcu_count(z);
+   p.segment_count = (p.mcu_count + z->restart_interval - 1) / z->restart_interval;
+   if (p.segment_count < 2) return -1;
+   p.task_count = p.segment_count < STBI__PARALLEL_TASKS ? p.segment_count : STBI__PARALLEL_TASKS;
+   p.z = z;
+   p.end = s->img_buffer_end;
+   p.start[0] = in;
+
+   // find where every group starts: stuffed zeros and fill bytes are skipped, the scan
+   // ends at the first marker that is not a restart marker
+   for (;;) {
+      stbi_uc *ff = (stbi_uc *) memchr(in, 0xff, (size_t) (p.end - in));
+      if (!ff || ff + 1 >= p.end) { in = p.end; break; }
+      if (ff[1] == 0x00) { in = ff + 2; continue; }
+      if (ff[1] == 0xff) { in = ff + 1; continue; }
+      if (!STBI__RESTART(ff[1])) { in = ff; break; }
+      if (segment == p.segment_count) return -1; // more restarts than intervals, leave it to the serial decoder
+      if (group < p.task_count && segment == group * p.segment_count / p.task_count)
+         p.start[group++] = ff + 2;
+      ++segment;
+      in = ff + 2;
+   }
+   // a missing restart marker means damaged data, which the serial decoder handles
+   if (segment != p.segment_count) return -1;
+
+   p.copies = (stbi__jpeg *) stbi__malloc_mad2(p.task_count, sizeof(stbi__jpeg), 0);
+   if (!p.copies) return stbi__err("outofmem", "Out of memory");
+   memset(p.failed, 0, sizeof(p.failed));
+   stbi__parallel_for(p.task_count, stbi__jpeg_decode_segments, &p);
+   stbi__free(p.copies);
+   for (i=0; i < p.task_count; ++i) {
+      if (p.failed[i]) {
+         stbi__g_failure_reason = p.failure[i];
+         return 0;
+      }
+   }
+
+   // carry on after the scan like the serial decoder: the marker that ends it is read next
+   stbi__jpeg_reset(z);
+   s->img_buffer = in;
+   return 1;
+}
+
+static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+{
+   stbi__jpeg_reset(z);
+   if (!z->progressive) {
+      int r = stbi__jpeg_parallel_baseline(z);
+      if (r >= 0) return r;
+      return stbi__jpeg_decode_baseline_mcus(z, 0, stbi__jpeg_baseline_mcu_count(z));
    } else {
       if (z->scan_n == 1) {
          int i,j;
@@ -3244,17 +4498,17 @@ static int stbi__free_jpeg_components(stbi__jpeg *z, int ncomp, int why)
    int i;
    for (i=0; i < ncomp; ++i) {
       if (z->img_comp[i].raw_data) {
-         STBI_FREE(z->img_comp[i].raw_data);
+         stbi__free(z->img_comp[i].raw_data);
          z->img_comp[i].raw_data = NULL;
          z->img_comp[i].data = NULL;
       }
       if (z->img_comp[i].raw_coeff) {
-         STBI_FREE(z->img_comp[i].raw_coeff);
+         stbi__free(z->img_comp[i].raw_coeff);
          z->img_comp[i].raw_coeff = 0;
          z->img_comp[i].coeff = 0;
       }
       if (z->img_comp[i].linebuf) {
-         STBI_FREE(z->img_comp[i].linebuf);
+         stbi__free(z->img_comp[i].linebuf);
          z->img_comp[i].linebuf = NULL;
       }
    }
@@ -3643,6 +4897,62 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_SSE2
+// same filter as stbi__resample_row_hv_2_simd, 16 input pixels (32 output pixels) per step
+STBI__TARGET_AVX2 static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass, 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i curr  = _mm256_add_epi16(_mm256_slli_epi16(nearw, 2), _mm256_sub_epi16(farw, nearw));
+
+      // shift the row by one pixel in each direction; alignr works within 128-bit lanes,
+      // so the neighbouring lane is brought in with a lane permute first
+      __m256i prv0 = _mm256_alignr_epi8(curr, _mm256_permute2x128_si256(curr, curr, 0x08), 14);
+      __m256i nxt0 = _mm256_alignr_epi8(_mm256_permute2x128_si256(curr, curr, 0x81), curr, 2);
+      __m256i prev = _mm256_insert_epi16(prv0, t1, 0);
+      __m256i next = _mm256_insert_epi16(nxt0, 3*in_near[i+16] + in_far[i+16], 15);
+
+      // horizontal pass, even = cur*4 + (prev - cur), odd = cur*4 + (next - cur)
+      __m256i curb = _mm256_add_epi16(_mm256_slli_epi16(curr, 2), _mm256_set1_epi16(8));
+      __m256i even = _mm256_add_epi16(_mm256_sub_epi16(prev, curr), curb);
+      __m256i odd  = _mm256_add_epi16(_mm256_sub_epi16(next, curr), curb);
+
+      // interleave and undo scaling; the per-lane unpacks and pack keep pixels in order
+      __m256i de0  = _mm256_srli_epi16(_mm256_unpacklo_epi16(even, odd), 4);
+      __m256i de1  = _mm256_srli_epi16(_mm256_unpackhi_epi16(even, odd), 4);
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(de0, de1));
+
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3817,6 +5127,101 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_SSE2
+// same transform as stbi__YCbCr_to_RGB_simd, 16 pixels per step. the channels are
+// interleaved in registers and written as RGBA, or as RGB after a byte shuffle, so
+// both 4 and 3 channel output come straight out of the kernel
+STBI__TARGET_AVX2 static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 4 || step == 3) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+      // drops every fourth byte of a 16 byte lane, leaving 12 bytes of RGB
+      __m256i rgb_pack = _mm256_setr_epi8(0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1,
+                                          0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1);
+      // the RGB stores write 16 bytes for every 12, keep the last one inside the row
+      int end = step == 4 ? count - 15 : count - 17;
+
+      for (; i < end; i += 16) {
+         // load, widen to short with y and the -128 biased cr, cb in the high byte
+         __m128i y_bytes  = _mm_loadu_si128((__m128i *) (y+i));
+         __m128i cr_bytes = _mm_xor_si128(_mm_loadu_si128((__m128i *) (pcr+i)), signflip);
+         __m128i cb_bytes = _mm_xor_si128(_mm_loadu_si128((__m128i *) (pcb+i)), signflip);
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cr_bytes), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cb_bytes), 8);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte and interleave; every 128-bit lane works on its own 8 pixels,
+         // o0 ends up with pixels 0-3 and 8-11, o1 with 4-7 and 12-15
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+         if (step == 4) {
+            _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+            _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+            out += 64;
+         } else {
+            __m256i p0 = _mm256_shuffle_epi8(o0, rgb_pack);
+            __m256i p1 = _mm256_shuffle_epi8(o1, rgb_pack);
+            _mm_storeu_si128((__m128i *) (out + 0),  _mm256_castsi256_si128(p0));
+            _mm_storeu_si128((__m128i *) (out + 12), _mm256_castsi256_si128(p1));
+            _mm_storeu_si128((__m128i *) (out + 24), _mm256_extracti128_si256(p0, 1));
+            _mm_storeu_si128((__m128i *) (out + 36), _mm256_extracti128_si256(p1, 1));
+            out += 48;
+         }
+      }
+   }
+
+   for (; i < count; ++i) {
+      int y_fixed = (y[i] << 20) + (1<<19); // rounding
+      int r,g,b;
+      int cr = pcr[i] - 128;
+      int cb = pcb[i] - 128;
+      r = y_fixed + cr* stbi__float2fixed(1.40200f);
+      g = y_fixed + cr*-stbi__float2fixed(0.71414f) + ((cb*-stbi__float2fixed(0.34414f)) & 0xffff0000);
+      b = y_fixed                                   +   cb* stbi__float2fixed(1.77200f);
+      r >>= 20;
+      g >>= 20;
+      b >>= 20;
+      if ((unsigned) r > 255) { if (r < 0) r = 0; else r = 255; }
+      if ((unsigned) g > 255) { if (g < 0) g = 0; else g = 255; }
+      if ((unsigned) b > 255) { if (b < 0) b = 0; else b = 255; }
+      out[0] = (stbi_uc)r;
+      out[1] = (stbi_uc)g;
+      out[2] = (stbi_uc)b;
+      out[3] = 255;
+      out += step;
+   }
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
@@ -3830,6 +5235,11 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
       j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
       j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
    }
+   if (stbi__cpu_features() & 2) {
+      j->idct_block_kernel = stbi__idct_avx2;
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+   }
 #endif
 
 #ifdef STBI_NEON
@@ -3862,6 +5272,172 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+// what the upsampling and color conversion of an image needs, shared by all bands
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi__resample res_comp[4];
+   stbi_uc *output;   // output row 0, the bottom row in memory if the image is flipped
+   ptrdiff_t stride;  // from one output row to the next, negative if flipped
+   int row_scratch;   // every row goes through a scratch row, see stbi__jpeg_convert_rows
+   int n, decode_n, is_rgb;
+   int band_count;
+   stbi_uc *band_scratch; // decode_n line buffers and an output row per band
+} stbi__jpeg_convert;
+
+// moves r to output row y as if the rows above it had been resampled one by one
+static void stbi__jpeg_seek_resample(stbi__jpeg *z, stbi__resample *r, int k, int y)
+{
+   // every vs output rows line0 takes over line1 and line1 moves down a row, until the last row
+   int steps = (r->vs >> 1) + y;
+   int wraps = steps / r->vs;
+   int last = z->img_comp[k].y - 1;
+   int row1 = wraps < last ? wraps : last;
+   int row0 = wraps > 0 ? (wraps-1 < last ? wraps-1 : last) : 0;
+   r->ystep = steps % r->vs;
+   r->ypos  = wraps;
+   r->line0 = z->img_comp[k].data + row0 * z->img_comp[k].w2;
+   r->line1 = z->img_comp[k].data + row1 * z->img_comp[k].w2;
+}
+
+// upsamples and color converts the next `rows` output rows into output (c->stride apart), from
+// wherever res_comp is. the conversion loops may write one byte past the end of a row, which is
+// only harmless if the next row is written after it; with a scratch row every row is converted
+// there and copied instead
+static void stbi__jpeg_convert_rows(stbi__jpeg_convert *c, stbi__resample *res_comp, stbi_uc **linebuf, stbi_uc *output, int rows, stbi_uc *scratch)
+{
+   stbi__jpeg *z = c->z;
+   int n = c->n, decode_n = c->decode_n, is_rgb = c->is_rgb;
+   int k;
+   unsigned int i,j;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+
+   for (j=0; j < (unsigned int) rows; ++j) {
+      stbi_uc *out = scratch ? scratch : output + c->stride * j;
+      for (k=0; k < decode_n; ++k) {
+         stbi__resample *r = &res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(linebuf[k],
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (is_rgb) {
+               for (i=0; i < z->s->img_x; ++i) {
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
+                  out += n;
+               }
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                  out[3] = 255;
+                  out += n;
+               }
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(255 - out[0], m);
+                  out[1] = stbi__blinn_8x8(255 - out[1], m);
+                  out[2] = stbi__blinn_8x8(255 - out[2], m);
+                  out += n;
+               }
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         if (is_rgb) {
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < z->s->img_x; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                  out[1] = 255;
+               }
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+               out[0] = stbi__compute_y(r, g, b);
+               out[1] = 255;
+               out += n;
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+               for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+         }
+      }
+      if (scratch) memcpy(output + c->stride * j, scratch, (size_t) n * z->s->img_x);
+   }
+}
+
+// one band of output rows per task, each with its own resample state and line buffers. the
+// band's last row goes through a scratch row so the byte written past it cannot land in the
+// first row of the next band after that band has written it, all rows do if c->row_scratch
+static void stbi__jpeg_convert_band(void *task_data, int index)
+{
+   stbi__jpeg_convert *c = (stbi__jpeg_convert *) task_data;
+   stbi__jpeg *z = c->z;
+   stbi__resample res_comp[4];
+   stbi_uc *linebuf[4];
+   size_t line = z->s->img_x + 3, row = (size_t) c->n * z->s->img_x;
+   stbi_uc *scratch = c->band_scratch + (size_t) index * (c->decode_n + c->n) * line;
+   int k;
+   int y0 = (int) ((stbi__uint64) z->s->img_y * index / c->band_count);
+   int y1 = (int) ((stbi__uint64) z->s->img_y * (index + 1) / c->band_count);
+   for (k=0; k < c->decode_n; ++k) {
+      res_comp[k] = c->res_comp[k];
+      stbi__jpeg_seek_resample(z, &res_comp[k], k, y0);
+      linebuf[k] = scratch + k * line;
+   }
+   scratch += c->decode_n * line;
+   if (c->row_scratch) {
+      stbi__jpeg_convert_rows(c, res_comp, linebuf, c->output + c->stride * y0, y1 - y0, scratch);
+   } else {
+      stbi__jpeg_convert_rows(c, res_comp, linebuf, c->output + c->stride * y0, y1 - y0 - 1, NULL);
+      stbi__jpeg_convert_rows(c, res_comp, linebuf, scratch, 1, NULL);
+      memcpy(c->output + c->stride * (y1 - 1), scratch, row);
+   }
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n, is_rgb;
@@ -3890,19 +5466,24 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // resample and color-convert
    {
       int k;
-      unsigned int i,j;
+      stbi__jpeg_convert c;
+      stbi_uc *linebuf[4];
       stbi_uc *output;
-      stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+      size_t row, pitch;
 
-      stbi__resample res_comp[4];
+      c.z = z;
+      c.n = n;
+      c.decode_n = decode_n;
+      c.is_rgb = is_rgb;
 
       for (k=0; k < decode_n; ++k) {
-         stbi__resample *r = &res_comp[k];
+         stbi__resample *r = &c.res_comp[k];
 
          // allocate line buffer big enough for upsampling off the edges
          // with upsample factor of 4
          z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
          if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+         linebuf[k] = z->img_comp[k].linebuf;
 
          r->hs      = z->img_h_max / z->img_comp[k].h;
          r->vs      = z->img_v_max / z->img_comp[k].v;
@@ -3918,105 +5499,60 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          else                               r->resample = stbi__resample_row_generic;
       }
 
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+      // can't error after this so, this is safe. the caller's buffer is taken with any stride
+      row = (size_t) n * z->s->img_x;
+      pitch = row;
+      output = stbi__result_dest(z->s, n, z->s->img_x, z->s->img_y, 1);
+      if (output && z->s->out_dest_stride)
+         pitch = (size_t) z->s->out_dest_stride;
+      if (!output)
+         output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
       if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
-      // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
+      // a flipped image is written bottom-up in the same pass. the byte past a row would then
+      // land in the row written just before it, as it would in the padding of padded rows
+      c.output = output;
+      c.stride = (ptrdiff_t) pitch;
+      if (z->s->flip_rows) {
+         c.output = output + pitch * (z->s->img_y - 1);
+         c.stride = -c.stride;
+      }
+      c.row_scratch = pitch != row || z->s->flip_rows;
+
+      // now go ahead and resample, in bands of rows on the user's threads if the image is big
+      // enough (every band needs its own line buffers; without them it is done here in one go)
+      c.band_count = 0;
+      c.band_scratch = NULL;
+      if (stbi__parallel_for_global && z->s->img_x * z->s->img_y >= STBI__PARALLEL_MIN_PIXELS) {
+         c.band_count = z->s->img_y / 16 < STBI__PARALLEL_TASKS ? z->s->img_y / 16 : STBI__PARALLEL_TASKS;
+         if (c.band_count > 1)
+            c.band_scratch = (stbi_uc *) stbi__malloc_mad3(c.band_count, decode_n + n, z->s->img_x + 3, 0);
+      }
+      if (c.band_scratch) {
+         stbi__parallel_for(c.band_count, stbi__jpeg_convert_band, &c);
+         stbi__free(c.band_scratch);
+      } else if (c.row_scratch || output == z->s->out_dest) {
+         // the caller's buffer has no spare byte past the last row, so that row goes through a
+         // scratch row like the last row of a band, or all of them do (failing here is fine if
+         // the buffer isn't ours, and stbi__cleanup_jpeg doesn't free it)
+         stbi_uc *last = (stbi_uc *) stbi__malloc(row + 1);
+         if (!last) {
+            if (output != z->s->out_dest) stbi__free(output);
+            stbi__cleanup_jpeg(z);
+            return stbi__errpuc("outofmem", "Out of memory");
          }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
+         if (c.row_scratch) {
+            stbi__jpeg_convert_rows(&c, c.res_comp, linebuf, c.output, z->s->img_y, last);
          } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
-            }
+            stbi__jpeg_convert_rows(&c, c.res_comp, linebuf, c.output, z->s->img_y - 1, NULL);
+            stbi__jpeg_convert_rows(&c, c.res_comp, linebuf, last, 1, NULL);
+            memcpy(c.output + c.stride * (z->s->img_y - 1), last, row);
          }
+         stbi__free(last);
+      } else {
+         stbi__jpeg_convert_rows(&c, c.res_comp, linebuf, c.output, z->s->img_y, NULL);
       }
+
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
       *out_y = z->s->img_y;
@@ -4031,11 +5567,11 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int re
    stbi__jpeg* j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
    if (!j) return stbi__errpuc("outofmem", "Out of memory");
    memset(j, 0, sizeof(stbi__jpeg));
-   STBI_NOTUSED(ri);
    j->s = s;
    stbi__setup_jpeg(j);
    result = load_jpeg_image(j, x,y,comp,req_comp);
-   STBI_FREE(j);
+   ri->flipped = s->flip_rows; // the color converter writes the rows where they end up
+   stbi__free(j);
    return result;
 }
 
@@ -4049,7 +5585,7 @@ static int stbi__jpeg_test(stbi__context *s)
    stbi__setup_jpeg(j);
    r = stbi__decode_jpeg_header(j, STBI__SCAN_type);
    stbi__rewind(s);
-   STBI_FREE(j);
+   stbi__free(j);
    return r;
 }
 
@@ -4073,7 +5609,7 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
    memset(j, 0, sizeof(stbi__jpeg));
    j->s = s;
    result = stbi__jpeg_info_raw(j, x, y, comp);
-   STBI_FREE(j);
+   stbi__free(j);
    return result;
 }
 #endif
@@ -4084,6 +5620,8 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 //      - all output is written to a single output buffer (can malloc/realloc)
 //    performance
 //      - fast huffman
+//      - 64-bit bit buffer, pre-decoded length/distance tables and wide match copies
+//        for the bulk of the stream (stbi__parse_huffman_fast)
 
 #ifndef STBI_NO_ZLIB
 
@@ -4092,6 +5630,21 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 #define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
 
+// the fast inflate loop decodes from wider tables whose entries are already resolved into what the
+// symbol means: a literal byte, or a length/distance base plus the number of extra bits after the code.
+//    bits  0-7   code length
+//    bits  8-14  number of extra bits
+//    bit   15    literal
+//    bits 16-31  literal byte, or length/distance base
+// a zero entry is a code longer than STBI__ZWIDE_BITS, the end of block or an invalid symbol
+#define STBI__ZWIDE_BITS     10
+#define STBI__ZWIDE_MASK     ((1 << STBI__ZWIDE_BITS) - 1)
+#define STBI__ZWIDE_LITERAL  0x8000
+
+// output the fast loop may need per iteration: a literal, the longest match and the overshoot of
+// the 16-byte match copies
+#define STBI__ZFAST_OUT_MARGIN  (1 + 258 + 16)
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -4121,7 +5674,34 @@ stbi_inline static int stbi__bit_reverse(int v, int bits)
    return stbi__bitreverse16(v) >> (16-bits);
 }
 
-static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int num)
+static const int stbi__zlength_base[31] = {
+   3,4,5,6,7,8,9,10,11,13,
+   15,17,19,23,27,31,35,43,51,59,
+   67,83,99,115,131,163,195,227,258,0,0 };
+
+static const int stbi__zlength_extra[31]=
+{ 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0,0,0 };
+
+static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,
+257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577,0,0};
+
+static const int stbi__zdist_extra[32] =
+{ 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+static stbi__uint32 stbi__zwide_entry(int sym, int size, int is_distance)
+{
+   if (is_distance) {
+      if (sym >= 30) return 0; // distance codes 30 and 31 must not appear
+      return ((stbi__uint32) stbi__zdist_base[sym] << 16) | (stbi__zdist_extra[sym] << 8) | size;
+   }
+   if (sym < 256) return ((stbi__uint32) sym << 16) | STBI__ZWIDE_LITERAL | size;
+   if (sym == 256 || sym >= 286) return 0; // end of block, or length codes that must not appear
+   sym -= 257;
+   return ((stbi__uint32) stbi__zlength_base[sym] << 16) | (stbi__zlength_extra[sym] << 8) | size;
+}
+
+// wide is the optional STBI__ZWIDE_BITS table for the fast loop, NULL for the code length alphabet
+static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int num, stbi__uint32 *wide, int is_distance)
 {
    int i,k=0;
    int code, next_code[16], sizes[17];
@@ -4129,6 +5709,7 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
    // DEFLATE spec for generating codes
    memset(sizes, 0, sizeof(sizes));
    memset(z->fast, 0, sizeof(z->fast));
+   if (wide) memset(wide, 0, sizeof(stbi__uint32) << STBI__ZWIDE_BITS);
    for (i=0; i < num; ++i)
       ++sizes[sizelist[i]];
    sizes[0] = 0;
@@ -4162,6 +5743,14 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
                j += (1 << s);
             }
          }
+         if (wide && s <= STBI__ZWIDE_BITS) {
+            stbi__uint32 widev = stbi__zwide_entry(i, s, is_distance);
+            int j = stbi__bit_reverse(next_code[s],s);
+            while (j < (1 << STBI__ZWIDE_BITS)) {
+               wide[j] = widev;
+               j += (1 << s);
+            }
+         }
          ++next_code[s];
       }
    }
@@ -4173,8 +5762,17 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
 //    and it's annoying structurally to have PNG call ZLIB call PNG,
 //    we require PNG read all the IDATs and combine them into a single
 //    memory buffer
+//
+//    except when decoding row by row (stbi_load_rows): then zrefill hands
+//    out the IDAT data a buffer at a time, and instead of growing the output
+//    zflush consumes the finished rows and slides the last 32K (the window
+//    back-references can reach) to the start of the output buffer
 
-typedef struct
+#define STBI__ZWINDOW 32768
+
+typedef struct stbi__zbuf stbi__zbuf;
+
+struct stbi__zbuf
 {
    stbi_uc *zbuffer, *zbuffer_end;
    int num_bits;
@@ -4186,12 +5784,20 @@ typedef struct
    char *zout_end;
    int   z_expandable;
 
+   // both NULL unless streaming; zrefill returns 0 at the end of the input,
+   // zflush makes room for n more bytes after z->zout
+   int (*zrefill)(stbi__zbuf *z);
+   int (*zflush)(stbi__zbuf *z, int n);
+   void *zuser;
+
    stbi__zhuffman z_length, z_distance;
-} stbi__zbuf;
+   stbi__uint32 wide_length[1 << STBI__ZWIDE_BITS];
+   stbi__uint32 wide_distance[1 << STBI__ZWIDE_BITS];
+};
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
 {
-   return (z->zbuffer >= z->zbuffer_end);
+   return (z->zbuffer >= z->zbuffer_end) && !(z->zrefill && z->zrefill(z));
 }
 
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
@@ -4204,6 +5810,7 @@ static void stbi__fill_bits(stbi__zbuf *z)
    do {
       if (z->code_buffer >= (1U << z->num_bits)) {
         z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
+        z->zrefill = NULL;
         return;
       }
       z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
@@ -4221,23 +5828,33 @@ stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
    return k;
 }
 
-static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+// decodes a code that is not in the fast table from the low 16 bits of bits,
+// returns the symbol (or -1) and stores the code length in *size
+static int stbi__zhuffman_decode_long(stbi__zhuffman *z, stbi__uint32 bits, int *size)
 {
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse((int) (bits & 0xffff), 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
    if (s >= 16) return -1; // invalid code!
    // code size is s, so:
    b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
-   if (b >= STBI__ZNSYMS) return -1; // some data was corrupt somewhere!
+   if (b < 0 || b >= STBI__ZNSYMS) return -1; // some data was corrupt somewhere!
    if (z->size[b] != s) return -1;  // was originally an assert, but report failure instead.
+   *size = s;
+   return z->value[b];
+}
+
+static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+{
+   int s, v = stbi__zhuffman_decode_long(z, a->code_buffer, &s);
+   if (v < 0) return -1;
    a->code_buffer >>= s;
    a->num_bits -= s;
-   return z->value[b];
+   return v;
 }
 
 stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
@@ -4275,6 +5892,7 @@ static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room
    char *q;
    unsigned int cur, limit, old_limit;
    z->zout = zout;
+   if (z->zflush) return z->zflush(z, n);
    if (!z->z_expandable) return stbi__err("output buffer limit","Corrupt PNG");
    cur   = (unsigned int) (z->zout - z->zout_start);
    limit = old_limit = (unsigned) (z->zout_end - z->zout_start);
@@ -4283,7 +5901,7 @@ static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room
       if(limit > UINT_MAX / 2) return stbi__err("outofmem", "Out of memory");
       limit *= 2;
    }
-   q = (char *) STBI_REALLOC_SIZED(z->zout_start, old_limit, limit);
+   q = (char *) stbi__realloc_sized(z->zout_start, old_limit, limit);
    STBI_NOTUSED(old_limit);
    if (q == NULL) return stbi__err("outofmem", "Out of memory");
    z->zout_start = q;
@@ -4292,25 +5910,132 @@ static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room
    return 1;
 }
 
-static const int stbi__zlength_base[31] = {
-   3,4,5,6,7,8,9,10,11,13,
-   15,17,19,23,27,31,35,43,51,59,
-   67,83,99,115,131,163,195,227,258,0,0 };
-
-static const int stbi__zlength_extra[31]=
-{ 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0,0,0 };
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc *p)
+{
+#if defined(STBI__X86_TARGET) || defined(STBI__X64_TARGET) || defined(_M_ARM64) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+   stbi__uint64 v;
+   memcpy(&v, p, 8);
+   return v;
+#else
+   return (stbi__uint64) p[0]       | ((stbi__uint64) p[1] << 8)  | ((stbi__uint64) p[2] << 16) | ((stbi__uint64) p[3] << 24) |
+         ((stbi__uint64) p[4] << 32) | ((stbi__uint64) p[5] << 40) | ((stbi__uint64) p[6] << 48) | ((stbi__uint64) p[7] << 56);
+#endif
+}
 
-static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,
-257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577,0,0};
+// inner loop of stbi__parse_huffman_block for the bulk of the stream, where at least 8 bytes of input
+// and STBI__ZFAST_OUT_MARGIN bytes of output are left so neither has to be checked per symbol:
+//    - the bits are kept in a 64-bit buffer refilled without branches, one refill covers a literal
+//      followed by a whole length/distance pair (10+10+5+15+13 bits)
+//    - lengths and distances come out of the wide tables together with their extra bit counts
+//    - matches are copied 16 or 8 bytes at a time, short distances by repeating an 8-byte pattern,
+//      all of them may write up to 15 bytes past the match
+// it stops at anything the wide tables do not resolve and leaves it for the careful path. on return
+// the whole bytes still in the bit buffer are handed back to the input, so the buffer is as
+// stbi__fill_bits would have left it
+static int stbi__parse_huffman_fast(stbi__zbuf *a, char **pzout)
+{
+   stbi_uc *zout = (stbi_uc *) *pzout;
+   stbi_uc *zout_start = (stbi_uc *) a->zout_start;
+   stbi_uc *zout_limit;
+   stbi_uc *in = a->zbuffer;
+   stbi_uc *in_limit;
+   stbi__uint64 bits = a->code_buffer;
+   int num_bits = a->num_bits;
+   int ok = 1;
+
+   // a streamed input is topped up here, so the loop below rarely runs out of it
+   if (a->zrefill && a->zbuffer_end - a->zbuffer < 4096) {
+      a->zrefill(a);
+      in = a->zbuffer;
+   }
+   if (a->zout_end - *pzout < STBI__ZFAST_OUT_MARGIN || a->zbuffer_end - a->zbuffer < 8)
+      return 1;
+   zout_limit = (stbi_uc *) a->zout_end - STBI__ZFAST_OUT_MARGIN;
+   in_limit = a->zbuffer_end - 8;
+
+   while (zout <= zout_limit && in <= in_limit) {
+      stbi__uint32 e;
+      int len, dist, s;
+      stbi_uc *p, *end;
+
+      // take as many whole bytes as fit; the bits loaded above num_bits are the next input bits
+      // either way, so they can be or-ed in again by the next refill
+      bits |= stbi__zload64(in) << num_bits;
+      in += (63 - num_bits) >> 3;
+      num_bits |= 56;
+
+      e = a->wide_length[bits & STBI__ZWIDE_MASK];
+      if (e & STBI__ZWIDE_LITERAL) {
+         s = e & 0xff;
+         bits >>= s;
+         num_bits -= s;
+         *zout++ = (stbi_uc) (e >> 16);
+         e = a->wide_length[bits & STBI__ZWIDE_MASK];
+         if (e & STBI__ZWIDE_LITERAL) {
+            s = e & 0xff;
+            bits >>= s;
+            num_bits -= s;
+            *zout++ = (stbi_uc) (e >> 16);
+            continue;
+         }
+      }
+      if (e == 0) break; // long code or end of block
+
+      s = e & 0xff;
+      len = (int) (e >> 16) + (int) ((bits >> s) & ((1u << ((e >> 8) & 0x7f)) - 1));
+      s += (e >> 8) & 0x7f;
+      bits >>= s;
+      num_bits -= s;
+
+      e = a->wide_distance[bits & STBI__ZWIDE_MASK];
+      if (e == 0) {
+         int z = stbi__zhuffman_decode_long(&a->z_distance, (stbi__uint32) bits, &s);
+         if (z < 0 || z >= 30) { ok = stbi__err("bad huffman code","Corrupt PNG"); break; }
+         bits >>= s;
+         num_bits -= s;
+         e = stbi__zwide_entry(z, 0, 1);
+      }
+      s = e & 0xff;
+      dist = (int) (e >> 16) + (int) ((bits >> s) & ((1u << ((e >> 8) & 0x7f)) - 1));
+      s += (e >> 8) & 0x7f;
+      bits >>= s;
+      num_bits -= s;
+
+      if (zout - zout_start < dist) { ok = stbi__err("bad dist","Corrupt PNG"); break; }
+      p = zout - dist;
+      end = zout + len;
+      if (dist >= 16) {
+         do { memcpy(zout, p, 16); zout += 16; p += 16; } while (zout < end);
+      } else if (dist >= 8) {
+         do { memcpy(zout, p, 8); zout += 8; p += 8; } while (zout < end);
+      } else {
+         // runs of a pixel or a byte, common in images: repeat the last dist bytes to fill 8,
+         // then store them advancing by the largest multiple of dist that fits
+         stbi_uc pattern[8];
+         int i, step = (8 / dist) * dist;
+         for (i=0; i < 8; ++i)
+            pattern[i] = i < dist ? p[i] : pattern[i - dist];
+         do { memcpy(zout, pattern, 8); zout += step; } while (zout < end);
+      }
+      zout = end;
+   }
 
-static const int stbi__zdist_extra[32] =
-{ 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+   in -= num_bits >> 3;
+   num_bits &= 7;
+   a->zbuffer = in;
+   a->code_buffer = (stbi__uint32) (bits & ((1u << num_bits) - 1));
+   a->num_bits = num_bits;
+   *pzout = (char *) zout;
+   return ok;
+}
 
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+      if (!stbi__parse_huffman_fast(a, &zout)) return 0;
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -4374,7 +6099,7 @@ static int stbi__compute_huffman_codes(stbi__zbuf *a)
       int s = stbi__zreceive(a,3);
       codelength_sizes[length_dezigzag[i]] = (stbi_uc) s;
    }
-   if (!stbi__zbuild_huffman(&z_codelength, codelength_sizes, 19)) return 0;
+   if (!stbi__zbuild_huffman(&z_codelength, codelength_sizes, 19, NULL, 0)) return 0;
 
    n = 0;
    while (n < ntot) {
@@ -4401,8 +6126,8 @@ static int stbi__compute_huffman_codes(stbi__zbuf *a)
       }
    }
    if (n != ntot) return stbi__err("bad codelengths","Corrupt PNG");
-   if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit)) return 0;
-   if (!stbi__zbuild_huffman(&a->z_distance, lencodes+hlit, hdist)) return 0;
+   if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit, a->wide_length, 0)) return 0;
+   if (!stbi__zbuild_huffman(&a->z_distance, lencodes+hlit, hdist, a->wide_distance, 1)) return 0;
    return 1;
 }
 
@@ -4426,12 +6151,22 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
-   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
+   if (a->zbuffer + len > a->zbuffer_end && !a->zrefill) return stbi__err("read past buffer","Corrupt PNG");
    if (a->zout + len > a->zout_end)
       if (!stbi__zexpand(a, a->zout, len)) return 0;
-   memcpy(a->zout, a->zbuffer, len);
-   a->zbuffer += len;
-   a->zout += len;
+   // a streamed block can span several input buffers
+   while (len > 0) {
+      int n = (int) (a->zbuffer_end - a->zbuffer);
+      if (n == 0) {
+         if (stbi__zeof(a)) return stbi__err("read past buffer","Corrupt PNG");
+         continue;
+      }
+      if (n > len) n = len;
+      memcpy(a->zout, a->zbuffer, n);
+      a->zbuffer += n;
+      a->zout += n;
+      len -= n;
+   }
    return 1;
 }
 
@@ -4496,8 +6231,8 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
       } else {
          if (type == 1) {
             // use fixed code lengths
-            if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , STBI__ZNSYMS)) return 0;
-            if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32)) return 0;
+            if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , STBI__ZNSYMS, a->wide_length  , 0)) return 0;
+            if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32         , a->wide_distance, 1)) return 0;
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
@@ -4513,6 +6248,8 @@ static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse
    a->zout       = obuf;
    a->zout_end   = obuf + olen;
    a->z_expandable = exp;
+   a->zrefill = NULL;
+   a->zflush = NULL;
 
    return stbi__parse_zlib(a, parse_header);
 }
@@ -4528,7 +6265,7 @@ STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
    } else {
-      STBI_FREE(a.zout_start);
+      stbi__free(a.zout_start);
       return NULL;
    }
 }
@@ -4549,7 +6286,7 @@ STBIDEF char *stbi_zlib_decode_malloc_guesssize_headerflag(const char *buffer, i
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
    } else {
-      STBI_FREE(a.zout_start);
+      stbi__free(a.zout_start);
       return NULL;
    }
 }
@@ -4576,7 +6313,7 @@ STBIDEF char *stbi_zlib_decode_noheader_malloc(char const *buffer, int len, int
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
    } else {
-      STBI_FREE(a.zout_start);
+      stbi__free(a.zout_start);
       return NULL;
    }
 }
@@ -4632,6 +6369,8 @@ typedef struct
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   int widen; // write samples of 8 bits and less out as 16 bits (stbi_load_16), so they're never copied wider
+   stbi_row_callbacks const *rows; // if not NULL, the image data is streamed to it at the first IDAT
 } stbi__png;
 
 
@@ -4667,6 +6406,292 @@ static int stbi__paeth(int a, int b, int c)
    return t1;
 }
 
+// SIMD unfiltering
+//
+// Sub, Average and Paeth predict every byte from the pixel to its left, so a row can't
+// be processed 16 bytes at a time; instead one 3 or 4 byte pixel is processed per step
+// with all of its channels in one register (the same approach as libpng). Up has no such
+// dependency and runs on whole vectors. SSE2 is part of every x64 CPU, the SSSE3 (Sub with
+// 3 byte pixels) and AVX2 (Up) kernels are compiled with target attributes and picked by a
+// run-time CPU check. Paeth with 3 byte pixels stays on the scalar loop on x86, the SSE2
+// kernel was slower than it. Define STBI_NO_PNG_SIMD to always use the scalar loops.
+
+typedef void (*stbi__png_unfilter_func)(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk);
+
+#if !defined(STBI_NO_PNG_SIMD) && (defined(STBI_SSE2) || defined(STBI_NEON))
+#define STBI__PNG_SIMD
+
+static int stbi__png_simd_global = 1;
+
+STBIDEF void stbi_set_png_simd(int flag_true_if_should_use_simd)
+{
+   stbi__png_simd_global = flag_true_if_should_use_simd;
+}
+
+// pixels are moved as 4 byte words; for 3 byte pixels the extra byte belongs to the next
+// pixel, which overwrites it, except for the last pixel of a row (whole == 0) which must not
+// read or write past the end of the row
+static stbi__uint32 stbi__png_load_pixel(const stbi_uc *p, int whole)
+{
+   stbi__uint32 v = 0;
+   if (whole) memcpy(&v, p, 4);
+   else       memcpy(&v, p, 3);
+   return v;
+}
+
+static void stbi__png_store_pixel(stbi_uc *p, stbi__uint32 v, int whole)
+{
+   if (whole) memcpy(p, &v, 4);
+   else       memcpy(p, &v, 3);
+}
+#else
+STBIDEF void stbi_set_png_simd(int flag_true_if_should_use_simd)
+{
+   STBI_NOTUSED(flag_true_if_should_use_simd);
+}
+#endif
+
+#if defined(STBI__PNG_SIMD) && defined(STBI_SSE2)
+
+static void stbi__png_unfilter_up_sse2(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk)
+{
+   int k = 0;
+   for (; k + 16 <= nk; k += 16) {
+      __m128i r = _mm_loadu_si128((const __m128i *) (raw + k));
+      __m128i b = _mm_loadu_si128((const __m128i *) (prior + k));
+      _mm_storeu_si128((__m128i *) (cur + k), _mm_add_epi8(r, b));
+   }
+   for (; k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+
+STBI__TARGET_AVX2 static void stbi__png_unfilter_up_avx2(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk)
+{
+   int k = 0;
+   for (; k + 32 <= nk; k += 32) {
+      __m256i r = _mm256_loadu_si256((const __m256i *) (raw + k));
+      __m256i b = _mm256_loadu_si256((const __m256i *) (prior + k));
+      _mm256_storeu_si256((__m256i *) (cur + k), _mm256_add_epi8(r, b));
+   }
+   for (; k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+
+// with 4 byte pixels, 4 pixels at a time: a running sum of the pixels in the register, plus the last pixel of the previous step
+static void stbi__png_unfilter_sub4_sse2(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk)
+{
+   __m128i a = _mm_setzero_si128();
+   int k = 0;
+   STBI_NOTUSED(prior);
+   for (; k + 16 <= nk; k += 16) {
+      __m128i d = _mm_loadu_si128((const __m128i *) (raw + k));
+      d = _mm_add_epi8(d, _mm_slli_si128(d, 4));
+      d = _mm_add_epi8(d, _mm_slli_si128(d, 8));
+      d = _mm_add_epi8(d, a);
+      _mm_storeu_si128((__m128i *) (cur + k), d);
+      a = _mm_shuffle_epi32(d, _MM_SHUFFLE(3,3,3,3));
+   }
+   for (; k < nk; k += 4) {
+      __m128i d = _mm_add_epi8(_mm_cvtsi32_si128((int) stbi__png_load_pixel(raw + k, 1)), a);
+      stbi__png_store_pixel(cur + k, (stbi__uint32) _mm_cvtsi128_si32(d), 1);
+      a = d;
+   }
+}
+
+static void stbi__png_unfilter_sub3_sse2(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk)
+{
+   __m128i a = _mm_setzero_si128();
+   int k;
+   STBI_NOTUSED(prior);
+   for (k = 0; k < nk; k += 3) {
+      int whole = k + 4 <= nk;
+      __m128i d = _mm_add_epi8(_mm_cvtsi32_si128((int) stbi__png_load_pixel(raw + k, whole)), a);
+      stbi__png_store_pixel(cur + k, (stbi__uint32) _mm_cvtsi128_si32(d), whole);
+      a = d;
+   }
+}
+
+// with 3 byte pixels, 5 pixels (15 bytes) at a time; the 16th byte is garbage that the next step overwrites,
+// and pshufb copies the last pixel into every pixel slot to carry it into the next step
+STBI__TARGET_SSSE3 static void stbi__png_unfilter_sub3_ssse3(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk)
+{
+   __m128i last_pixel = _mm_setr_epi8(12,13,14, 12,13,14, 12,13,14, 12,13,14, 12,13,14, -1);
+   __m128i a = _mm_setzero_si128();
+   int k = 0;
+   STBI_NOTUSED(prior);
+   for (; k + 16 <= nk; k += 15) {
+      __m128i d = _mm_loadu_si128((const __m128i *) (raw + k));
+      d = _mm_add_epi8(d, _mm_slli_si128(d, 3));
+      d = _mm_add_epi8(d, _mm_slli_si128(d, 6));
+      d = _mm_add_epi8(d, _mm_slli_si128(d, 12));
+      d = _mm_add_epi8(d, a);
+      _mm_storeu_si128((__m128i *) (cur + k), d);
+      a = _mm_shuffle_epi8(d, last_pixel);
+   }
+   for (; k < nk; k += 3) {
+      int whole = k + 4 <= nk;
+      __m128i d = _mm_add_epi8(_mm_cvtsi32_si128((int) stbi__png_load_pixel(raw + k, whole)), a);
+      stbi__png_store_pixel(cur + k, (stbi__uint32) _mm_cvtsi128_si32(d), whole);
+      a = d;
+   }
+}
+
+// (a + b) >> 1 per byte: _mm_avg_epu8 rounds up, so take back the 1 it added when a + b is odd
+static void stbi__png_unfilter_avg_sse2(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk, int bpp)
+{
+   __m128i a = _mm_setzero_si128();
+   __m128i one = _mm_set1_epi8(1);
+   int k;
+   for (k = 0; k < nk; k += bpp) {
+      int whole = k + 4 <= nk;
+      __m128i b = _mm_cvtsi32_si128((int) stbi__png_load_pixel(prior + k, whole));
+      __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+      __m128i d = _mm_add_epi8(_mm_cvtsi32_si128((int) stbi__png_load_pixel(raw + k, whole)), avg);
+      stbi__png_store_pixel(cur + k, (stbi__uint32) _mm_cvtsi128_si32(d), whole);
+      a = d;
+   }
+}
+
+static void stbi__png_unfilter_avg3_sse2(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk) { stbi__png_unfilter_avg_sse2(cur, raw, prior, nk, 3); }
+static void stbi__png_unfilter_avg4_sse2(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk) { stbi__png_unfilter_avg_sse2(cur, raw, prior, nk, 4); }
+
+static __m128i stbi__png_select(__m128i mask, __m128i x, __m128i y)
+{
+   return _mm_or_si128(_mm_and_si128(mask, x), _mm_andnot_si128(mask, y));
+}
+
+// Paeth with the same threshold formulation as stbi__paeth, on 16 bit lanes; it has a much shorter
+// dependency chain than comparing |p-a|, |p-b| and |p-c|, which matters because every pixel waits for
+// the previous one. The previous pixel a stays widened so there is no unpacking on that chain either
+static void stbi__png_unfilter_paeth_sse2(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk, int bpp)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i low_bytes = _mm_set1_epi16(0xff);
+   __m128i a = zero, c = zero;
+   int k;
+   for (k = 0; k < nk; k += bpp) {
+      int whole = k + 4 <= nk;
+      __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int) stbi__png_load_pixel(prior + k, whole)), zero);
+      __m128i x = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int) stbi__png_load_pixel(raw + k, whole)), zero);
+      __m128i c3 = _mm_add_epi16(c, _mm_add_epi16(c, c));
+      __m128i thresh = _mm_sub_epi16(c3, _mm_add_epi16(a, b));
+      __m128i lo = _mm_min_epi16(a, b);
+      __m128i hi = _mm_max_epi16(a, b);
+      __m128i t0 = stbi__png_select(_mm_cmpgt_epi16(hi, thresh), c, lo);
+      __m128i t1 = stbi__png_select(_mm_cmpgt_epi16(thresh, lo), t0, hi);
+      a = _mm_and_si128(_mm_add_epi16(x, t1), low_bytes);
+      stbi__png_store_pixel(cur + k, (stbi__uint32) _mm_cvtsi128_si32(_mm_packus_epi16(a, a)), whole);
+      c = b;
+   }
+}
+
+static void stbi__png_unfilter_paeth4_sse2(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk) { stbi__png_unfilter_paeth_sse2(cur, raw, prior, nk, 4); }
+
+// fills in a kernel per filter type, entries left 0 use the scalar loop
+static void stbi__png_select_unfilter(stbi__png_unfilter_func *unfilter, int filter_bytes)
+{
+   int features = stbi__cpu_features();
+   unfilter[STBI__F_up] = (features & 2) ? stbi__png_unfilter_up_avx2 : stbi__png_unfilter_up_sse2;
+   if (filter_bytes == 3) {
+      unfilter[STBI__F_sub]   = (features & 1) ? stbi__png_unfilter_sub3_ssse3 : stbi__png_unfilter_sub3_sse2;
+      unfilter[STBI__F_avg]   = stbi__png_unfilter_avg3_sse2;
+   } else if (filter_bytes == 4) {
+      unfilter[STBI__F_sub]   = stbi__png_unfilter_sub4_sse2;
+      unfilter[STBI__F_avg]   = stbi__png_unfilter_avg4_sse2;
+      unfilter[STBI__F_paeth] = stbi__png_unfilter_paeth4_sse2;
+   }
+}
+
+#endif // STBI__PNG_SIMD && STBI_SSE2
+
+#if defined(STBI__PNG_SIMD) && defined(STBI_NEON)
+
+static void stbi__png_unfilter_up_neon(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk)
+{
+   int k = 0;
+   for (; k + 16 <= nk; k += 16)
+      vst1q_u8(cur + k, vaddq_u8(vld1q_u8(raw + k), vld1q_u8(prior + k)));
+   for (; k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+
+static uint8x8_t stbi__png_load_pixel_neon(const stbi_uc *p, int whole)
+{
+   return vreinterpret_u8_u32(vdup_n_u32(stbi__png_load_pixel(p, whole)));
+}
+
+static void stbi__png_store_pixel_neon(stbi_uc *p, uint8x8_t v, int whole)
+{
+   stbi__png_store_pixel(p, vget_lane_u32(vreinterpret_u32_u8(v), 0), whole);
+}
+
+static void stbi__png_unfilter_sub_neon(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk, int bpp)
+{
+   uint8x8_t a = vdup_n_u8(0);
+   int k;
+   STBI_NOTUSED(prior);
+   for (k = 0; k < nk; k += bpp) {
+      int whole = k + 4 <= nk;
+      a = vadd_u8(stbi__png_load_pixel_neon(raw + k, whole), a);
+      stbi__png_store_pixel_neon(cur + k, a, whole);
+   }
+}
+
+// vhadd_u8 is (a + b) >> 1 without overflow, exactly what the filter needs
+static void stbi__png_unfilter_avg_neon(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk, int bpp)
+{
+   uint8x8_t a = vdup_n_u8(0);
+   int k;
+   for (k = 0; k < nk; k += bpp) {
+      int whole = k + 4 <= nk;
+      uint8x8_t b = stbi__png_load_pixel_neon(prior + k, whole);
+      a = vadd_u8(stbi__png_load_pixel_neon(raw + k, whole), vhadd_u8(a, b));
+      stbi__png_store_pixel_neon(cur + k, a, whole);
+   }
+}
+
+static void stbi__png_unfilter_paeth_neon(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk, int bpp)
+{
+   uint8x8_t a = vdup_n_u8(0), c = vdup_n_u8(0);
+   int k;
+   for (k = 0; k < nk; k += bpp) {
+      int whole = k + 4 <= nk;
+      uint8x8_t b = stbi__png_load_pixel_neon(prior + k, whole);
+      uint16x8_t pa = vabdl_u8(b, c);
+      uint16x8_t pb = vabdl_u8(a, c);
+      uint16x8_t pc = vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c));
+      uint16x8_t smallest = vminq_u16(pc, vminq_u16(pa, pb));
+      uint8x8_t pick = vbsl_u8(vmovn_u16(vceqq_u16(smallest, pb)), b, c);
+      pick = vbsl_u8(vmovn_u16(vceqq_u16(smallest, pa)), a, pick);
+      a = vadd_u8(stbi__png_load_pixel_neon(raw + k, whole), pick);
+      stbi__png_store_pixel_neon(cur + k, a, whole);
+      c = b;
+   }
+}
+
+static void stbi__png_unfilter_sub3_neon(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk) { stbi__png_unfilter_sub_neon(cur, raw, prior, nk, 3); }
+static void stbi__png_unfilter_sub4_neon(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk) { stbi__png_unfilter_sub_neon(cur, raw, prior, nk, 4); }
+static void stbi__png_unfilter_avg3_neon(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk) { stbi__png_unfilter_avg_neon(cur, raw, prior, nk, 3); }
+static void stbi__png_unfilter_avg4_neon(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk) { stbi__png_unfilter_avg_neon(cur, raw, prior, nk, 4); }
+static void stbi__png_unfilter_paeth3_neon(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk) { stbi__png_unfilter_paeth_neon(cur, raw, prior, nk, 3); }
+static void stbi__png_unfilter_paeth4_neon(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk) { stbi__png_unfilter_paeth_neon(cur, raw, prior, nk, 4); }
+
+static void stbi__png_select_unfilter(stbi__png_unfilter_func *unfilter, int filter_bytes)
+{
+   unfilter[STBI__F_up] = stbi__png_unfilter_up_neon;
+   if (filter_bytes == 3) {
+      unfilter[STBI__F_sub]   = stbi__png_unfilter_sub3_neon;
+      unfilter[STBI__F_avg]   = stbi__png_unfilter_avg3_neon;
+      unfilter[STBI__F_paeth] = stbi__png_unfilter_paeth3_neon;
+   } else if (filter_bytes == 4) {
+      unfilter[STBI__F_sub]   = stbi__png_unfilter_sub4_neon;
+      unfilter[STBI__F_avg]   = stbi__png_unfilter_avg4_neon;
+      unfilter[STBI__F_paeth] = stbi__png_unfilter_paeth4_neon;
+   }
+}
+
+#endif // STBI__PNG_SIMD && STBI_NEON
+
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
 // adds an extra all-255 alpha channel
@@ -4692,24 +6717,152 @@ static void stbi__create_png_alpha_expand8(stbi_uc *dest, stbi_uc *src, stbi__ui
    }
 }
 
+// undoes the filter of one row: raw is the row after its filter byte, prior the previous
+// unfiltered row. unfilter holds the SIMD kernels picked by stbi__png_select_unfilter
+static void stbi__png_unfilter_row(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int filter, int nk, int filter_bytes, const stbi__png_unfilter_func *unfilter)
+{
+   int k;
+   if (unfilter[filter]) {
+      unfilter[filter](cur, raw, prior, nk);
+      return;
+   }
+   switch (filter) {
+   case STBI__F_none:
+      memcpy(cur, raw, nk);
+      break;
+   case STBI__F_sub:
+      memcpy(cur, raw, filter_bytes);
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]);
+      break;
+   case STBI__F_up:
+      for (k = 0; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      break;
+   case STBI__F_avg:
+      for (k = 0; k < filter_bytes; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1));
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1));
+      break;
+   case STBI__F_paeth:
+      for (k = 0; k < filter_bytes; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes], prior[k], prior[k-filter_bytes]));
+      break;
+   case STBI__F_avg_first:
+      memcpy(cur, raw, filter_bytes);
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + (cur[k-filter_bytes] >> 1));
+      break;
+   }
+}
+
+// expands the unfiltered samples of one row in cur to bytes (or native 16-bit words) in dest,
+// adding an alpha channel if out_n is img_n+1; 8-bit rows are converted to any out_n
+static void stbi__png_expand_row(stbi_uc *dest, stbi_uc *cur, stbi__uint32 x, int img_n, int out_n, int depth, int color)
+{
+   stbi__uint32 i;
+   if (depth < 8) {
+      stbi_uc scale = (color == 0) ? stbi__depth_scale_table[depth] : 1; // scale grayscale values to 0..255 range
+      stbi_uc *in = cur;
+      stbi_uc *out = dest;
+      stbi_uc inb = 0;
+      stbi__uint32 nsmp = x*img_n;
+
+      // expand bits to bytes first
+      if (depth == 4) {
+         for (i=0; i < nsmp; ++i) {
+            if ((i & 1) == 0) inb = *in++;
+            *out++ = scale * (inb >> 4);
+            inb <<= 4;
+         }
+      } else if (depth == 2) {
+         for (i=0; i < nsmp; ++i) {
+            if ((i & 3) == 0) inb = *in++;
+            *out++ = scale * (inb >> 6);
+            inb <<= 2;
+         }
+      } else {
+         STBI_ASSERT(depth == 1);
+         for (i=0; i < nsmp; ++i) {
+            if ((i & 7) == 0) inb = *in++;
+            *out++ = scale * (inb >> 7);
+            inb <<= 1;
+         }
+      }
+
+      // insert alpha=255 values if desired
+      if (img_n != out_n)
+         stbi__create_png_alpha_expand8(dest, dest, x, img_n);
+   } else if (depth == 8) {
+      if (img_n == out_n)
+         memcpy(dest, cur, x*img_n);
+      else if (out_n == img_n+1 && img_n != 2)
+         stbi__create_png_alpha_expand8(dest, cur, x, img_n);
+      else
+         stbi__convert_row(cur, img_n, dest, out_n, x);
+   } else if (depth == 16) {
+      // convert the image data from big-endian to platform-native
+      stbi__uint16 *dest16 = (stbi__uint16*)dest;
+      stbi__uint32 nsmp = x*img_n;
+
+      if (img_n == out_n) {
+         i = 0;
+#ifdef STBI_SSE2
+         for (; i + 8 <= nsmp; i += 8, dest16 += 8, cur += 16) {
+            __m128i v = _mm_loadu_si128((__m128i const *) cur);
+            _mm_storeu_si128((__m128i *) dest16, _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+         }
+#endif
+         for (; i < nsmp; ++i, ++dest16, cur += 2)
+            *dest16 = (cur[0] << 8) | cur[1];
+      } else {
+         STBI_ASSERT(img_n+1 == out_n);
+         if (img_n == 1) {
+            for (i = 0; i < x; ++i, dest16 += 2, cur += 2) {
+               dest16[0] = (cur[0] << 8) | cur[1];
+               dest16[1] = 0xffff;
+            }
+         } else {
+            STBI_ASSERT(img_n == 3);
+            for (i = 0; i < x; ++i, dest16 += 4, cur += 6) {
+               dest16[0] = (cur[0] << 8) | cur[1];
+               dest16[1] = (cur[2] << 8) | cur[3];
+               dest16[2] = (cur[4] << 8) | cur[5];
+               dest16[3] = 0xffff;
+            }
+         }
+      }
+   }
+}
+
 // create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+// whole is 0 for the passes of an interlaced image, which only the de-interlacing reads. a whole
+// image is written bottom-up if it is flipped, and 8 and 16-bit rows are converted to any out_n.
+// with a->widen every sample is written as a 16-bit word
+static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color, int whole)
 {
-   int bytes = (depth == 16 ? 2 : 1);
+   int bytes = (depth == 16 || a->widen ? 2 : 1);
    stbi__context *s = a->s;
-   stbi__uint32 i,j,stride = x*out_n*bytes;
-   stbi__uint32 img_len, img_width_bytes;
-   stbi_uc *filter_buf;
+   stbi__uint32 j,stride = x*out_n*bytes;
+   stbi__uint32 img_len, img_width_bytes, row_len = 0;
+   stbi_uc *filter_buf, *row_buf;
    int all_ok = 1;
-   int k;
    int img_n = s->img_n; // copy it into a local for later
+   int convert16 = depth == 16 && out_n != img_n && !(out_n == img_n+1 && img_n != 2);
 
    int output_bytes = out_n*bytes;
-   int filter_bytes = img_n*bytes;
+   int filter_bytes = img_n*(depth == 16 ? 2 : 1);
    int width = x;
+   stbi__png_unfilter_func unfilter[STBI__F_avg_first+1] = { 0 };
 
-   STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
-   a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
+   STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1 || depth >= 8);
+   if (whole && bytes == 1)
+      a->out = (stbi_uc *) stbi__malloc_result(s, out_n, x, y, 0);
+   else
+      a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
    if (!a->out) return stbi__err("outofmem", "Out of memory");
 
    // note: error exits here don't need to clean up a->out individually,
@@ -4724,9 +6877,18 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    // so just check for raw_len < img_len always.
    if (raw_len < img_len) return stbi__err("not enough pixels","Corrupt PNG");
 
+   // a row goes through row_buf on its way to dest if it can't be written there in one step: widened
+   // rows other than plain 8-bit ones are expanded to bytes there first, 16-bit rows that change their
+   // channel count are put in native order first
+   if (a->widen && !(depth == 8 && img_n == out_n))
+      row_len = x*out_n;
+   else if (convert16)
+      row_len = img_width_bytes;
+
    // Allocate two scan lines worth of filter workspace buffer.
-   filter_buf = (stbi_uc *) stbi__malloc_mad2(img_width_bytes, 2, 0);
+   filter_buf = (stbi_uc *) stbi__malloc_mad2(img_width_bytes, 2, row_len);
    if (!filter_buf) return stbi__err("outofmem", "Out of memory");
+   row_buf = filter_buf + img_width_bytes*2;
 
    // Filtering for low-bit-depth images
    if (depth < 8) {
@@ -4734,11 +6896,16 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       width = img_width_bytes;
    }
 
+#ifdef STBI__PNG_SIMD
+   if (stbi__png_simd_global)
+      stbi__png_select_unfilter(unfilter, filter_bytes);
+#endif
+
    for (j=0; j < y; ++j) {
       // cur/prior filter buffers alternate
       stbi_uc *cur = filter_buf + (j & 1)*img_width_bytes;
       stbi_uc *prior = filter_buf + (~j & 1)*img_width_bytes;
-      stbi_uc *dest = a->out + stride*j;
+      stbi_uc *dest = a->out + stride*(whole && s->flip_rows ? y-1-j : j);
       int nk = width * filter_bytes;
       int filter = *raw++;
 
@@ -4751,108 +6918,26 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
 
-      // perform actual filtering
-      switch (filter) {
-      case STBI__F_none:
-         memcpy(cur, raw, nk);
-         break;
-      case STBI__F_sub:
-         memcpy(cur, raw, filter_bytes);
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]);
-         break;
-      case STBI__F_up:
-         for (k = 0; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
-         break;
-      case STBI__F_avg:
-         for (k = 0; k < filter_bytes; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1));
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1));
-         break;
-      case STBI__F_paeth:
-         for (k = 0; k < filter_bytes; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes], prior[k], prior[k-filter_bytes]));
-         break;
-      case STBI__F_avg_first:
-         memcpy(cur, raw, filter_bytes);
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + (cur[k-filter_bytes] >> 1));
-         break;
-      }
-
+      stbi__png_unfilter_row(cur, raw, prior, filter, nk, filter_bytes, unfilter);
       raw += nk;
 
       // expand decoded bits in cur to dest, also adding an extra alpha channel if desired
-      if (depth < 8) {
-         stbi_uc scale = (color == 0) ? stbi__depth_scale_table[depth] : 1; // scale grayscale values to 0..255 range
-         stbi_uc *in = cur;
-         stbi_uc *out = dest;
-         stbi_uc inb = 0;
-         stbi__uint32 nsmp = x*img_n;
-
-         // expand bits to bytes first
-         if (depth == 4) {
-            for (i=0; i < nsmp; ++i) {
-               if ((i & 1) == 0) inb = *in++;
-               *out++ = scale * (inb >> 4);
-               inb <<= 4;
-            }
-         } else if (depth == 2) {
-            for (i=0; i < nsmp; ++i) {
-               if ((i & 3) == 0) inb = *in++;
-               *out++ = scale * (inb >> 6);
-               inb <<= 2;
-            }
+      if (a->widen) {
+         if (row_len) {
+            stbi__png_expand_row(row_buf, cur, x, img_n, out_n, depth, color);
+            stbi__widen_8_to_16((stbi__uint16 *) dest, row_buf, x*out_n);
          } else {
-            STBI_ASSERT(depth == 1);
-            for (i=0; i < nsmp; ++i) {
-               if ((i & 7) == 0) inb = *in++;
-               *out++ = scale * (inb >> 7);
-               inb <<= 1;
-            }
-         }
-
-         // insert alpha=255 values if desired
-         if (img_n != out_n)
-            stbi__create_png_alpha_expand8(dest, dest, x, img_n);
-      } else if (depth == 8) {
-         if (img_n == out_n)
-            memcpy(dest, cur, x*img_n);
-         else
-            stbi__create_png_alpha_expand8(dest, cur, x, img_n);
-      } else if (depth == 16) {
-         // convert the image data from big-endian to platform-native
-         stbi__uint16 *dest16 = (stbi__uint16*)dest;
-         stbi__uint32 nsmp = x*img_n;
-
-         if (img_n == out_n) {
-            for (i = 0; i < nsmp; ++i, ++dest16, cur += 2)
-               *dest16 = (cur[0] << 8) | cur[1];
-         } else {
-            STBI_ASSERT(img_n+1 == out_n);
-            if (img_n == 1) {
-               for (i = 0; i < x; ++i, dest16 += 2, cur += 2) {
-                  dest16[0] = (cur[0] << 8) | cur[1];
-                  dest16[1] = 0xffff;
-               }
-            } else {
-               STBI_ASSERT(img_n == 3);
-               for (i = 0; i < x; ++i, dest16 += 4, cur += 6) {
-                  dest16[0] = (cur[0] << 8) | cur[1];
-                  dest16[1] = (cur[2] << 8) | cur[3];
-                  dest16[2] = (cur[4] << 8) | cur[5];
-                  dest16[3] = 0xffff;
-               }
-            }
+            stbi__widen_8_to_16((stbi__uint16 *) dest, cur, x*out_n);
          }
+      } else if (convert16) {
+         stbi__png_expand_row(row_buf, cur, x, img_n, img_n, depth, color);
+         stbi__convert_row16((stbi__uint16 *) row_buf, img_n, (stbi__uint16 *) dest, out_n, x);
+      } else {
+         stbi__png_expand_row(dest, cur, x, img_n, out_n, depth, color);
       }
    }
 
-   STBI_FREE(filter_buf);
+   stbi__free(filter_buf);
    if (!all_ok) return 0;
 
    return 1;
@@ -4860,15 +6945,18 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 
 static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint32 image_data_len, int out_n, int depth, int color, int interlaced)
 {
-   int bytes = (depth == 16 ? 2 : 1);
+   int bytes = (depth == 16 || a->widen ? 2 : 1);
    int out_bytes = out_n * bytes;
    stbi_uc *final;
    int p;
    if (!interlaced)
-      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
+      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color, 1);
 
    // de-interlacing
-   final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
+   if (bytes == 1)
+      final = (stbi_uc *) stbi__malloc_result(a->s, out_n, a->s->img_x, a->s->img_y, 0);
+   else
+      final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
    if (!final) return stbi__err("outofmem", "Out of memory");
    for (p=0; p < 7; ++p) {
       int xorig[] = { 0,4,0,2,0,1,0 };
@@ -4881,19 +6969,20 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
       y = (a->s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
       if (x && y) {
          stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
-         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
-            STBI_FREE(final);
+         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color, 0)) {
+            stbi__free_result(a->s, final);
             return 0;
          }
          for (j=0; j < y; ++j) {
             for (i=0; i < x; ++i) {
                int out_y = j*yspc[p]+yorig[p];
                int out_x = i*xspc[p]+xorig[p];
+               if (a->s->flip_rows) out_y = a->s->img_y - 1 - out_y;
                memcpy(final + out_y*a->s->img_x*out_bytes + out_x*out_bytes,
                       a->out + (j*x+i)*out_bytes, out_bytes);
             }
          }
-         STBI_FREE(a->out);
+         stbi__free(a->out);
          image_data += img_len;
          image_data_len -= img_len;
       }
@@ -4903,11 +6992,9 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    return 1;
 }
 
-static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
+static int stbi__compute_transparency(stbi_uc *p, stbi__uint32 pixel_count, stbi_uc tc[3], int out_n)
 {
-   stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-   stbi_uc *p = z->out;
+   stbi__uint32 i;
 
    // compute color-based transparency, assuming we've
    // already got 255 as the alpha value in the output
@@ -4928,11 +7015,9 @@ static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
    return 1;
 }
 
-static int stbi__compute_transparency16(stbi__png *z, stbi__uint16 tc[3], int out_n)
+static int stbi__compute_transparency16(stbi__uint16 *p, stbi__uint32 pixel_count, stbi__uint16 tc[3], int out_n)
 {
-   stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-   stbi__uint16 *p = (stbi__uint16*) z->out;
+   stbi__uint32 i;
 
    // compute color-based transparency, assuming we've
    // already got 65535 as the alpha value in the output
@@ -4949,22 +7034,30 @@ static int stbi__compute_transparency16(stbi__png *z, stbi__uint16 tc[3], int ou
             p[3] = 0;
          p += 4;
       }
-   }
-   return 1;
-}
-
-static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int pal_img_n)
-{
-   stbi__uint32 i, pixel_count = a->s->img_x * a->s->img_y;
-   stbi_uc *p, *temp_out, *orig = a->out;
-
-   p = (stbi_uc *) stbi__malloc_mad2(pixel_count, pal_img_n, 0);
-   if (p == NULL) return stbi__err("outofmem", "Out of memory");
-
-   // between here and free(out) below, exitting would leak
-   temp_out = p;
+   }
+   return 1;
+}
 
-   if (pal_img_n == 3) {
+// looks up pixel_count palette indices from orig, writing out_n (1..4) channels to p
+static void stbi__png_apply_palette(stbi_uc *p, const stbi_uc *orig, stbi__uint32 pixel_count, const stbi_uc *palette, int len, int out_n)
+{
+   stbi__uint32 i;
+   if (out_n < 3) {
+      // gray output converts the palette rather than every pixel
+      stbi_uc gray[256*2];
+      stbi__convert_row(palette, 4, gray, out_n, len);
+      if (out_n == 1) {
+         for (i=0; i < pixel_count; ++i)
+            p[i] = gray[orig[i]];
+      } else {
+         for (i=0; i < pixel_count; ++i) {
+            int n = orig[i]*2;
+            p[0] = gray[n  ];
+            p[1] = gray[n+1];
+            p += 2;
+         }
+      }
+   } else if (out_n == 3) {
       for (i=0; i < pixel_count; ++i) {
          int n = orig[i]*4;
          p[0] = palette[n  ];
@@ -4982,10 +7075,16 @@ static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int
          p += 4;
       }
    }
-   STBI_FREE(a->out);
-   a->out = temp_out;
+}
 
-   STBI_NOTUSED(len);
+static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int pal_img_n)
+{
+   stbi_uc *p = (stbi_uc *) stbi__malloc_result(a->s, pal_img_n, a->s->img_x, a->s->img_y, 0);
+   if (p == NULL) return stbi__err("outofmem", "Out of memory");
+
+   stbi__png_apply_palette(p, a->out, a->s->img_x * a->s->img_y, palette, len, pal_img_n);
+   stbi__free_result(a->s, a->out);
+   a->out = p;
 
    return 1;
 }
@@ -5075,6 +7174,241 @@ static void stbi__de_iphone(stbi__png *z)
 
 #define STBI__PNG_TYPE(a,b,c,d)  (((unsigned) (a) << 24) + ((unsigned) (b) << 16) + ((unsigned) (c) << 8) + (unsigned) (d))
 
+// exact size of the filtered image data the zlib stream inflates to: a filter byte plus the
+// packed samples per row, summed over the 7 reduced images when interlaced
+static stbi__uint32 stbi__png_raw_size(stbi__png *z, int interlace)
+{
+   static const int xorig[] = { 0,4,0,2,0,1,0 };
+   static const int yorig[] = { 0,0,4,0,2,0,1 };
+   static const int xspc[]  = { 8,8,4,4,2,2,1 };
+   static const int yspc[]  = { 8,8,8,4,4,2,2 };
+   stbi__context *s = z->s;
+   stbi__uint32 size = 0;
+   int p;
+   if (!interlace)
+      return ((((s->img_n * s->img_x * z->depth) + 7) >> 3) + 1) * s->img_y;
+   for (p=0; p < 7; ++p) {
+      stbi__uint32 x = (s->img_x - xorig[p] + xspc[p]-1) / xspc[p];
+      stbi__uint32 y = (s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
+      if (x && y)
+         size += ((((s->img_n * x * z->depth) + 7) >> 3) + 1) * y;
+   }
+   return size;
+}
+
+// Row-by-row decoding (stbi_load_rows) of a non-interlaced PNG: the IDAT data is read
+// STBI__PNG_STREAM_INPUT bytes at a time and inflated into a buffer that holds the 32K
+// window, a partial row and STBI__PNG_STREAM_OUTPUT bytes more; whenever that is full
+// the whole rows in it are unfiltered, converted and handed to the callback one by one.
+// Nothing is the size of the image, the largest buffers are a few rows
+
+#define STBI__PNG_STREAM_INPUT   (1 << 16)
+#define STBI__PNG_STREAM_OUTPUT  (1 << 18) // more than a stored block (65535) plus STBI__ZFAST_OUT_MARGIN
+
+typedef struct
+{
+   stbi__png *z;
+   stbi__uint32 chunk_left;   // bytes of the current IDAT not read yet
+   int idat_done;             // a chunk other than IDAT (or the end of the file) was reached
+   stbi_uc *input;
+
+   stbi__uint32 width_bytes;  // packed samples per row, without the filter byte
+   stbi__uint32 consumed;     // offset of the first inflated byte that is not part of a finished row
+   stbi__uint32 j;            // rows finished
+   int filter_bytes, nk;
+   stbi__png_unfilter_func unfilter[STBI__F_avg_first+1];
+   stbi_uc *filter_buf;       // current and previous unfiltered row
+   stbi_uc *expanded;         // a row of bytes (or 16-bit words) with expand_n channels
+   stbi_uc *converted;        // a row with the channels that are handed out, 16-bit until narrowed
+   int expand_n, out_n, color;
+
+   int pal_img_n, pal_len, has_trans;
+   stbi_uc *palette, *tc;
+   stbi__uint16 *tc16;
+} stbi__png_stream;
+
+// the input keeps the 8 bytes before a->zbuffer: the fast huffman loop hands the whole bytes
+// left in its bit buffer back by moving a->zbuffer back over them
+static int stbi__png_stream_refill(stbi__zbuf *a)
+{
+   stbi__png_stream *ps = (stbi__png_stream *) a->zuser;
+   stbi__context *s = ps->z->s;
+   int left = (int) (a->zbuffer_end - a->zbuffer);
+   int filled = 8 + left;
+
+   if (ps->idat_done && ps->chunk_left == 0) return 0;
+   memmove(ps->input, a->zbuffer - 8, filled);
+   while (filled < 8 + STBI__PNG_STREAM_INPUT) {
+      int n;
+      if (ps->chunk_left == 0) {
+         stbi__pngchunk c;
+         stbi__get32be(s); // CRC of the IDAT just finished
+         c = stbi__get_chunk_header(s);
+         if (c.type != STBI__PNG_TYPE('I','D','A','T')) {
+            ps->idat_done = 1;
+            break;
+         }
+         if (c.length > (1u << 30)) return stbi__err("IDAT size limit", "IDAT section larger than 2^30 bytes");
+         ps->chunk_left = c.length;
+         continue;
+      }
+      n = 8 + STBI__PNG_STREAM_INPUT - filled;
+      if ((stbi__uint32) n > ps->chunk_left) n = (int) ps->chunk_left;
+      if (!stbi__getn(s, ps->input + filled, n)) {
+         // truncated file: the inflate runs out of data and fails
+         ps->chunk_left = 0;
+         ps->idat_done = 1;
+         break;
+      }
+      filled += n;
+      ps->chunk_left -= n;
+   }
+   a->zbuffer = ps->input + 8;
+   a->zbuffer_end = ps->input + filled;
+   return filled > 8 + left;
+}
+
+// unfilters one row of inflated data (starting at its filter byte) and hands it out
+static int stbi__png_stream_row(stbi__png_stream *ps, stbi_uc *raw)
+{
+   stbi__context *s = ps->z->s;
+   stbi__uint32 i, x = s->img_x;
+   stbi_uc *cur = ps->filter_buf + (ps->j & 1)*ps->width_bytes;
+   stbi_uc *prior = ps->filter_buf + (~ps->j & 1)*ps->width_bytes;
+   stbi_uc *row = ps->expanded;
+   int depth = ps->z->depth;
+   int n = ps->expand_n;
+   int filter = *raw++;
+
+   if (filter > 4) return stbi__err("invalid filter","Corrupt PNG");
+   if (ps->j == 0) filter = first_row_filter[filter];
+   stbi__png_unfilter_row(cur, raw, prior, filter, ps->nk, ps->filter_bytes, ps->unfilter);
+   stbi__png_expand_row(row, cur, x, s->img_n, n, depth, ps->color);
+
+   if (depth == 16) {
+      // rows are handed out as 8-bit like stbi_load does: the channels are converted on the
+      // 16-bit samples first (gray from RGB differs otherwise), then the bytes go down in place
+      stbi__uint16 *wide = (stbi__uint16 *) row;
+      if (ps->has_trans) stbi__compute_transparency16(wide, x, ps->tc16, n);
+      if (n != ps->out_n) {
+         wide = (stbi__uint16 *) ps->converted;
+         stbi__convert_row16((stbi__uint16 *) row, n, wide, ps->out_n, x);
+         row = ps->converted;
+      }
+      for (i=0; i < x*ps->out_n; ++i)
+         row[i] = (stbi_uc) (wide[i] >> 8);
+   } else {
+      if (ps->has_trans) stbi__compute_transparency(row, x, ps->tc, n);
+      if (ps->pal_img_n) {
+         stbi__png_apply_palette(ps->converted, row, x, ps->palette, ps->pal_len, ps->out_n);
+         row = ps->converted;
+      } else if (n != ps->out_n) {
+         stbi__convert_row(row, n, ps->converted, ps->out_n, x);
+         row = ps->converted;
+      }
+   }
+
+   if (!ps->z->rows->row(ps->z->rows->user, s->flip_rows ? (int) (s->img_y-1-ps->j) : (int) ps->j, row))
+      return stbi__err("stopped", "Row callback stopped decoding");
+   ++ps->j;
+   return 1;
+}
+
+// zflush: hands out the finished rows, then keeps the window and the partial row
+static int stbi__png_stream_flush(stbi__zbuf *a, int n)
+{
+   stbi__png_stream *ps = (stbi__png_stream *) a->zuser;
+   stbi__uint32 row_bytes = ps->width_bytes + 1;
+   stbi_uc *start = (stbi_uc *) a->zout_start;
+   stbi_uc *end = (stbi_uc *) a->zout;
+   stbi_uc *p = start + ps->consumed;
+   stbi_uc *keep;
+
+   while (ps->j < ps->z->s->img_y && (stbi__uint32) (end - p) >= row_bytes) {
+      if (!stbi__png_stream_row(ps, p)) return 0;
+      p += row_bytes;
+   }
+   if (ps->j == ps->z->s->img_y) p = end; // anything after the last row is padding
+
+   keep = end - start > STBI__ZWINDOW ? end - STBI__ZWINDOW : start;
+   if (p < keep) keep = p;
+   memmove(start, keep, end - keep);
+   ps->consumed = (stbi__uint32) (p - keep);
+   a->zout = (char *) start + (end - keep);
+   if (a->zout_end - a->zout < n) return stbi__err("output buffer limit","Corrupt PNG");
+   return 1;
+}
+
+// called at the first IDAT chunk (whose header has been read) instead of collecting the IDATs
+static int stbi__png_stream_rows(stbi__png *z, stbi__uint32 idat_length, int req_comp, int color, stbi_uc *palette, int pal_len, int pal_img_n, int has_trans, stbi_uc *tc, stbi__uint16 *tc16)
+{
+   stbi__context *s = z->s;
+   stbi__png_stream ps;
+   stbi__zbuf *a;
+   stbi_uc *output;
+   int bytes = z->depth == 16 ? 2 : 1;
+   int channels_in_file = pal_img_n ? pal_img_n : s->img_n + has_trans;
+   int ok = 0;
+
+   if (!stbi__mad3sizes_valid(s->img_n, s->img_x, z->depth, 7)) return stbi__err("too large", "Corrupt PNG");
+   memset(&ps, 0, sizeof(ps));
+   ps.z = z;
+   ps.chunk_left = idat_length;
+   ps.width_bytes = ((s->img_n * s->img_x * z->depth) + 7) >> 3;
+   ps.filter_bytes = z->depth < 8 ? 1 : s->img_n * bytes;
+   ps.nk = (int) ps.width_bytes;
+   ps.color = color;
+   ps.expand_n = has_trans ? s->img_n + 1 : s->img_n;
+   ps.out_n = req_comp ? req_comp : channels_in_file;
+   // 8-bit rows go straight to out_n when nothing else has to happen first
+   if (z->depth == 8 && !pal_img_n && !has_trans) ps.expand_n = ps.out_n;
+   ps.pal_img_n = pal_img_n;
+   ps.pal_len = pal_len;
+   ps.has_trans = has_trans;
+   ps.palette = palette;
+   ps.tc = tc;
+   ps.tc16 = tc16;
+#ifdef STBI__PNG_SIMD
+   if (stbi__png_simd_global)
+      stbi__png_select_unfilter(ps.unfilter, ps.filter_bytes);
+#endif
+
+   if (z->rows->begin && !z->rows->begin(z->rows->user, s->img_x, s->img_y, channels_in_file, ps.out_n))
+      return stbi__err("stopped", "Row callback stopped decoding");
+
+   a = (stbi__zbuf *) stbi__malloc(sizeof(*a));
+   ps.input = (stbi_uc *) stbi__malloc(8 + STBI__PNG_STREAM_INPUT);
+   ps.filter_buf = (stbi_uc *) stbi__malloc_mad2(ps.width_bytes, 2, 0);
+   ps.expanded = (stbi_uc *) stbi__malloc_mad3(s->img_x, 4, bytes, 0);
+   ps.converted = (stbi_uc *) stbi__malloc_mad3(s->img_x, 4, bytes, 0);
+   output = (stbi_uc *) stbi__malloc_mad2(ps.width_bytes + 1, 1, STBI__ZWINDOW + STBI__PNG_STREAM_OUTPUT);
+   if (a && ps.input && ps.filter_buf && ps.expanded && ps.converted && output) {
+      a->zbuffer = a->zbuffer_end = ps.input + 8;
+      a->zout_start = a->zout = (char *) output;
+      a->zout_end = (char *) output + ps.width_bytes + 1 + STBI__ZWINDOW + STBI__PNG_STREAM_OUTPUT;
+      a->z_expandable = 0;
+      a->zrefill = stbi__png_stream_refill;
+      a->zflush = stbi__png_stream_flush;
+      a->zuser = &ps;
+      ok = stbi__parse_zlib(a, 1) && stbi__png_stream_flush(a, 0);
+      if (ok && ps.j < s->img_y) ok = stbi__err("not enough pixels","Corrupt PNG");
+   } else {
+      stbi__err("outofmem", "Out of memory");
+   }
+
+   stbi__free(output);
+   stbi__free(ps.converted);
+   stbi__free(ps.expanded);
+   stbi__free(ps.filter_buf);
+   stbi__free(ps.input);
+   stbi__free(a);
+   if (ok) {
+      s->img_n = channels_in_file;
+      s->img_out_n = ps.out_n;
+   }
+   return ok;
+}
+
 static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 {
    stbi_uc palette[1024], pal_img_n=0;
@@ -5179,6 +7513,11 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                   s->img_n = pal_img_n;
                return 1;
             }
+            if (z->rows) {
+               // the rest of the file is not needed
+               if (c.length > (1u << 30)) return stbi__err("IDAT size limit", "IDAT section larger than 2^30 bytes");
+               return stbi__png_stream_rows(z, c.length, req_comp, color, palette, pal_len, pal_img_n, has_trans, tc, tc16);
+            }
             if (c.length > (1u << 30)) return stbi__err("IDAT size limit", "IDAT section larger than 2^30 bytes");
             if ((int)(ioff + c.length) < (int)ioff) return 0;
             if (ioff + c.length > idata_limit) {
@@ -5188,7 +7527,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                while (ioff + c.length > idata_limit)
                   idata_limit *= 2;
                STBI_NOTUSED(idata_limit_old);
-               p = (stbi_uc *) STBI_REALLOC_SIZED(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
+               p = (stbi_uc *) stbi__realloc_sized(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
                z->idata = p;
             }
             if (!stbi__getn(s, z->idata+ioff,c.length)) return stbi__err("outofdata","Corrupt PNG");
@@ -5197,26 +7536,34 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
          }
 
          case STBI__PNG_TYPE('I','E','N','D'): {
-            stbi__uint32 raw_len, bpl;
+            stbi__uint32 raw_len;
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (scan != STBI__SCAN_load) return 1;
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
-            // initial guess for decoded data size to avoid unnecessary reallocs
-            bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
-            raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
+            // allocate the decoded data size up front so inflate never reallocs, plus the margin
+            // that lets its fast loop run up to the end of the stream
+            raw_len = stbi__png_raw_size(z, interlace) + STBI__ZFAST_OUT_MARGIN;
             z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
             if (z->expanded == NULL) return 0; // zlib should set error
-            STBI_FREE(z->idata); z->idata = NULL;
+            stbi__free(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
                s->img_out_n = s->img_n+1;
+            else if (req_comp && z->depth >= 8 && !pal_img_n && !is_iphone)
+               s->img_out_n = req_comp; // converted as the rows are unfiltered
             else
                s->img_out_n = s->img_n;
+            // palette indices and iPhone pixels have more work to do as bytes
+            if (pal_img_n || is_iphone || z->depth == 16) z->widen = 0;
+            if (z->widen && has_trans) {
+               for (k = 0; k < s->img_n; ++k)
+                  tc16[k] = (stbi__uint16) (tc[k] * 257);
+            }
             if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
             if (has_trans) {
-               if (z->depth == 16) {
-                  if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
+               if (z->depth == 16 || z->widen) {
+                  if (!stbi__compute_transparency16((stbi__uint16 *) z->out, s->img_x * s->img_y, tc16, s->img_out_n)) return 0;
                } else {
-                  if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
+                  if (!stbi__compute_transparency(z->out, s->img_x * s->img_y, tc, s->img_out_n)) return 0;
                }
             }
             if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
@@ -5224,15 +7571,14 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             if (pal_img_n) {
                // pal_img_n == 3 or 4
                s->img_n = pal_img_n; // record the actual colors we had
-               s->img_out_n = pal_img_n;
-               if (req_comp >= 3) s->img_out_n = req_comp;
+               s->img_out_n = req_comp ? req_comp : pal_img_n;
                if (!stbi__expand_png_palette(z, palette, pal_len, s->img_out_n))
                   return 0;
             } else if (has_trans) {
                // non-paletted image with tRNS -> source image has (constant) alpha
                ++s->img_n;
             }
-            STBI_FREE(z->expanded); z->expanded = NULL;
+            stbi__free(z->expanded); z->expanded = NULL;
             // end of PNG chunk, read and skip CRC
             stbi__get32be(s);
             return 1;
@@ -5266,13 +7612,14 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
    if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
    if (stbi__parse_png_file(p, STBI__SCAN_load, req_comp)) {
       if (p->depth <= 8)
-         ri->bits_per_channel = 8;
+         ri->bits_per_channel = p->widen ? 16 : 8;
       else if (p->depth == 16)
          ri->bits_per_channel = 16;
       else
          return stbi__errpuc("bad bits_per_channel", "PNG not supported: unsupported color depth");
       result = p->out;
       p->out = NULL;
+      ri->flipped = p->s->flip_rows; // every pass after the rows are written is per pixel
       if (req_comp && req_comp != p->s->img_out_n) {
          if (ri->bits_per_channel == 8)
             result = stbi__convert_format((unsigned char *) result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);
@@ -5285,17 +7632,19 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
       *y = p->s->img_y;
       if (n) *n = p->s->img_n;
    }
-   STBI_FREE(p->out);      p->out      = NULL;
-   STBI_FREE(p->expanded); p->expanded = NULL;
-   STBI_FREE(p->idata);    p->idata    = NULL;
+   stbi__free_result(p->s, p->out); p->out = NULL;
+   stbi__free(p->expanded); p->expanded = NULL;
+   stbi__free(p->idata);    p->idata    = NULL;
 
    return result;
 }
 
-static void *stbi__png_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
+static void *stbi__png_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    stbi__png p;
    p.s = s;
+   p.widen = bpc == 16;
+   p.rows = NULL;
    return stbi__do_png(&p, x,y,comp,req_comp, ri);
 }
 
@@ -5323,6 +7672,8 @@ static int stbi__png_info(stbi__context *s, int *x, int *y, int *comp)
 {
    stbi__png p;
    p.s = s;
+   p.widen = 0;
+   p.rows = NULL;
    return stbi__png_info_raw(&p, x, y, comp);
 }
 
@@ -5330,6 +7681,8 @@ static int stbi__png_is16(stbi__context *s)
 {
    stbi__png p;
    p.s = s;
+   p.widen = 0;
+   p.rows = NULL;
    if (!stbi__png_info_raw(&p, NULL, NULL, NULL))
 	   return 0;
    if (p.depth != 16) {
@@ -5338,6 +7691,32 @@ static int stbi__png_is16(stbi__context *s)
    }
    return 1;
 }
+
+// decodes a non-interlaced PNG row by row, returns -1 (with s rewound) for anything else,
+// including iPhone PNGs, whose CgBI chunk comes before IHDR
+static int stbi__png_load_rows(stbi__context *s, stbi_row_callbacks const *rows, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__png p;
+   int streamable = 0;
+   if (stbi__check_png_header(s)) {
+      stbi__pngchunk c = stbi__get_chunk_header(s);
+      if (c.type == STBI__PNG_TYPE('I','H','D','R') && c.length == 13) {
+         stbi__skip(s, 12);
+         streamable = stbi__get8(s) == 0;
+      }
+   }
+   stbi__rewind(s);
+   if (!streamable) return -1;
+
+   p.s = s;
+   p.widen = 0;
+   p.rows = rows;
+   if (!stbi__parse_png_file(&p, STBI__SCAN_load, req_comp)) return 0;
+   *x = s->img_x;
+   *y = s->img_y;
+   *comp = s->img_n;
+   return 1;
+}
 #endif
 
 // Microsoft/Windows BMP image
@@ -5530,13 +7909,12 @@ static void *stbi__bmp_parse_header(stbi__context *s, stbi__bmp_data *info)
 
 static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
-   stbi_uc *out;
+   stbi_uc *out, *scratch = NULL;
    unsigned int mr=0,mg=0,mb=0,ma=0, all_a;
    stbi_uc pal[256][4];
    int psize=0,i,j,width;
-   int flip_vertically, pad, target;
+   int flip_vertically, pad, target, out_n;
    stbi__bmp_data info;
-   STBI_NOTUSED(ri);
 
    info.all_a = 255;
    if (stbi__bmp_parse_header(s, &info) == NULL)
@@ -5544,6 +7922,8 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 
    flip_vertically = ((int) s->img_y) > 0;
    s->img_y = abs((int) s->img_y);
+   // rows are stored bottom-up unless the height is negative, and go straight to where they end up
+   flip_vertically ^= s->flip_rows;
 
    if (s->img_y > STBI_MAX_DIMENSIONS) return stbi__errpuc("too large","Very large image (corrupt?)");
    if (s->img_x > STBI_MAX_DIMENSIONS) return stbi__errpuc("too large","Very large image (corrupt?)");
@@ -5588,17 +7968,22 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
    if (req_comp && req_comp >= 3) // we can directly decode 3 or 4
       target = req_comp;
    else
-      target = s->img_n; // if they want monochrome, we'll post-convert
+      target = s->img_n; // if they want monochrome, we'll convert each row from a scratch row
+   out_n = req_comp ? req_comp : target;
 
    // sanity-check size
-   if (!stbi__mad3sizes_valid(target, s->img_x, s->img_y, 0))
+   if (!stbi__mad3sizes_valid(out_n, s->img_x, s->img_y, 0) || !stbi__mad2sizes_valid(target, s->img_x, 0))
       return stbi__errpuc("too large", "Corrupt BMP");
 
-   out = (stbi_uc *) stbi__malloc_mad3(target, s->img_x, s->img_y, 0);
+   out = (stbi_uc *) stbi__malloc_mad3(out_n, s->img_x, s->img_y, 0);
    if (!out) return stbi__errpuc("outofmem", "Out of memory");
+   if (out_n != target) {
+      scratch = (stbi_uc *) stbi__malloc_mad2(target, s->img_x, 0);
+      if (!scratch) { stbi__free(out); return stbi__errpuc("outofmem", "Out of memory"); }
+   }
    if (info.bpp < 16) {
-      int z=0;
-      if (psize == 0 || psize > 256) { STBI_FREE(out); return stbi__errpuc("invalid", "Corrupt BMP"); }
+      int z;
+      if (psize == 0 || psize > 256) { stbi__free(out); stbi__free(scratch); return stbi__errpuc("invalid", "Corrupt BMP"); }
       for (i=0; i < psize; ++i) {
          pal[i][2] = stbi__get8(s);
          pal[i][1] = stbi__get8(s);
@@ -5610,50 +7995,58 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
       if (info.bpp == 1) width = (s->img_x + 7) >> 3;
       else if (info.bpp == 4) width = (s->img_x + 1) >> 1;
       else if (info.bpp == 8) width = s->img_x;
-      else { STBI_FREE(out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
+      else { stbi__free(out); stbi__free(scratch); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
       pad = (-width)&3;
       if (info.bpp == 1) {
          for (j=0; j < (int) s->img_y; ++j) {
             int bit_offset = 7, v = stbi__get8(s);
+            stbi_uc *dest = out + (size_t) out_n * s->img_x * (flip_vertically ? (int) s->img_y-1-j : j);
+            stbi_uc *row = scratch ? scratch : dest;
+            z = 0;
             for (i=0; i < (int) s->img_x; ++i) {
                int color = (v>>bit_offset)&0x1;
-               out[z++] = pal[color][0];
-               out[z++] = pal[color][1];
-               out[z++] = pal[color][2];
-               if (target == 4) out[z++] = 255;
+               row[z++] = pal[color][0];
+               row[z++] = pal[color][1];
+               row[z++] = pal[color][2];
+               if (target == 4) row[z++] = 255;
                if (i+1 == (int) s->img_x) break;
                if((--bit_offset) < 0) {
                   bit_offset = 7;
                   v = stbi__get8(s);
                }
             }
+            if (scratch) stbi__convert_row(scratch, target, dest, out_n, s->img_x);
             stbi__skip(s, pad);
          }
       } else {
          for (j=0; j < (int) s->img_y; ++j) {
+            stbi_uc *dest = out + (size_t) out_n * s->img_x * (flip_vertically ? (int) s->img_y-1-j : j);
+            stbi_uc *row = scratch ? scratch : dest;
+            z = 0;
             for (i=0; i < (int) s->img_x; i += 2) {
                int v=stbi__get8(s),v2=0;
                if (info.bpp == 4) {
                   v2 = v & 15;
                   v >>= 4;
                }
-               out[z++] = pal[v][0];
-               out[z++] = pal[v][1];
-               out[z++] = pal[v][2];
-               if (target == 4) out[z++] = 255;
+               row[z++] = pal[v][0];
+               row[z++] = pal[v][1];
+               row[z++] = pal[v][2];
+               if (target == 4) row[z++] = 255;
                if (i+1 == (int) s->img_x) break;
                v = (info.bpp == 8) ? stbi__get8(s) : v2;
-               out[z++] = pal[v][0];
-               out[z++] = pal[v][1];
-               out[z++] = pal[v][2];
-               if (target == 4) out[z++] = 255;
+               row[z++] = pal[v][0];
+               row[z++] = pal[v][1];
+               row[z++] = pal[v][2];
+               if (target == 4) row[z++] = 255;
             }
+            if (scratch) stbi__convert_row(scratch, target, dest, out_n, s->img_x);
             stbi__skip(s, pad);
          }
       }
    } else {
       int rshift=0,gshift=0,bshift=0,ashift=0,rcount=0,gcount=0,bcount=0,acount=0;
-      int z = 0;
+      int z;
       int easy=0;
       stbi__skip(s, info.offset - info.extra_read - info.hsz);
       if (info.bpp == 24) width = 3 * s->img_x;
@@ -5667,64 +8060,55 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
             easy = 2;
       }
       if (!easy) {
-         if (!mr || !mg || !mb) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
+         if (!mr || !mg || !mb) { stbi__free(out); stbi__free(scratch); return stbi__errpuc("bad masks", "Corrupt BMP"); }
          // right shift amt to put high bit in position #7
          rshift = stbi__high_bit(mr)-7; rcount = stbi__bitcount(mr);
          gshift = stbi__high_bit(mg)-7; gcount = stbi__bitcount(mg);
          bshift = stbi__high_bit(mb)-7; bcount = stbi__bitcount(mb);
          ashift = stbi__high_bit(ma)-7; acount = stbi__bitcount(ma);
-         if (rcount > 8 || gcount > 8 || bcount > 8 || acount > 8) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
+         if (rcount > 8 || gcount > 8 || bcount > 8 || acount > 8) { stbi__free(out); stbi__free(scratch); return stbi__errpuc("bad masks", "Corrupt BMP"); }
       }
       for (j=0; j < (int) s->img_y; ++j) {
+         stbi_uc *dest = out + (size_t) out_n * s->img_x * (flip_vertically ? (int) s->img_y-1-j : j);
+         stbi_uc *row = scratch ? scratch : dest;
+         z = 0;
          if (easy) {
             for (i=0; i < (int) s->img_x; ++i) {
                unsigned char a;
-               out[z+2] = stbi__get8(s);
-               out[z+1] = stbi__get8(s);
-               out[z+0] = stbi__get8(s);
+               row[z+2] = stbi__get8(s);
+               row[z+1] = stbi__get8(s);
+               row[z+0] = stbi__get8(s);
                z += 3;
                a = (easy == 2 ? stbi__get8(s) : 255);
                all_a |= a;
-               if (target == 4) out[z++] = a;
+               if (target == 4) row[z++] = a;
             }
          } else {
             int bpp = info.bpp;
             for (i=0; i < (int) s->img_x; ++i) {
                stbi__uint32 v = (bpp == 16 ? (stbi__uint32) stbi__get16le(s) : stbi__get32le(s));
                unsigned int a;
-               out[z++] = STBI__BYTECAST(stbi__shiftsigned(v & mr, rshift, rcount));
-               out[z++] = STBI__BYTECAST(stbi__shiftsigned(v & mg, gshift, gcount));
-               out[z++] = STBI__BYTECAST(stbi__shiftsigned(v & mb, bshift, bcount));
+               row[z++] = STBI__BYTECAST(stbi__shiftsigned(v & mr, rshift, rcount));
+               row[z++] = STBI__BYTECAST(stbi__shiftsigned(v & mg, gshift, gcount));
+               row[z++] = STBI__BYTECAST(stbi__shiftsigned(v & mb, bshift, bcount));
                a = (ma ? stbi__shiftsigned(v & ma, ashift, acount) : 255);
                all_a |= a;
-               if (target == 4) out[z++] = STBI__BYTECAST(a);
+               if (target == 4) row[z++] = STBI__BYTECAST(a);
             }
          }
+         if (scratch) stbi__convert_row(scratch, target, dest, out_n, s->img_x);
          stbi__skip(s, pad);
       }
    }
 
+   stbi__free(scratch);
+
    // if alpha channel is all 0s, replace with all 255s
-   if (target == 4 && all_a == 0)
-      for (i=4*s->img_x*s->img_y-1; i >= 0; i -= 4)
+   if (target == 4 && all_a == 0 && (out_n == 2 || out_n == 4))
+      for (i=out_n*s->img_x*s->img_y-1; i >= 0; i -= out_n)
          out[i] = 255;
 
-   if (flip_vertically) {
-      stbi_uc t;
-      for (j=0; j < (int) s->img_y>>1; ++j) {
-         stbi_uc *p1 = out +      j     *s->img_x*target;
-         stbi_uc *p2 = out + (s->img_y-1-j)*s->img_x*target;
-         for (i=0; i < (int) s->img_x*target; ++i) {
-            t = p1[i]; p1[i] = p2[i]; p2[i] = t;
-         }
-      }
-   }
-
-   if (req_comp && req_comp != target) {
-      out = stbi__convert_format(out, target, req_comp, s->img_x, s->img_y);
-      if (out == NULL) return out; // stbi__convert_format frees input on failure
-   }
-
+   ri->flipped = s->flip_rows;
    *x = s->img_x;
    *y = s->img_y;
    if (comp) *comp = s->img_n;
@@ -5868,6 +8252,23 @@ static void stbi__tga_read_rgb16(stbi__context *s, stbi_uc* out)
    // so let's treat all 15 and 16bit TGAs as RGB with no alpha.
 }
 
+// swaps BGR to RGB in a row read from the file, and converts it to out_n components if it was
+// read into a scratch row rather than where it ends up
+static void stbi__tga_store_row(stbi_uc *row, stbi_uc *dest, int width, int comp, int out_n, int swap)
+{
+   int i;
+   if (swap) {
+      for (i=0; i < width; ++i) {
+         stbi_uc *pixel = row + i*comp;
+         stbi_uc temp = pixel[0];
+         pixel[0] = pixel[2];
+         pixel[2] = temp;
+      }
+   }
+   if (row != dest)
+      stbi__convert_row(row, comp, dest, out_n, width);
+}
+
 static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
    //   read in the TGA header stuff
@@ -5889,12 +8290,12 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
    //   image data
    unsigned char *tga_data;
    unsigned char *tga_palette = NULL;
-   int i, j;
+   unsigned char *tga_scratch = NULL;
+   int i, j, k, out_n;
    unsigned char raw_data[4] = {0};
    int RLE_count = 0;
    int RLE_repeating = 0;
    int read_next_pixel = 1;
-   STBI_NOTUSED(ri);
    STBI_NOTUSED(tga_x_origin); // @TODO
    STBI_NOTUSED(tga_y_origin); // @TODO
 
@@ -5908,6 +8309,7 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
       tga_is_RLE = 1;
    }
    tga_inverted = 1 - ((tga_inverted >> 5) & 1);
+   tga_inverted ^= s->flip_rows; // rows go straight to where they end up
 
    //   If I'm paletted, then I'll use the number of bits from the palette
    if ( tga_indexed ) tga_comp = stbi__tga_get_comp(tga_palette_bits, 0, &tga_rgb16);
@@ -5921,27 +8323,40 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
    *y = tga_height;
    if (comp) *comp = tga_comp;
 
-   if (!stbi__mad3sizes_valid(tga_width, tga_height, tga_comp, 0))
+   out_n = req_comp ? req_comp : tga_comp;
+   if (!stbi__mad3sizes_valid(tga_width, tga_height, out_n, 0) || !stbi__mad2sizes_valid(tga_width, tga_comp, 0))
       return stbi__errpuc("too large", "Corrupt TGA");
 
-   tga_data = (unsigned char*)stbi__malloc_mad3(tga_width, tga_height, tga_comp, 0);
+   tga_data = (unsigned char*)stbi__malloc_mad3(tga_width, tga_height, out_n, 0);
    if (!tga_data) return stbi__errpuc("outofmem", "Out of memory");
 
+   // rows of another component count are read into a scratch row and converted from there
+   if (out_n != tga_comp) {
+      tga_scratch = (unsigned char*)stbi__malloc_mad2(tga_width, tga_comp, 0);
+      if (!tga_scratch) {
+         stbi__free(tga_data);
+         return stbi__errpuc("outofmem", "Out of memory");
+      }
+   }
+
    // skip to the data's starting position (offset usually = 0)
    stbi__skip(s, tga_offset );
 
    if ( !tga_indexed && !tga_is_RLE && !tga_rgb16 ) {
-      for (i=0; i < tga_height; ++i) {
-         int row = tga_inverted ? tga_height -i - 1 : i;
-         stbi_uc *tga_row = tga_data + row*tga_width*tga_comp;
-         stbi__getn(s, tga_row, tga_width * tga_comp);
+      for (j=0; j < tga_height; ++j) {
+         int row = tga_inverted ? tga_height -j - 1 : j;
+         stbi_uc *tga_row = tga_data + (size_t) row*tga_width*out_n;
+         stbi_uc *tga_read = tga_scratch ? tga_scratch : tga_row;
+         stbi__getn(s, tga_read, tga_width * tga_comp);
+         stbi__tga_store_row(tga_read, tga_row, tga_width, tga_comp, out_n, tga_comp >= 3);
       }
    } else  {
       //   do I need to load a palette?
       if ( tga_indexed)
       {
          if (tga_palette_len == 0) {  /* you have to have at least one entry! */
-            STBI_FREE(tga_data);
+            stbi__free(tga_data);
+            stbi__free(tga_scratch);
             return stbi__errpuc("bad palette", "Corrupt TGA");
          }
 
@@ -5950,7 +8365,8 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
          //   load the palette
          tga_palette = (unsigned char*)stbi__malloc_mad2(tga_palette_len, tga_comp, 0);
          if (!tga_palette) {
-            STBI_FREE(tga_data);
+            stbi__free(tga_data);
+            stbi__free(tga_scratch);
             return stbi__errpuc("outofmem", "Out of memory");
          }
          if (tga_rgb16) {
@@ -5961,108 +8377,86 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
                pal_entry += tga_comp;
             }
          } else if (!stbi__getn(s, tga_palette, tga_palette_len * tga_comp)) {
-               STBI_FREE(tga_data);
-               STBI_FREE(tga_palette);
+               stbi__free(tga_data);
+               stbi__free(tga_scratch);
+               stbi__free(tga_palette);
                return stbi__errpuc("bad palette", "Corrupt TGA");
          }
       }
-      //   load the data
-      for (i=0; i < tga_width * tga_height; ++i)
+      //   load the data, a row at a time (RLE packets may run across rows)
+      for (j=0; j < tga_height; ++j)
       {
-         //   if I'm in RLE mode, do I need to get a RLE stbi__pngchunk?
-         if ( tga_is_RLE )
+         int row = tga_inverted ? tga_height -j - 1 : j;
+         stbi_uc *tga_row = tga_data + (size_t) row*tga_width*out_n;
+         stbi_uc *tga_read = tga_scratch ? tga_scratch : tga_row;
+         for (i=0; i < tga_width; ++i)
          {
-            if ( RLE_count == 0 )
+            //   if I'm in RLE mode, do I need to get a RLE stbi__pngchunk?
+            if ( tga_is_RLE )
             {
-               //   yep, get the next byte as a RLE command
-               int RLE_cmd = stbi__get8(s);
-               RLE_count = 1 + (RLE_cmd & 127);
-               RLE_repeating = RLE_cmd >> 7;
-               read_next_pixel = 1;
-            } else if ( !RLE_repeating )
+               if ( RLE_count == 0 )
+               {
+                  //   yep, get the next byte as a RLE command
+                  int RLE_cmd = stbi__get8(s);
+                  RLE_count = 1 + (RLE_cmd & 127);
+                  RLE_repeating = RLE_cmd >> 7;
+                  read_next_pixel = 1;
+               } else if ( !RLE_repeating )
+               {
+                  read_next_pixel = 1;
+               }
+            } else
             {
                read_next_pixel = 1;
             }
-         } else
-         {
-            read_next_pixel = 1;
-         }
-         //   OK, if I need to read a pixel, do it now
-         if ( read_next_pixel )
-         {
-            //   load however much data we did have
-            if ( tga_indexed )
+            //   OK, if I need to read a pixel, do it now
+            if ( read_next_pixel )
             {
-               // read in index, then perform the lookup
-               int pal_idx = (tga_bits_per_pixel == 8) ? stbi__get8(s) : stbi__get16le(s);
-               if ( pal_idx >= tga_palette_len ) {
-                  // invalid index
-                  pal_idx = 0;
-               }
-               pal_idx *= tga_comp;
-               for (j = 0; j < tga_comp; ++j) {
-                  raw_data[j] = tga_palette[pal_idx+j];
-               }
-            } else if(tga_rgb16) {
-               STBI_ASSERT(tga_comp == STBI_rgb);
-               stbi__tga_read_rgb16(s, raw_data);
-            } else {
-               //   read in the data raw
-               for (j = 0; j < tga_comp; ++j) {
-                  raw_data[j] = stbi__get8(s);
+               //   load however much data we did have
+               if ( tga_indexed )
+               {
+                  // read in index, then perform the lookup
+                  int pal_idx = (tga_bits_per_pixel == 8) ? stbi__get8(s) : stbi__get16le(s);
+                  if ( pal_idx >= tga_palette_len ) {
+                     // invalid index
+                     pal_idx = 0;
+                  }
+                  pal_idx *= tga_comp;
+                  for (k = 0; k < tga_comp; ++k) {
+                     raw_data[k] = tga_palette[pal_idx+k];
+                  }
+               } else if(tga_rgb16) {
+                  STBI_ASSERT(tga_comp == STBI_rgb);
+                  stbi__tga_read_rgb16(s, raw_data);
+               } else {
+                  //   read in the data raw
+                  for (k = 0; k < tga_comp; ++k) {
+                     raw_data[k] = stbi__get8(s);
+                  }
                }
-            }
-            //   clear the reading flag for the next pixel
-            read_next_pixel = 0;
-         } // end of reading a pixel
+               //   clear the reading flag for the next pixel
+               read_next_pixel = 0;
+            } // end of reading a pixel
 
-         // copy data
-         for (j = 0; j < tga_comp; ++j)
-           tga_data[i*tga_comp+j] = raw_data[j];
+            // copy data
+            for (k = 0; k < tga_comp; ++k)
+              tga_read[i*tga_comp+k] = raw_data[k];
 
-         //   in case we're in RLE mode, keep counting down
-         --RLE_count;
-      }
-      //   do I need to invert the image?
-      if ( tga_inverted )
-      {
-         for (j = 0; j*2 < tga_height; ++j)
-         {
-            int index1 = j * tga_width * tga_comp;
-            int index2 = (tga_height - 1 - j) * tga_width * tga_comp;
-            for (i = tga_width * tga_comp; i > 0; --i)
-            {
-               unsigned char temp = tga_data[index1];
-               tga_data[index1] = tga_data[index2];
-               tga_data[index2] = temp;
-               ++index1;
-               ++index2;
-            }
+            //   in case we're in RLE mode, keep counting down
+            --RLE_count;
          }
+         // swap RGB - if the source data was RGB16, it already is in the right order
+         stbi__tga_store_row(tga_read, tga_row, tga_width, tga_comp, out_n, tga_comp >= 3 && !tga_rgb16);
       }
       //   clear my palette, if I had one
       if ( tga_palette != NULL )
       {
-         STBI_FREE( tga_palette );
-      }
-   }
-
-   // swap RGB - if the source data was RGB16, it already is in the right order
-   if (tga_comp >= 3 && !tga_rgb16)
-   {
-      unsigned char* tga_pixel = tga_data;
-      for (i=0; i < tga_width * tga_height; ++i)
-      {
-         unsigned char temp = tga_pixel[0];
-         tga_pixel[0] = tga_pixel[2];
-         tga_pixel[2] = temp;
-         tga_pixel += tga_comp;
+         stbi__free( tga_palette );
       }
    }
 
-   // convert to target component count
-   if (req_comp && req_comp != tga_comp)
-      tga_data = stbi__convert_format(tga_data, tga_comp, req_comp, tga_width, tga_height);
+   stbi__free(tga_scratch);
+   ri->flipped = s->flip_rows;
 
    //   the things I do to get rid of an error message, and yet keep
    //   Microsoft's C compilers happy... [8^(
@@ -6235,7 +8629,7 @@ static void *stbi__psd_load(stbi__context *s, int *x, int *y, int *comp, int req
          } else {
             // Read the RLE data.
             if (!stbi__psd_decode_rle(s, p, pixelCount)) {
-               STBI_FREE(out);
+               stbi__free(out);
                return stbi__errpuc("corrupt", "bad RLE data");
             }
          }
@@ -6527,7 +8921,7 @@ static void *stbi__pic_load(stbi__context *s,int *px,int *py,int *comp,int req_c
    memset(result, 0xff, x*y*4);
 
    if (!stbi__pic_load_core(s,x,y,comp, result)) {
-      STBI_FREE(result);
+      stbi__free(result);
       result=0;
    }
    *px = x;
@@ -6561,8 +8955,9 @@ typedef struct
 {
    int w,h;
    stbi_uc *out;                 // output buffer (always 4 components)
-   stbi_uc *background;          // The current "background" as far as a gif is concerned
-   stbi_uc *history;
+   stbi_uc *background;          // what the frame's rectangle held before the frame, if its disposal puts it back
+   int background_size;
+   stbi_uc *history;             // pixels the frame drew, only ever set inside its rectangle
    int flags, bgindex, ratio, transparent, eflags;
    stbi_uc  pal[256][4];
    stbi_uc lpal[256][4];
@@ -6575,6 +8970,9 @@ typedef struct
    int cur_x, cur_y;
    int line_size;
    int delay;
+   int rect_x0, rect_y0, rect_x1, rect_y1;     // the frame's rectangle in pixels, x1/y1 exclusive
+   int dirty_x0, dirty_y0, dirty_x1, dirty_y1; // the pixels that changed since the previous frame
+   int saved;                                  // background holds the frame's rectangle
 } stbi__gif;
 
 static int stbi__gif_test_raw(stbi__context *s)
@@ -6641,13 +9039,13 @@ static int stbi__gif_info_raw(stbi__context *s, int *x, int *y, int *comp)
    stbi__gif* g = (stbi__gif*) stbi__malloc(sizeof(stbi__gif));
    if (!g) return stbi__err("outofmem", "Out of memory");
    if (!stbi__gif_header(s, g, comp, 1)) {
-      STBI_FREE(g);
+      stbi__free(g);
       stbi__rewind( s );
       return 0;
    }
    if (x) *x = g->w;
    if (y) *y = g->h;
-   STBI_FREE(g);
+   stbi__free(g);
    return 1;
 }
 
@@ -6773,9 +9171,63 @@ static stbi_uc *stbi__process_gif_raster(stbi__context *s, stbi__gif *g)
    }
 }
 
+// disposal methods 2 and 3 both put the frame's rectangle back the way it was before the frame, which
+// is also what the frame before was left as after its own disposal; only that rectangle is saved
+static int stbi__gif_save_background(stbi__gif *g)
+{
+   int row = (g->rect_x1 - g->rect_x0) * 4;
+   int size = row * (g->rect_y1 - g->rect_y0);
+   int y;
+   if (size > g->background_size) {
+      stbi_uc *p = (stbi_uc *) stbi__realloc_sized(g->background, g->background_size, size);
+      if (!p) return stbi__err("outofmem", "Out of memory");
+      g->background = p;
+      g->background_size = size;
+   }
+   for (y = g->rect_y0; y < g->rect_y1; ++y)
+      memcpy(g->background + (y - g->rect_y0) * row, g->out + (y * g->w + g->rect_x0) * 4, row);
+   g->saved = 1;
+   return 1;
+}
+
+static void stbi__gif_restore_background(stbi__gif *g)
+{
+   int row = (g->rect_x1 - g->rect_x0) * 4;
+   int x, y;
+   for (y = g->rect_y0; y < g->rect_y1; ++y) {
+      stbi_uc *history = g->history + y * g->w;
+      stbi_uc *saved = g->background + (y - g->rect_y0) * row;
+      for (x = g->rect_x0; x < g->rect_x1; ++x)
+         if (history[x])
+            memcpy(&g->out[(y * g->w + x) * 4], &saved[(x - g->rect_x0) * 4], 4);
+   }
+}
+
+// grows the dirty rectangle to cover x0,y0 .. x1,y1 (exclusive)
+static void stbi__gif_add_dirty(stbi__gif *g, int x0, int y0, int x1, int y1)
+{
+   if (x0 >= x1 || y0 >= y1) return;
+   if (g->dirty_x0 == g->dirty_x1) {
+      g->dirty_x0 = x0; g->dirty_y0 = y0;
+      g->dirty_x1 = x1; g->dirty_y1 = y1;
+      return;
+   }
+   if (x0 < g->dirty_x0) g->dirty_x0 = x0;
+   if (y0 < g->dirty_y0) g->dirty_y0 = y0;
+   if (x1 > g->dirty_x1) g->dirty_x1 = x1;
+   if (y1 > g->dirty_y1) g->dirty_y1 = y1;
+}
+
+static void stbi__gif_clear_history(stbi__gif *g)
+{
+   int y;
+   for (y = g->rect_y0; y < g->rect_y1; ++y)
+      memset(g->history + y * g->w + g->rect_x0, 0, g->rect_x1 - g->rect_x0);
+}
+
 // this function is designed to support animated gifs, although stb_image doesn't support it
-// two back is the image from two frames ago, used for a very specific disposal format
-static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, int req_comp, stbi_uc *two_back)
+// disposal only touches the previous frame's rectangle, and g->dirty_* tells which pixels changed
+static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, int req_comp)
 {
    int dispose;
    int first_frame;
@@ -6791,40 +9243,28 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
          return stbi__errpuc("too large", "GIF image is too large");
       pcount = g->w * g->h;
       g->out = (stbi_uc *) stbi__malloc(4 * pcount);
-      g->background = (stbi_uc *) stbi__malloc(4 * pcount);
       g->history = (stbi_uc *) stbi__malloc(pcount);
-      if (!g->out || !g->background || !g->history)
+      if (!g->out || !g->history)
          return stbi__errpuc("outofmem", "Out of memory");
 
       // image is treated as "transparent" at the start - ie, nothing overwrites the current background;
       // background colour is only used for pixels that are not rendered first frame, after that "background"
       // color refers to the color that was there the previous frame.
       memset(g->out, 0x00, 4 * pcount);
-      memset(g->background, 0x00, 4 * pcount); // state of the background (starts transparent)
       memset(g->history, 0x00, pcount);        // pixels that were affected previous frame
       first_frame = 1;
+      g->dirty_x0 = g->dirty_y0 = 0;
+      g->dirty_x1 = g->w;
+      g->dirty_y1 = g->h;
    } else {
       // second frame - how do we dispose of the previous one?
       dispose = (g->eflags & 0x1C) >> 2;
-      pcount = g->w * g->h;
 
-      if ((dispose == 3) && (two_back == 0)) {
-         dispose = 2; // if I don't have an image to revert back to, default to the old background
-      }
-
-      if (dispose == 3) { // use previous graphic
-         for (pi = 0; pi < pcount; ++pi) {
-            if (g->history[pi]) {
-               memcpy( &g->out[pi * 4], &two_back[pi * 4], 4 );
-            }
-         }
-      } else if (dispose == 2) {
-         // restore what was changed last frame to background before that frame;
-         for (pi = 0; pi < pcount; ++pi) {
-            if (g->history[pi]) {
-               memcpy( &g->out[pi * 4], &g->background[pi * 4], 4 );
-            }
-         }
+      g->dirty_x0 = g->dirty_y0 = g->dirty_x1 = g->dirty_y1 = 0;
+      if ((dispose == 2 || dispose == 3) && g->saved) {
+         // restore what was changed last frame to what it was before that frame
+         stbi__gif_restore_background(g);
+         stbi__gif_add_dirty(g, g->rect_x0, g->rect_y0, g->rect_x1, g->rect_y1);
       } else {
          // This is a non-disposal case eithe way, so just
          // leave the pixels as is, and they will become the new background
@@ -6832,12 +9272,11 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
          // 0:  not specified.
       }
 
-      // background is what out is after the undoing of the previou frame;
-      memcpy( g->background, g->out, 4 * g->w * g->h );
+      // clear my history;
+      stbi__gif_clear_history(g);
    }
-
-   // clear my history;
-   memset( g->history, 0x00, g->w * g->h );        // pixels that were affected previous frame
+   g->saved = 0;
+   g->rect_x0 = g->rect_y0 = g->rect_x1 = g->rect_y1 = 0;
 
    for (;;) {
       int tag = stbi__get8(s);
@@ -6869,6 +9308,17 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
             if (w == 0)
                g->cur_y = g->max_y;
 
+            g->rect_x0 = x;
+            g->rect_y0 = y;
+            g->rect_x1 = x + w;
+            g->rect_y1 = y + h;
+            stbi__gif_add_dirty(g, x, y, x + w, y + h);
+
+            // the disposal is known from the graphic control extension that came before
+            dispose = (g->eflags & 0x1C) >> 2;
+            if ((dispose == 2 || dispose == 3) && !stbi__gif_save_background(g))
+               return NULL;
+
             g->lflags = stbi__get8(s);
 
             if (g->lflags & 0x40) {
@@ -6951,12 +9401,12 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
 
 static void *stbi__load_gif_main_outofmem(stbi__gif *g, stbi_uc *out, int **delays)
 {
-   STBI_FREE(g->out);
-   STBI_FREE(g->history);
-   STBI_FREE(g->background);
+   stbi__free(g->out);
+   stbi__free(g->history);
+   stbi__free(g->background);
 
-   if (out) STBI_FREE(out);
-   if (delays && *delays) STBI_FREE(*delays);
+   if (out) stbi__free(out);
+   if (delays && *delays) stbi__free(*delays);
    return stbi__errpuc("outofmem", "Out of memory");
 }
 
@@ -6964,24 +9414,21 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
 {
    if (stbi__gif_test(s)) {
       int layers = 0;
+      int capacity = 0;
       stbi_uc *u = 0;
       stbi_uc *out = 0;
-      stbi_uc *two_back = 0;
       stbi__gif g;
-      int stride;
+      int stride = 0;
       int out_size = 0;
       int delays_size = 0;
 
-      STBI_NOTUSED(out_size);
-      STBI_NOTUSED(delays_size);
-
       memset(&g, 0, sizeof(g));
       if (delays) {
          *delays = 0;
       }
 
       do {
-         u = stbi__gif_load_next(s, &g, comp, req_comp, two_back);
+         u = stbi__gif_load_next(s, &g, comp, req_comp);
          if (u == (stbi_uc *) s) u = 0;  // end of animated gif marker
 
          if (u) {
@@ -6990,38 +9437,35 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
             ++layers;
             stride = g.w * g.h * 4;
 
-            if (out) {
-               void *tmp = (stbi_uc*) STBI_REALLOC_SIZED( out, out_size, layers * stride );
-               if (!tmp)
+            // grow by half again, so frame n doesn't copy all the frames before it
+            if (layers > capacity) {
+               capacity = layers + layers / 2;
+               if (!stbi__mul2sizes_valid(capacity, stride))
+                  capacity = layers;
+               if (!stbi__mul2sizes_valid(capacity, stride))
                   return stbi__load_gif_main_outofmem(&g, out, delays);
-               else {
-                   out = (stbi_uc*) tmp;
-                   out_size = layers * stride;
+
+               if (out) {
+                  void *tmp = (stbi_uc*) stbi__realloc_sized( out, out_size, capacity * stride );
+                  if (!tmp)
+                     return stbi__load_gif_main_outofmem(&g, out, delays);
+                  out = (stbi_uc*) tmp;
+               } else {
+                  out = (stbi_uc*)stbi__malloc( capacity * stride );
+                  if (!out)
+                     return stbi__load_gif_main_outofmem(&g, out, delays);
                }
+               out_size = capacity * stride;
 
                if (delays) {
-                  int *new_delays = (int*) STBI_REALLOC_SIZED( *delays, delays_size, sizeof(int) * layers );
+                  int *new_delays = (int*) stbi__realloc_sized( *delays, delays_size, sizeof(int) * capacity );
                   if (!new_delays)
                      return stbi__load_gif_main_outofmem(&g, out, delays);
                   *delays = new_delays;
-                  delays_size = layers * sizeof(int);
-               }
-            } else {
-               out = (stbi_uc*)stbi__malloc( layers * stride );
-               if (!out)
-                  return stbi__load_gif_main_outofmem(&g, out, delays);
-               out_size = layers * stride;
-               if (delays) {
-                  *delays = (int*) stbi__malloc( layers * sizeof(int) );
-                  if (!*delays)
-                     return stbi__load_gif_main_outofmem(&g, out, delays);
-                  delays_size = layers * sizeof(int);
+                  delays_size = capacity * sizeof(int);
                }
             }
             memcpy( out + ((layers - 1) * stride), u, stride );
-            if (layers >= 2) {
-               two_back = out - 2 * stride;
-            }
 
             if (delays) {
                (*delays)[layers - 1U] = g.delay;
@@ -7030,9 +9474,15 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
       } while (u != 0);
 
       // free temp buffer;
-      STBI_FREE(g.out);
-      STBI_FREE(g.history);
-      STBI_FREE(g.background);
+      stbi__free(g.out);
+      stbi__free(g.history);
+      stbi__free(g.background);
+
+      // give back what the last growth didn't use
+      if (capacity > layers) {
+         void *tmp = stbi__realloc_sized( out, out_size, layers * stride );
+         if (tmp) out = (stbi_uc*) tmp;
+      }
 
       // do the final conversion after loading everything;
       if (req_comp && req_comp != 4)
@@ -7052,7 +9502,7 @@ static void *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp, int req
    memset(&g, 0, sizeof(g));
    STBI_NOTUSED(ri);
 
-   u = stbi__gif_load_next(s, &g, comp, req_comp, 0);
+   u = stbi__gif_load_next(s, &g, comp, req_comp);
    if (u == (stbi_uc *) s) u = 0;  // end of animated gif marker
    if (u) {
       *x = g.w;
@@ -7064,12 +9514,12 @@ static void *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp, int req
          u = stbi__convert_format(u, 4, req_comp, g.w, g.h);
    } else if (g.out) {
       // if there was an error and we allocated an image buffer, free it!
-      STBI_FREE(g.out);
+      stbi__free(g.out);
    }
 
    // free buffers needed for multiple frame loading;
-   STBI_FREE(g.history);
-   STBI_FREE(g.background);
+   stbi__free(g.history);
+   stbi__free(g.background);
 
    return u;
 }
@@ -7078,6 +9528,101 @@ static int stbi__gif_info(stbi__context *s, int *x, int *y, int *comp)
 {
    return stbi__gif_info_raw(s,x,y,comp);
 }
+
+// counts the image descriptors after the header, skipping the data sub-blocks; ends at the trailer or
+// at anything that isn't a block, where stbi__gif_load_next would stop too
+static int stbi__gif_count_frames(stbi__context *s)
+{
+   int count = 0, lflags, len;
+   for (;;) {
+      switch (stbi__get8(s)) {
+         case 0x2C:
+            stbi__skip(s, 8);
+            lflags = stbi__get8(s);
+            if (lflags & 0x80)
+               stbi__skip(s, 3 * (2 << (lflags & 7)));
+            stbi__skip(s, 1); // lzw code size
+            while ((len = stbi__get8(s)) != 0)
+               stbi__skip(s, len);
+            ++count;
+            break;
+
+         case 0x21:
+            stbi__skip(s, 1);
+            while ((len = stbi__get8(s)) != 0)
+               stbi__skip(s, len);
+            break;
+
+         default:
+            return count;
+      }
+   }
+}
+
+struct stbi__gif_frames
+{
+   stbi__context s;
+   stbi__gif g;
+   int done;
+};
+
+STBIDEF stbi_gif_frames *stbi_gif_frames_open_memory(stbi_uc const *buffer, int len, int *x, int *y, int *frame_count)
+{
+   int comp;
+   stbi_gif_frames *frames = (stbi_gif_frames *) stbi__malloc(sizeof(*frames));
+   if (!frames) {
+      stbi__err("outofmem", "Out of memory");
+      return NULL;
+   }
+   memset(frames, 0, sizeof(*frames));
+   stbi__start_mem(&frames->s, buffer, len);
+
+   if (!stbi__gif_header(&frames->s, &frames->g, &comp, 0)) {
+      stbi__free(frames);
+      return NULL;
+   }
+   if (x) *x = frames->g.w;
+   if (y) *y = frames->g.h;
+   if (frame_count) *frame_count = stbi__gif_count_frames(&frames->s);
+
+   // stbi_gif_frames_next reads the header again for the first frame
+   stbi__rewind(&frames->s);
+   return frames;
+}
+
+STBIDEF int stbi_gif_frames_next(stbi_gif_frames *frames, stbi_gif_frame *frame)
+{
+   int comp;
+   stbi_uc *u;
+   if (frames->done) return 0;
+
+   u = stbi__gif_load_next(&frames->s, &frames->g, &comp, 4);
+   if (u == (stbi_uc *) &frames->s) {
+      frames->done = 1;
+      return 0;
+   }
+   if (!u) {
+      frames->done = 1;
+      return -1;
+   }
+
+   frame->pixels = u;
+   frame->x0 = frames->g.dirty_x0;
+   frame->y0 = frames->g.dirty_y0;
+   frame->x1 = frames->g.dirty_x1;
+   frame->y1 = frames->g.dirty_y1;
+   frame->delay = frames->g.delay;
+   return 1;
+}
+
+STBIDEF void stbi_gif_frames_close(stbi_gif_frames *frames)
+{
+   if (!frames) return;
+   stbi__free(frames->g.out);
+   stbi__free(frames->g.history);
+   stbi__free(frames->g.background);
+   stbi__free(frames);
+}
 #endif
 
 // *************************************************************************************************
@@ -7128,12 +9673,22 @@ static char *stbi__hdr_gettoken(stbi__context *z, char *buffer)
    return buffer;
 }
 
+// 2^(e - (128 + 8)), the scale of the RGBE mantissa bytes, built from its bits rather than with
+// ldexp. exponents below 10 give denormals
+static float stbi__hdr_scale(int e)
+{
+   stbi__uint32 bits = e >= 10 ? (stbi__uint32) (e - 9) << 23 : e ? (stbi__uint32) 1 << (e + 13) : 0;
+   float f;
+   memcpy(&f, &bits, 4);
+   return f;
+}
+
 static void stbi__hdr_convert(float *output, stbi_uc *input, int req_comp)
 {
    if ( input[3] != 0 ) {
       float f1;
       // Exponent
-      f1 = (float) ldexp(1.0f, input[3] - (int)(128 + 8));
+      f1 = stbi__hdr_scale(input[3]);
       if (req_comp <= 2)
          output[0] = (input[0] + input[1] + input[2]) * f1 / 3;
       else {
@@ -7155,6 +9710,49 @@ static void stbi__hdr_convert(float *output, stbi_uc *input, int req_comp)
    }
 }
 
+// converts a scanline of count RGBE pixels. for RGB(A) output the SSE2 loop converts four pixels
+// at a time, to exactly the floats stbi__hdr_convert gives
+static void stbi__hdr_convert_row(float *output, stbi_uc *input, int count, int req_comp)
+{
+   int i = 0;
+#ifdef STBI_SSE2
+   if (req_comp >= 3) {
+      // an RGB pixel is stored as four floats, the fourth of which the next pixel overwrites, so
+      // the last pixel is left to the scalar loop
+      int end = req_comp == 4 ? count : count - 1;
+      __m128i zero = _mm_setzero_si128();
+      __m128 rgb = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+      __m128 one = _mm_setr_ps(0, 0, 0, 1.0f);
+      for (; i + 4 <= end; i += 4) {
+         __m128i px = _mm_loadu_si128((__m128i const *) (input + i*4));
+         __m128i e = _mm_srli_epi32(px, 24);
+         __m128i denormal = _mm_cmplt_epi32(e, _mm_set1_epi32(10));
+         __m128i lo = _mm_unpacklo_epi8(px, zero), hi = _mm_unpackhi_epi8(px, zero);
+         __m128 scale, p[4];
+         int k;
+         if (_mm_movemask_epi8(_mm_andnot_si128(_mm_cmpeq_epi32(e, zero), denormal))) {
+            // the scale is a denormal, which is too rare to build in vectors
+            for (k=0; k < 4; ++k)
+               stbi__hdr_convert(output + (i+k)*req_comp, input + (i+k)*4, req_comp);
+            continue;
+         }
+         // 2^(e-136) as in stbi__hdr_scale, and 0 for e == 0
+         scale = _mm_castsi128_ps(_mm_andnot_si128(denormal, _mm_slli_epi32(_mm_sub_epi32(e, _mm_set1_epi32(9)), 23)));
+         p[0] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), _mm_shuffle_ps(scale, scale, 0x00));
+         p[1] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), _mm_shuffle_ps(scale, scale, 0x55));
+         p[2] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), _mm_shuffle_ps(scale, scale, 0xaa));
+         p[3] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), _mm_shuffle_ps(scale, scale, 0xff));
+         for (k=0; k < 4; ++k) {
+            if (req_comp == 4) p[k] = _mm_or_ps(_mm_and_ps(p[k], rgb), one);
+            _mm_storeu_ps(output + (i+k)*req_comp, p[k]);
+         }
+      }
+   }
+#endif
+   for (; i < count; ++i)
+      stbi__hdr_convert(output + i*req_comp, input + i*4, req_comp);
+}
+
 static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
    char buffer[STBI__HDR_BUFLEN];
@@ -7242,16 +9840,16 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
             stbi__hdr_convert(hdr_data, rgbe, req_comp);
             i = 1;
             j = 0;
-            STBI_FREE(scanline);
+            stbi__free(scanline);
             goto main_decode_loop; // yes, this makes no sense
          }
          len <<= 8;
          len |= stbi__get8(s);
-         if (len != width) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
+         if (len != width) { stbi__free(hdr_data); stbi__free(scanline); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
          if (scanline == NULL) {
             scanline = (stbi_uc *) stbi__malloc_mad2(width, 4, 0);
             if (!scanline) {
-               STBI_FREE(hdr_data);
+               stbi__free(hdr_data);
                return stbi__errpf("outofmem", "Out of memory");
             }
          }
@@ -7265,22 +9863,21 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
                   // Run
                   value = stbi__get8(s);
                   count -= 128;
-                  if ((count == 0) || (count > nleft)) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
+                  if ((count == 0) || (count > nleft)) { stbi__free(hdr_data); stbi__free(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
                   for (z = 0; z < count; ++z)
                      scanline[i++ * 4 + k] = value;
                } else {
                   // Dump
-                  if ((count == 0) || (count > nleft)) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
+                  if ((count == 0) || (count > nleft)) { stbi__free(hdr_data); stbi__free(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
                   for (z = 0; z < count; ++z)
                      scanline[i++ * 4 + k] = stbi__get8(s);
                }
             }
          }
-         for (i=0; i < width; ++i)
-            stbi__hdr_convert(hdr_data+(j*width + i)*req_comp, scanline + i*4, req_comp);
+         stbi__hdr_convert_row(hdr_data + (size_t) j*width*req_comp, scanline, width, req_comp);
       }
       if (scanline)
-         STBI_FREE(scanline);
+         stbi__free(scanline);
    }
 
    return hdr_data;
@@ -7344,7 +9941,7 @@ static int stbi__bmp_info(stbi__context *s, int *x, int *y, int *comp)
       return 0;
    }
    if (x) *x = s->img_x;
-   if (y) *y = s->img_y;
+   if (y) *y = abs((int) s->img_y); // negative for top-down files
    if (comp) {
       if (info.bpp == 24 && info.ma == 0xff000000)
          *comp = 3;
@@ -7525,7 +10122,7 @@ static void *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int req
    out = (stbi_uc *) stbi__malloc_mad4(s->img_n, s->img_x, s->img_y, ri->bits_per_channel / 8, 0);
    if (!out) return stbi__errpuc("outofmem", "Out of memory");
    if (!stbi__getn(s, out, s->img_n * s->img_x * s->img_y * (ri->bits_per_channel / 8))) {
-      STBI_FREE(out);
+      stbi__free(out);
       return stbi__errpuc("bad PNM", "PNM file truncated");
    }
 
@@ -7629,48 +10226,65 @@ static int stbi__pnm_is16(stbi__context *s)
 }
 #endif
 
-static int stbi__info_main(stbi__context *s, int *x, int *y, int *comp)
+// stbi__info_main that also reports which decoder recognized the image
+static int stbi__info_format_main(stbi__context *s, int *x, int *y, int *comp, int *format)
 {
    #ifndef STBI_NO_JPEG
+   *format = STBI_FORMAT_JPEG;
    if (stbi__jpeg_info(s, x, y, comp)) return 1;
    #endif
 
    #ifndef STBI_NO_PNG
+   *format = STBI_FORMAT_PNG;
    if (stbi__png_info(s, x, y, comp))  return 1;
    #endif
 
    #ifndef STBI_NO_GIF
+   *format = STBI_FORMAT_GIF;
    if (stbi__gif_info(s, x, y, comp))  return 1;
    #endif
 
    #ifndef STBI_NO_BMP
+   *format = STBI_FORMAT_BMP;
    if (stbi__bmp_info(s, x, y, comp))  return 1;
    #endif
 
    #ifndef STBI_NO_PSD
+   *format = STBI_FORMAT_PSD;
    if (stbi__psd_info(s, x, y, comp))  return 1;
    #endif
 
    #ifndef STBI_NO_PIC
+   *format = STBI_FORMAT_PIC;
    if (stbi__pic_info(s, x, y, comp))  return 1;
    #endif
 
    #ifndef STBI_NO_PNM
+   *format = STBI_FORMAT_PNM;
    if (stbi__pnm_info(s, x, y, comp))  return 1;
    #endif
 
    #ifndef STBI_NO_HDR
+   *format = STBI_FORMAT_HDR;
    if (stbi__hdr_info(s, x, y, comp))  return 1;
    #endif
 
    // test tga last because it's a crappy test!
    #ifndef STBI_NO_TGA
+   *format = STBI_FORMAT_TGA;
    if (stbi__tga_info(s, x, y, comp))
        return 1;
    #endif
+   *format = STBI_FORMAT_UNKNOWN;
    return stbi__err("unknown image type", "Image not of any known type, or corrupt");
 }
 
+static int stbi__info_main(stbi__context *s, int *x, int *y, int *comp)
+{
+   int format;
+   return stbi__info_format_main(s, x, y, comp, &format);
+}
+
 static int stbi__is_16_main(stbi__context *s)
 {
    #ifndef STBI_NO_PNG
@@ -7759,6 +10373,64 @@ STBIDEF int stbi_is_16_bit_from_callbacks(stbi_io_callbacks const *c, void *user
    return stbi__is_16_main(&s);
 }
 
+static int stbi__probe_main(stbi__context *s, stbi_probe_info *info)
+{
+   int x, y, comp;
+   info->x = info->y = info->comp = info->bits_per_channel = 0;
+   if (!stbi__info_format_main(s, &x, &y, &comp, &info->format)) return 0;
+   info->x = x;
+   info->y = y;
+   info->comp = comp;
+
+   // only the formats that can hold 16 bits are asked, their headers are
+   // within the first buffer fill, so rewinding works for files and callbacks too
+   info->bits_per_channel = 8;
+   if (info->format == STBI_FORMAT_HDR) {
+      info->bits_per_channel = 32;
+   } else if (info->format == STBI_FORMAT_PNG || info->format == STBI_FORMAT_PSD || info->format == STBI_FORMAT_PNM) {
+      stbi__rewind(s);
+      if (stbi__is_16_main(s)) info->bits_per_channel = 16;
+   }
+   return 1;
+}
+
+STBIDEF int stbi_probe_from_memory(stbi_uc const *buffer, int len, stbi_probe_info *info)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__probe_main(&s,info);
+}
+
+STBIDEF int stbi_probe_from_callbacks(stbi_io_callbacks const *c, void *user, stbi_probe_info *info)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) c, user);
+   return stbi__probe_main(&s,info);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_probe(char const *filename, stbi_probe_info *info)
+{
+    FILE *f = stbi__fopen(filename, "rb");
+    int result;
+    if (!f) return stbi__err("can't fopen", "Unable to open file");
+    result = stbi_probe_from_file(f, info);
+    fclose(f);
+    return result;
+}
+
+STBIDEF int stbi_probe_from_file(FILE *f, stbi_probe_info *info)
+{
+   int r;
+   stbi__context s;
+   long pos = ftell(f);
+   stbi__start_file(&s, f);
+   r = stbi__probe_main(&s,info);
+   fseek(f,pos,SEEK_SET);
+   return r;
+}
+#endif // !STBI_NO_STDIO
+
 #endif // STB_IMAGE_IMPLEMENTATION
 
 /*
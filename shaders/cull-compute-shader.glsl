@@ -0,0 +1,65 @@
+#version 460 core
+
+// Frustum culls one instance per invocation and appends the visible ones to a compacted list for an indirect draw
+
+layout (local_size_x = 256) in;
+
+// Same layout as DrawElementsIndirectCommand in gpu-culling.h
+struct DrawElementsIndirectCommand
+{
+  uint count;
+  uint instanceCount;
+  uint firstIndex;
+  int baseVertex;
+  uint baseInstance;
+};
+
+// Bounding sphere of every instance: xyz = center, w = radius
+layout (std430, binding = 0) readonly buffer InstanceBounds
+{
+  vec4 instanceBounds[];
+};
+
+layout (std430, binding = 1) readonly buffer InstanceTransforms
+{
+  mat4 instanceModels[];
+};
+
+// Transforms of the instances that survived, read by the vertex shader as a_instanceModel
+layout (std430, binding = 2) writeonly buffer VisibleTransforms
+{
+  mat4 visibleModels[];
+};
+
+layout (std430, binding = 3) buffer DrawCommands
+{
+  DrawElementsIndirectCommand command;
+};
+
+// Number of commands glMultiDrawElementsIndirectCount reads, 0 skips the draw when nothing is visible
+layout (std430, binding = 4) buffer DrawCount
+{
+  uint drawCount;
+};
+
+// Frustum planes in the space of the instance transforms, normals point inwards
+uniform vec4 u_frustumPlanes[6];
+uniform uint u_instanceCount;
+
+void main()
+{
+  uint instance = gl_GlobalInvocationID.x;
+  if (instance >= u_instanceCount) return;
+
+  vec4 sphere = instanceBounds[instance];
+  for (int i = 0; i < 6; i++)
+  {
+    if (dot(u_frustumPlanes[i].xyz, sphere.xyz) + u_frustumPlanes[i].w < -sphere.w) return;
+  }
+
+  uint slot = atomicAdd(command.instanceCount, 1u);
+  visibleModels[slot] = instanceModels[instance];
+
+  // Exactly one invocation gets slot 0
+  if (slot == 0u) drawCount = 1u;
+}
\ No newline at end of file
@@ -6,7 +6,18 @@ out vec4 FragColor;
 
 uniform sampler2D u_texture;
 
+// With --animated-texture the crates show one layer (frame) of this array instead, -1 when there is none
+uniform sampler2DArray u_animation;
+uniform int u_animationLayer = -1;
+
+// With --height-map the crates are darker where the height (red channel) is low
+uniform sampler2D u_heightMap;
+uniform bool u_heightShading = false;
+
 void main()
 {
-    FragColor = texture(u_texture, v_textureCoord);
+    if (u_animationLayer >= 0) FragColor = texture(u_animation, vec3(v_textureCoord, u_animationLayer));
+    else FragColor = texture(u_texture, v_textureCoord);
+
+    if (u_heightShading) FragColor.rgb *= mix(0.25, 1.0, texture(u_heightMap, v_textureCoord).r);
 }
\ No newline at end of file
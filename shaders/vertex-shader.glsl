@@ -3,14 +3,23 @@
 layout (location = 0) in vec3 a_pos;
 layout (location = 1) in vec2 a_textureCoord;
 
+// Per instance transform, the same for every vertex of one instance (occupies locations 2 to 5)
+layout (location = 2) in mat4 a_instanceModel;
+
 out vec2 v_textureCoord;
 
+// Per frame camera matrices, shared by every draw (std140 so the layout matches CameraUniforms in main.cpp)
+layout (std140, binding = 0) uniform Camera
+{
+  mat4 u_view;
+  mat4 u_projection;
+};
+
+// Transform of the whole scene, applied on top of the instance transform
 uniform mat4 u_model;
-uniform mat4 u_view;
-uniform mat4 u_projection;
 
 void main()
 {
-  gl_Position = u_projection * u_view * u_model * vec4(a_pos, 1.0);
+  gl_Position = u_projection * u_view * u_model * a_instanceModel * vec4(a_pos, 1.0);
   v_textureCoord = a_textureCoord;
 }
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include "allocation-benchmark.h"
+
+#include "benchmark-helpers.h"
+#include "image-arena.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+struct SourceImage
+{
+  std::string name;
+  std::vector<unsigned char> bytes;
+};
+
+// What one image cost on each path in the last round, times are the fastest of all rounds
+struct ImageResult
+{
+  double loadMilliseconds = 1e30;
+  double intoMilliseconds = 1e30;
+  std::uint64_t loadAllocations = 0;
+  std::uint64_t loadBytes = 0;
+  std::uint64_t intoAllocations = 0;
+  std::uint64_t arenaAllocations = 0;
+  bool match = true;
+};
+
+std::uint64_t heapCalls(const HeapTracker::Stats& stats)
+{
+  return stats.allocations + stats.reallocations;
+}
+
+std::vector<SourceImage> readImages(const std::string& directory)
+{
+  std::vector<SourceImage> images;
+  std::error_code error;
+  for (const fs::directory_entry& entry : fs::directory_iterator(directory, error))
+  {
+    if (!entry.is_regular_file()) continue;
+
+    std::ifstream file(entry.path(), std::ios::binary);
+    SourceImage image = { entry.path().generic_string(),
+                          std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()) };
+    int width, height, channels;
+    if (stbi_info_from_memory(image.bytes.data(), (int)image.bytes.size(), &width, &height, &channels)) images.push_back(std::move(image));
+  }
+
+  std::sort(images.begin(), images.end(), [](const SourceImage& a, const SourceImage& b) { return a.name < b.name; });
+  return images;
+}
+
+}
+
+bool runAllocationBenchmark(const std::string& directory, int rounds)
+{
+  std::vector<SourceImage> images = readImages(directory);
+  if (images.empty())
+  {
+    std::cerr << "No images in " << directory << std::endl;
+    return false;
+  }
+
+  std::vector<ImageResult> results(images.size());
+  std::vector<unsigned char> reference;
+  std::vector<unsigned char> buffer;
+  ImageArena arena;
+  std::uint64_t laterHeapAllocations = 0;
+  bool success = true;
+
+  // Every heap allocation stb_image makes on this thread goes through heap, the arena path should make none
+  HeapTracker heap;
+  stbi_set_allocator_thread(heap.allocator());
+
+  for (int round = 0; round < rounds; round++)
+  {
+    for (size_t i = 0; i < images.size(); i++)
+    {
+      const std::vector<unsigned char>& bytes = images[i].bytes;
+      ImageResult& result = results[i];
+      int width, height, channels;
+
+      HeapTracker::Stats before = heap.stats();
+      auto start = std::chrono::steady_clock::now();
+      unsigned char* pixels = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &width, &height, &channels, 4);
+      result.loadMilliseconds = std::min(result.loadMilliseconds, millisecondsSince(start));
+      result.loadAllocations = heapCalls(heap.stats()) - heapCalls(before);
+      result.loadBytes = heap.stats().bytesAllocated - before.bytesAllocated;
+      if (!pixels)
+      {
+        std::cerr << "Failed to decode " << images[i].name << ": " << stbi_failure_reason() << std::endl;
+        stbi_set_allocator_thread(nullptr);
+        return false;
+      }
+      reference.assign(pixels, pixels + (size_t)width * height * 4);
+      heap.release(pixels);
+
+      // The caller's buffer only ever grows, like a staging buffer would
+      if (buffer.size() < reference.size()) buffer.resize(reference.size());
+
+      before = heap.stats();
+      arena.resetStats();
+      start = std::chrono::steady_clock::now();
+      int loaded = stbi_load_from_memory_into(bytes.data(), (int)bytes.size(), buffer.data(), buffer.size(), 0, &width, &height,
+                                              &channels, 4, arena.allocator());
+      arena.reset();
+      result.intoMilliseconds = std::min(result.intoMilliseconds, millisecondsSince(start));
+      result.intoAllocations = heapCalls(heap.stats()) - heapCalls(before) + arena.stats().heapBlocks;
+      result.arenaAllocations = arena.stats().allocations + arena.stats().reallocations;
+      if (!loaded)
+      {
+        std::cerr << "Failed to decode " << images[i].name << " into a buffer: " << stbi_failure_reason() << std::endl;
+        stbi_set_allocator_thread(nullptr);
+        return false;
+      }
+
+      result.match = memcmp(buffer.data(), reference.data(), reference.size()) == 0;
+      success = result.match && success;
+      if (round > 0) laterHeapAllocations += result.intoAllocations;
+    }
+  }
+  stbi_set_allocator_thread(nullptr);
+
+  std::cout << std::left << std::setw(40) << "image" << std::right << std::setw(10) << "load ms" << std::setw(10) << "into ms"
+            << std::setw(14) << "load allocs" << std::setw(12) << "load KB" << std::setw(14) << "into allocs"
+            << std::setw(14) << "arena allocs" << "   pixels" << std::endl;
+  for (size_t i = 0; i < images.size(); i++)
+  {
+    const ImageResult& result = results[i];
+    std::cout << std::left << std::setw(40) << images[i].name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << result.loadMilliseconds << std::setw(10) << result.intoMilliseconds
+              << std::setw(14) << result.loadAllocations << std::setw(12) << result.loadBytes / 1024
+              << std::setw(14) << result.intoAllocations << std::setw(14) << result.arenaAllocations
+              << "   " << (result.match ? "ok" : "MISMATCH") << std::endl;
+  }
+  std::cout.unsetf(std::ios::floatfield);
+
+  std::cout << "Arena: " << arena.capacity() / 1024 << " KB, " << laterHeapAllocations << " heap allocations after the first of "
+            << rounds << " rounds" << std::endl;
+  if (laterHeapAllocations > 0)
+  {
+    std::cerr << "Decoding into the buffer still allocated from the heap" << std::endl;
+    success = false;
+  }
+
+  return success;
+}
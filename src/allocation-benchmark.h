@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+/**
+ * Decodes every image in directory with stbi_load_from_memory and with stbi_load_from_memory_into into a reused
+ * buffer with an ImageArena, counts the heap allocations stb_image makes on each path and prints them with the times
+ *
+ * The images are decoded rounds times, the arena only has to grow in the first round
+ *
+ * Returns false if an image failed to decode, the two paths disagree, or the arena path touched the heap after
+ * the first round
+*/
+bool runAllocationBenchmark(const std::string& directory, int rounds);
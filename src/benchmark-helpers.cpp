@@ -0,0 +1,183 @@
+#include "benchmark-helpers.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+
+double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+namespace
+{
+
+const std::size_t SIZE_HEADER = 16;
+
+std::uint32_t crc32(const unsigned char* data, std::size_t size)
+{
+  std::uint32_t crc = ~0u;
+  for (std::size_t i = 0; i < size; i++)
+  {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+  }
+  return ~crc;
+}
+
+void appendBigEndian(std::vector<unsigned char>& output, std::uint32_t value)
+{
+  for (int shift = 24; shift >= 0; shift -= 8) output.push_back((unsigned char)(value >> shift));
+}
+
+void appendChunk(std::vector<unsigned char>& png, const char type[4], const unsigned char* data, std::size_t size)
+{
+  appendBigEndian(png, (std::uint32_t)size);
+  std::size_t start = png.size();
+  png.insert(png.end(), type, type + 4);
+  png.insert(png.end(), data, data + size);
+  appendBigEndian(png, crc32(&png[start], png.size() - start));
+}
+
+// The predictor from the PNG specification, deliberately not the branch free version stb_image uses
+int paethPredictor(int a, int b, int c)
+{
+  int p = a + b - c;
+  int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) return a;
+  if (pb <= pc) return b;
+  return c;
+}
+
+}
+
+HeapTracker::HeapTracker()
+{
+  callbacks.alloc = [](void* user, size_t size) { return ((HeapTracker*)user)->allocate(size); };
+  callbacks.realloc = [](void* user, void* pointer, size_t, size_t newSize) { return ((HeapTracker*)user)->reallocate(pointer, newSize); };
+  callbacks.free = [](void* user, void* pointer) { ((HeapTracker*)user)->release(pointer); };
+  callbacks.user = this;
+}
+
+void* HeapTracker::allocate(std::size_t size)
+{
+  unsigned char* block = (unsigned char*)std::malloc(size + SIZE_HEADER);
+  if (!block) return nullptr;
+  *(std::size_t*)block = size;
+  counters.allocations++;
+  counters.bytesAllocated += size;
+  liveBytes += size;
+  peakBytes = std::max(peakBytes, liveBytes);
+  return block + SIZE_HEADER;
+}
+
+void* HeapTracker::reallocate(void* pointer, std::size_t size)
+{
+  if (!pointer) return allocate(size);
+  unsigned char* block = (unsigned char*)pointer - SIZE_HEADER;
+  std::size_t oldSize = *(std::size_t*)block;
+  block = (unsigned char*)std::realloc(block, size + SIZE_HEADER);
+  if (!block) return nullptr;
+  *(std::size_t*)block = size;
+  counters.reallocations++;
+  counters.bytesAllocated += size;
+  liveBytes += size - oldSize;
+  peakBytes = std::max(peakBytes, liveBytes);
+  return block + SIZE_HEADER;
+}
+
+void HeapTracker::release(void* pointer)
+{
+  if (!pointer) return;
+  unsigned char* block = (unsigned char*)pointer - SIZE_HEADER;
+  liveBytes -= *(std::size_t*)block;
+  std::free(block);
+}
+
+int PngWriter::channelsOf(int colorType)
+{
+  return colorType == 0 ? 1 : colorType == 2 ? 3 : colorType == 4 ? 2 : 4;
+}
+
+PngWriter::PngWriter(int width, int height, int colorType, int depth, int filter) : colorType(colorType), filter(filter)
+{
+  pixelBytes = channelsOf(colorType) * depth / 8;
+  rowBytes = (std::size_t)width * pixelBytes;
+  prior.assign(rowBytes, 0);
+  filtered.resize(rowBytes + 1);
+
+  png = { 137, 80, 78, 71, 13, 10, 26, 10 };
+  png.reserve((rowBytes + 1) * height + (rowBytes + 1) * height / 65535 * 5 + 1024);
+
+  std::vector<unsigned char> header;
+  appendBigEndian(header, width);
+  appendBigEndian(header, height);
+  header.insert(header.end(), { (unsigned char)depth, (unsigned char)colorType, 0, 0, 0 });
+  appendChunk(png, "IHDR", header.data(), header.size());
+
+  // zlib header, then the filtered rows in stored blocks of at most 65535 bytes
+  zlib = { 0x78, 0x01 };
+}
+
+void PngWriter::transparentColor(const std::uint16_t* samples)
+{
+  std::vector<unsigned char> color;
+  for (int c = 0; c < channelsOf(colorType); c++) color.insert(color.end(), { (unsigned char)(samples[c] >> 8), (unsigned char)samples[c] });
+  appendChunk(png, "tRNS", color.data(), color.size());
+}
+
+void PngWriter::addRow(const unsigned char* row)
+{
+  int rowFilter = filter >= 0 ? filter : rows % 5;
+  filtered[0] = (unsigned char)rowFilter;
+  for (std::size_t i = 0; i < rowBytes; i++)
+  {
+    int a = i >= (std::size_t)pixelBytes ? row[i - pixelBytes] : 0;
+    int b = prior[i];
+    int c = i >= (std::size_t)pixelBytes ? prior[i - pixelBytes] : 0;
+    int prediction = rowFilter == 1 ? a : rowFilter == 2 ? b : rowFilter == 3 ? (a + b) / 2 : rowFilter == 4 ? paethPredictor(a, b, c) : 0;
+    filtered[i + 1] = (unsigned char)(row[i] - prediction);
+  }
+  prior.assign(row, row + rowBytes);
+  rows++;
+
+  for (unsigned char byte : filtered)
+  {
+    s1 = (s1 + byte) % 65521;
+    s2 = (s2 + s1) % 65521;
+  }
+  for (std::size_t offset = 0; offset < filtered.size();)
+  {
+    std::size_t length = std::min(filtered.size() - offset, 65535 - block.size());
+    block.insert(block.end(), filtered.begin() + offset, filtered.begin() + offset + length);
+    offset += length;
+    if (block.size() == 65535) flushBlock(false);
+  }
+}
+
+void PngWriter::flushBlock(bool last)
+{
+  const std::size_t chunkBytes = 1 << 20;
+  std::size_t length = block.size();
+  zlib.insert(zlib.end(), { (unsigned char)last, (unsigned char)length, (unsigned char)(length >> 8), (unsigned char)~length,
+                            (unsigned char)(~length >> 8) });
+  zlib.insert(zlib.end(), block.begin(), block.end());
+  block.clear();
+  if (zlib.size() >= chunkBytes || last)
+  {
+    appendChunk(png, "IDAT", zlib.data(), zlib.size());
+    zlib.clear();
+  }
+}
+
+std::vector<unsigned char> PngWriter::finish()
+{
+  flushBlock(true);
+
+  // Adler-32 in a chunk of its own, a stream can end anywhere in the IDAT chunks
+  std::vector<unsigned char> adler;
+  appendBigEndian(adler, (s2 << 16) | s1);
+  appendChunk(png, "IDAT", adler.data(), adler.size());
+  appendChunk(png, "IEND", nullptr, 0);
+  return std::move(png);
+}
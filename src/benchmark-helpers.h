@@ -0,0 +1,95 @@
+#pragma once
+
+#include "stb_image.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What the image benchmarks share: heap tracking of stb_image, synthetic PNGs and timing
+
+double millisecondsSince(std::chrono::steady_clock::time_point start);
+
+/**
+ * Heap allocator for stb_image that counts what it holds, for measuring the peak heap of a decode
+ * Hand allocator() to stbi_set_allocator_thread (of whichever stb_image copy decodes) around the decodes
+ * and free what they returned with release, not stbi_image_free
+ * Every block carries its size in front of it, 16 bytes to keep the alignment of malloc
+ *
+ * Not thread safe, use one tracker per decoding thread
+*/
+class HeapTracker
+{
+public:
+  // Counters since the last resetStats
+  struct Stats
+  {
+    std::uint64_t allocations = 0;
+    std::uint64_t reallocations = 0;
+    std::uint64_t bytesAllocated = 0;
+  };
+
+  HeapTracker();
+  HeapTracker(const HeapTracker&) = delete;
+  HeapTracker& operator=(const HeapTracker&) = delete;
+
+  const stbi_allocator* allocator() const { return &callbacks; }
+
+  // The callbacks of allocator(), also for the benchmarks' own blocks that are freed like stb_image's
+  void* allocate(std::size_t size);
+  void* reallocate(void* pointer, std::size_t size);
+  void release(void* pointer);
+
+  // Bytes allocated and not freed yet, and the most there were since the last resetPeak
+  std::uint64_t live() const { return liveBytes; }
+  std::uint64_t peak() const { return peakBytes; }
+  void resetPeak() { peakBytes = liveBytes; }
+
+  const Stats& stats() const { return counters; }
+  void resetStats() { counters = Stats(); }
+
+private:
+  std::uint64_t liveBytes = 0;
+  std::uint64_t peakBytes = 0;
+  Stats counters;
+  stbi_allocator callbacks;
+};
+
+/**
+ * Encodes a PNG a row at a time, with one filter for every row or cycling through the five so every unfilter runs
+ * The zlib stream uses stored blocks and is split over IDAT chunks of about 1 MB like encoders write them,
+ * so decoding it costs little next to the unfiltering and the only image sized buffer is the PNG itself
+*/
+class PngWriter
+{
+public:
+  // colorType 0, 2, 4 or 6 (gray, RGB, gray + alpha, RGBA) at a depth of 8 or 16 bits, filter 0 to 4 or -1 to cycle
+  PngWriter(int width, int height, int colorType, int depth, int filter = -1);
+
+  // Makes pixels of one color transparent with a tRNS chunk, a sample per channel (gray or RGB only), before the first row
+  void transparentColor(const std::uint16_t* samples);
+
+  // A row of width pixels at the file's depth, 16 bit samples big endian
+  void addRow(const unsigned char* row);
+
+  // The PNG, once all rows are added
+  std::vector<unsigned char> finish();
+
+  static int channelsOf(int colorType);
+
+private:
+  void flushBlock(bool last);
+
+  std::vector<unsigned char> png;
+  std::vector<unsigned char> zlib;
+  std::vector<unsigned char> block;
+  std::vector<unsigned char> prior;
+  std::vector<unsigned char> filtered;
+  std::size_t rowBytes;
+  int pixelBytes;
+  int colorType;
+  int filter;
+  int rows = 0;
+  std::uint32_t s1 = 1, s2 = 0;
+};
@@ -0,0 +1,178 @@
+#include "benchmark.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+const char* framePhaseName(FramePhase phase)
+{
+  switch (phase)
+  {
+    case PHASE_UPDATE: return "update";
+    case PHASE_UNIFORMS: return "uniforms";
+    case PHASE_CULL: return "cull";
+    case PHASE_DRAW: return "draw";
+    case PHASE_SWAP: return "swap";
+    default: return "unknown";
+  }
+}
+
+std::string jsonString(const std::string& text)
+{
+  std::string quoted = "\"";
+  for (char c : text)
+  {
+    if (c == '"' || c == '\\') quoted += '\\';
+    if ((unsigned char)c < 0x20) continue;
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+TimingStats computeTimingStats(std::vector<double> samples)
+{
+  TimingStats stats;
+  if (samples.empty()) return stats;
+
+  std::sort(samples.begin(), samples.end());
+
+  // Nearest rank: the smallest sample that is greater than or equal to p percent of the samples
+  auto percentile = [&](double p)
+  {
+    size_t rank = (size_t)std::ceil(p / 100.0 * samples.size());
+    return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+  };
+
+  double total = 0;
+  for (double sample : samples) total += sample;
+
+  stats.mean = total / samples.size();
+  stats.min = samples.front();
+  stats.max = samples.back();
+  stats.p50 = percentile(50);
+  stats.p95 = percentile(95);
+  stats.p99 = percentile(99);
+  return stats;
+}
+
+FrameProfiler::FrameProfiler()
+{
+  glGenQueries(QUERY_LATENCY * (PHASE_COUNT + 1), &queries[0][0]);
+}
+
+void FrameProfiler::beginFrame(bool record)
+{
+  // The queries in this slot were issued QUERY_LATENCY frames ago, by now they are (almost always) done
+  if (slotPending[slot]) collectQueries(slot);
+
+  recording = record;
+  frameStart = phaseStart = Clock::now();
+  glQueryCounter(queries[slot][0], GL_TIMESTAMP);
+}
+
+void FrameProfiler::endPhase(FramePhase phase)
+{
+  Clock::time_point now = Clock::now();
+  if (recording) cpuPhase[phase].push_back(std::chrono::duration<double, std::milli>(now - phaseStart).count());
+  phaseStart = now;
+
+  glQueryCounter(queries[slot][phase + 1], GL_TIMESTAMP);
+}
+
+void FrameProfiler::endFrame()
+{
+  if (recording) cpuFrame.push_back(std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count());
+
+  slotPending[slot] = recording;
+  slot = (slot + 1) % QUERY_LATENCY;
+}
+
+void FrameProfiler::finish()
+{
+  for (int i = 0; i < QUERY_LATENCY; i++)
+  {
+    // Oldest frame first so the samples stay in frame order
+    int pending = (slot + i) % QUERY_LATENCY;
+    if (slotPending[pending]) collectQueries(pending);
+  }
+
+  glDeleteQueries(QUERY_LATENCY * (PHASE_COUNT + 1), &queries[0][0]);
+}
+
+void FrameProfiler::collectQueries(int pending)
+{
+  GLuint64 timestamps[PHASE_COUNT + 1];
+  for (int i = 0; i <= PHASE_COUNT; i++)
+  {
+    // Blocks if the GPU has not reached this query yet
+    glGetQueryObjectui64v(queries[pending][i], GL_QUERY_RESULT, &timestamps[i]);
+  }
+
+  for (int phase = 0; phase < PHASE_COUNT; phase++)
+  {
+    gpuPhase[phase].push_back((timestamps[phase + 1] - timestamps[phase]) / 1e6);
+  }
+  gpuFrame.push_back((timestamps[PHASE_COUNT] - timestamps[0]) / 1e6);
+
+  slotPending[pending] = false;
+}
+
+void FrameProfiler::printSummary(std::ostream& stream) const
+{
+  auto printRow = [&](const std::string& name, const std::vector<double>& samples)
+  {
+    TimingStats stats = computeTimingStats(samples);
+    stream << std::left << std::setw(14) << name << std::right << std::fixed << std::setprecision(3)
+           << std::setw(10) << stats.mean << std::setw(10) << stats.p50 << std::setw(10) << stats.p95
+           << std::setw(10) << stats.p99 << std::setw(10) << stats.max << std::endl;
+  };
+
+  stream << "Frame times over " << cpuFrame.size() << " frames (ms)" << std::endl;
+  stream << std::left << std::setw(14) << "phase" << std::right << std::setw(10) << "mean" << std::setw(10) << "p50"
+         << std::setw(10) << "p95" << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+
+  for (int phase = 0; phase < PHASE_COUNT; phase++) printRow(std::string("cpu ") + framePhaseName((FramePhase)phase), cpuPhase[phase]);
+  printRow("cpu frame", cpuFrame);
+  for (int phase = 0; phase < PHASE_COUNT; phase++) printRow(std::string("gpu ") + framePhaseName((FramePhase)phase), gpuPhase[phase]);
+  printRow("gpu frame", gpuFrame);
+
+  stream.unsetf(std::ios::floatfield);
+}
+
+static void writeStats(std::ostream& stream, const std::vector<double>& samples)
+{
+  TimingStats stats = computeTimingStats(samples);
+  stream << "{ \"mean\": " << stats.mean << ", \"min\": " << stats.min << ", \"max\": " << stats.max
+         << ", \"p50\": " << stats.p50 << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99 << " }";
+}
+
+void FrameProfiler::writeJson(std::ostream& report, const std::vector<std::pair<std::string, std::string>>& metadata) const
+{
+  std::streamsize precision = report.precision(6);
+  report << "{" << std::endl;
+  for (const auto& [key, value] : metadata) report << "  \"" << key << "\": " << value << "," << std::endl;
+  report << "  \"recordedFrames\": " << cpuFrame.size() << "," << std::endl;
+
+  const std::vector<double>* phases[2] = { cpuPhase, gpuPhase };
+  const std::vector<double>* frames[2] = { &cpuFrame, &gpuFrame };
+  const char* names[2] = { "cpu", "gpu" };
+
+  for (int clock = 0; clock < 2; clock++)
+  {
+    report << "  \"" << names[clock] << "\": {" << std::endl;
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+      report << "    \"" << framePhaseName((FramePhase)phase) << "\": ";
+      writeStats(report, phases[clock][phase]);
+      report << "," << std::endl;
+    }
+    report << "    \"frame\": ";
+    writeStats(report, *frames[clock]);
+    report << std::endl << "  }" << (clock == 0 ? "," : "") << std::endl;
+  }
+  report << "}";
+  report.precision(precision);
+}
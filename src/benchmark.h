@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * The parts of a frame we time separately
+ * Each phase ends when FrameProfiler::endPhase is called with it, so they have to be ended in this order
+*/
+enum FramePhase
+{
+  PHASE_UPDATE,
+  PHASE_UNIFORMS,
+  PHASE_CULL,
+  PHASE_DRAW,
+  PHASE_SWAP,
+  PHASE_COUNT
+};
+
+const char* framePhaseName(FramePhase phase);
+
+struct TimingStats
+{
+  double mean = 0;
+  double min = 0;
+  double max = 0;
+  double p50 = 0;
+  double p95 = 0;
+  double p99 = 0;
+};
+
+// Quotes and escapes a string so it can be used as a JSON value
+std::string jsonString(const std::string& text);
+
+// Nearest rank percentiles of a list of samples (in milliseconds)
+TimingStats computeTimingStats(std::vector<double> samples);
+
+/**
+ * Records CPU and GPU time of every frame phase
+ * CPU time comes from std::chrono::steady_clock
+ * GPU time comes from GL_TIMESTAMP queries written with glQueryCounter at every phase boundary
+ * The queries of a frame are only read back a few frames later so reading them does not stall the pipeline
+*/
+class FrameProfiler
+{
+public:
+  FrameProfiler();
+
+  FrameProfiler(const FrameProfiler&) = delete;
+  FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+  // record is false for warm-up frames, they are timed but not kept
+  void beginFrame(bool record);
+  void endPhase(FramePhase phase);
+  void endFrame();
+
+  // Waits for the queries that are still in flight and deletes them, call it while the context is still current
+  void finish();
+
+  size_t recordedFrames() const { return cpuFrame.size(); }
+
+  void printSummary(std::ostream& stream) const;
+
+  // Writes the stats as a JSON object, metadata is a list of extra "key": value pairs whose values must already be valid JSON
+  void writeJson(std::ostream& stream, const std::vector<std::pair<std::string, std::string>>& metadata) const;
+
+private:
+  static const int QUERY_LATENCY = 4;
+
+  void collectQueries(int slot);
+
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point frameStart;
+  Clock::time_point phaseStart;
+  bool recording = false;
+
+  // One set of timestamp queries per in-flight frame: frame start + the end of each phase
+  unsigned int queries[QUERY_LATENCY][PHASE_COUNT + 1] = {};
+  bool slotPending[QUERY_LATENCY] = {};
+  int slot = 0;
+
+  std::vector<double> cpuPhase[PHASE_COUNT];
+  std::vector<double> cpuFrame;
+  std::vector<double> gpuPhase[PHASE_COUNT];
+  std::vector<double> gpuFrame;
+};
@@ -0,0 +1,493 @@
+#include "cpu-culling.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <immintrin.h>
+
+// The AVX2 kernels are compiled with a target attribute and only called after a run-time check,
+// so the rest of the program does not need -mavx2
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+#endif
+
+void BoxBatch::set(std::size_t index, const glm::vec3& min, const glm::vec3& max)
+{
+  for (int i = 0; i < 3; i++)
+  {
+    lane(i)[index] = min[i];
+    lane(3 + i)[index] = max[i];
+  }
+}
+
+glm::vec3 BoxBatch::min(std::size_t index) const
+{
+  return glm::vec3(lane(0)[index], lane(1)[index], lane(2)[index]);
+}
+
+glm::vec3 BoxBatch::max(std::size_t index) const
+{
+  return glm::vec3(lane(3)[index], lane(4)[index], lane(5)[index]);
+}
+
+CullingStats& CullingStats::operator+=(const CullingStats& other)
+{
+  objects += other.objects;
+  visible += other.visible;
+  objectsTested += other.objectsTested;
+  groupsTested += other.groupsTested;
+  groupsOutside += other.groupsOutside;
+  groupsInside += other.groupsInside;
+  milliseconds += other.milliseconds;
+  return *this;
+}
+
+namespace
+{
+
+const std::size_t GROUP_SIZE = CullingHierarchy::GROUP_SIZE;
+
+// Grows bounds to contain the box from min to max, or starts them over with it
+void extend(CullingHierarchy::Bounds& bounds, const glm::vec3& min, const glm::vec3& max, bool first)
+{
+  bounds.min = first ? min : glm::min(bounds.min, min);
+  bounds.max = first ? max : glm::max(bounds.max, max);
+}
+
+}
+
+void CullingHierarchy::build(const SphereBatch& spheres)
+{
+  std::vector<Bounds> groups((spheres.size() + GROUP_SIZE - 1) / GROUP_SIZE);
+  for (std::size_t i = 0; i < spheres.size(); i++)
+  {
+    glm::vec4 sphere = spheres.get(i);
+    extend(groups[i / GROUP_SIZE], glm::vec3(sphere) - sphere.w, glm::vec3(sphere) + sphere.w, i % GROUP_SIZE == 0);
+  }
+  objectCount = spheres.size();
+  buildLevels(std::move(groups));
+}
+
+void CullingHierarchy::build(const BoxBatch& boxes)
+{
+  std::vector<Bounds> groups((boxes.size() + GROUP_SIZE - 1) / GROUP_SIZE);
+  for (std::size_t i = 0; i < boxes.size(); i++) extend(groups[i / GROUP_SIZE], boxes.min(i), boxes.max(i), i % GROUP_SIZE == 0);
+  objectCount = boxes.size();
+  buildLevels(std::move(groups));
+}
+
+void CullingHierarchy::buildLevels(std::vector<Bounds> groups)
+{
+  boundsLevels.clear();
+  boundsLevels.push_back(std::move(groups));
+  while (boundsLevels.back().size() > 1)
+  {
+    const std::vector<Bounds>& below = boundsLevels.back();
+    std::vector<Bounds> level((below.size() + GROUP_SIZE - 1) / GROUP_SIZE);
+    for (std::size_t i = 0; i < below.size(); i++) extend(level[i / GROUP_SIZE], below[i].min, below[i].max, i % GROUP_SIZE == 0);
+    boundsLevels.push_back(std::move(level));
+  }
+}
+
+namespace
+{
+
+const int ALL_PLANES = 0x3f;
+
+// The planes objects still have to be tested against
+struct ActivePlanes
+{
+  int count = 0;
+  glm::vec4 planes[6];
+
+  // For boxes, the lanes of the corner farthest along each plane's normal: minimum (0, 1, 2) or maximum (3, 4, 5) x, y, z
+  int corner[6][3];
+};
+
+ActivePlanes activePlanes(const Frustum& frustum, int mask)
+{
+  ActivePlanes active;
+  for (int p = 0; p < 6; p++)
+  {
+    if (!(mask & (1 << p))) continue;
+    const glm::vec4& plane = frustum.planes[p];
+    active.planes[active.count] = plane;
+    for (int axis = 0; axis < 3; axis++) active.corner[active.count][axis] = plane[axis] >= 0 ? 3 + axis : axis;
+    active.count++;
+  }
+  return active;
+}
+
+/**
+ * The kernels test objects [first, last) of bounds against the planes and write the indices of the visible ones to out,
+ * returning how many, first is a multiple of 8 and out has room for last - first + 8 indices
+ *
+ * They compute a distance as ((x * nx + y * ny) + z * nz) + w like glm::dot and the tests of frustum.h,
+ * so they decide exactly as sphereInFrustum and boxInFrustum do
+ * The SIMD kernels run over whole registers into the padding of the lanes and drop the indices from last on
+*/
+using TestKernel = std::size_t (*)(const ActivePlanes& planes, const SoaBuffer& bounds, std::size_t first, std::size_t last, std::uint32_t* out);
+
+std::size_t testSpheresScalar(const ActivePlanes& planes, const SoaBuffer& spheres, std::size_t first, std::size_t last, std::uint32_t* out)
+{
+  const float* x = spheres.lane(0);
+  const float* y = spheres.lane(1);
+  const float* z = spheres.lane(2);
+  const float* radius = spheres.lane(3);
+
+  std::size_t count = 0;
+  for (std::size_t i = first; i < last; i++)
+  {
+    bool visible = true;
+    for (int p = 0; p < planes.count; p++)
+    {
+      const glm::vec4& plane = planes.planes[p];
+      visible = visible && !(((plane.x * x[i] + plane.y * y[i]) + plane.z * z[i]) + plane.w < -radius[i]);
+    }
+
+    // Written either way and kept by counting it, there is no branch to mispredict
+    out[count] = (std::uint32_t)i;
+    count += visible;
+  }
+  return count;
+}
+
+std::size_t testBoxesScalar(const ActivePlanes& planes, const SoaBuffer& boxes, std::size_t first, std::size_t last, std::uint32_t* out)
+{
+  const float* corners[6][3];
+  for (int p = 0; p < planes.count; p++)
+  {
+    for (int axis = 0; axis < 3; axis++) corners[p][axis] = boxes.lane(planes.corner[p][axis]);
+  }
+
+  std::size_t count = 0;
+  for (std::size_t i = first; i < last; i++)
+  {
+    bool visible = true;
+    for (int p = 0; p < planes.count; p++)
+    {
+      const glm::vec4& plane = planes.planes[p];
+      visible = visible && !(((plane.x * corners[p][0][i] + plane.y * corners[p][1][i]) + plane.z * corners[p][2][i]) + plane.w < 0);
+    }
+    out[count] = (std::uint32_t)i;
+    count += visible;
+  }
+  return count;
+}
+
+// Indices from first to last, for groups entirely inside the frustum
+std::size_t appendRange(std::size_t first, std::size_t last, std::uint32_t* out)
+{
+  for (std::size_t i = first; i < last; i++) *out++ = (std::uint32_t)i;
+  return last - first;
+}
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+
+// Writes base + lane for the lanes of a 4 wide register whose bit is set in mask and that are before last
+std::size_t appendLanesSse(int mask, std::size_t base, std::size_t last, std::uint32_t* out)
+{
+  if (last - base < 4) mask &= (1 << (last - base)) - 1;
+
+  std::size_t count = 0;
+  for (int lane = 0; lane < 4; lane++)
+  {
+    out[count] = (std::uint32_t)(base + lane);
+    count += (mask >> lane) & 1;
+  }
+  return count;
+}
+
+std::size_t testSpheresSse(const ActivePlanes& planes, const SoaBuffer& spheres, std::size_t first, std::size_t last, std::uint32_t* out)
+{
+  __m128 nx[6], ny[6], nz[6], nw[6];
+  for (int p = 0; p < planes.count; p++)
+  {
+    nx[p] = _mm_set1_ps(planes.planes[p].x);
+    ny[p] = _mm_set1_ps(planes.planes[p].y);
+    nz[p] = _mm_set1_ps(planes.planes[p].z);
+    nw[p] = _mm_set1_ps(planes.planes[p].w);
+  }
+  const __m128 sign = _mm_set1_ps(-0.f);
+
+  std::size_t count = 0;
+  for (std::size_t i = first; i < last; i += 4)
+  {
+    __m128 x = _mm_load_ps(spheres.lane(0) + i);
+    __m128 y = _mm_load_ps(spheres.lane(1) + i);
+    __m128 z = _mm_load_ps(spheres.lane(2) + i);
+    __m128 negativeRadius = _mm_xor_ps(_mm_load_ps(spheres.lane(3) + i), sign);
+
+    __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < planes.count; p++)
+    {
+      __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], x), _mm_mul_ps(ny[p], y)), _mm_mul_ps(nz[p], z)), nw[p]);
+      visible = _mm_and_ps(visible, _mm_cmpnlt_ps(distance, negativeRadius));
+    }
+    count += appendLanesSse(_mm_movemask_ps(visible), i, last, out + count);
+  }
+  return count;
+}
+
+std::size_t testBoxesSse(const ActivePlanes& planes, const SoaBuffer& boxes, std::size_t first, std::size_t last, std::uint32_t* out)
+{
+  __m128 nx[6], ny[6], nz[6], nw[6];
+  for (int p = 0; p < planes.count; p++)
+  {
+    nx[p] = _mm_set1_ps(planes.planes[p].x);
+    ny[p] = _mm_set1_ps(planes.planes[p].y);
+    nz[p] = _mm_set1_ps(planes.planes[p].z);
+    nw[p] = _mm_set1_ps(planes.planes[p].w);
+  }
+  const __m128 zero = _mm_setzero_ps();
+
+  std::size_t count = 0;
+  for (std::size_t i = first; i < last; i += 4)
+  {
+    __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < planes.count; p++)
+    {
+      const int* corner = planes.corner[p];
+      __m128 x = _mm_load_ps(boxes.lane(corner[0]) + i);
+      __m128 y = _mm_load_ps(boxes.lane(corner[1]) + i);
+      __m128 z = _mm_load_ps(boxes.lane(corner[2]) + i);
+      __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], x), _mm_mul_ps(ny[p], y)), _mm_mul_ps(nz[p], z)), nw[p]);
+      visible = _mm_and_ps(visible, _mm_cmpnlt_ps(distance, zero));
+    }
+    count += appendLanesSse(_mm_movemask_ps(visible), i, last, out + count);
+  }
+  return count;
+}
+
+// For every 8 bit mask, the lanes whose bits are set, one per byte from the lowest, for _mm256_permutevar8x32_epi32
+struct CompactionTable
+{
+  std::uint64_t lanes[256];
+
+  constexpr CompactionTable() : lanes()
+  {
+    for (int mask = 0; mask < 256; mask++)
+    {
+      int count = 0;
+      for (int lane = 0; lane < 8; lane++)
+      {
+        if (mask & (1 << lane)) lanes[mask] |= (std::uint64_t)lane << (8 * count++);
+      }
+    }
+  }
+};
+
+constexpr CompactionTable COMPACTION;
+
+// Like appendLanesSse for 8 lanes, with one store of all 8 indices moved into place
+TARGET_AVX2 std::size_t appendLanesAvx2(int mask, std::size_t base, std::size_t last, std::uint32_t* out)
+{
+  if (last - base < 8) mask &= (1 << (last - base)) - 1;
+
+  __m256i indices = _mm256_add_epi32(_mm256_set1_epi32((int)base), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+  __m256i order = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&COMPACTION.lanes[mask]));
+  _mm256_storeu_si256((__m256i*)out, _mm256_permutevar8x32_epi32(indices, order));
+  return std::popcount((unsigned int)mask);
+}
+
+TARGET_AVX2 std::size_t testSpheresAvx2(const ActivePlanes& planes, const SoaBuffer& spheres, std::size_t first, std::size_t last, std::uint32_t* out)
+{
+  __m256 nx[6], ny[6], nz[6], nw[6];
+  for (int p = 0; p < planes.count; p++)
+  {
+    nx[p] = _mm256_set1_ps(planes.planes[p].x);
+    ny[p] = _mm256_set1_ps(planes.planes[p].y);
+    nz[p] = _mm256_set1_ps(planes.planes[p].z);
+    nw[p] = _mm256_set1_ps(planes.planes[p].w);
+  }
+  const __m256 sign = _mm256_set1_ps(-0.f);
+
+  std::size_t count = 0;
+  for (std::size_t i = first; i < last; i += 8)
+  {
+    __m256 x = _mm256_load_ps(spheres.lane(0) + i);
+    __m256 y = _mm256_load_ps(spheres.lane(1) + i);
+    __m256 z = _mm256_load_ps(spheres.lane(2) + i);
+    __m256 negativeRadius = _mm256_xor_ps(_mm256_load_ps(spheres.lane(3) + i), sign);
+
+    __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < planes.count; p++)
+    {
+      __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], x), _mm256_mul_ps(ny[p], y)), _mm256_mul_ps(nz[p], z)), nw[p]);
+      visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, negativeRadius, _CMP_NLT_UQ));
+    }
+    count += appendLanesAvx2(_mm256_movemask_ps(visible), i, last, out + count);
+  }
+  return count;
+}
+
+TARGET_AVX2 std::size_t testBoxesAvx2(const ActivePlanes& planes, const SoaBuffer& boxes, std::size_t first, std::size_t last, std::uint32_t* out)
+{
+  __m256 nx[6], ny[6], nz[6], nw[6];
+  for (int p = 0; p < planes.count; p++)
+  {
+    nx[p] = _mm256_set1_ps(planes.planes[p].x);
+    ny[p] = _mm256_set1_ps(planes.planes[p].y);
+    nz[p] = _mm256_set1_ps(planes.planes[p].z);
+    nw[p] = _mm256_set1_ps(planes.planes[p].w);
+  }
+  const __m256 zero = _mm256_setzero_ps();
+
+  std::size_t count = 0;
+  for (std::size_t i = first; i < last; i += 8)
+  {
+    __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < planes.count; p++)
+    {
+      const int* corner = planes.corner[p];
+      __m256 x = _mm256_load_ps(boxes.lane(corner[0]) + i);
+      __m256 y = _mm256_load_ps(boxes.lane(corner[1]) + i);
+      __m256 z = _mm256_load_ps(boxes.lane(corner[2]) + i);
+      __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], x), _mm256_mul_ps(ny[p], y)), _mm256_mul_ps(nz[p], z)), nw[p]);
+      visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, zero, _CMP_NLT_UQ));
+    }
+    count += appendLanesAvx2(_mm256_movemask_ps(visible), i, last, out + count);
+  }
+  return count;
+}
+
+#endif
+
+struct Kernels
+{
+  TestKernel testSpheres;
+  TestKernel testBoxes;
+};
+
+Kernels kernelsFor(TransformKernel kernel)
+{
+  if (!transformKernelSupported(kernel) || kernel == TransformKernel::Auto) kernel = bestTransformKernel();
+  switch (kernel)
+  {
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+  case TransformKernel::Sse: return { testSpheresSse, testBoxesSse };
+  case TransformKernel::Avx2:
+  case TransformKernel::Avx512: return { testSpheresAvx2, testBoxesAvx2 };
+#endif
+  default: return { testSpheresScalar, testBoxesScalar };
+  }
+}
+
+/**
+ * -1 if the box is entirely behind one of the planes of mask, otherwise the planes of mask it crosses
+ * Rounding puts the distances of a group's corners and of its objects a few ULPs apart, so a group only counts as
+ * outside or inside a plane when it is by more than that and otherwise leaves it to its objects
+*/
+int classifyGroup(const Frustum& frustum, int mask, const CullingHierarchy::Bounds& box)
+{
+  int crossed = 0;
+  for (int p = 0; p < 6; p++)
+  {
+    if (!(mask & (1 << p))) continue;
+    const glm::vec4& plane = frustum.planes[p];
+    glm::vec3 normal = glm::vec3(plane);
+    glm::vec3 farthest(plane.x >= 0 ? box.max.x : box.min.x, plane.y >= 0 ? box.max.y : box.min.y, plane.z >= 0 ? box.max.z : box.min.z);
+    glm::vec3 nearest(plane.x >= 0 ? box.min.x : box.max.x, plane.y >= 0 ? box.min.y : box.max.y, plane.z >= 0 ? box.min.z : box.max.z);
+    float margin = 1e-5f * (glm::dot(glm::abs(normal), glm::max(glm::abs(box.min), glm::abs(box.max))) + std::abs(plane.w));
+
+    if (glm::dot(normal, farthest) + plane.w < -margin) return -1;
+    if (glm::dot(normal, nearest) + plane.w < margin) crossed |= 1 << p;
+  }
+  return crossed;
+}
+
+struct CullPass
+{
+  const Frustum& frustum;
+  const SoaBuffer& bounds;
+  const CullingHierarchy& hierarchy;
+  TestKernel test;
+  std::uint32_t* out;
+  std::size_t visible;
+  CullingStats stats;
+};
+
+// Culls the objects of one group of hierarchy level level, mask are the planes its parent crosses
+void cullGroup(CullPass& pass, int level, std::size_t group, int mask)
+{
+  pass.stats.groupsTested++;
+  int crossed = classifyGroup(pass.frustum, mask, pass.hierarchy.levels()[level][group]);
+  if (crossed < 0)
+  {
+    pass.stats.groupsOutside++;
+    return;
+  }
+
+  std::size_t span = GROUP_SIZE;
+  for (int i = 0; i < level; i++) span *= GROUP_SIZE;
+  std::size_t first = group * span;
+  std::size_t last = std::min(first + span, pass.hierarchy.size());
+
+  if (crossed == 0)
+  {
+    pass.stats.groupsInside++;
+    pass.visible += appendRange(first, last, pass.out + pass.visible);
+  }
+  else if (level == 0)
+  {
+    pass.stats.objectsTested += last - first;
+    pass.visible += pass.test(activePlanes(pass.frustum, crossed), pass.bounds, first, last, pass.out + pass.visible);
+  }
+  else
+  {
+    std::size_t children = std::min((group + 1) * GROUP_SIZE, pass.hierarchy.levels()[level - 1].size());
+    for (std::size_t child = group * GROUP_SIZE; child < children; child++) cullGroup(pass, level - 1, child, crossed);
+  }
+}
+
+void cull(const Frustum& frustum, const SoaBuffer& bounds, const CullingHierarchy* hierarchy, VisibleList& visible, CullingStats* stats, TestKernel test)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  std::size_t count = bounds.size();
+  if (visible.indices.size() < count + 8) visible.indices.resize(count + 8);
+
+  // Without a hierarchy that matches the batch, every object is tested against every plane
+  static const CullingHierarchy none;
+  bool useHierarchy = hierarchy && count && hierarchy->size() == count;
+  CullPass pass = { frustum, bounds, useHierarchy ? *hierarchy : none, test, visible.indices.data(), 0, CullingStats() };
+
+  if (useHierarchy)
+  {
+    cullGroup(pass, (int)hierarchy->levels().size() - 1, 0, ALL_PLANES);
+  }
+  else if (count)
+  {
+    pass.stats.objectsTested = count;
+    pass.visible = test(activePlanes(frustum, ALL_PLANES), bounds, 0, count, pass.out);
+  }
+  visible.size = pass.visible;
+
+  if (stats)
+  {
+    *stats = pass.stats;
+    stats->objects = count;
+    stats->visible = pass.visible;
+    stats->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+}
+
+}
+
+void cullSpheres(const Frustum& frustum, const SphereBatch& spheres, const CullingHierarchy* hierarchy, VisibleList& visible,
+                 CullingStats* stats, TransformKernel kernel)
+{
+  cull(frustum, spheres, hierarchy, visible, stats, kernelsFor(kernel).testSpheres);
+}
+
+void cullBoxes(const Frustum& frustum, const BoxBatch& boxes, const CullingHierarchy* hierarchy, VisibleList& visible,
+               CullingStats* stats, TransformKernel kernel)
+{
+  cull(frustum, boxes, hierarchy, visible, stats, kernelsFor(kernel).testBoxes);
+}
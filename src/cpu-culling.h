@@ -0,0 +1,101 @@
+#pragma once
+
+#include "frustum.h"
+#include "transform-batch.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Axis aligned boxes, lanes x, y, z of the minimum corners then x, y, z of the maximum corners
+class BoxBatch : public SoaBuffer
+{
+public:
+  BoxBatch() : SoaBuffer(6) {}
+
+  void set(std::size_t index, const glm::vec3& min, const glm::vec3& max);
+  glm::vec3 min(std::size_t index) const;
+  glm::vec3 max(std::size_t index) const;
+};
+
+/**
+ * Boxes around groups of GROUP_SIZE consecutive objects, boxes around groups of GROUP_SIZE of those and so on up to a
+ * single box around everything
+ * Culling tests a group before its objects: a group outside the frustum skips all of them, a group inside it accepts
+ * them without a test and the objects of a group that crosses some planes are only tested against those planes,
+ * so a frame costs about as much as the objects near the edges of the frustum, not as all objects
+ *
+ * This only pays off when objects close in index are close in space (a grid, or objects sorted along a space filling
+ * curve), and the hierarchy must be built again after the bounds it was built from changed
+*/
+class CullingHierarchy
+{
+public:
+  static constexpr std::size_t GROUP_SIZE = 64;
+
+  void build(const SphereBatch& spheres);
+  void build(const BoxBatch& boxes);
+
+  // Objects of the batch it was built from, 0 before the first build
+  std::size_t size() const { return objectCount; }
+
+  struct Bounds
+  {
+    glm::vec3 min;
+    glm::vec3 max;
+  };
+
+  // levels()[0] holds the boxes around the objects, the last level the single box around everything
+  const std::vector<std::vector<Bounds>>& levels() const { return boundsLevels; }
+
+private:
+  void buildLevels(std::vector<Bounds> groups);
+
+  std::vector<std::vector<Bounds>> boundsLevels;
+  std::size_t objectCount = 0;
+};
+
+/**
+ * Indices of the visible objects in increasing order, the first size entries of indices
+ * The kernels store 8 indices at a time and keep the visible ones, so indices is kept 8 longer than the batch
+ * and never shrinks, the list costs nothing to reuse from frame to frame
+*/
+struct VisibleList
+{
+  std::vector<std::uint32_t> indices;
+  std::size_t size = 0;
+};
+
+// What one cull did, add them up with += for per frame averages
+struct CullingStats
+{
+  std::size_t objects = 0;
+  std::size_t visible = 0;
+
+  // Objects whose own bounds were tested, the rest were decided by their group
+  std::size_t objectsTested = 0;
+
+  std::size_t groupsTested = 0;
+  std::size_t groupsOutside = 0;
+  std::size_t groupsInside = 0;
+
+  double milliseconds = 0;
+
+  CullingStats& operator+=(const CullingStats& other);
+};
+
+/**
+ * Writes the indices of the spheres that are at least partly inside the frustum to visible
+ * The result is the same as sphereInFrustum for every sphere, with or without a hierarchy
+ *
+ * hierarchy may be null, or one built from spheres, AVX2 tests 8 spheres per iteration and SSE 4,
+ * Avx512 runs the AVX2 kernel and kernels the CPU does not support fall back to the best one it does
+*/
+void cullSpheres(const Frustum& frustum, const SphereBatch& spheres, const CullingHierarchy* hierarchy, VisibleList& visible,
+                 CullingStats* stats = nullptr, TransformKernel kernel = TransformKernel::Auto);
+
+// Same as cullSpheres for boxes, the result is the same as boxInFrustum for every box
+void cullBoxes(const Frustum& frustum, const BoxBatch& boxes, const CullingHierarchy* hierarchy, VisibleList& visible,
+               CullingStats* stats = nullptr, TransformKernel kernel = TransformKernel::Auto);
@@ -0,0 +1,218 @@
+#include "culling-benchmark.h"
+
+#include "cpu-culling.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const TransformKernel KERNELS[] = { TransformKernel::Scalar, TransformKernel::Sse, TransformKernel::Avx2 };
+
+// Views per timed run, the camera turns a full circle over them
+const int FRAME_COUNT = 16;
+
+struct Rng
+{
+  std::uint32_t state = 12345;
+  std::uint32_t next() { return state = state * 1664525u + 1013904223u; }
+
+  // In [low, high)
+  float uniform(float low, float high) { return low + (high - low) * (next() >> 8) * (1.f / (1 << 24)); }
+};
+
+/**
+ * A camera in the middle of a grid of side^3 objects one unit apart, looking a little down and turning around the
+ * y axis, with the far plane at half the size of the grid so some objects are behind it
+*/
+std::vector<Frustum> buildFrustums(int side)
+{
+  glm::mat4 projection = glm::perspective(glm::radians(60.f), 16 / 9.f, .1f, side * .5f);
+  std::vector<Frustum> frustums;
+  for (int frame = 0; frame < FRAME_COUNT; frame++)
+  {
+    float angle = frame * 6.2831853f / FRAME_COUNT;
+    glm::vec3 direction(std::sin(angle), -.3f, std::cos(angle));
+    frustums.push_back(extractFrustum(projection * glm::lookAt(glm::vec3(0), direction, glm::vec3(0, 1, 0))));
+  }
+  return frustums;
+}
+
+// Fastest of iterations runs of body, each one culling every frame, in milliseconds per frame
+template <typename Body>
+double timeFrames(int iterations, Body body)
+{
+  double best = 1e30;
+  for (int i = 0; i < iterations; i++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAME_COUNT; frame++) body(frame);
+    best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / FRAME_COUNT);
+  }
+  return best;
+}
+
+bool sameList(const VisibleList& visible, const std::vector<std::uint32_t>& expected)
+{
+  return visible.size == expected.size() && std::memcmp(visible.indices.data(), expected.data(), expected.size() * sizeof(std::uint32_t)) == 0;
+}
+
+// Milliseconds per frame of each column, negative for columns that were not run
+struct Row
+{
+  std::string name;
+  double loop = -1;
+  double kernels[3] = { -1, -1, -1 };
+  double hierarchy = -1;
+  CullingStats stats;
+  bool match = true;
+};
+
+void printHeader()
+{
+  std::cout << std::left << std::setw(18) << "objects" << std::right << std::setw(10) << "loop";
+  for (const char* kernel : { "scalar", "SSE", "AVX2", "hierarchy" }) std::cout << std::setw(10) << kernel;
+  std::cout << std::setw(9) << "best x" << std::setw(10) << "visible" << std::setw(10) << "tested" << std::setw(16) << "groups out/in"
+            << "   output (ms per frame)" << std::endl;
+}
+
+void printRow(const Row& row)
+{
+  std::cout << std::left << std::setw(18) << row.name << std::right << std::fixed << std::setprecision(3);
+  double best = row.loop;
+  for (double column : { row.loop, row.kernels[0], row.kernels[1], row.kernels[2], row.hierarchy })
+  {
+    if (column < 0) std::cout << std::setw(10) << "-";
+    else std::cout << std::setw(10) << column;
+    if (column > 0) best = std::min(best, column);
+  }
+
+  // Per frame averages of the hierarchy pass
+  const CullingStats& stats = row.stats;
+  std::cout << std::setprecision(1) << std::setw(8) << row.loop / best << "x" << std::setw(9) << 100. * stats.visible / stats.objects << "%"
+            << std::setw(9) << 100. * stats.objectsTested / stats.objects << "%" << std::setw(16)
+            << std::to_string(stats.groupsOutside / FRAME_COUNT) + "/" + std::to_string(stats.groupsInside / FRAME_COUNT)
+            << "   " << (row.match ? "ok" : "MISMATCH") << std::endl;
+  std::cout.unsetf(std::ios::floatfield);
+}
+
+/**
+ * Times cull (a call of cullSpheres or cullBoxes with a hierarchy or null and a kernel) against reference,
+ * which fills the expected visible list of a frame
+*/
+template <typename Reference, typename Cull>
+Row benchmarkCulling(const std::string& name, int iterations, const CullingHierarchy& hierarchy, Reference reference, Cull cull)
+{
+  Row row;
+  row.name = name;
+
+  std::vector<std::vector<std::uint32_t>> expected(FRAME_COUNT);
+  row.loop = timeFrames(iterations, [&](int frame) { reference(frame, expected[frame]); });
+
+  VisibleList visible;
+  for (int k = 0; k < 3; k++)
+  {
+    if (!transformKernelSupported(KERNELS[k])) continue;
+    row.kernels[k] = timeFrames(iterations, [&](int frame) { cull(frame, nullptr, visible, nullptr, KERNELS[k]); });
+    for (int frame = 0; frame < FRAME_COUNT; frame++)
+    {
+      cull(frame, nullptr, visible, nullptr, KERNELS[k]);
+      row.match = sameList(visible, expected[frame]) && row.match;
+    }
+  }
+
+  row.hierarchy = timeFrames(iterations, [&](int frame) { cull(frame, &hierarchy, visible, nullptr, TransformKernel::Auto); });
+  for (int frame = 0; frame < FRAME_COUNT; frame++)
+  {
+    CullingStats stats;
+    cull(frame, &hierarchy, visible, &stats, TransformKernel::Auto);
+    row.stats += stats;
+    row.match = sameList(visible, expected[frame]) && row.match;
+  }
+  return row;
+}
+
+}
+
+bool runCullingBenchmark(int iterations)
+{
+  // There is no AVX-512 culling kernel, those CPUs run the AVX2 one
+  TransformKernel best = bestTransformKernel() == TransformKernel::Avx512 ? TransformKernel::Avx2 : bestTransformKernel();
+  std::cout << "Culling kernel: " << transformKernelName(best) << ", " << FRAME_COUNT << " views per run" << std::endl;
+  printHeader();
+
+  bool success = true;
+  Rng rng;
+  for (int side : { 22, 47, 100, 159 })
+  {
+    // Objects jittered around the points of the grid, in the order of the grid so neighbours in index are close in space
+    std::size_t count = (std::size_t)side * side * side;
+    std::vector<glm::vec4> spheres(count);
+    std::vector<glm::vec3> boxMin(count), boxMax(count);
+    SphereBatch sphereBatch;
+    BoxBatch boxBatch;
+    sphereBatch.resize(count);
+    boxBatch.resize(count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+      glm::vec3 center = glm::vec3(i % side, (i / side) % side, i / side / side) - (side - 1) * .5f;
+      center += glm::vec3(rng.uniform(-.3f, .3f), rng.uniform(-.3f, .3f), rng.uniform(-.3f, .3f));
+      glm::vec3 extent(rng.uniform(.05f, .4f), rng.uniform(.05f, .4f), rng.uniform(.05f, .4f));
+      spheres[i] = glm::vec4(center, glm::length(extent));
+      boxMin[i] = center - extent;
+      boxMax[i] = center + extent;
+      sphereBatch.set(i, spheres[i]);
+      boxBatch.set(i, boxMin[i], boxMax[i]);
+    }
+
+    std::vector<Frustum> frustums = buildFrustums(side);
+    CullingHierarchy sphereHierarchy, boxHierarchy;
+    sphereHierarchy.build(sphereBatch);
+    boxHierarchy.build(boxBatch);
+
+    Row rows[] = {
+      benchmarkCulling("spheres " + std::to_string(count), iterations, sphereHierarchy,
+        [&](int frame, std::vector<std::uint32_t>& visible)
+        {
+          visible.clear();
+          for (std::size_t i = 0; i < count; i++)
+          {
+            if (sphereInFrustum(frustums[frame], glm::vec3(spheres[i]), spheres[i].w)) visible.push_back((std::uint32_t)i);
+          }
+        },
+        [&](int frame, const CullingHierarchy* hierarchy, VisibleList& visible, CullingStats* stats, TransformKernel kernel)
+        {
+          cullSpheres(frustums[frame], sphereBatch, hierarchy, visible, stats, kernel);
+        }),
+      benchmarkCulling("boxes " + std::to_string(count), iterations, boxHierarchy,
+        [&](int frame, std::vector<std::uint32_t>& visible)
+        {
+          visible.clear();
+          for (std::size_t i = 0; i < count; i++)
+          {
+            if (boxInFrustum(frustums[frame], boxMin[i], boxMax[i])) visible.push_back((std::uint32_t)i);
+          }
+        },
+        [&](int frame, const CullingHierarchy* hierarchy, VisibleList& visible, CullingStats* stats, TransformKernel kernel)
+        {
+          cullBoxes(frustums[frame], boxBatch, hierarchy, visible, stats, kernel);
+        }),
+    };
+    for (const Row& row : rows)
+    {
+      printRow(row);
+      success = row.match && success;
+    }
+  }
+  return success;
+}
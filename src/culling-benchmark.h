@@ -0,0 +1,10 @@
+#pragma once
+
+/**
+ * Culls 10k to 4M bounding spheres and boxes laid out in a grid against a camera turning inside it, with a loop of
+ * sphereInFrustum / boxInFrustum, with every kernel of cpu-culling.h and with the best one plus a CullingHierarchy,
+ * prints the time per frame and what the hierarchy skipped
+ *
+ * Returns false if any visible list differs from the loop's
+*/
+bool runCullingBenchmark(int iterations);
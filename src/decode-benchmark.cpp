@@ -0,0 +1,148 @@
+#include "decode-benchmark.h"
+
+#include "benchmark-helpers.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+// PNG filter types, the byte in front of every row
+enum PngFilter
+{
+  PNG_FILTER_NONE,
+  PNG_FILTER_SUB,
+  PNG_FILTER_UP,
+  PNG_FILTER_AVERAGE,
+  PNG_FILTER_PAETH
+};
+
+static const char* pngFilterName(int filter)
+{
+  static const char* names[] = { "none", "sub", "up", "average", "paeth" };
+  return names[filter];
+}
+
+// An 8 bit RGB or RGBA image as a PNG with every row filtered with the same filter
+static std::vector<unsigned char> encodePng(const std::vector<unsigned char>& pixels, int width, int height, int channels, int filter)
+{
+  size_t rowBytes = (size_t)width * channels;
+  PngWriter writer(width, height, channels == 4 ? 6 : 2, 8, filter);
+  for (int y = 0; y < height; y++) writer.addRow(&pixels[y * rowBytes]);
+  return writer.finish();
+}
+
+// Smooth gradients with some noise, roughly what textures look like to the filters
+static std::vector<unsigned char> syntheticImage(int width, int height, int channels)
+{
+  std::vector<unsigned char> pixels((size_t)width * height * channels);
+  std::uint32_t random = 12345;
+  for (int y = 0; y < height; y++)
+  {
+    for (int x = 0; x < width; x++)
+    {
+      for (int c = 0; c < channels; c++)
+      {
+        random = random * 1664525u + 1013904223u;
+        int value = (x * (c + 1) + y * (3 - c)) / 8 + (int)(random >> 29);
+        pixels[((size_t)y * width + x) * channels + c] = (unsigned char)value;
+      }
+    }
+  }
+  return pixels;
+}
+
+struct DecodeTiming
+{
+  double milliseconds = 0;
+  std::vector<unsigned char> pixels;
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+};
+
+// Fastest of iterations decodes, the pixels of the last one are kept for comparison
+static bool timeDecode(const std::vector<unsigned char>& png, int iterations, bool simd, DecodeTiming& timing)
+{
+  stbi_set_png_simd(simd);
+  timing.milliseconds = 1e30;
+
+  for (int i = 0; i < iterations; i++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    unsigned char* pixels = stbi_load_from_memory(png.data(), (int)png.size(), &timing.width, &timing.height, &timing.channels, 0);
+    double milliseconds = millisecondsSince(start);
+
+    if (!pixels)
+    {
+      std::cerr << "Failed to decode: " << stbi_failure_reason() << std::endl;
+      stbi_set_png_simd(1);
+      return false;
+    }
+
+    timing.milliseconds = std::min(timing.milliseconds, milliseconds);
+    timing.pixels.assign(pixels, pixels + (size_t)timing.width * timing.height * timing.channels);
+    stbi_image_free(pixels);
+  }
+
+  stbi_set_png_simd(1);
+  return true;
+}
+
+static bool benchmarkImage(const std::string& name, const std::vector<unsigned char>& png, int iterations)
+{
+  DecodeTiming scalar, simd;
+  if (!timeDecode(png, iterations, false, scalar) || !timeDecode(png, iterations, true, simd)) return false;
+
+  bool match = scalar.pixels == simd.pixels;
+  double megabytes = scalar.pixels.size() / (1024.0 * 1024.0);
+
+  std::cout << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(3)
+            << std::setw(10) << scalar.milliseconds << std::setw(10) << simd.milliseconds
+            << std::setprecision(2) << std::setw(9) << scalar.milliseconds / simd.milliseconds << "x"
+            << std::setprecision(0) << std::setw(10) << megabytes / (scalar.milliseconds / 1000)
+            << std::setw(10) << megabytes / (simd.milliseconds / 1000)
+            << "   " << (match ? "ok" : "MISMATCH") << std::endl;
+  std::cout.unsetf(std::ios::floatfield);
+
+  return match;
+}
+
+bool runDecodeBenchmark(const std::string& texturePath, int iterations)
+{
+  std::cout << std::left << std::setw(32) << "image" << std::right << std::setw(10) << "scalar ms" << std::setw(10) << "simd ms"
+            << std::setw(10) << "speedup" << std::setw(10) << "C MB/s" << std::setw(10) << "SIMD MB/s" << "   pixels" << std::endl;
+
+  bool success = true;
+
+  std::ifstream file(texturePath, std::ios::binary);
+  std::vector<unsigned char> texture((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (texture.empty())
+  {
+    std::cerr << "Cannot read file: " << texturePath << std::endl;
+    success = false;
+  }
+  else
+  {
+    success = benchmarkImage(texturePath, texture, iterations) && success;
+  }
+
+  const int size = 2048;
+  for (int channels : { 3, 4 })
+  {
+    std::vector<unsigned char> pixels = syntheticImage(size, size, channels);
+    for (int filter = PNG_FILTER_SUB; filter <= PNG_FILTER_PAETH; filter++)
+    {
+      std::string name = std::to_string(size) + "x" + std::to_string(size) + (channels == 4 ? " rgba " : " rgb ") + pngFilterName(filter);
+      success = benchmarkImage(name, encodePng(pixels, size, size, channels, filter), iterations) && success;
+    }
+  }
+
+  return success;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+/**
+ * Decodes texturePath and a set of synthetic PNGs with the scalar and the SIMD PNG unfilter loops of stb_image,
+ * checks that both produce the same pixels and prints how long each took
+ *
+ * The synthetic images are stored without compression and use a single filter type for every row,
+ * so their decode time is almost only unfiltering and each filter's throughput can be read off directly
+ *
+ * Returns false if any image failed to decode or the two paths disagree
+*/
+bool runDecodeBenchmark(const std::string& texturePath, int iterations);
@@ -0,0 +1,196 @@
+#include "flip-benchmark.h"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+struct SourceImage
+{
+  std::string name;
+  std::vector<unsigned char> bytes;
+};
+
+struct Decoded
+{
+  double milliseconds = 1e30;
+  std::vector<unsigned char> pixels;
+};
+
+void appendLittleEndian(std::vector<unsigned char>& output, std::uint32_t value, int bytes)
+{
+  for (int i = 0; i < bytes; i++) output.push_back((unsigned char)(value >> (8 * i)));
+}
+
+// Smooth gradients with some noise, the same for every run
+std::vector<unsigned char> syntheticImage(int width, int height, int channels)
+{
+  std::vector<unsigned char> pixels((size_t)width * height * channels);
+  std::uint32_t random = 12345;
+  for (size_t i = 0; i < pixels.size(); i++)
+  {
+    random = random * 1664525u + 1013904223u;
+    size_t pixel = i / channels;
+    pixels[i] = (unsigned char)((pixel % width + pixel / width * (i % channels + 1)) / 8 + (random >> 29));
+  }
+  return pixels;
+}
+
+// A 24 bit BMP with the rows bottom-up, the usual kind
+std::vector<unsigned char> encodeBmp(const std::vector<unsigned char>& rgb, int width, int height)
+{
+  size_t rowBytes = ((size_t)width * 3 + 3) & ~(size_t)3;
+  std::vector<unsigned char> bmp = { 'B', 'M' };
+  appendLittleEndian(bmp, (std::uint32_t)(54 + rowBytes * height), 4);
+  appendLittleEndian(bmp, 0, 4);
+  appendLittleEndian(bmp, 54, 4);
+  appendLittleEndian(bmp, 40, 4);
+  appendLittleEndian(bmp, width, 4);
+  appendLittleEndian(bmp, height, 4);
+  appendLittleEndian(bmp, 1, 2);
+  appendLittleEndian(bmp, 24, 2);
+  for (int i = 0; i < 6; i++) appendLittleEndian(bmp, 0, 4);
+
+  for (int y = height - 1; y >= 0; y--)
+  {
+    const unsigned char* row = &rgb[(size_t)y * width * 3];
+    for (int x = 0; x < width; x++)
+    {
+      bmp.push_back(row[x * 3 + 2]);
+      bmp.push_back(row[x * 3 + 1]);
+      bmp.push_back(row[x * 3 + 0]);
+    }
+    bmp.resize(bmp.size() + rowBytes - (size_t)width * 3);
+  }
+  return bmp;
+}
+
+// An uncompressed 32 bit TGA with the rows bottom-up, the default origin
+std::vector<unsigned char> encodeTga(const std::vector<unsigned char>& rgba, int width, int height)
+{
+  std::vector<unsigned char> tga = { 0, 0, 2 };
+  tga.resize(12);
+  appendLittleEndian(tga, width, 2);
+  appendLittleEndian(tga, height, 2);
+  tga.push_back(32);
+  tga.push_back(8);
+
+  for (int y = height - 1; y >= 0; y--)
+  {
+    const unsigned char* row = &rgba[(size_t)y * width * 4];
+    for (int x = 0; x < width; x++)
+    {
+      tga.push_back(row[x * 4 + 2]);
+      tga.push_back(row[x * 4 + 1]);
+      tga.push_back(row[x * 4 + 0]);
+      tga.push_back(row[x * 4 + 3]);
+    }
+  }
+  return tga;
+}
+
+std::vector<SourceImage> readImages(const std::string& directory)
+{
+  std::vector<SourceImage> images;
+  std::error_code error;
+  for (const fs::directory_entry& entry : fs::directory_iterator(directory, error))
+  {
+    if (!entry.is_regular_file()) continue;
+
+    std::ifstream file(entry.path(), std::ios::binary);
+    SourceImage image = { entry.path().generic_string(),
+                          std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()) };
+    int width, height, channels;
+    if (stbi_info_from_memory(image.bytes.data(), (int)image.bytes.size(), &width, &height, &channels)) images.push_back(std::move(image));
+  }
+  std::sort(images.begin(), images.end(), [](const SourceImage& a, const SourceImage& b) { return a.name < b.name; });
+
+  const int size = 2048;
+  images.push_back({ "2048x2048 bmp", encodeBmp(syntheticImage(size, size, 3), size, size) });
+  images.push_back({ "2048x2048 tga", encodeTga(syntheticImage(size, size, 4), size, size) });
+  return images;
+}
+
+// Swaps the rows in a separate pass after decoding, like stb_image did for every flipped image before
+void flipRows(std::vector<unsigned char>& pixels, int height)
+{
+  size_t rowBytes = pixels.size() / height;
+  std::vector<unsigned char> temp(rowBytes);
+  for (int y = 0; y < height / 2; y++)
+  {
+    unsigned char* top = &pixels[y * rowBytes];
+    unsigned char* bottom = &pixels[(height - 1 - y) * rowBytes];
+    memcpy(temp.data(), top, rowBytes);
+    memcpy(top, bottom, rowBytes);
+    memcpy(bottom, temp.data(), rowBytes);
+  }
+}
+
+// Fastest of iterations decodes, the pixels of the last one are kept, flipped afterwards if postFlip
+bool timeDecode(const SourceImage& image, int channels, bool flip, bool postFlip, int iterations, Decoded& decoded)
+{
+  stbi_set_flip_vertically_on_load(flip);
+  for (int i = 0; i < iterations; i++)
+  {
+    int width, height, fileChannels;
+    auto start = std::chrono::steady_clock::now();
+    unsigned char* pixels = stbi_load_from_memory(image.bytes.data(), (int)image.bytes.size(), &width, &height, &fileChannels, channels);
+    if (!pixels)
+    {
+      std::cerr << "Failed to decode " << image.name << ": " << stbi_failure_reason() << std::endl;
+      stbi_set_flip_vertically_on_load(false);
+      return false;
+    }
+    decoded.pixels.assign(pixels, pixels + (size_t)width * height * (channels ? channels : fileChannels));
+    stbi_image_free(pixels);
+    if (postFlip) flipRows(decoded.pixels, height);
+    decoded.milliseconds = std::min(decoded.milliseconds, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+  stbi_set_flip_vertically_on_load(false);
+  return true;
+}
+
+}
+
+bool runFlipBenchmark(const std::string& directory, int iterations)
+{
+  std::vector<SourceImage> images = readImages(directory);
+  bool success = true;
+
+  std::cout << std::left << std::setw(40) << "image" << std::right << std::setw(10) << "channels" << std::setw(12) << "no flip ms"
+            << std::setw(12) << "flip ms" << std::setw(14) << "post flip ms" << "   pixels" << std::endl;
+
+  for (const SourceImage& image : images)
+  {
+    for (int channels : { 0, 4 })
+    {
+      // Every path copies the pixels out of stb_image's buffer, so only the flip differs
+      Decoded plain, fused, separate;
+      if (!timeDecode(image, channels, false, false, iterations, plain) || !timeDecode(image, channels, true, false, iterations, fused) ||
+          !timeDecode(image, channels, false, true, iterations, separate))
+        return false;
+
+      bool match = fused.pixels == separate.pixels;
+      success = match && success;
+      std::cout << std::left << std::setw(40) << image.name << std::right << std::setw(10) << (channels ? "rgba" : "file")
+                << std::fixed << std::setprecision(3) << std::setw(12) << plain.milliseconds << std::setw(12) << fused.milliseconds
+                << std::setw(14) << separate.milliseconds << "   " << (match ? "ok" : "MISMATCH") << std::endl;
+      std::cout.unsetf(std::ios::floatfield);
+    }
+  }
+
+  return success;
+}
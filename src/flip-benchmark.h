@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+/**
+ * Decodes every image in directory and a synthetic BMP and TGA with stb_image, each as stored and as RGBA,
+ * without flipping, with stb_image flipping the rows as it writes them, and without flipping followed by
+ * a separate pass that swaps the rows, which is what flipping on load used to cost
+ *
+ * Prints the fastest of iterations decodes for each and checks both flipped results are the same
+ *
+ * Returns false if an image failed to decode or the two flipped results disagree
+*/
+bool runFlipBenchmark(const std::string& directory, int iterations);
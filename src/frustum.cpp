@@ -0,0 +1,44 @@
+#include "frustum.h"
+
+Frustum extractFrustum(const glm::mat4& viewProjection)
+{
+  // glm matrices are column major, the planes are built from the rows
+  glm::vec4 row0 = glm::vec4(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+  glm::vec4 row1 = glm::vec4(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+  glm::vec4 row2 = glm::vec4(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+  glm::vec4 row3 = glm::vec4(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+  // A point is inside when -w <= x, y, z <= w in clip space, each inequality is one plane
+  Frustum frustum;
+  frustum.planes[0] = row3 + row0;
+  frustum.planes[1] = row3 - row0;
+  frustum.planes[2] = row3 + row1;
+  frustum.planes[3] = row3 - row1;
+  frustum.planes[4] = row3 + row2;
+  frustum.planes[5] = row3 - row2;
+
+  // Normalize so the plane equation gives real distances, needed to compare against a sphere radius
+  for (glm::vec4& plane : frustum.planes) plane /= glm::length(glm::vec3(plane));
+
+  return frustum;
+}
+
+bool sphereInFrustum(const Frustum& frustum, const glm::vec3& center, float radius)
+{
+  for (const glm::vec4& plane : frustum.planes)
+  {
+    if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+  }
+  return true;
+}
+
+bool boxInFrustum(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max)
+{
+  for (const glm::vec4& plane : frustum.planes)
+  {
+    // The corner farthest along the normal, if it is behind the plane the whole box is
+    glm::vec3 corner(plane.x >= 0 ? max.x : min.x, plane.y >= 0 ? max.y : min.y, plane.z >= 0 ? max.z : min.z);
+    if (glm::dot(glm::vec3(plane), corner) + plane.w < 0) return false;
+  }
+  return true;
+}
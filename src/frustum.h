@@ -0,0 +1,25 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/**
+ * The six planes of a view frustum: left, right, bottom, top, near, far
+ * Each plane is (normal, distance) with the normal pointing into the frustum and normalized,
+ * so dot(normal, point) + distance is the signed distance of a point to the plane
+*/
+struct Frustum
+{
+  glm::vec4 planes[6];
+};
+
+/**
+ * Extracts the frustum planes from a combined projection * view (* model) matrix (Gribb/Hartmann)
+ * The planes are in the space the matrix transforms from, e.g. world space for projection * view
+*/
+Frustum extractFrustum(const glm::mat4& viewProjection);
+
+// True if any part of the sphere is inside the frustum
+bool sphereInFrustum(const Frustum& frustum, const glm::vec3& center, float radius);
+
+// True unless the box is entirely behind one of the planes, boxes near the corners of the frustum can pass without being inside
+bool boxInFrustum(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max);
@@ -0,0 +1,292 @@
+#include "gif-benchmark.h"
+
+#include "benchmark-helpers.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+struct SourceImage
+{
+  std::string name;
+  std::vector<unsigned char> bytes;
+};
+
+// Times are the fastest of all iterations, the rest is from the last one
+struct DecodeResult
+{
+  double milliseconds = 1e30;
+  std::uint64_t peakBytes = 0;
+  std::uint64_t uploadBytes = 0;
+  int frames = 0;
+};
+
+void appendLittleEndian(std::vector<unsigned char>& output, std::uint32_t value, int bytes)
+{
+  for (int i = 0; i < bytes; i++) output.push_back((unsigned char)(value >> (8 * i)));
+}
+
+/**
+ * Appends one frame of 8 bit palette indices as a graphic control extension and an image
+ * The LZW stream only holds literal codes and sends a clear code before the table would need 10 bit codes,
+ * so it stays 9 bits per pixel without having to build the string table
+*/
+void appendGifFrame(std::vector<unsigned char>& gif, const std::vector<unsigned char>& indices, int x, int y, int width, int height,
+                    int disposal, int transparent, int delay)
+{
+  gif.insert(gif.end(), { 0x21, 0xF9, 4, (unsigned char)((disposal << 2) | (transparent >= 0 ? 1 : 0)) });
+  appendLittleEndian(gif, delay / 10, 2);
+  gif.push_back((unsigned char)(transparent >= 0 ? transparent : 0));
+  gif.push_back(0);
+
+  gif.push_back(0x2C);
+  appendLittleEndian(gif, x, 2);
+  appendLittleEndian(gif, y, 2);
+  appendLittleEndian(gif, width, 2);
+  appendLittleEndian(gif, height, 2);
+  gif.push_back(0);
+
+  const int clearCode = 256, endCode = 257, literalsPerClear = 254;
+  std::vector<unsigned char> codes;
+  std::uint32_t bits = 0;
+  int bitCount = 0;
+  auto emit = [&](int code)
+  {
+    bits |= (std::uint32_t)code << bitCount;
+    for (bitCount += 9; bitCount >= 8; bitCount -= 8, bits >>= 8) codes.push_back((unsigned char)bits);
+  };
+  for (size_t i = 0; i < indices.size(); i++)
+  {
+    if (i % literalsPerClear == 0) emit(clearCode);
+    emit(indices[i]);
+  }
+  emit(endCode);
+  if (bitCount > 0) codes.push_back((unsigned char)bits);
+
+  gif.push_back(8);
+  for (size_t offset = 0; offset < codes.size(); offset += 255)
+  {
+    size_t length = std::min<size_t>(255, codes.size() - offset);
+    gif.push_back((unsigned char)length);
+    gif.insert(gif.end(), codes.begin() + offset, codes.begin() + offset + length);
+  }
+  gif.push_back(0);
+}
+
+/**
+ * A still background with a round sprite crossing it, drawn like animation tools write GIFs:
+ * every frame after the first only holds the sprite's box, transparent around the sprite, and is disposed
+ * by restoring what was under it; every eighth frame also changes a counter box that stays
+*/
+std::vector<unsigned char> encodeSyntheticGif(int size, int frameCount)
+{
+  std::vector<unsigned char> gif = { 'G', 'I', 'F', '8', '9', 'a' };
+  appendLittleEndian(gif, size, 2);
+  appendLittleEndian(gif, size, 2);
+  gif.insert(gif.end(), { 0xF7, 0, 0 });
+  for (int i = 0; i < 256; i++) gif.insert(gif.end(), { (unsigned char)i, (unsigned char)(255 - i), (unsigned char)(i * 7) });
+
+  std::vector<unsigned char> background((size_t)size * size);
+  for (int y = 0; y < size; y++)
+  {
+    for (int x = 0; x < size; x++) background[(size_t)y * size + x] = (unsigned char)(1 + ((x / 16 + y / 16) % 2) * 64 + (x + y) % 60);
+  }
+  appendGifFrame(gif, background, 0, 0, size, size, 1, -1, 40);
+
+  const int sprite = 48, counter = 24;
+  for (int frame = 1; frame < frameCount; frame++)
+  {
+    if (frame % 8 == 0)
+    {
+      std::vector<unsigned char> box((size_t)counter * counter, (unsigned char)(200 + frame / 8 % 50));
+      appendGifFrame(gif, box, size - counter - 4, 4, counter, counter, 1, -1, 0);
+    }
+
+    int x = (frame * 9) % (size - sprite), y = (size - sprite) / 2 + (int)((frame * 13) % 64) - 32;
+    std::vector<unsigned char> pixels((size_t)sprite * sprite);
+    for (int j = 0; j < sprite; j++)
+    {
+      for (int i = 0; i < sprite; i++)
+      {
+        int dx = 2 * i - sprite + 1, dy = 2 * j - sprite + 1;
+        pixels[(size_t)j * sprite + i] = dx * dx + dy * dy < sprite * sprite ? (unsigned char)(130 + (i + j) / 4) : 0;
+      }
+    }
+    appendGifFrame(gif, pixels, x, y, sprite, sprite, 2, 0, 40);
+  }
+
+  gif.push_back(0x3B);
+  return gif;
+}
+
+std::vector<SourceImage> readImages(const std::string& directory)
+{
+  std::vector<SourceImage> images;
+  std::error_code error;
+  for (const fs::directory_entry& entry : fs::directory_iterator(directory, error))
+  {
+    if (!entry.is_regular_file() || entry.path().extension() != ".gif") continue;
+
+    std::ifstream file(entry.path(), std::ios::binary);
+    images.push_back({ entry.path().generic_string(),
+                       std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()) });
+  }
+  std::sort(images.begin(), images.end(), [](const SourceImage& a, const SourceImage& b) { return a.name < b.name; });
+  return images;
+}
+
+// Decodes all frames at once, the frames of the last iteration are kept for comparing
+bool decodeWhole(const SourceImage& image, int iterations, HeapTracker& heap, DecodeResult& result, std::vector<unsigned char>& frames, int& width, int& height)
+{
+  for (int i = 0; i < iterations; i++)
+  {
+    int* delays = nullptr;
+    int channels;
+    heap.resetPeak();
+    std::uint64_t start = heap.live();
+    auto time = std::chrono::steady_clock::now();
+    unsigned char* pixels = stbi_load_gif_from_memory(image.bytes.data(), (int)image.bytes.size(), &delays, &width, &height, &result.frames, &channels, 4);
+    result.milliseconds = std::min(result.milliseconds, millisecondsSince(time));
+    result.peakBytes = heap.peak() - start;
+    if (!pixels)
+    {
+      std::cerr << "Failed to decode " << image.name << ": " << stbi_failure_reason() << std::endl;
+      return false;
+    }
+    result.uploadBytes = (std::uint64_t)width * height * 4 * result.frames;
+    frames.assign(pixels, pixels + result.uploadBytes);
+    heap.release(pixels);
+    heap.release(delays);
+  }
+  return true;
+}
+
+// Decodes frame by frame and packs the changed rectangles one after the other, like TextureLoader does
+bool decodeFrames(const SourceImage& image, int iterations, HeapTracker& heap, DecodeResult& result)
+{
+  std::vector<unsigned char> packed;
+  for (int i = 0; i < iterations; i++)
+  {
+    int width, height, frameCount;
+    heap.resetPeak();
+    std::uint64_t start = heap.live();
+    auto time = std::chrono::steady_clock::now();
+    stbi_gif_frames* frames = stbi_gif_frames_open_memory(image.bytes.data(), (int)image.bytes.size(), &width, &height, &frameCount);
+    if (!frames)
+    {
+      std::cerr << "Failed to open " << image.name << ": " << stbi_failure_reason() << std::endl;
+      return false;
+    }
+
+    packed.clear();
+    result.frames = 0;
+    stbi_gif_frame frame;
+    int status;
+    while ((status = stbi_gif_frames_next(frames, &frame)) > 0)
+    {
+      for (int y = frame.y0; y < frame.y1; y++)
+      {
+        const unsigned char* row = frame.pixels + ((size_t)y * width + frame.x0) * 4;
+        packed.insert(packed.end(), row, row + (frame.x1 - frame.x0) * 4);
+      }
+      result.frames++;
+    }
+    stbi_gif_frames_close(frames);
+    result.milliseconds = std::min(result.milliseconds, millisecondsSince(time));
+    result.peakBytes = heap.peak() - start;
+    result.uploadBytes = packed.size();
+
+    if (status < 0 || result.frames != frameCount)
+    {
+      std::cerr << "Failed to decode " << image.name << " frame by frame: " << stbi_failure_reason() << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Every frame has to match the whole decode, and outside its rectangle also the frame before
+bool compareFrames(const SourceImage& image, const std::vector<unsigned char>& whole, int frameCount)
+{
+  int width, height;
+  stbi_gif_frames* frames = stbi_gif_frames_open_memory(image.bytes.data(), (int)image.bytes.size(), &width, &height, nullptr);
+  if (!frames) return false;
+
+  size_t frameBytes = (size_t)width * height * 4;
+  stbi_gif_frame frame;
+  int index = 0;
+  bool match = true;
+  while (match && stbi_gif_frames_next(frames, &frame) > 0)
+  {
+    match = index < frameCount && memcmp(frame.pixels, &whole[index * frameBytes], frameBytes) == 0;
+    for (int y = 0; match && index > 0 && y < height; y++)
+    {
+      for (int x = 0; match && x < width; x++)
+      {
+        bool inside = x >= frame.x0 && x < frame.x1 && y >= frame.y0 && y < frame.y1;
+        size_t pixel = ((size_t)y * width + x) * 4;
+        match = inside || memcmp(&whole[index * frameBytes + pixel], &whole[(index - 1) * frameBytes + pixel], 4) == 0;
+      }
+    }
+    index++;
+  }
+  stbi_gif_frames_close(frames);
+  return match && index == frameCount;
+}
+
+}
+
+bool runGifBenchmark(const std::string& directory, int iterations)
+{
+  // 120 sprite positions, plus a counter frame every eighth
+  const int syntheticSize = 512, syntheticFrames = 120;
+
+  std::vector<SourceImage> images = readImages(directory);
+  images.push_back({ std::to_string(syntheticSize) + "x" + std::to_string(syntheticSize) + " animated gif", encodeSyntheticGif(syntheticSize, syntheticFrames) });
+
+  std::cout << std::left << std::setw(36) << "image" << std::right << std::setw(8) << "frames" << std::setw(11) << "whole ms"
+            << std::setw(11) << "frames ms" << std::setw(15) << "whole peak KB" << std::setw(16) << "frames peak KB"
+            << std::setw(15) << "whole up KB" << std::setw(15) << "rects up KB" << "   pixels" << std::endl;
+
+  // Every allocation stb_image makes on this thread goes through heap until the end of the run
+  HeapTracker heap;
+  stbi_set_allocator_thread(heap.allocator());
+
+  bool success = true;
+  for (const SourceImage& image : images)
+  {
+    DecodeResult whole, frames;
+    std::vector<unsigned char> wholeFrames;
+    int width, height;
+    if (!decodeWhole(image, iterations, heap, whole, wholeFrames, width, height) || !decodeFrames(image, iterations, heap, frames))
+    {
+      success = false;
+      break;
+    }
+
+    bool match = frames.frames == whole.frames && compareFrames(image, wholeFrames, whole.frames);
+    success = match && success;
+
+    std::cout << std::left << std::setw(36) << image.name << std::right << std::setw(8) << whole.frames << std::fixed << std::setprecision(3)
+              << std::setw(11) << whole.milliseconds << std::setw(11) << frames.milliseconds << std::setw(15) << whole.peakBytes / 1024
+              << std::setw(16) << frames.peakBytes / 1024 << std::setw(15) << whole.uploadBytes / 1024 << std::setw(15)
+              << frames.uploadBytes / 1024 << "   " << (match ? "ok" : "MISMATCH") << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+  }
+
+  stbi_set_allocator_thread(nullptr);
+  return success;
+}
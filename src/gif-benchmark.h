@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+/**
+ * Decodes every GIF in directory and a synthetic animation (a sprite moving over a still background) with
+ * stbi_load_gif_from_memory and frame by frame with stbi_gif_frames, and prints the time and peak heap of each,
+ * and how many bytes uploading only the changed rectangles sends compared to uploading every frame whole
+ *
+ * Returns false if a GIF failed to decode, a frame differs between the two, or a pixel outside a frame's
+ * rectangle changed
+*/
+bool runGifBenchmark(const std::string& directory, int iterations);
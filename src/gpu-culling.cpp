@@ -0,0 +1,113 @@
+#include "gpu-culling.h"
+#include "shader.h"
+
+#include <glad/glad.h>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+// Must match local_size_x in cull-compute-shader.glsl
+static const int CULL_WORKGROUP_SIZE = 256;
+
+bool createGpuCulling(GpuCulling& culling, const ProgramCache& programCache)
+{
+  ProgramLoadResult programLoad = loadComputeProgram(programCache, readFile("shaders/cull-compute-shader.glsl"));
+  if (!programLoad.program)
+  {
+    std::cerr << "Failed to create culling program" << std::endl;
+    return false;
+  }
+
+  ShaderProgram cullProgram = reflectProgram(programLoad.program);
+  culling.program = cullProgram.id;
+  culling.frustumPlanesLocation = cullProgram.uniformLocation("u_frustumPlanes");
+  culling.instanceCountLocation = cullProgram.uniformLocation("u_instanceCount");
+
+  glGenBuffers(1, &culling.boundsBuffer);
+  glGenBuffers(1, &culling.visibleBuffer);
+  glGenBuffers(1, &culling.commandBuffer);
+  glGenBuffers(1, &culling.drawCountBuffer);
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culling.commandBuffer);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_PARAMETER_BUFFER, culling.drawCountBuffer);
+  glBufferData(GL_PARAMETER_BUFFER, sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+
+  return true;
+}
+
+void destroyGpuCulling(GpuCulling& culling)
+{
+  glDeleteProgram(culling.program);
+  glDeleteBuffers(1, &culling.boundsBuffer);
+  glDeleteBuffers(1, &culling.visibleBuffer);
+  glDeleteBuffers(1, &culling.commandBuffer);
+  glDeleteBuffers(1, &culling.drawCountBuffer);
+  culling = GpuCulling();
+}
+
+void setCullingInstances(GpuCulling& culling, const std::vector<glm::mat4>& transforms, float boundingRadius, int indexCount)
+{
+  culling.instanceCount = (int)transforms.size();
+  culling.indexCount = indexCount;
+
+  // The sphere follows the instance's translation and grows with its largest scale
+  std::vector<glm::vec4> bounds;
+  bounds.reserve(transforms.size());
+  for (const glm::mat4& transform : transforms)
+  {
+    float scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) });
+    bounds.push_back(glm::vec4(glm::vec3(transform[3]), boundingRadius * scale));
+  }
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, culling.boundsBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, bounds.size() * sizeof(glm::vec4), bounds.data(), GL_STATIC_DRAW);
+
+  // Worst case everything is visible
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, culling.visibleBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, transforms.size() * sizeof(glm::mat4), NULL, GL_DYNAMIC_COPY);
+}
+
+void cullInstances(const GpuCulling& culling, unsigned int instanceBuffer, const Frustum& frustum)
+{
+  // Start from an empty command, the shader counts the visible instances into instanceCount
+  DrawElementsIndirectCommand command = { (unsigned int)culling.indexCount, 0, 0, 0, 0 };
+  unsigned int drawCount = 0;
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culling.commandBuffer);
+  glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(command), &command);
+  glBindBuffer(GL_PARAMETER_BUFFER, culling.drawCountBuffer);
+  glBufferSubData(GL_PARAMETER_BUFFER, 0, sizeof(drawCount), &drawCount);
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, culling.boundsBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instanceBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, culling.visibleBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, culling.commandBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, culling.drawCountBuffer);
+
+  glUseProgram(culling.program);
+  glUniform4fv(culling.frustumPlanesLocation, 6, glm::value_ptr(frustum.planes[0]));
+  glUniform1ui(culling.instanceCountLocation, (unsigned int)culling.instanceCount);
+  glDispatchCompute((culling.instanceCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+  // The draw reads the command + count as indirect parameters and the visible transforms as vertex attributes
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void drawCulledInstances(const GpuCulling& culling, unsigned int vao)
+{
+  glBindVertexArray(vao);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culling.commandBuffer);
+  glBindBuffer(GL_PARAMETER_BUFFER, culling.drawCountBuffer);
+
+  /**
+   * first argument: the type of primitive we would like to draw
+   * second argument: the type of the indices
+   * third argument: offset of the first command in the draw indirect buffer
+   * fourth argument: offset of the draw count in the parameter buffer
+   * fifth argument: the most commands that will be drawn
+   * sixth argument: space between commands, 0 means tightly packed
+   */
+  glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, 0, 1, 0);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "frustum.h"
+#include "program-cache.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Layout of one command in the GL_DRAW_INDIRECT_BUFFER, defined by OpenGL
+struct DrawElementsIndirectCommand
+{
+  unsigned int count;
+  unsigned int instanceCount;
+  unsigned int firstIndex;
+  int baseVertex;
+  unsigned int baseInstance;
+};
+
+/**
+ * Frustum culling of instances on the GPU
+ * A compute shader tests each instance's bounding sphere and appends the visible transforms to a compacted buffer,
+ * counting them into an indirect draw command, so the draw is issued with glMultiDrawElementsIndirectCount
+ * and the CPU never touches individual instances
+*/
+struct GpuCulling
+{
+  unsigned int program = 0;
+  int frustumPlanesLocation = -1;
+  int instanceCountLocation = -1;
+
+  unsigned int boundsBuffer = 0;
+  unsigned int visibleBuffer = 0;
+  unsigned int commandBuffer = 0;
+  unsigned int drawCountBuffer = 0;
+
+  int instanceCount = 0;
+  int indexCount = 0;
+};
+
+bool createGpuCulling(GpuCulling& culling, const ProgramCache& programCache);
+void destroyGpuCulling(GpuCulling& culling);
+
+/**
+ * (Re)creates the per instance buffers
+ * boundingRadius is the radius of the mesh's bounding sphere around its origin
+ * The visible transforms end up in culling.visibleBuffer, attach it to the mesh's vertex array as its instance buffer
+*/
+void setCullingInstances(GpuCulling& culling, const std::vector<glm::mat4>& transforms, float boundingRadius, int indexCount);
+
+// Runs the culling pass, frustum must be in the space of the instance transforms
+// The culling program is left in use, switch back to the render program before drawing
+void cullInstances(const GpuCulling& culling, unsigned int instanceBuffer, const Frustum& frustum);
+
+// Draws the instances that survived the last cullInstances with the mesh's vertex array
+void drawCulledInstances(const GpuCulling& culling, unsigned int vao);
@@ -0,0 +1,278 @@
+#include "hdr-benchmark.h"
+
+// A private copy of stb_image with internal linkage, so its static conversions can be called directly
+// main.cpp holds the copy the rest of the program uses
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#include "stb_image.h"
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct Rng
+{
+  std::uint32_t state = 12345;
+  std::uint32_t next() { return state = state * 1664525u + 1013904223u; }
+  float uniform() { return (next() >> 8) / 16777216.0f; }
+};
+
+// Fastest of iterations runs of body in milliseconds, setup runs before each one untimed
+template <typename Setup, typename Body>
+double timeRuns(int iterations, Setup setup, Body body)
+{
+  double best = 1e30;
+  for (int i = 0; i < iterations; i++)
+  {
+    setup();
+    auto start = std::chrono::steady_clock::now();
+    body();
+    best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+void printHeader()
+{
+  std::cout << std::left << std::setw(36) << "conversion" << std::right << std::setw(12) << "old ms" << std::setw(12) << "new ms"
+            << std::setw(10) << "speedup" << std::setw(14) << "off by one" << "   result" << std::endl;
+}
+
+void printRow(const std::string& name, double before, double after, size_t offByOne, size_t count, bool ok)
+{
+  std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(3) << std::setw(12) << before
+            << std::setw(12) << after << std::setprecision(2) << std::setw(9) << before / after << "x" << std::setprecision(4)
+            << std::setw(13) << 100.0 * offByOne / count << "%" << "   " << (ok ? "ok" : "FAILED") << std::endl;
+  std::cout.unsetf(std::ios::floatfield);
+}
+
+// The conversions as stb_image did them before, one ldexp or pow per sample
+void referenceRgbe(float* output, const stbi_uc* input, int count, int comp)
+{
+  for (int i = 0; i < count; i++, input += 4, output += comp)
+  {
+    if (input[3] != 0)
+    {
+      float f1 = (float)ldexp(1.0f, input[3] - (int)(128 + 8));
+      if (comp <= 2) output[0] = (input[0] + input[1] + input[2]) * f1 / 3;
+      else
+      {
+        output[0] = input[0] * f1;
+        output[1] = input[1] * f1;
+        output[2] = input[2] * f1;
+      }
+      if (comp == 2) output[1] = 1;
+      if (comp == 4) output[3] = 1;
+    }
+    else
+    {
+      for (int k = 0; k < comp; k++) output[k] = (comp == 2 || comp == 4) && k == comp - 1 ? 1.0f : 0.0f;
+    }
+  }
+}
+
+void referenceLdrToHdr(float* output, const stbi_uc* data, size_t pixels, int comp, float gamma, float scale)
+{
+  int n = (comp & 1) ? comp : comp - 1;
+  for (size_t i = 0; i < pixels; i++)
+  {
+    for (int k = 0; k < n; k++) output[i * comp + k] = (float)(pow(data[i * comp + k] / 255.0f, gamma) * scale);
+    if (n < comp) output[i * comp + n] = data[i * comp + n] / 255.0f;
+  }
+}
+
+void referenceHdrToLdr(stbi_uc* output, const float* data, size_t pixels, int comp, float gammaInverse, float scaleInverse)
+{
+  int n = (comp & 1) ? comp : comp - 1;
+  for (size_t i = 0; i < pixels; i++)
+  {
+    for (int k = 0; k < comp; k++)
+    {
+      float value = data[i * comp + k];
+      float z = (k < n ? (float)pow(value * scaleInverse, gammaInverse) : value) * 255 + 0.5f;
+      if (z < 0) z = 0;
+      if (z > 255) z = 255;
+      output[i * comp + k] = (stbi_uc)(int)z;
+    }
+  }
+}
+
+// Exponents around 128 as in real images, with some dark, black and denormal pixels among them
+std::vector<stbi_uc> randomRgbe(int count)
+{
+  std::vector<stbi_uc> rgbe((size_t)count * 4);
+  Rng rng;
+  for (int i = 0; i < count; i++)
+  {
+    std::uint32_t bits = rng.next();
+    for (int k = 0; k < 3; k++) rgbe[i * 4 + k] = (stbi_uc)(rng.next() >> 24);
+    int exponent = 120 + (int)(bits % 16);
+    if ((bits >> 8) % 64 == 0) exponent = (int)((bits >> 16) % 12);
+    rgbe[i * 4 + 3] = (stbi_uc)exponent;
+  }
+  return rgbe;
+}
+
+bool benchmarkRgbe(int iterations)
+{
+  const int width = 4096, rows = 256;
+  std::vector<stbi_uc> rgbe = randomRgbe(width * rows);
+  bool success = true;
+
+  for (int comp = 1; comp <= 4; comp++)
+  {
+    std::vector<float> before((size_t)width * rows * comp), after(before.size());
+    double oldTime = timeRuns(iterations, [] {}, [&]
+    {
+      for (int y = 0; y < rows; y++) referenceRgbe(&before[(size_t)y * width * comp], &rgbe[(size_t)y * width * 4], width, comp);
+    });
+    double newTime = timeRuns(iterations, [] {}, [&]
+    {
+      for (int y = 0; y < rows; y++) stbi__hdr_convert_row(&after[(size_t)y * width * comp], &rgbe[(size_t)y * width * 4], width, comp);
+    });
+
+    bool match = memcmp(before.data(), after.data(), before.size() * sizeof(float)) == 0;
+    success = match && success;
+    printRow("rgbe to float, " + std::to_string(comp) + " channels", oldTime, newTime, 0, before.size(), match);
+  }
+  return success;
+}
+
+bool benchmarkLdrToHdr(int iterations)
+{
+  const size_t pixels = 2048 * 1024;
+  Rng rng;
+  bool success = true;
+
+  for (int comp : { 3, 4 })
+  {
+    std::vector<stbi_uc> ldr(pixels * comp);
+    for (stbi_uc& value : ldr) value = (stbi_uc)(rng.next() >> 24);
+    std::vector<float> before(ldr.size());
+    float* after = nullptr;
+    stbi_uc* input = nullptr;
+
+    stbi_ldr_to_hdr_gamma(2.2f);
+    stbi_ldr_to_hdr_scale(1.0f);
+    double oldTime = timeRuns(iterations, [] {}, [&] { referenceLdrToHdr(before.data(), ldr.data(), pixels, comp, 2.2f, 1.0f); });
+    // stbi__ldr_to_hdr frees its input, so every run gets a fresh copy
+    double newTime = timeRuns(iterations, [&]
+    {
+      stbi_image_free(after);
+      input = (stbi_uc*)malloc(ldr.size());
+      memcpy(input, ldr.data(), ldr.size());
+    }, [&] { after = stbi__ldr_to_hdr(input, (int)pixels, 1, comp); });
+
+    bool match = after && memcmp(before.data(), after, before.size() * sizeof(float)) == 0;
+    success = match && success;
+    stbi_image_free(after);
+    printRow("8 bit to float, " + std::to_string(comp) + " channels", oldTime, newTime, 0, before.size(), match);
+  }
+  return success;
+}
+
+// A dense sweep of the values that matter for 8 bit output, a wide logarithmic spread and some special values
+// The RGBE decoder never gives negative values, -infinity (where pow is infinity, not NaN) is left out
+std::vector<float> sweepInputs(size_t count)
+{
+  std::vector<float> values(count);
+  Rng rng;
+  for (size_t i = 0; i < count; i++)
+  {
+    if (i % 2 == 0) values[i] = 1.25f * i / count;
+    else values[i] = std::exp2(-20.0f + 30.0f * rng.uniform());
+  }
+  const float special[] = { 0.0f, -0.0f, -1.0f, 1e-40f, 1.0f, 255.0f, std::numeric_limits<float>::infinity(),
+                            std::numeric_limits<float>::quiet_NaN() };
+  std::copy(std::begin(special), std::end(special), values.begin());
+  return values;
+}
+
+bool benchmarkHdrToLdr(int iterations)
+{
+  const size_t pixels = 1024 * 1024;
+  struct Setting
+  {
+    float gamma;
+    float scale;
+  };
+  const Setting settings[] = { { 2.2f, 1.0f }, { 1.0f, 1.0f }, { 2.4f, 0.5f }, { 1.8f, 4.0f } };
+  bool success = true;
+
+  for (int comp : { 3, 4 })
+  {
+    std::vector<float> hdr = sweepInputs(pixels * comp);
+    for (const Setting& setting : settings)
+    {
+      std::vector<stbi_uc> before(hdr.size());
+      stbi_uc* after = nullptr;
+      float* input = nullptr;
+
+      stbi_hdr_to_ldr_gamma(setting.gamma);
+      stbi_hdr_to_ldr_scale(setting.scale);
+      double oldTime = timeRuns(iterations, [] {}, [&]
+      {
+        referenceHdrToLdr(before.data(), hdr.data(), pixels, comp, 1 / setting.gamma, 1 / setting.scale);
+      });
+      // stbi__hdr_to_ldr frees its input, so every run gets a fresh copy
+      double newTime = timeRuns(iterations, [&]
+      {
+        stbi_image_free(after);
+        input = (float*)malloc(hdr.size() * sizeof(float));
+        memcpy(input, hdr.data(), hdr.size() * sizeof(float));
+      }, [&] { after = stbi__hdr_to_ldr(input, (int)pixels, 1, comp); });
+
+      // Gamma 1 skips the polynomial pow and must match exactly
+      int tolerance = setting.gamma == 1.0f ? 0 : 1;
+      size_t offByOne = 0;
+      bool ok = after != nullptr;
+      for (size_t i = 0; ok && i < before.size(); i++)
+      {
+        int difference = std::abs(before[i] - after[i]);
+        offByOne += difference == 1;
+        ok = difference <= tolerance;
+      }
+      success = ok && success;
+      stbi_image_free(after);
+
+      std::ostringstream name;
+      name << "float to 8 bit, " << comp << " ch, g " << setting.gamma << " s " << setting.scale;
+      printRow(name.str(), oldTime, newTime, offByOne, before.size(), ok);
+    }
+  }
+
+  stbi_hdr_to_ldr_gamma(2.2f);
+  stbi_hdr_to_ldr_scale(1.0f);
+  return success;
+}
+
+}
+
+bool runHdrBenchmark(int iterations)
+{
+  printHeader();
+  bool success = benchmarkRgbe(iterations);
+  success = benchmarkLdrToHdr(iterations) && success;
+  success = benchmarkHdrToLdr(iterations) && success;
+  return success;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+/**
+ * Times stb_image's Radiance RGBE to float conversion and its 8 bit to float and float to 8 bit conversions
+ * against the ldexp and pow loops they replaced, on random but deterministic input
+ *
+ * RGBE decoding and 8 bit to float must give exactly the same floats as the old loops
+ * Float to 8 bit uses a polynomial pow, it may be one off where pow lands within a few thousandths of a rounding
+ * boundary and never more, which is checked over a sweep of inputs for several gamma and scale settings; gamma 1 skips
+ * the pow and must match exactly
+ *
+ * Returns false if any conversion is outside those bounds
+*/
+bool runHdrBenchmark(int iterations);
@@ -0,0 +1,206 @@
+#include "headless-context.h"
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#if defined(__linux__)
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#if defined(__linux__)
+
+bool createHeadlessContext(HeadlessContext& headless)
+{
+  // Ask Mesa for a display that does not need a window system (EGL_MESA_platform_surfaceless)
+  EGLDisplay display = EGL_NO_DISPLAY;
+  auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (getPlatformDisplay) display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  EGLint major, minor;
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+  {
+    std::cerr << "Failed to initialize EGL display" << std::endl;
+    return false;
+  }
+
+  if (!eglBindAPI(EGL_OPENGL_API))
+  {
+    std::cerr << "EGL does not support desktop OpenGL" << std::endl;
+    eglTerminate(display);
+    return false;
+  }
+
+  // We never render to an EGL surface, the config only has to be able to create a desktop GL context
+  EGLint configAttributes[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_NONE
+  };
+  EGLConfig config;
+  EGLint configCount = 0;
+  eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+
+  // Same version and profile the windowed path asks GLFW for: OpenGL 4.6 Core
+  EGLint contextAttributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 4,
+    EGL_CONTEXT_MINOR_VERSION, 6,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+  EGLContext context = eglCreateContext(display, configCount > 0 ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes);
+  if (context == EGL_NO_CONTEXT)
+  {
+    std::cerr << "Failed to create an OpenGL 4.6 Core EGL context (EGL error 0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+    std::cerr << "Older Mesa drivers may need MESA_GL_VERSION_OVERRIDE=4.6 MESA_GLSL_VERSION_OVERRIDE=460" << std::endl;
+    eglTerminate(display);
+    return false;
+  }
+
+  // Make the context current without a surface (EGL_KHR_surfaceless_context)
+  if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+  {
+    std::cerr << "Failed to make the EGL context current" << std::endl;
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    return false;
+  }
+
+  headless.display = display;
+  headless.context = context;
+  return true;
+}
+
+void destroyHeadlessContext(HeadlessContext& headless)
+{
+  if (!headless.display) return;
+
+  eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(headless.display, headless.context);
+  eglTerminate(headless.display);
+  headless = HeadlessContext();
+}
+
+void* getHeadlessProcAddress(const char* name)
+{
+  return (void*)eglGetProcAddress(name);
+}
+
+#else
+
+bool createHeadlessContext(HeadlessContext& headless)
+{
+  // No surfaceless EGL here, so create a window that is never shown
+  if (!glfwInit())
+  {
+    std::cerr << "Failed to initialize GLFW" << std::endl;
+    return false;
+  }
+
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+  headless.hiddenWindow = glfwCreateWindow(1, 1, "Learn OpenGL (headless)", NULL, NULL);
+  if (headless.hiddenWindow == NULL)
+  {
+    std::cerr << "Failed to create hidden GLFW window" << std::endl;
+    glfwTerminate();
+    return false;
+  }
+  glfwMakeContextCurrent(headless.hiddenWindow);
+  return true;
+}
+
+void destroyHeadlessContext(HeadlessContext& headless)
+{
+  if (!headless.hiddenWindow) return;
+
+  glfwDestroyWindow(headless.hiddenWindow);
+  glfwTerminate();
+  headless = HeadlessContext();
+}
+
+void* getHeadlessProcAddress(const char* name)
+{
+  return (void*)glfwGetProcAddress(name);
+}
+
+#endif
+
+Framebuffer createFramebuffer(int width, int height)
+{
+  Framebuffer framebuffer;
+  framebuffer.width = width;
+  framebuffer.height = height;
+
+  // Color attachment, a texture so it can be sampled or read back later
+  glGenTextures(1, &framebuffer.colorTexture);
+  glBindTexture(GL_TEXTURE_2D, framebuffer.colorTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // Depth attachment, a renderbuffer since we never sample it
+  glGenRenderbuffers(1, &framebuffer.depthRenderbuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, framebuffer.depthRenderbuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &framebuffer.fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, framebuffer.colorTexture, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, framebuffer.depthRenderbuffer);
+
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+  {
+    std::cerr << "Framebuffer is not complete" << std::endl;
+  }
+
+  return framebuffer;
+}
+
+void destroyFramebuffer(Framebuffer& framebuffer)
+{
+  glDeleteFramebuffers(1, &framebuffer.fbo);
+  glDeleteRenderbuffers(1, &framebuffer.depthRenderbuffer);
+  glDeleteTextures(1, &framebuffer.colorTexture);
+  framebuffer = Framebuffer();
+}
+
+bool writeFramebufferToPPM(const Framebuffer& framebuffer, const std::string& path)
+{
+  std::vector<unsigned char> pixels((size_t)framebuffer.width * framebuffer.height * 3);
+
+  // Rows are tightly packed RGB, so drop the default 4 byte row alignment
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer.fbo);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, framebuffer.width, framebuffer.height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+  std::ofstream outputFile(path, std::ios::binary);
+  if (!outputFile)
+  {
+    std::cerr << "Cannot write file: " << path << std::endl;
+    return false;
+  }
+
+  outputFile << "P6\n" << framebuffer.width << " " << framebuffer.height << "\n255\n";
+
+  // OpenGL's origin is the bottom left corner while image files start at the top
+  size_t rowSize = (size_t)framebuffer.width * 3;
+  for (int y = framebuffer.height - 1; y >= 0; y--)
+  {
+    outputFile.write((const char*)pixels.data() + y * rowSize, rowSize);
+  }
+
+  return (bool)outputFile;
+}
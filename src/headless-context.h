@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+
+struct GLFWwindow;
+
+/**
+ * An OpenGL context that is not tied to a visible window
+ * On Linux this is an EGL surfaceless context (works with Mesa's llvmpipe on machines without a GPU)
+ * On other platforms we fall back to a hidden GLFW window
+*/
+struct HeadlessContext
+{
+  void* display = nullptr;
+  void* context = nullptr;
+  GLFWwindow* hiddenWindow = nullptr;
+};
+
+/**
+ * Off-screen render target
+ * A framebuffer object with a color texture and a depth renderbuffer attached
+*/
+struct Framebuffer
+{
+  unsigned int fbo = 0;
+  unsigned int colorTexture = 0;
+  unsigned int depthRenderbuffer = 0;
+  int width = 0;
+  int height = 0;
+};
+
+bool createHeadlessContext(HeadlessContext& headless);
+void destroyHeadlessContext(HeadlessContext& headless);
+
+// Function loader passed to GLAD when using a headless context
+void* getHeadlessProcAddress(const char* name);
+
+Framebuffer createFramebuffer(int width, int height);
+void destroyFramebuffer(Framebuffer& framebuffer);
+
+// Reads back the color attachment and writes it as a binary PPM (P6) image
+bool writeFramebufferToPPM(const Framebuffer& framebuffer, const std::string& path);
@@ -0,0 +1,106 @@
+#include "image-arena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+static std::size_t alignUp(std::size_t size)
+{
+  return (size + ImageArena::ALIGNMENT - 1) & ~(ImageArena::ALIGNMENT - 1);
+}
+
+ImageArena::ImageArena()
+{
+  callbacks.alloc = [](void* user, size_t size) { return ((ImageArena*)user)->allocate(size); };
+  callbacks.realloc = [](void* user, void* pointer, size_t oldSize, size_t newSize)
+  {
+    return ((ImageArena*)user)->reallocate(pointer, oldSize, newSize);
+  };
+  callbacks.free = [](void* user, void* pointer) { ((ImageArena*)user)->release(pointer); };
+  callbacks.user = this;
+}
+
+ImageArena::~ImageArena()
+{
+  for (Block& block : blocks) ::operator delete(block.data, std::align_val_t(ALIGNMENT));
+}
+
+bool ImageArena::addBlock(std::size_t size)
+{
+  // stb_image handles running out of memory, so no exceptions
+  unsigned char* data = (unsigned char*)::operator new(size, std::align_val_t(ALIGNMENT), std::nothrow);
+  if (!data) return false;
+  blocks.push_back({ data, size });
+  counters.heapBlocks++;
+  return true;
+}
+
+std::size_t ImageArena::capacity() const
+{
+  std::size_t total = 0;
+  for (const Block& block : blocks) total += block.size;
+  return total;
+}
+
+void ImageArena::reset()
+{
+  used = 0;
+  usedBefore = 0;
+  last = nullptr;
+
+  // A decode that did not fit gets one block big enough for all of it, the next one like it fits
+  if (blocks.size() > 1)
+  {
+    std::size_t total = capacity();
+    for (Block& block : blocks) ::operator delete(block.data, std::align_val_t(ALIGNMENT));
+    blocks.clear();
+    addBlock(total);
+  }
+}
+
+void* ImageArena::allocate(std::size_t size)
+{
+  counters.allocations++;
+  size = alignUp(std::max<std::size_t>(size, 1));
+  if (blocks.empty() || blocks.back().size - used < size)
+  {
+    if (!addBlock(std::max(MIN_BLOCK_SIZE, alignUp(size + size / 2)))) return nullptr;
+    usedBefore += blocks.size() > 1 ? used : 0;
+    used = 0;
+  }
+
+  last = blocks.back().data + used;
+  used += size;
+  counters.peakBytes = std::max(counters.peakBytes, usedBefore + used);
+  return last;
+}
+
+void* ImageArena::reallocate(void* pointer, std::size_t oldSize, std::size_t newSize)
+{
+  counters.reallocations++;
+  if (pointer && pointer == last)
+  {
+    std::size_t start = last - blocks.back().data;
+    if (blocks.back().size - start >= alignUp(newSize))
+    {
+      counters.inPlaceReallocations++;
+      used = start + alignUp(std::max<std::size_t>(newSize, 1));
+      counters.peakBytes = std::max(counters.peakBytes, usedBefore + used);
+      return pointer;
+    }
+  }
+
+  void* result = allocate(newSize);
+  if (result && pointer) memcpy(result, pointer, std::min(oldSize, newSize));
+  return result;
+}
+
+void ImageArena::release(void* pointer)
+{
+  // Everything else goes away with the next reset
+  if (pointer && pointer == last)
+  {
+    used = last - blocks.back().data;
+    last = nullptr;
+  }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "stb_image.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Bump allocator for the scratch memory of stb_image decodes (zlib output, JPEG component planes, line buffers)
+ * Hand allocator() to stbi_load_mapped_into or stbi_load_from_memory_into and call reset() once the image is done
+ *
+ * Allocations only move a pointer, free only takes back the most recent allocation and realloc of the most
+ * recent allocation grows it in place, which is how the PNG and zlib buffers grow
+ * When a decode needs more than the arena has it adds another block, reset() then replaces the blocks with one
+ * that holds all of it, so after the first few images a batch of decodes does not touch the heap at all
+ *
+ * Not thread safe, use one arena per decoding thread
+*/
+class ImageArena
+{
+public:
+  static constexpr std::size_t ALIGNMENT = 16;
+  static constexpr std::size_t MIN_BLOCK_SIZE = 1 << 20;
+
+  // Counters since the last resetStats
+  struct Stats
+  {
+    std::uint64_t allocations = 0;
+    std::uint64_t reallocations = 0;
+    std::uint64_t inPlaceReallocations = 0;
+    std::uint64_t heapBlocks = 0;
+    std::size_t peakBytes = 0;
+  };
+
+  ImageArena();
+  ImageArena(const ImageArena&) = delete;
+  ImageArena& operator=(const ImageArena&) = delete;
+  ~ImageArena();
+
+  // Releases everything allocated since the last reset
+  void reset();
+
+  const stbi_allocator* allocator() const { return &callbacks; }
+  std::size_t capacity() const;
+  const Stats& stats() const { return counters; }
+  void resetStats() { counters = Stats(); }
+
+private:
+  struct Block
+  {
+    unsigned char* data;
+    std::size_t size;
+  };
+
+  void* allocate(std::size_t size);
+  void* reallocate(void* pointer, std::size_t oldSize, std::size_t newSize);
+  void release(void* pointer);
+  bool addBlock(std::size_t size);
+
+  // Allocations come from the last block, the earlier ones are full
+  std::vector<Block> blocks;
+  std::size_t used = 0;
+  std::size_t usedBefore = 0; // by the blocks before the last one
+
+  // The most recent allocation, the only one free and realloc can give back or grow
+  unsigned char* last = nullptr;
+
+  stbi_allocator callbacks;
+  Stats counters;
+};
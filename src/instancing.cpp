@@ -0,0 +1,68 @@
+#include "instancing.h"
+
+#include <glad/glad.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+
+// Number of crates along each axis of the grid
+static int gridSide(int count)
+{
+  int side = (int)std::ceil(std::cbrt((double)count));
+
+  // cbrt can land just above a whole number
+  while (side > 1 && (side - 1) * (side - 1) * (side - 1) >= count) side--;
+  return side;
+}
+
+std::vector<glm::mat4> buildCrateGrid(int count, float spacing)
+{
+  std::vector<glm::mat4> transforms;
+  transforms.reserve(count);
+
+  int side = gridSide(count);
+  float center = (side - 1) * spacing / 2;
+
+  for (int i = 0; i < count; i++)
+  {
+    int x = i % side;
+    int y = (i / side) % side;
+    int z = i / (side * side);
+    glm::vec3 position = glm::vec3(x, y, z) * spacing - center;
+    transforms.push_back(glm::translate(glm::mat4(1), position));
+  }
+
+  return transforms;
+}
+
+float crateGridRadius(int count, float spacing, float crateRadius)
+{
+  // Distance from the center to the farthest corner crate
+  float halfExtent = (gridSide(count) - 1) * spacing / 2;
+  return std::sqrt(3.f) * halfExtent + crateRadius;
+}
+
+unsigned int createInstanceBuffer(const std::vector<glm::mat4>& transforms)
+{
+  unsigned int instanceBuffer;
+  glGenBuffers(1, &instanceBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  glBufferData(GL_ARRAY_BUFFER, transforms.size() * sizeof(glm::mat4), transforms.data(), GL_STATIC_DRAW);
+  return instanceBuffer;
+}
+
+void attachInstanceBuffer(unsigned int vao, unsigned int instanceBuffer, std::uintptr_t offset)
+{
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+  // A vertex attribute holds at most a vec4, so the matrix is passed as 4 column attributes
+  for (unsigned int column = 0; column < 4; column++)
+  {
+    unsigned int location = INSTANCE_MODEL_LOCATION + column;
+    glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + column * sizeof(glm::vec4)));
+    glEnableVertexAttribArray(location);
+    glVertexAttribDivisor(location, 1);
+  }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// First of the four vertex attribute locations that hold a_instanceModel in vertex-shader.glsl (a mat4 takes one per column)
+const unsigned int INSTANCE_MODEL_LOCATION = 2;
+
+/**
+ * Model matrices for count crates laid out in a cube shaped grid centered on the origin
+ * A single crate sits exactly at the origin
+*/
+std::vector<glm::mat4> buildCrateGrid(int count, float spacing);
+
+// Radius of a sphere around the origin that contains every crate of buildCrateGrid
+float crateGridRadius(int count, float spacing, float crateRadius);
+
+// Static buffer holding one mat4 per instance
+unsigned int createInstanceBuffer(const std::vector<glm::mat4>& transforms);
+
+/**
+ * Makes a vertex array read a_instanceModel from instanceBuffer, starting offset bytes in
+ * The attribute divisor of 1 advances the attribute once per instance instead of once per vertex
+*/
+void attachInstanceBuffer(unsigned int vao, unsigned int instanceBuffer, std::uintptr_t offset = 0);
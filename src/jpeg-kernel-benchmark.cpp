@@ -0,0 +1,189 @@
+#include "jpeg-kernel-benchmark.h"
+
+// A private copy of stb_image with internal linkage, so its static kernels can be called directly
+// main.cpp holds the copy the rest of the program uses
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#include "stb_image.h"
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct Rng
+{
+  std::uint32_t state = 12345;
+  std::uint32_t next() { return state = state * 1664525u + 1013904223u; }
+};
+
+// Fastest of iterations runs of body, each one calling it repeat times, in nanoseconds per call
+template <typename Body>
+double timeKernel(int iterations, int repeat, Body body)
+{
+  double best = 1e30;
+  for (int i = 0; i < iterations; i++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++) body(r);
+    double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    best = std::min(best, nanoseconds / repeat);
+  }
+  return best;
+}
+
+void printHeader()
+{
+  std::cout << std::left << std::setw(28) << "kernel" << std::right << std::setw(10) << "C ns" << std::setw(10) << "SSE2 ns"
+            << std::setw(10) << "AVX2 ns" << std::setw(10) << "SSE2 x" << std::setw(10) << "AVX2 x" << "   output" << std::endl;
+}
+
+void printRow(const std::string& name, double scalar, double sse2, double avx2, bool match)
+{
+  std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << scalar << std::setw(10) << sse2;
+  if (avx2 > 0) std::cout << std::setw(10) << avx2;
+  else std::cout << std::setw(10) << "-";
+  std::cout << std::setprecision(2) << std::setw(9) << scalar / sse2 << "x";
+  if (avx2 > 0) std::cout << std::setw(9) << scalar / avx2 << "x";
+  else std::cout << std::setw(10) << "-";
+  std::cout << "   " << (match ? "ok" : "MISMATCH") << std::endl;
+  std::cout.unsetf(std::ios::floatfield);
+}
+
+typedef void (*IdctKernel)(stbi_uc* out, int out_stride, short data[64]);
+typedef stbi_uc* (*ResampleKernel)(stbi_uc* out, stbi_uc* in_near, stbi_uc* in_far, int w, int hs);
+typedef void (*ColorKernel)(stbi_uc* out, const stbi_uc* y, const stbi_uc* pcb, const stbi_uc* pcr, int count, int step);
+
+// Dequantized coefficients as they come out of the entropy decoder: a large DC term, AC terms falling off with frequency
+std::vector<short> randomBlocks(int blockCount)
+{
+  Rng rng;
+  std::vector<short> blocks((size_t)blockCount * 64);
+  for (int b = 0; b < blockCount; b++)
+  {
+    for (int i = 0; i < 64; i++)
+    {
+      int range = i == 0 ? 2048 : 1024 / (1 + (i & 7) + (i >> 3));
+      blocks[b * 64 + i] = (short)((int)(rng.next() >> 16) % (2 * range + 1) - range);
+    }
+  }
+  return blocks;
+}
+
+bool benchmarkIdct(int iterations, bool avx2)
+{
+  const int blockCount = 4096;
+  std::vector<short> blocks = randomBlocks(blockCount);
+  STBI_SIMD_ALIGN(short, block[64]);
+
+  std::vector<stbi_uc> outputs[3];
+  double times[3] = { 0, 0, 0 };
+  IdctKernel kernels[3] = { stbi__idct_block, stbi__idct_simd, avx2 ? stbi__idct_avx2 : nullptr };
+
+  for (int k = 0; k < 3; k++)
+  {
+    if (!kernels[k]) continue;
+    outputs[k].resize(blocks.size());
+    times[k] = timeKernel(iterations, 1, [&](int) {
+      for (int b = 0; b < blockCount; b++)
+      {
+        std::memcpy(block, &blocks[b * 64], sizeof(block));
+        kernels[k](&outputs[k][b * 64], 8, block);
+      }
+    }) / blockCount;
+  }
+
+  bool match = outputs[1] == outputs[0] && (!avx2 || outputs[2] == outputs[0]);
+  printRow("idct 8x8", times[0], times[1], times[2], match);
+  return match;
+}
+
+bool benchmarkResample(int iterations, bool avx2, int width)
+{
+  Rng rng;
+  std::vector<stbi_uc> nearRow(width + 16), farRow(width + 16);
+  for (int i = 0; i < width; i++)
+  {
+    nearRow[i] = (stbi_uc)(rng.next() >> 24);
+    farRow[i] = (stbi_uc)(rng.next() >> 24);
+  }
+
+  std::vector<stbi_uc> outputs[3];
+  double times[3] = { 0, 0, 0 };
+  ResampleKernel kernels[3] = { stbi__resample_row_hv_2, stbi__resample_row_hv_2_simd, avx2 ? stbi__resample_row_hv_2_avx2 : nullptr };
+
+  for (int k = 0; k < 3; k++)
+  {
+    if (!kernels[k]) continue;
+    outputs[k].assign(width * 2 + 3, 0);
+    times[k] = timeKernel(iterations, 64, [&](int) { kernels[k](outputs[k].data(), nearRow.data(), farRow.data(), width, 2); });
+  }
+
+  bool match = outputs[1] == outputs[0] && (!avx2 || outputs[2] == outputs[0]);
+  printRow("upsample hv2 " + std::to_string(width) + " px", times[0], times[1], times[2], match);
+  return match;
+}
+
+bool benchmarkColor(int iterations, bool avx2, int width, int step)
+{
+  Rng rng;
+  std::vector<stbi_uc> y(width), cb(width), cr(width);
+  for (int i = 0; i < width; i++)
+  {
+    y[i] = (stbi_uc)(rng.next() >> 24);
+    cb[i] = (stbi_uc)(rng.next() >> 24);
+    cr[i] = (stbi_uc)(rng.next() >> 24);
+  }
+
+  std::vector<stbi_uc> outputs[3];
+  double times[3] = { 0, 0, 0 };
+  ColorKernel kernels[3] = { stbi__YCbCr_to_RGB_row, stbi__YCbCr_to_RGB_simd, avx2 ? stbi__YCbCr_to_RGB_avx2 : nullptr };
+
+  for (int k = 0; k < 3; k++)
+  {
+    if (!kernels[k]) continue;
+    // the kernels may write one byte past the row
+    outputs[k].assign((size_t)width * step + 1, 0);
+    times[k] = timeKernel(iterations, 64, [&](int) { kernels[k](outputs[k].data(), y.data(), cb.data(), cr.data(), width, step); });
+    outputs[k].pop_back();
+  }
+
+  bool match = outputs[1] == outputs[0] && (!avx2 || outputs[2] == outputs[0]);
+  printRow(std::string("ycbcr to ") + (step == 4 ? "rgba " : "rgb ") + std::to_string(width) + " px", times[0], times[1], times[2], match);
+  return match;
+}
+
+}
+
+bool runJpegKernelBenchmark(int iterations)
+{
+  bool avx2 = (stbi__cpu_features() & 2) != 0;
+  if (!avx2) std::cout << "This CPU has no AVX2, only the C and SSE2 kernels are timed" << std::endl;
+
+  printHeader();
+
+  bool success = benchmarkIdct(iterations, avx2);
+  // Widths of a 1024 and a 4096 pixel image's chroma rows, plus one that leaves a ragged tail
+  for (int width : { 512, 2048, 1021 }) success = benchmarkResample(iterations, avx2, width) && success;
+  for (int step : { 4, 3 })
+  {
+    for (int width : { 1024, 4096, 1021 }) success = benchmarkColor(iterations, avx2, width, step) && success;
+  }
+
+  return success;
+}
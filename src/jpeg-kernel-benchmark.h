@@ -0,0 +1,12 @@
+#pragma once
+
+/**
+ * Times stb_image's JPEG kernels (IDCT, 2x2 chroma upsampling and YCbCr to RGB/RGBA conversion) one by one
+ * in their C, SSE2 and AVX2 versions, on random but deterministic input, and checks the SIMD versions
+ * produce exactly the same bytes as the C ones
+ *
+ * The AVX2 versions are skipped on CPUs without AVX2
+ *
+ * Returns false if any SIMD kernel disagrees with the C kernel
+*/
+bool runJpegKernelBenchmark(int iterations);
@@ -13,295 +13,348 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "headless-context.h"
+#include "benchmark.h"
+#include "shader.h"
+#include "program-cache.h"
+#include "mesh.h"
+#include "instancing.h"
+#include "frustum.h"
+#include "gpu-culling.h"
+#include "cpu-culling.h"
+#include "ring-buffer.h"
+#include "texture-loader.h"
+#include "texture-cooker.h"
+#include "decode-benchmark.h"
+#include "jpeg-kernel-benchmark.h"
+#include "allocation-benchmark.h"
+#include "flip-benchmark.h"
+#include "hdr-benchmark.h"
+#include "stream-benchmark.h"
+#include "gif-benchmark.h"
+#include "precision-benchmark.h"
+#include "transform-benchmark.h"
+#include "matrix-benchmark.h"
+#include "culling-benchmark.h"
+#include "texture-catalog.h"
+
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 
-void framebufferSizeCallback(GLFWwindow* window, int width, int height)
+/**
+ * Command line options
+ * --headless renders into an off-screen framebuffer instead of a window (used on machines without a display or GPU)
+ * --frames N renders N frames and then exits (headless only)
+ * --width W / --height H sets the size of the framebuffer
+ * --output PATH writes the last frame to PATH as a PPM image (headless only)
+ * --benchmark renders --warmup + --frames frames with a fixed --timestep, then prints per phase timings and writes a JSON --report
+ * --instances N draws N crates with one instanced draw call, --instance-sweep benchmarks 1, 10, 100, ... up to N instances
+ * --gpu-culling frustum culls the instances in a compute shader and draws the survivors with glMultiDrawElementsIndirectCount
+ * --cpu-culling frustum culls the instances on the CPU with SIMD kernels and a hierarchy of bounding boxes and streams the visible transforms through the stream buffer every frame (not with --gpu-culling)
+ * --animated-texture PATH draws an animated GIF on the crates instead of the crate texture, one frame after another at the GIF's delays
+ * --height-map PATH shades the crates by a height map loaded with 16 bits per channel, or half floats with --height-precision half
+ * --program-cache DIR stores linked shader programs in DIR, --no-program-cache always compiles from source
+ * --texture-catalog probes every image in textures/, updates the index of them in textures/catalog.index, prints it and exits
+ * --cook-textures compresses every .png in textures/ with its mipmaps into textures/cooked/ and exits, later runs load those instead
+ * --bench-decode times PNG decoding with and without stb_image's SIMD unfilter kernels, checks they agree and exits
+ * --bench-jpeg-kernels times stb_image's C, SSE2 and AVX2 JPEG kernels one by one, checks they agree and exits
+ * --bench-allocations decodes textures/ with stbi_load and into a buffer with an arena, prints the heap allocations of each and exits
+ * --bench-flip times decoding textures/ and synthetic BMP/TGA images unflipped, flipped by the decoders and flipped afterwards, and exits
+ * --bench-hdr times stb_image's RGBE, 8 bit to float and float to 8 bit conversions against the old loops, checks their error and exits
+ * --bench-stream decodes every .png in textures/ and synthetic 8 and 16 bit PNGs whole and row by row to every channel count, checks they agree, prints the time and peak heap of each and exits
+ * --bench-gif decodes every .gif in textures/ and a synthetic animation whole and frame by frame, prints the time, peak heap and bytes to upload of each and exits
+ * --bench-precision decodes synthetic height and normal maps to 16 bits and half floats per channel directly and in two passes, prints the time and peak heap of each and exits
+ * --bench-transforms multiplies 1k to 1M matrices, points and bounding spheres by one matrix with glm and with every batch kernel, prints the time per object and exits
+ * --bench-matrix times glm's mat4 multiply, inverse and determinant on the scalar, SSE2, AVX and FMA paths the build has, prints their time and error and exits
+ * --bench-culling culls 10k to 4M bounding spheres and boxes with a plain loop, every SIMD kernel and a hierarchy, checks they agree, prints the time per frame and exits
+*/
+struct Options
 {
-  glViewport(0, 0, width, height);
-}
+  bool headless = false;
+  int frames = 60;
+  int width = 800;
+  int height = 800;
+  std::string outputPath = "frame.ppm";
+  bool benchmark = false;
+  int warmupFrames = 30;
+  float timeStep = 1 / 60.f;
+  std::string reportPath = "benchmark.json";
+  ProgramCache programCache;
+  int instances = 1;
+  bool instanceSweep = false;
+  bool gpuCulling = false;
+  bool cpuCulling = false;
+  std::string animatedTexturePath;
+  std::string heightMapPath;
+  TexturePrecision heightPrecision = TexturePrecision::Unorm16;
+  bool textureCatalog = false;
+  bool cookTextures = false;
+  bool benchDecode = false;
+  bool benchJpegKernels = false;
+  bool benchAllocations = false;
+  bool benchFlip = false;
+  bool benchHdr = false;
+  bool benchStream = false;
+  bool benchGif = false;
+  bool benchPrecision = false;
+  bool benchTransforms = false;
+  bool benchMatrix = false;
+  bool benchCulling = false;
+};
 
-void update(GLFWwindow* window)
+/**
+ * Everything the shaders need from the camera, uploaded once per frame into the Camera uniform block
+ * The std140 layout of two mat4s has no padding, so this struct can be copied into the buffer as is
+*/
+struct CameraUniforms
 {
-  /**
-   * glfwGetKey` returns 1 if pressed else 0
-  */
+  glm::mat4 view;
+  glm::mat4 projection;
+};
 
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE)) glfwSetWindowShouldClose(window, true);
-}
+// Binding point of the Camera uniform block, matches binding = 0 in vertex-shader.glsl
+const unsigned int CAMERA_BLOCK_BINDING = 0;
 
-std::string readFile(std::string path)
+bool parseArguments(int argc, char** argv, Options& options)
 {
-  std::ifstream inputFile(path);
-  if (!inputFile)
+  for (int i = 1; i < argc; i++)
   {
-    std::cerr << "Cannot read file: " << path << std::endl;
-    return "";
+    std::string argument = argv[i];
+    bool hasValue = i + 1 < argc;
+
+    if (argument == "--headless") options.headless = true;
+    else if (argument == "--frames" && hasValue) options.frames = std::stoi(argv[++i]);
+    else if (argument == "--width" && hasValue) options.width = std::stoi(argv[++i]);
+    else if (argument == "--height" && hasValue) options.height = std::stoi(argv[++i]);
+    else if (argument == "--output" && hasValue) options.outputPath = argv[++i];
+    else if (argument == "--benchmark") options.benchmark = true;
+    else if (argument == "--warmup" && hasValue) options.warmupFrames = std::stoi(argv[++i]);
+    else if (argument == "--timestep" && hasValue) options.timeStep = std::stof(argv[++i]);
+    else if (argument == "--report" && hasValue) options.reportPath = argv[++i];
+    else if (argument == "--instances" && hasValue) options.instances = std::stoi(argv[++i]);
+    else if (argument == "--instance-sweep") options.instanceSweep = options.benchmark = true;
+    else if (argument == "--gpu-culling") options.gpuCulling = true;
+    else if (argument == "--cpu-culling") options.cpuCulling = true;
+    else if (argument == "--animated-texture" && hasValue) options.animatedTexturePath = argv[++i];
+    else if (argument == "--height-map" && hasValue) options.heightMapPath = argv[++i];
+    else if (argument == "--height-precision" && hasValue)
+    {
+      std::string precision = argv[++i];
+      if (precision == "16") options.heightPrecision = TexturePrecision::Unorm16;
+      else if (precision == "half") options.heightPrecision = TexturePrecision::Half;
+      else
+      {
+        std::cerr << "Height map precision must be 16 or half" << std::endl;
+        return false;
+      }
+    }
+    else if (argument == "--program-cache" && hasValue) options.programCache.directory = argv[++i];
+    else if (argument == "--no-program-cache") options.programCache.enabled = false;
+    else if (argument == "--texture-catalog") options.textureCatalog = true;
+    else if (argument == "--cook-textures") options.cookTextures = true;
+    else if (argument == "--bench-decode") options.benchDecode = true;
+    else if (argument == "--bench-jpeg-kernels") options.benchJpegKernels = true;
+    else if (argument == "--bench-allocations") options.benchAllocations = true;
+    else if (argument == "--bench-flip") options.benchFlip = true;
+    else if (argument == "--bench-hdr") options.benchHdr = true;
+    else if (argument == "--bench-stream") options.benchStream = true;
+    else if (argument == "--bench-gif") options.benchGif = true;
+    else if (argument == "--bench-precision") options.benchPrecision = true;
+    else if (argument == "--bench-transforms") options.benchTransforms = true;
+    else if (argument == "--bench-matrix") options.benchMatrix = true;
+    else if (argument == "--bench-culling") options.benchCulling = true;
+    else
+    {
+      std::cerr << "Unknown or incomplete argument: " << argument << std::endl;
+      return false;
+    }
   }
-  std::ostringstream buffer;
-  std::string line;
-  while (std::getline(inputFile, line))
+
+  if (options.frames < 1 || options.width < 1 || options.height < 1 || options.warmupFrames < 0 || options.instances < 1)
   {
-    buffer << line << std::endl;
+    std::cerr << "Frame count and framebuffer size must be positive" << std::endl;
+    return false;
   }
-  return buffer.str();
+
+  return true;
 }
 
-unsigned int compileShader(unsigned int type, std::string source)
+void framebufferSizeCallback(GLFWwindow* window, int width, int height)
 {
-  // Create a pointer to the first char of the shader string
-  const char* src = source.c_str();
-
-  // Create a shader object referenced by an id
-  unsigned int shader = glCreateShader(type);
-
-  // Set shader source and compile shader
-  glShaderSource(shader, 1, &src, NULL);
-  glCompileShader(shader);
-
-  int success;
-  char infoLog[512];
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-  if (!success)
-  {
-    glGetShaderInfoLog(shader, 512, NULL, infoLog);
-    std::cerr << "Failed to compile " << (type == GL_VERTEX_SHADER ? "vertex" : "fragment") << "shader" << std::endl;
-    std::cerr << infoLog << std::endl;
-    return 0;
-  }
-
-  // return shader id
-  return shader;
+  glViewport(0, 0, width, height);
 }
 
-unsigned int createProgram(unsigned int vertexShader, unsigned int fragmentShader)
+void update(GLFWwindow* window)
 {
-    // Create shader program
   /**
-   * A shader program links all the shaders together to help them communicate with each other
+   * glfwGetKey` returns 1 if pressed else 0
   */
-  unsigned int shaderProgram = glCreateProgram();
-
-  // Link shaders together
-  glAttachShader(shaderProgram, vertexShader);
-  glAttachShader(shaderProgram, fragmentShader);
-  glLinkProgram(shaderProgram);
-
-  // Delete the shader objects since we no longer need them
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader); 
-
-  int success;
-  char infoLog[512];
-  glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-  if(!success) {
-    glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-    std::cerr << "Failed to Link Program" << std::endl;
-    std::cerr << infoLog << std::endl;
-    return 0;
-  }
 
-  return shaderProgram;
+  if (glfwGetKey(window, GLFW_KEY_ESCAPE)) glfwSetWindowShouldClose(window, true);
 }
 
-int main() {
-  // Initialize GLFW
-  glfwInit();
-  
-  // Tell GLFW we are using OpenGL 4.6 
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
-
-  // Tell GLFW we are using OpenGL Core
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-  // Initialise window + check for errors + make window current context
-  GLFWwindow* window = glfwCreateWindow(800, 800,"Learn OpenGL", NULL, NULL);
-  if (window == NULL)
-  {
-    std::cerr << "Failed to create GLFW window" << std::endl;
-    return -1;
-  }
-  glfwMakeContextCurrent(window);
-
-  // Initialise GLAD + error handling
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-  {
-    std::cerr << "Failed to initialize GLAD" << std::endl;
-    return -1;
-  }
+// Everything the render loop draws
+struct Scene
+{
+  GpuMesh mesh;
+  unsigned int program = 0;
+  int modelLocation = -1;
+  unsigned int instanceBuffer = 0;
+  int instanceCount = 0;
 
-  // Tell OpenGL the window size so thet we can use normalized device coordinates
-  glViewport(0, 0, 800, 800);
+  // Radius of a sphere around the origin that contains every instance, the camera backs off to fit it in view
+  float radius = 0;
 
-  // Resize window if window size changes
-  glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+  bool gpuCulling = false;
+  GpuCulling culling;
 
-  // Set clear color
-  glClearColor(.5f, .5f, .5f, 1);
+  // CPU culling tests the bounding spheres of the instances every frame and copies the visible transforms into the
+  // stream buffer, the instances are drawn from there
+  bool cpuCulling = false;
+  std::vector<glm::mat4> transforms;
+  SphereBatch bounds;
+  CullingHierarchy hierarchy;
+  VisibleList visible;
 
-  // Enable depth test
-  glEnable(GL_DEPTH_TEST);
+  // Visible transforms written to the stream buffer this frame, 0 if they did not fit
+  int visibleInstances = 0;
 
-  // Define vertices of a cube
-  // Each vertex has 5 attributes : x, y, z, u, v
-  float vertices[] = {
-    -.25f, -.25f, -.25f,  0, 0,
-     .25f, -.25f, -.25f,  1, 0,
-     .25f, .25f, -.25f,  1, 1,
-     .25f, .25f, -.25f,  1, 1,
-    -.25f, .25f, -.25f,  0, 1,
-    -.25f, -.25f, -.25f,  0, 0,
-
-    -.25f, -.25f, .25f,  0, 0,
-     .25f, -.25f, .25f,  1, 0,
-     .25f, .25f, .25f,  1, 1,
-     .25f, .25f, .25f,  1, 1,
-    -.25f, .25f, .25f,  0, 1,
-    -.25f, -.25f, .25f,  0, 0,
-
-    -.25f, .25f, .25f,  1, 0,
-    -.25f, .25f, -.25f,  1, 1,
-    -.25f, -.25f, -.25f,  0, 1,
-    -.25f, -.25f, -.25f,  0, 1,
-    -.25f, -.25f, .25f,  0, 0,
-    -.25f, .25f, .25f,  1, 0,
-
-     .25f, .25f, .25f,  1, 0,
-     .25f, .25f, -.25f,  1, 1,
-     .25f, -.25f, -.25f,  0, 1,
-     .25f, -.25f, -.25f,  0, 1,
-     .25f, -.25f, .25f,  0, 0,
-     .25f, .25f, .25f,  1, 0,
-
-    -.25f, -.25f, -.25f,  0, 1,
-     .25f, -.25f, -.25f,  1, 1,
-     .25f, -.25f, .25f,  1, 0,
-     .25f, -.25f, .25f,  1, 0,
-    -.25f, -.25f, .25f,  0, 0,
-    -.25f, -.25f, -.25f,  0, 1,
-
-    -.25f, .25f, -.25f,  0, 1,
-     .25f, .25f, -.25f,  1, 1,
-     .25f, .25f, .25f,  1, 0,
-     .25f, .25f, .25f,  1, 0,
-    -.25f, .25f, .25f,  0, 0,
-    -.25f, .25f, -.25f,  0, 1
-  };
+  // Summed over the recorded frames of a run
+  CullingStats cullingStats;
 
-  unsigned int indices[] = {
-    0, 3, 2,
-    2, 1, 0
-  };
+  // Per frame data (the camera uniforms, the transforms of CPU culling) is written here instead of going through
+  // glBufferSubData or a new glBufferData every frame
+  StreamRingBuffer stream;
+  int uniformAlignment = 256;
 
-  // Generate vertex buffer, vertex attribute array
-  unsigned int vbo, vao, ebo;
-  glGenVertexArrays(1, &vao);
-  glGenBuffers(1, &vbo);
-  glGenBuffers(1, &ebo);
+  // Textures are decoded in the background, the crates show a placeholder until theirs is uploaded
+  TextureLoader textures;
+  int crateTexture = -1;
 
-  // Bind Vertex Array
-  glBindVertexArray(vao);
+  // With --animated-texture, a GL_TEXTURE_2D_ARRAY bound to ANIMATION_TEXTURE_UNIT that the crates show a layer of
+  int animatedTexture = -1;
+  int animationLayerLocation = -1;
 
-  // Bind buffers to its buffer type
-  /**
-   * OpenGL allows you to bind multiple buffers as long as they have separate buffer types
-  */
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+  // With --height-map, a GL_R16 to GL_RGBA16 or GL_R16F to GL_RGBA16F texture bound to HEIGHT_MAP_TEXTURE_UNIT
+  int heightMap = -1;
+};
 
-  // Copies the data to the buffer bound to the its respective buffer type
-  /**
-   * first argument: type of the buffer we want to copy data into
-   * second argument: size of the data in bytes
-   * third argument: data
-   * fourth argument: specifies the graphics card how you want to manage the data
-   *   - GL_STREAM_DRAW: the data is set only once and used by the GPU at most a few times.
-   *   - GL_STATIC_DRAW: the data is set only once and used many times.
-   *   - GL_DYNAMIC_DRAW: the data is changed a lot and used many times.
-  */
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+// Texture units of u_animation and u_heightMap in fragment-shader.glsl, u_texture stays on unit 0
+const int ANIMATION_TEXTURE_UNIT = 1;
+const int HEIGHT_MAP_TEXTURE_UNIT = 2;
 
-  // Tells OpenGL the layout of out vertex data
-  /**
-   * first argument: location of the vertex attribute array we want to configure
-   * second argument: number of values in the vertex attribute
-   * third argument: data type
-   * forth argument: whether the values should be normalized
-   * fifth argument: the space between the start of two consecutive vertex attributes in the array in bytes (also known as stride)
-   * sixth argument: offset of where the position data begins (it has to be cast into a void pointer for some reason, idk why)
-  */
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
+// Bytes of per frame data the stream buffer can hold for each frame in flight
+const std::uintptr_t STREAM_REGION_SIZE = 64 * 1024;
 
-  // Generate Texture
-  unsigned int texture;
-  glGenTextures(1, &texture);
+// Half the diagonal of the cube
+const float CRATE_RADIUS = .25f * std::sqrt(3.f);
 
-  // Clamp the texture so that anything outside the texture will be a user defined color
-  /**
-   * first argument: texture target (21d, 2d, 3d, etc...)
-   * second argument: which axis we are configuring (axes: s, t, r(if using 3d textures))
-   * third argument: texture wrapping mode we would like
-  */
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-  // Specify user defined border color
-  float borderColor[] = { 0.0f, 0.0f, 0.0f, 1.0f };
-  glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-  // Specify the filtering mode
-  /**
-   * the filtering mode the color is at a point on the texture relative to the colors of the four texels that surround it
-   * nearest neighbour or point filtering returns the color of the nearest texel
-   * bilinear filtering linearly interpolates between the four colors to get a ratiod mix of the four
-  */
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// Distance between the centers of neighbouring crates when there are many of them
+const float CRATE_SPACING = 1;
 
-  // Bind texture
-  glBindTexture(GL_TEXTURE_2D, texture);
+void setInstanceCount(Scene& scene, int instanceCount)
+{
+  glDeleteBuffers(1, &scene.instanceBuffer);
 
-  // Read image file
-  int width, height, numChannels;
-  unsigned char* imageData = stbi_load("textures/crate-texture1024x1024.png", &width, &height, &numChannels, 0);
+  std::vector<glm::mat4> transforms = buildCrateGrid(instanceCount, CRATE_SPACING);
+  scene.instanceBuffer = createInstanceBuffer(transforms);
 
-  // Error handling
-  if (imageData)
+  // With GPU culling the vertex shader only sees the transforms that survived culling
+  if (scene.gpuCulling)
+  {
+    setCullingInstances(scene.culling, transforms, CRATE_RADIUS, scene.mesh.indexCount);
+    attachInstanceBuffer(scene.mesh.vao, scene.culling.visibleBuffer);
+  }
+  else if (scene.cpuCulling)
   {
-    // TODO: Explain this
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    // The same spheres as setCullingInstances, in the order of the grid so the groups of the hierarchy are compact
+    scene.bounds.resize(transforms.size());
+    for (std::size_t i = 0; i < transforms.size(); i++)
+    {
+      const glm::mat4& transform = transforms[i];
+      float scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) });
+      scene.bounds.set(i, glm::vec4(glm::vec3(transform[3]), CRATE_RADIUS * scale));
+    }
+    scene.hierarchy.build(scene.bounds);
+    scene.transforms = transforms;
+
+    // cullInstancesOnCpu points the instance attributes at each frame's allocation
   }
   else
   {
-    std::cerr << "Failed to load texture" << std::endl;
+    attachInstanceBuffer(scene.mesh.vao, scene.instanceBuffer);
   }
 
-  // Cleanup
-  stbi_image_free(imageData);
+  scene.instanceCount = instanceCount;
+  scene.radius = crateGridRadius(instanceCount, CRATE_SPACING, CRATE_RADIUS);
+}
 
-  // Compile and link shaders
-  unsigned int vertexShader = compileShader(GL_VERTEX_SHADER, readFile("shaders/vertex-shader.glsl"));
-  unsigned int fragmentShader = compileShader(GL_FRAGMENT_SHADER, readFile("shaders/fragment-shader.glsl"));
-  unsigned int shaderProgram = createProgram(vertexShader, fragmentShader);
+/**
+ * Culls the instances against frustum (in the space of their transforms), copies the transforms of the visible ones
+ * into this frame's region of the stream buffer and points the instance attributes at them
+ * record adds the stats of the cull to scene.cullingStats
+*/
+void cullInstancesOnCpu(Scene& scene, const Frustum& frustum, bool record)
+{
+  CullingStats stats;
+  cullSpheres(frustum, scene.bounds, &scene.hierarchy, scene.visible, &stats);
+  if (record) scene.cullingStats += stats;
 
-  // Use the program we just created
-  glUseProgram(shaderProgram);
+  scene.visibleInstances = 0;
+  if (!scene.visible.size) return;
 
-  while(!glfwWindowShouldClose(window))
+  // The region was fenced by the frame that last used it, so nothing the GPU still reads is overwritten
+  std::uintptr_t offset;
+  glm::mat4* visible = (glm::mat4*)scene.stream.allocate(scene.visible.size * sizeof(glm::mat4), sizeof(glm::vec4), offset);
+  if (!visible) return;
+  for (std::size_t i = 0; i < scene.visible.size; i++) visible[i] = scene.transforms[scene.visible.indices[i]];
+
+  attachInstanceBuffer(scene.mesh.vao, scene.stream.buffer(), offset);
+  scene.visibleInstances = (int)scene.visible.size;
+}
+
+/**
+ * Renders frames until the window is closed, or warmupFrames + options.frames frames for headless and benchmark runs
+ * Returns when the first frame was finished (presented, or rendered for headless runs)
+*/
+std::chrono::steady_clock::time_point runFrames(GLFWwindow* window, const Options& options, Scene& scene, FrameProfiler& profiler, int warmupFrames)
+{
+  std::chrono::steady_clock::time_point firstFrameEnd;
+
+  bool fixedFrameCount = options.headless || options.benchmark;
+  int totalFrames = warmupFrames + options.frames;
+
+  // Move the camera back until all instances fit into the 60 degree field of view
+  float viewDistance = std::max(1.5f, 2 * scene.radius);
+  float farPlane = std::max(100.f, viewDistance + scene.radius);
+
+  for (int frame = 0; fixedFrameCount ? frame < totalFrames : !glfwWindowShouldClose(window); frame++)
   {
-    update(window);
+    profiler.beginFrame(frame >= warmupFrames);
+
+    // Wait (rarely) until the GPU has finished with the stream buffer region we are about to overwrite
+    scene.stream.beginFrame();
 
     // Get width and height of screen
-    int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
+    int width = options.width, height = options.height;
+    if (!options.headless)
+    {
+      update(window);
+      glfwGetFramebufferSize(window, &width, &height);
+    }
+
+    // Copy textures that finished decoding to the GPU, a few MB per frame at most
+    scene.textures.update();
+
+    // Benchmark and headless frames advance by a fixed time step so every run renders the same frames
+    float time = fixedFrameCount ? frame * options.timeStep : (float)glfwGetTime();
 
     // Clear color and depth buffers
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -313,46 +366,425 @@ int main() {
 
     // Transform the matrices to fit our needs
     // If you don't know what these matrices do, unfortunately that is a big topic and i cannot explain it without it being over 50 lines.
-    model = glm::rotate(model, (float)glfwGetTime() * glm::radians(60.f), glm::vec3(.5f, 1, .25f));
-    view = glm::translate(view, glm::vec3(0, 0, -1.5));
-    projection = glm::perspective(glm::radians(60.f), width / (float)height, 0.1f, 100.f);
-
-    // Create uniform for the matrices
+    model = glm::rotate(model, time * glm::radians(60.f), glm::vec3(.5f, 1, .25f));
+    view = glm::translate(view, glm::vec3(0, 0, -viewDistance));
+    projection = glm::perspective(glm::radians(60.f), width / (float)height, 0.1f, farPlane);
+
+    profiler.endPhase(PHASE_UPDATE);
+
+    // Upload the camera matrices once per frame by writing them into the mapped stream buffer
+    std::uintptr_t cameraOffset;
+    void* cameraData = scene.stream.allocate(sizeof(CameraUniforms), scene.uniformAlignment, cameraOffset);
+    if (cameraData)
+    {
+      CameraUniforms camera = { view, projection };
+      memcpy(cameraData, &camera, sizeof(camera));
+      glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, scene.stream.buffer(), cameraOffset, sizeof(CameraUniforms));
+    }
+
+    // Create uniform for the model matrix
     /**
      * first argument: uniform location
      * second argument: how many matrices we would like to send
      * third argument: if we would like to transpose out matrix (swap columns and rows)
      * fourth argument: convert to OpenGL format
      */
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "u_model"), 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "u_view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "u_projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniformMatrix4fv(scene.modelLocation, 1, GL_FALSE, glm::value_ptr(model));
 
-    // Draw Vertex Arrays
+    profiler.endPhase(PHASE_UNIFORMS);
+
+    // Planes of the frustum in the space of the instance transforms, so u_model is part of the matrix
+    if (scene.gpuCulling) cullInstances(scene.culling, scene.instanceBuffer, extractFrustum(projection * view * model));
+    else if (scene.cpuCulling) cullInstancesOnCpu(scene, extractFrustum(projection * view * model), frame >= warmupFrames);
+
+    profiler.endPhase(PHASE_CULL);
+
+    // Draw every instance of the indexed mesh with one call
     /**
      * frist argument: the type of primitive we would like to draw
-     * second argument: the index of the vertex array
-     * third argument: the number of vertices to draw
+     * second argument: the number of indices to draw
+     * third argument: the type of the indices
+     * fourth argument: offset into the element buffer of the bound vertex array
+     * fifth argument: the number of instances, each one reads its own a_instanceModel
      */
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+    glUseProgram(scene.program);
+    glBindTexture(GL_TEXTURE_2D, scene.textures.texture(scene.crateTexture));
+    if (scene.animatedTexture >= 0)
+    {
+      // The placeholder is a one layer array, so layer 0 is always there until the animation is uploaded
+      glActiveTexture(GL_TEXTURE0 + ANIMATION_TEXTURE_UNIT);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, scene.textures.texture(scene.animatedTexture));
+      glActiveTexture(GL_TEXTURE0);
+      glUniform1i(scene.animationLayerLocation, scene.textures.animationLayer(scene.animatedTexture, time * 1000.0));
+    }
+    if (scene.heightMap >= 0)
+    {
+      glActiveTexture(GL_TEXTURE0 + HEIGHT_MAP_TEXTURE_UNIT);
+      glBindTexture(GL_TEXTURE_2D, scene.textures.texture(scene.heightMap));
+      glActiveTexture(GL_TEXTURE0);
+    }
+    if (scene.gpuCulling)
+    {
+      drawCulledInstances(scene.culling, scene.mesh.vao);
+    }
+    else
+    {
+      glBindVertexArray(scene.mesh.vao);
+      int instanceCount = scene.cpuCulling ? scene.visibleInstances : scene.instanceCount;
+      glDrawElementsInstanced(GL_TRIANGLES, scene.mesh.indexCount, GL_UNSIGNED_INT, (void*)0, instanceCount);
+    }
+
+    // Everything that reads this frame's stream buffer region has been submitted
+    scene.stream.endFrame();
+
+    profiler.endPhase(PHASE_DRAW);
+
+    if (options.headless)
+    {
+      // There is nothing to present, wait for the GPU instead so the frame time includes the rendering
+      glFinish();
+    }
+    else
+    {
+      // Swaps front and back buffers
+      /**
+       * An application takes time to draw all the pixels on the screen
+       * When an application draws on a single buffer, it can have a flickering effect as not all pixels have been drawn when the screen renders
+       * To solve this issue, applications implement double buffers
+       * The front buffer contains the final output image shown on the screen
+       * All the rendering commands draw to the back buffer
+       * As soon as the back buffer is complete, they swap, instantaneously changing frames without flickering
+       */
+      glfwSwapBuffers(window);
+
+      // Checks if any events are triggered (keyboard, mouse, etc)
+      glfwPollEvents();
+    }
+
+    profiler.endPhase(PHASE_SWAP);
+    profiler.endFrame();
+
+    if (frame == 0) firstFrameEnd = std::chrono::steady_clock::now();
+  }
 
-    // Swaps front and back buffers
-    /**
-     * An application takes time to draw all the pixels on the screen
-     * When an application draws on a single buffer, it can have a flickering effect as not all pixels have been drawn when the screen renders
-     * To solve this issue, applications implement double buffers
-     * The front buffer contains the final output image shown on the screen
-     * All the rendering commands draw to the back buffer
-     * As soon as the back buffer is complete, they swap, instantaneously changing frames without flickering
-     */
-    glfwSwapBuffers(window);
+  return firstFrameEnd;
+}
+
+int main(int argc, char** argv) {
+  auto startTime = std::chrono::steady_clock::now();
+
+  Options options;
+  if (!parseArguments(argc, argv, options)) return -1;
+
+  // Building the texture catalog, cooking and the benchmarks are offline steps, they do not need a window or an OpenGL context
+  if (options.textureCatalog)
+  {
+    TextureCatalog catalog;
+    if (!buildTextureCatalog("textures", catalog)) return -1;
+    printTextureCatalog(catalog, std::cout);
+    return 0;
+  }
+  if (options.cookTextures) return cookTextures("textures") >= 0 ? 0 : -1;
+  if (options.benchDecode) return runDecodeBenchmark("textures/crate-texture1024x1024.png", 5) ? 0 : -1;
+  if (options.benchJpegKernels) return runJpegKernelBenchmark(9) ? 0 : -1;
+  if (options.benchAllocations) return runAllocationBenchmark("textures", 5) ? 0 : -1;
+  if (options.benchFlip) return runFlipBenchmark("textures", 5) ? 0 : -1;
+  if (options.benchHdr) return runHdrBenchmark(5) ? 0 : -1;
+  if (options.benchStream) return runStreamBenchmark("textures", 3) ? 0 : -1;
+  if (options.benchGif) return runGifBenchmark("textures", 5) ? 0 : -1;
+  if (options.benchPrecision) return runPrecisionBenchmark(3) ? 0 : -1;
+  if (options.benchTransforms) return runTransformBenchmark(5) ? 0 : -1;
+  if (options.benchMatrix) return runMatrixBenchmark(5) ? 0 : -1;
+  if (options.benchCulling) return runCullingBenchmark(5) ? 0 : -1;
+
+  GLFWwindow* window = NULL;
+  HeadlessContext headless;
+
+  if (options.headless)
+  {
+    // Get a context without a window + load OpenGL functions through it
+    if (!createHeadlessContext(headless)) return -1;
+
+    if (!gladLoadGLLoader((GLADloadproc)getHeadlessProcAddress))
+    {
+      std::cerr << "Failed to initialize GLAD" << std::endl;
+      return -1;
+    }
+  }
+  else
+  {
+    // Initialize GLFW
+    glfwInit();
+    
+    // Tell GLFW we are using OpenGL 4.6 
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+
+    // Tell GLFW we are using OpenGL Core
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    // Initialise window + check for errors + make window current context
+    window = glfwCreateWindow(options.width, options.height, "Learn OpenGL", NULL, NULL);
+    if (window == NULL)
+    {
+      std::cerr << "Failed to create GLFW window" << std::endl;
+      return -1;
+    }
+    glfwMakeContextCurrent(window);
+
+    // Initialise GLAD + error handling
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+      std::cerr << "Failed to initialize GLAD" << std::endl;
+      return -1;
+    }
+
+    // Resize window if window size changes
+    glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+
+    // Don't let vsync cap the frame rate we are measuring
+    if (options.benchmark) glfwSwapInterval(0);
+  }
+
+  // Headless rendering goes into our own framebuffer instead of the default one
+  Framebuffer framebuffer;
+  if (options.headless) framebuffer = createFramebuffer(options.width, options.height);
+
+  // Tell OpenGL the window size so thet we can use normalized device coordinates
+  glViewport(0, 0, options.width, options.height);
+
+  // Set clear color
+  glClearColor(.5f, .5f, .5f, 1);
+
+  // Enable depth test
+  glEnable(GL_DEPTH_TEST);
+
+  // Start decoding the crate texture right away so it overlaps building the mesh and compiling shaders, it is uploaded in the background while the first frames render
+  Scene scene;
+  if (!scene.textures.create()) return -1;
+  scene.crateTexture = scene.textures.load("textures/crate-texture1024x1024.png");
+  if (!options.animatedTexturePath.empty()) scene.animatedTexture = scene.textures.loadAnimation(options.animatedTexturePath);
+  if (!options.heightMapPath.empty()) scene.heightMap = scene.textures.load(options.heightMapPath, options.heightPrecision);
+
+  // Define vertices of a cube
+  // Each vertex has 5 attributes : x, y, z, u, v
+  Vertex vertices[] = {
+    { { -.25f, -.25f, -.25f }, { 0, 0 } },
+    { {  .25f, -.25f, -.25f }, { 1, 0 } },
+    { {  .25f, .25f, -.25f }, { 1, 1 } },
+    { {  .25f, .25f, -.25f }, { 1, 1 } },
+    { { -.25f, .25f, -.25f }, { 0, 1 } },
+    { { -.25f, -.25f, -.25f }, { 0, 0 } },
+
+    { { -.25f, -.25f, .25f }, { 0, 0 } },
+    { {  .25f, -.25f, .25f }, { 1, 0 } },
+    { {  .25f, .25f, .25f }, { 1, 1 } },
+    { {  .25f, .25f, .25f }, { 1, 1 } },
+    { { -.25f, .25f, .25f }, { 0, 1 } },
+    { { -.25f, -.25f, .25f }, { 0, 0 } },
+
+    { { -.25f, .25f, .25f }, { 1, 0 } },
+    { { -.25f, .25f, -.25f }, { 1, 1 } },
+    { { -.25f, -.25f, -.25f }, { 0, 1 } },
+    { { -.25f, -.25f, -.25f }, { 0, 1 } },
+    { { -.25f, -.25f, .25f }, { 0, 0 } },
+    { { -.25f, .25f, .25f }, { 1, 0 } },
+
+    { {  .25f, .25f, .25f }, { 1, 0 } },
+    { {  .25f, .25f, -.25f }, { 1, 1 } },
+    { {  .25f, -.25f, -.25f }, { 0, 1 } },
+    { {  .25f, -.25f, -.25f }, { 0, 1 } },
+    { {  .25f, -.25f, .25f }, { 0, 0 } },
+    { {  .25f, .25f, .25f }, { 1, 0 } },
+
+    { { -.25f, -.25f, -.25f }, { 0, 1 } },
+    { {  .25f, -.25f, -.25f }, { 1, 1 } },
+    { {  .25f, -.25f, .25f }, { 1, 0 } },
+    { {  .25f, -.25f, .25f }, { 1, 0 } },
+    { { -.25f, -.25f, .25f }, { 0, 0 } },
+    { { -.25f, -.25f, -.25f }, { 0, 1 } },
+
+    { { -.25f, .25f, -.25f }, { 0, 1 } },
+    { {  .25f, .25f, -.25f }, { 1, 1 } },
+    { {  .25f, .25f, .25f }, { 1, 0 } },
+    { {  .25f, .25f, .25f }, { 1, 0 } },
+    { { -.25f, .25f, .25f }, { 0, 0 } },
+    { { -.25f, .25f, -.25f }, { 0, 1 } }
+  };
+
+  // Weld the 36 expanded vertices into the unique ones + 36 indices and order the triangles for the vertex cache
+  size_t vertexCount = sizeof(vertices) / sizeof(vertices[0]);
+  Mesh cube = buildIndexedMesh(vertices, vertexCount);
+
+  std::vector<unsigned int> drawArraysOrder(vertexCount);
+  for (size_t i = 0; i < vertexCount; i++) drawArraysOrder[i] = (unsigned int)i;
+  float acmrBefore = computeACMR(drawArraysOrder, vertexCount);
+  float acmrIndexed = computeACMR(cube.indices, cube.vertices.size());
+  optimizeVertexCache(cube.indices, cube.vertices.size());
+  float acmrOptimized = computeACMR(cube.indices, cube.vertices.size());
+
+  std::cout << "Cube mesh: " << vertexCount << " -> " << cube.vertices.size() << " vertices, ACMR "
+            << acmrBefore << " (glDrawArrays) -> " << acmrIndexed << " (indexed) -> " << acmrOptimized << " (optimized)" << std::endl;
 
-    // Checks if any events are triggered (keyboard, mouse, etc)
-    glfwPollEvents();
+  // Upload vertex + index buffers and describe the vertex layout
+  GpuMesh cubeMesh = uploadMesh(cube);
+
+  // Compile and link shaders, or load the linked program from the cache of an earlier run
+  ProgramLoadResult programLoad = loadProgram(options.programCache, readFile("shaders/vertex-shader.glsl"), readFile("shaders/fragment-shader.glsl"));
+  ShaderProgram shaderProgram = reflectProgram(programLoad.program);
+  std::cout << "Shader program " << (programLoad.cacheHit ? "loaded from cache (warm)" : "compiled from source (cold)")
+            << " in " << programLoad.milliseconds << " ms" << std::endl;
+
+  // Use the program we just created
+  glUseProgram(shaderProgram.id);
+
+  // Look up uniform locations once instead of every frame
+  int modelLocation = shaderProgram.uniformLocation("u_model");
+  glUniform1i(shaderProgram.uniformLocation("u_animation"), ANIMATION_TEXTURE_UNIT);
+  glUniform1i(shaderProgram.uniformLocation("u_heightMap"), HEIGHT_MAP_TEXTURE_UNIT);
+  glUniform1i(shaderProgram.uniformLocation("u_heightShading"), options.heightMapPath.empty() ? GL_FALSE : GL_TRUE);
+
+  // The camera matrices live in a uniform block that all draws share, filled from the stream buffer every frame
+  const ShaderUniformBlock* cameraBlock = shaderProgram.uniformBlock("Camera");
+  if (!cameraBlock || cameraBlock->dataSize != sizeof(CameraUniforms))
+  {
+    std::cerr << "Camera uniform block does not match CameraUniforms" << std::endl;
+  }
+
+  // A sweep benchmarks the same scene with 1, 10, 100, ... instances up to --instances, otherwise there is one run
+  std::vector<int> instanceCounts;
+  if (options.instanceSweep)
+  {
+    for (long long count = 1; count <= options.instances; count *= 10) instanceCounts.push_back((int)count);
+  }
+  else
+  {
+    instanceCounts.push_back(options.instances);
+  }
+
+  scene.mesh = cubeMesh;
+  scene.program = shaderProgram.id;
+  scene.modelLocation = modelLocation;
+  scene.animationLayerLocation = shaderProgram.uniformLocation("u_animationLayer");
+  scene.gpuCulling = options.gpuCulling && createGpuCulling(scene.culling, options.programCache);
+  scene.cpuCulling = options.cpuCulling && !scene.gpuCulling;
+
+  // With CPU culling every frame may stream the transforms of all instances
+  std::uintptr_t streamRegionSize = STREAM_REGION_SIZE;
+  if (scene.cpuCulling) streamRegionSize += (std::uintptr_t)options.instances * sizeof(glm::mat4);
+  if (!scene.stream.create(streamRegionSize)) return -1;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &scene.uniformAlignment);
+
+  // Headless output is compared between runs, so it must not depend on how fast the texture arrived
+  if (options.headless) scene.textures.waitAll();
+
+  int warmupFrames = options.benchmark ? options.warmupFrames : 0;
+  std::vector<std::string> reports;
+  double timeToFirstFrame = -1;
+
+  for (int instanceCount : instanceCounts)
+  {
+    setInstanceCount(scene, instanceCount);
+
+    FrameProfiler profiler;
+    scene.stream.resetStats();
+    scene.cullingStats = CullingStats();
+    auto firstFrameEnd = runFrames(window, options, scene, profiler, warmupFrames);
+    profiler.finish();
+
+    if (timeToFirstFrame < 0)
+    {
+      timeToFirstFrame = std::chrono::duration<double, std::milli>(firstFrameEnd - startTime).count();
+      std::cout << "First frame after " << timeToFirstFrame << " ms" << std::endl;
+    }
+
+    const StreamRingBuffer::Stats& streamStats = scene.stream.stats();
+
+    if (options.headless || options.benchmark)
+    {
+      std::cout << "Rendered " << profiler.recordedFrames() << " frames (+" << warmupFrames << " warm-up) of "
+                << instanceCount << " instances at " << options.width << "x" << options.height << " on " << glGetString(GL_RENDERER) << std::endl;
+      profiler.printSummary(std::cout);
+      std::cout << "Stream buffer: " << streamStats.waits << " waits over " << streamStats.frames << " frames, "
+                << streamStats.stallMilliseconds << " ms stalled, " << streamStats.bytesAllocated << " bytes streamed" << std::endl;
+      if (scene.cpuCulling)
+      {
+        const CullingStats& culled = scene.cullingStats;
+        double frames = (double)std::max<size_t>(1, profiler.recordedFrames());
+        std::cout << "CPU culling per frame: " << culled.visible / frames << " of " << instanceCount << " instances visible, "
+                  << culled.objectsTested / frames << " tested, " << culled.groupsOutside / frames << " groups outside and "
+                  << culled.groupsInside / frames << " inside, " << culled.milliseconds / frames << " ms" << std::endl;
+      }
+    }
+
+    if (options.benchmark)
+    {
+      std::ostringstream report;
+      profiler.writeJson(report, {
+        { "renderer", jsonString((const char*)glGetString(GL_RENDERER)) },
+        { "version", jsonString((const char*)glGetString(GL_VERSION)) },
+        { "headless", options.headless ? "true" : "false" },
+        { "width", std::to_string(options.width) },
+        { "height", std::to_string(options.height) },
+        { "warmupFrames", std::to_string(warmupFrames) },
+        { "timeStep", std::to_string(options.timeStep) },
+        { "instances", std::to_string(instanceCount) },
+        { "gpuCulling", scene.gpuCulling ? "true" : "false" },
+        { "cpuCulling", scene.cpuCulling ? "true" : "false" },
+        { "cullVisible", std::to_string(scene.cullingStats.visible / std::max<size_t>(1, profiler.recordedFrames())) },
+        { "cullTested", std::to_string(scene.cullingStats.objectsTested / std::max<size_t>(1, profiler.recordedFrames())) },
+        { "cullMs", std::to_string(scene.cullingStats.milliseconds / std::max<size_t>(1, profiler.recordedFrames())) },
+        { "streamWaits", std::to_string(streamStats.waits) },
+        { "streamStallMs", std::to_string(streamStats.stallMilliseconds) },
+        { "streamBytes", std::to_string(streamStats.bytesAllocated) },
+        { "programCacheHit", programLoad.cacheHit ? "true" : "false" },
+        { "programLoadMs", std::to_string(programLoad.milliseconds) },
+        { "acmr", std::to_string(acmrOptimized) },
+        { "timeToFirstFrameMs", std::to_string(timeToFirstFrame) }
+      });
+      reports.push_back(report.str());
+    }
+  }
+
+  bool success = true;
+  if (options.benchmark)
+  {
+    std::ofstream reportFile(options.reportPath);
+    if (options.instanceSweep)
+    {
+      reportFile << "{ \"sweep\": [" << std::endl;
+      for (size_t i = 0; i < reports.size(); i++) reportFile << reports[i] << (i + 1 < reports.size() ? "," : "") << std::endl;
+      reportFile << "] }" << std::endl;
+    }
+    else
+    {
+      reportFile << reports[0] << std::endl;
+    }
+
+    success = (bool)reportFile;
+    if (success) std::cout << "Wrote " << options.reportPath << std::endl;
+    else std::cerr << "Cannot write file: " << options.reportPath << std::endl;
+  }
+
+  if (options.headless)
+  {
+    bool written = writeFramebufferToPPM(framebuffer, options.outputPath);
+    if (written) std::cout << "Wrote " << options.outputPath << std::endl;
+
+    // Proper cleanup
+    glDeleteBuffers(1, &scene.instanceBuffer);
+    if (scene.gpuCulling) destroyGpuCulling(scene.culling);
+    scene.stream.destroy();
+    scene.textures.destroy();
+    destroyMesh(cubeMesh);
+    destroyFramebuffer(framebuffer);
+    destroyHeadlessContext(headless);
+    return success && written ? 0 : -1;
   }
 
   // Proper cleanup
+  scene.textures.destroy();
   glfwTerminate();
 
-  return 0;
-}
\ No newline at end of file
+  return success ? 0 : -1;
+}
@@ -0,0 +1,96 @@
+#include "mapped-file.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+bool openMappedFile(const std::string& path, MappedFile& mappedFile)
+{
+  mappedFile = MappedFile();
+
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE) return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+  if (!data)
+  {
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  mappedFile.data = (const unsigned char*)data;
+  mappedFile.size = (size_t)size.QuadPart;
+  mappedFile.file = file;
+  mappedFile.mapping = mapping;
+  return true;
+}
+
+void closeMappedFile(MappedFile& mappedFile)
+{
+  if (mappedFile.data) UnmapViewOfFile(mappedFile.data);
+  if (mappedFile.mapping) CloseHandle((HANDLE)mappedFile.mapping);
+  if (mappedFile.file) CloseHandle((HANDLE)mappedFile.file);
+  mappedFile = MappedFile();
+}
+
+void prefetchMappedFile(const MappedFile& mappedFile)
+{
+  // FILE_FLAG_SEQUENTIAL_SCAN already makes the cache manager read ahead
+}
+
+#else
+
+bool openMappedFile(const std::string& path, MappedFile& mappedFile)
+{
+  mappedFile = MappedFile();
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat status;
+  if (fstat(fd, &status) != 0 || status.st_size == 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  // The mapping keeps the file alive, the descriptor is not needed after this
+  void* data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return false;
+
+  mappedFile.data = (const unsigned char*)data;
+  mappedFile.size = (size_t)status.st_size;
+  return true;
+}
+
+void closeMappedFile(MappedFile& mappedFile)
+{
+  if (mappedFile.data) munmap((void*)mappedFile.data, mappedFile.size);
+  mappedFile = MappedFile();
+}
+
+void prefetchMappedFile(const MappedFile& mappedFile)
+{
+  if (mappedFile.data) madvise((void*)mappedFile.data, mappedFile.size, MADV_WILLNEED);
+}
+
+#endif
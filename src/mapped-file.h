@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * A read only memory mapping of a whole file
+ * The operating system pages the file in on first access, so nothing is copied until the bytes are actually read
+ * and the pages can be dropped again under memory pressure without being written to swap
+*/
+struct MappedFile
+{
+  const unsigned char* data = nullptr;
+  size_t size = 0;
+
+  // File and mapping handles on Windows, POSIX only needs the mapped address
+  void* file = nullptr;
+  void* mapping = nullptr;
+};
+
+// Returns false if the file cannot be opened or is empty
+bool openMappedFile(const std::string& path, MappedFile& mappedFile);
+void closeMappedFile(MappedFile& mappedFile);
+
+// Asks the operating system to start reading the file in the background (a no-op where that is not available)
+void prefetchMappedFile(const MappedFile& mappedFile);
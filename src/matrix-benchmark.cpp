@@ -0,0 +1,297 @@
+#include "matrix-benchmark.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_aligned.hpp>
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <glm/simd/matrix.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// Matrices per timed pass, 256 KB of input, small enough to stay in the L2 cache
+const int MATRIX_COUNT = 4096;
+
+// How much further from the double precision result than the scalar code the SIMD paths may be: the projections
+// with a 0.1 near plane lose about a thousand ULPs to cancellation in inverse and determinant whatever the order of the sums
+const double ERROR_BOUND_FACTOR = 2;
+const double ERROR_BOUND_ULPS = 4;
+
+const char* OPERATIONS[3] = { "multiply", "inverse", "determinant" };
+
+struct Rng
+{
+  std::uint32_t state = 12345;
+  std::uint32_t next() { return state = state * 1664525u + 1013904223u; }
+
+  // In [low, high)
+  float uniform(float low, float high) { return low + (high - low) * (next() >> 8) * (1.f / (1 << 24)); }
+};
+
+/**
+ * What a game multiplies and inverts: model matrices (translation, rotation, non uniform scale),
+ * cameras looking at random points and their products with perspective projections
+*/
+std::vector<glm::mat4> buildMatrices(Rng& rng)
+{
+  std::vector<glm::mat4> matrices;
+  for (int i = 0; i < MATRIX_COUNT; i++)
+  {
+    glm::vec3 position(rng.uniform(-100, 100), rng.uniform(-100, 100), rng.uniform(-100, 100));
+    glm::vec3 axis = glm::normalize(glm::vec3(rng.uniform(-1, 1), rng.uniform(-1, 1), rng.uniform(.1f, 1)));
+    glm::vec3 scale(rng.uniform(.5f, 2), rng.uniform(.5f, 2), rng.uniform(.5f, 2));
+    glm::mat4 model = glm::scale(glm::rotate(glm::translate(glm::mat4(1), position), rng.uniform(0, 6.28f), axis), scale);
+    glm::mat4 view = glm::lookAt(position, glm::vec3(rng.uniform(-10, 10), rng.uniform(-10, 10), rng.uniform(-10, 10)), glm::vec3(0, 1, 0));
+    glm::mat4 projection = glm::perspective(rng.uniform(.5f, 1.5f), rng.uniform(1, 2), .1f, 1000.f);
+
+    switch (i % 3)
+    {
+    case 0: matrices.push_back(model); break;
+    case 1: matrices.push_back(view); break;
+    default: matrices.push_back(projection * view); break;
+    }
+  }
+  return matrices;
+}
+
+// Distance from x to reference in units in the last place of scale
+double ulps(double x, double reference, double scale)
+{
+  float magnitude = (float)std::abs(scale);
+  double ulp = std::nextafter(magnitude, INFINITY) - magnitude;
+  return std::abs(x - reference) / ulp;
+}
+
+// Largest distance of any element, each in ULPs of the largest element of its column
+double matrixUlps(const glm::mat4& m, const glm::dmat4& reference)
+{
+  double worst = 0;
+  for (int column = 0; column < 4; column++)
+  {
+    double scale = 0;
+    for (int row = 0; row < 4; row++) scale = std::max(scale, std::abs(reference[column][row]));
+    for (int row = 0; row < 4; row++) worst = std::max(worst, ulps(m[column][row], reference[column][row], scale));
+  }
+  return worst;
+}
+
+// The results of one operation over all matrices, as matrices or as determinants
+struct Results
+{
+  std::vector<glm::mat4> matrices;
+  std::vector<float> values;
+};
+
+// The same matrices as glm::mat4 for the scalar code and as aligned_highp_mat4 for the SIMD code
+struct Inputs
+{
+  std::vector<glm::mat4> packed;
+  std::vector<glm::aligned_highp_mat4> aligned;
+};
+
+struct Path
+{
+  std::string name;
+  // Runs the operation on every matrix into results
+  std::function<void(const Inputs&, Results&)> run;
+};
+
+// Fastest of iterations runs of body, each one calling it repeat times, in nanoseconds per matrix
+template <typename Body>
+double timePasses(int iterations, int repeat, Body body)
+{
+  double best = 1e30;
+  for (int i = 0; i < iterations; i++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++) body();
+    double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    best = std::min(best, nanoseconds / repeat / MATRIX_COUNT);
+  }
+  return best;
+}
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+const glm_vec4* columns(const glm::aligned_highp_mat4& m)
+{
+  return reinterpret_cast<const glm_vec4*>(&m[0]);
+}
+
+glm_vec4* columns(glm::mat4& m)
+{
+  return reinterpret_cast<glm_vec4*>(&m[0]);
+}
+#endif
+
+// The SIMD paths of one operation, the first one is the scalar code glm::mat4 uses
+std::vector<Path> pathsOf(int operation)
+{
+  std::vector<Path> paths;
+  const glm::aligned_highp_mat4 parent = glm::aligned_highp_mat4(glm::perspective(1.f, 1.5f, .1f, 1000.f));
+
+  if (operation == 0)
+  {
+    paths.push_back({ "glm::mat4 (scalar)", [=](const Inputs& in, Results& out)
+    {
+      glm::mat4 left(parent);
+      for (int i = 0; i < MATRIX_COUNT; i++) out.matrices[i] = left * in.packed[i];
+    } });
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    paths.push_back({ "glm_mat4_mul (SSE2)", [=](const Inputs& in, Results& out)
+    {
+      for (int i = 0; i < MATRIX_COUNT; i++) glm_mat4_mul(columns(parent), columns(in.aligned[i]), columns(out.matrices[i]));
+    } });
+#endif
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+    paths.push_back({ GLM_HAS_FMA ? "glm_mat4_mul_avx (FMA)" : "glm_mat4_mul_avx", [=](const Inputs& in, Results& out)
+    {
+      for (int i = 0; i < MATRIX_COUNT; i++) glm_mat4_mul_avx(columns(parent), columns(in.aligned[i]), columns(out.matrices[i]));
+    } });
+#endif
+    paths.push_back({ "aligned_highp_mat4", [=](const Inputs& in, Results& out)
+    {
+      for (int i = 0; i < MATRIX_COUNT; i++) out.matrices[i] = glm::mat4(parent * in.aligned[i]);
+    } });
+  }
+  else if (operation == 1)
+  {
+    paths.push_back({ "glm::mat4 (scalar)", [](const Inputs& in, Results& out)
+    {
+      for (int i = 0; i < MATRIX_COUNT; i++) out.matrices[i] = glm::detail::compute_inverse<glm::tmat4x4, float, glm::highp, false>::call(in.packed[i]);
+    } });
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    paths.push_back({ "glm_mat4_inverse (SSE2)", [](const Inputs& in, Results& out)
+    {
+      for (int i = 0; i < MATRIX_COUNT; i++) glm_mat4_inverse(columns(in.aligned[i]), columns(out.matrices[i]));
+    } });
+#endif
+#if GLM_HAS_FMA
+    paths.push_back({ "glm_mat4_inverse_fma", [](const Inputs& in, Results& out)
+    {
+      for (int i = 0; i < MATRIX_COUNT; i++) glm_mat4_inverse_fma(columns(in.aligned[i]), columns(out.matrices[i]));
+    } });
+#endif
+    paths.push_back({ "aligned_highp_mat4", [](const Inputs& in, Results& out)
+    {
+      for (int i = 0; i < MATRIX_COUNT; i++) out.matrices[i] = glm::mat4(glm::inverse(in.aligned[i]));
+    } });
+  }
+  else
+  {
+    paths.push_back({ "glm::mat4 (scalar)", [](const Inputs& in, Results& out)
+    {
+      for (int i = 0; i < MATRIX_COUNT; i++) out.values[i] = glm::determinant(in.packed[i]);
+    } });
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    paths.push_back({ "glm_mat4_determinant (SSE2)", [](const Inputs& in, Results& out)
+    {
+      for (int i = 0; i < MATRIX_COUNT; i++) out.values[i] = _mm_cvtss_f32(glm_mat4_determinant(columns(in.aligned[i])));
+    } });
+#endif
+#if GLM_HAS_FMA
+    paths.push_back({ "glm_mat4_determinant_fma", [](const Inputs& in, Results& out)
+    {
+      for (int i = 0; i < MATRIX_COUNT; i++) out.values[i] = _mm_cvtss_f32(glm_mat4_determinant_fma(columns(in.aligned[i])));
+    } });
+#endif
+    paths.push_back({ "aligned_highp_mat4", [](const Inputs& in, Results& out)
+    {
+      for (int i = 0; i < MATRIX_COUNT; i++) out.values[i] = glm::determinant(in.aligned[i]);
+    } });
+  }
+  return paths;
+}
+
+// Largest distance of any result of the operation to reference, in ULPs
+double resultUlps(int operation, const Results& results, const std::vector<glm::dmat4>& matrices, const std::vector<double>& values)
+{
+  double worst = 0;
+  for (int i = 0; i < MATRIX_COUNT; i++)
+  {
+    if (operation == 2) worst = std::max(worst, ulps(results.values[i], values[i], values[i]));
+    else worst = std::max(worst, matrixUlps(results.matrices[i], matrices[i]));
+  }
+  return worst;
+}
+
+}
+
+bool runMatrixBenchmark(int iterations)
+{
+  const char* build = GLM_HAS_FMA ? "AVX and FMA" : (GLM_ARCH & GLM_ARCH_AVX_BIT) ? "AVX without FMA" : (GLM_ARCH & GLM_ARCH_SSE2_BIT) ? "SSE2" : "no SIMD";
+  std::cout << "glm SIMD paths in this build: " << build;
+  if (!GLM_HAS_FMA) std::cout << " (build with -mavx2 -mfma or -march=native for the AVX and FMA paths)";
+  std::cout << std::endl;
+
+  Rng rng;
+  Inputs inputs;
+  inputs.packed = buildMatrices(rng);
+  inputs.aligned.assign(inputs.packed.begin(), inputs.packed.end());
+  glm::dmat4 parent = glm::dmat4(glm::perspective(1.f, 1.5f, .1f, 1000.f));
+
+  std::cout << std::left << std::setw(14) << "operation" << std::setw(30) << "path" << std::right << std::setw(9) << "ns" << std::setw(9) << "x"
+            << std::setw(16) << "ulps vs scalar" << std::setw(16) << "ulps vs double" << std::endl;
+
+  bool success = true;
+  for (int operation = 0; operation < 3; operation++)
+  {
+    // The same operation in double precision
+    std::vector<glm::dmat4> exactMatrices(MATRIX_COUNT);
+    std::vector<double> exactValues(MATRIX_COUNT);
+    for (int i = 0; i < MATRIX_COUNT; i++)
+    {
+      glm::dmat4 m = glm::dmat4(inputs.packed[i]);
+      if (operation == 0) exactMatrices[i] = parent * m;
+      else if (operation == 1) exactMatrices[i] = glm::inverse(m);
+      else exactValues[i] = glm::determinant(m);
+    }
+
+    Results scalar;
+    std::vector<glm::dmat4> scalarMatrices(MATRIX_COUNT);
+    std::vector<double> scalarValues(MATRIX_COUNT);
+    double scalarNanoseconds = 0;
+    double scalarUlps = 0;
+
+    for (const Path& path : pathsOf(operation))
+    {
+      Results results;
+      results.matrices.resize(MATRIX_COUNT);
+      results.values.resize(MATRIX_COUNT);
+      double nanoseconds = timePasses(iterations, 64, [&] { path.run(inputs, results); });
+
+      bool first = scalarNanoseconds == 0;
+      if (first)
+      {
+        scalarNanoseconds = nanoseconds;
+        for (int i = 0; i < MATRIX_COUNT; i++)
+        {
+          scalarMatrices[i] = glm::dmat4(results.matrices[i]);
+          scalarValues[i] = results.values[i];
+        }
+        scalarUlps = resultUlps(operation, results, exactMatrices, exactValues);
+      }
+
+      double vsScalar = resultUlps(operation, results, scalarMatrices, scalarValues);
+      double vsExact = resultUlps(operation, results, exactMatrices, exactValues);
+      bool withinBound = vsExact <= scalarUlps * ERROR_BOUND_FACTOR + ERROR_BOUND_ULPS;
+      success = withinBound && success;
+
+      std::cout << std::left << std::setw(14) << OPERATIONS[operation] << std::setw(30) << path.name << std::right << std::fixed
+                << std::setprecision(2) << std::setw(9) << nanoseconds << std::setw(8) << scalarNanoseconds / nanoseconds << "x"
+                << std::setprecision(1) << std::setw(16) << vsScalar << std::setw(16) << vsExact << (withinBound ? "" : "   TOO FAR") << std::endl;
+      std::cout.unsetf(std::ios::floatfield);
+    }
+  }
+  return success;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+/**
+ * Times glm's mat4 multiply, inverse and determinant: the scalar code glm::mat4 uses, the SSE2 functions of
+ * glm/simd/matrix.h, their AVX and FMA versions when the build enables them (-mavx2 -mfma or -march=native)
+ * and glm::aligned_highp_mat4, which goes through whichever of those the build has
+ *
+ * Every SIMD result is compared to the scalar one and to a double precision reference, in ULPs of the largest
+ * element of the column (of the determinant itself)
+ *
+ * Returns false if a SIMD result is further from the double precision reference than the scalar one by more than
+ * ERROR_BOUND_FACTOR and ERROR_BOUND_ULPS of matrix-benchmark.cpp allow
+*/
+bool runMatrixBenchmark(int iterations);
@@ -0,0 +1,278 @@
+#include "mesh.h"
+
+#include <glad/glad.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <unordered_map>
+
+static_assert(sizeof(Vertex) == 5 * sizeof(float), "Vertex must be tightly packed to match the vertex attribute layout");
+
+// Welding compares vertices bit for bit, so hash their bytes
+struct VertexHash
+{
+  size_t operator()(const Vertex& vertex) const
+  {
+    unsigned char bytes[sizeof(Vertex)];
+    memcpy(bytes, &vertex, sizeof(Vertex));
+
+    size_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char byte : bytes)
+    {
+      hash ^= byte;
+      hash *= 0x100000001b3ull;
+    }
+    return hash;
+  }
+};
+
+struct VertexEqual
+{
+  bool operator()(const Vertex& a, const Vertex& b) const
+  {
+    return memcmp(&a, &b, sizeof(Vertex)) == 0;
+  }
+};
+
+Mesh buildIndexedMesh(const Vertex* vertices, size_t vertexCount)
+{
+  Mesh mesh;
+  mesh.indices.reserve(vertexCount);
+
+  std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> uniqueVertices;
+  uniqueVertices.reserve(vertexCount);
+
+  for (size_t i = 0; i < vertexCount; i++)
+  {
+    auto [entry, inserted] = uniqueVertices.try_emplace(vertices[i], (unsigned int)mesh.vertices.size());
+    if (inserted) mesh.vertices.push_back(vertices[i]);
+    mesh.indices.push_back(entry->second);
+  }
+
+  return mesh;
+}
+
+// Size of the cache the scores are tuned for, real caches are usually smaller but the ordering still helps them
+static const int FORSYTH_CACHE_SIZE = 32;
+
+static float forsythVertexScore(int cachePosition, int remainingTriangles)
+{
+  // A vertex without triangles left can't help any future triangle
+  if (remainingTriangles == 0) return -1.f;
+
+  float score = 0;
+  if (cachePosition >= 0)
+  {
+    // The 3 vertices of the last triangle get a fixed score so the next triangle doesn't just reuse the same edge
+    if (cachePosition < 3) score = .75f;
+    else score = std::pow(1.f - (cachePosition - 3) / (float)(FORSYTH_CACHE_SIZE - 3), 1.5f);
+  }
+
+  // Vertices with few triangles left get a boost so they are finished off and leave the cache for good
+  score += 2.f * std::pow((float)remainingTriangles, -.5f);
+  return score;
+}
+
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+  size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) return;
+
+  // Triangles that use each vertex, stored as one list with an offset per vertex
+  std::vector<int> remainingTriangles(vertexCount, 0);
+  for (unsigned int index : indices) remainingTriangles[index]++;
+
+  std::vector<size_t> adjacencyOffset(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; v++) adjacencyOffset[v + 1] = adjacencyOffset[v] + remainingTriangles[v];
+
+  std::vector<unsigned int> adjacency(indices.size());
+  std::vector<int> filled(vertexCount, 0);
+  for (size_t t = 0; t < triangleCount; t++)
+  {
+    for (int corner = 0; corner < 3; corner++)
+    {
+      unsigned int v = indices[t * 3 + corner];
+      adjacency[adjacencyOffset[v] + filled[v]++] = (unsigned int)t;
+    }
+  }
+
+  std::vector<float> vertexScore(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++) vertexScore[v] = forsythVertexScore(-1, remainingTriangles[v]);
+
+  auto triangleScore = [&](size_t t)
+  {
+    return vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+  };
+
+  // The first triangle is the best one overall, after that we only look at triangles touching the cache
+  int bestTriangle = 0;
+  for (size_t t = 1; t < triangleCount; t++)
+  {
+    if (triangleScore(t) > triangleScore(bestTriangle)) bestTriangle = (int)t;
+  }
+
+  std::vector<bool> triangleAdded(triangleCount, false);
+
+  std::vector<unsigned int> cache;
+  std::vector<unsigned int> newCache;
+  cache.reserve(FORSYTH_CACHE_SIZE + 3);
+  newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+  std::vector<unsigned int> output;
+  output.reserve(indices.size());
+  size_t scanCursor = 0;
+
+  while (output.size() < indices.size())
+  {
+    // Nothing in the cache has triangles left, continue with the next triangle that was not added yet
+    if (bestTriangle < 0)
+    {
+      while (triangleAdded[scanCursor]) scanCursor++;
+      bestTriangle = (int)scanCursor;
+    }
+
+    const unsigned int* triangle = &indices[bestTriangle * 3];
+    triangleAdded[bestTriangle] = true;
+
+    newCache.clear();
+    for (int corner = 0; corner < 3; corner++)
+    {
+      unsigned int v = triangle[corner];
+      output.push_back(v);
+      newCache.push_back(v);
+
+      // Remove the triangle from the vertex's list of remaining triangles
+      unsigned int* begin = &adjacency[adjacencyOffset[v]];
+      int count = remainingTriangles[v];
+      for (int i = 0; i < count; i++)
+      {
+        if (begin[i] == (unsigned int)bestTriangle)
+        {
+          begin[i] = begin[count - 1];
+          break;
+        }
+      }
+      remainingTriangles[v]--;
+    }
+
+    // Move the triangle's vertices to the front of the cache, everything else moves back
+    for (unsigned int v : cache)
+    {
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2]) newCache.push_back(v);
+    }
+
+    // Vertices pushed past the end fall out of the cache
+    for (size_t i = FORSYTH_CACHE_SIZE; i < newCache.size(); i++)
+    {
+      vertexScore[newCache[i]] = forsythVertexScore(-1, remainingTriangles[newCache[i]]);
+    }
+    if (newCache.size() > (size_t)FORSYTH_CACHE_SIZE) newCache.resize(FORSYTH_CACHE_SIZE);
+    cache.swap(newCache);
+
+    // Rescore everything in the cache and pick the best triangle that touches it
+    for (size_t i = 0; i < cache.size(); i++)
+    {
+      vertexScore[cache[i]] = forsythVertexScore((int)i, remainingTriangles[cache[i]]);
+    }
+
+    bestTriangle = -1;
+    float bestScore = -1;
+    for (unsigned int v : cache)
+    {
+      for (int j = 0; j < remainingTriangles[v]; j++)
+      {
+        unsigned int t = adjacency[adjacencyOffset[v] + j];
+        float score = triangleScore(t);
+        if (score > bestScore)
+        {
+          bestScore = score;
+          bestTriangle = (int)t;
+        }
+      }
+    }
+  }
+
+  indices.swap(output);
+}
+
+float computeACMR(const std::vector<unsigned int>& indices, size_t vertexCount, size_t cacheSize)
+{
+  size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) return 0;
+
+  // FIFO cache: a vertex is still cached if fewer than cacheSize misses happened since it was loaded
+  std::vector<size_t> loadedAt(vertexCount, 0);
+  std::vector<bool> loaded(vertexCount, false);
+  size_t misses = 0;
+
+  for (unsigned int index : indices)
+  {
+    if (loaded[index] && misses - loadedAt[index] < cacheSize) continue;
+
+    loaded[index] = true;
+    loadedAt[index] = misses;
+    misses++;
+  }
+
+  return misses / (float)triangleCount;
+}
+
+GpuMesh uploadMesh(const Mesh& mesh)
+{
+  GpuMesh gpuMesh;
+  gpuMesh.indexCount = (int)mesh.indices.size();
+
+  // Generate vertex buffer, element buffer, vertex attribute array
+  glGenVertexArrays(1, &gpuMesh.vao);
+  glGenBuffers(1, &gpuMesh.vbo);
+  glGenBuffers(1, &gpuMesh.ebo);
+
+  // Bind Vertex Array
+  glBindVertexArray(gpuMesh.vao);
+
+  // Bind buffers to its buffer type
+  /**
+   * OpenGL allows you to bind multiple buffers as long as they have separate buffer types
+   * The element buffer binding is stored in the vertex array, so glDrawElements picks it up when the vertex array is bound
+  */
+  glBindBuffer(GL_ARRAY_BUFFER, gpuMesh.vbo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuMesh.ebo);
+
+  // Copies the data to the buffer bound to the its respective buffer type
+  /**
+   * first argument: type of the buffer we want to copy data into
+   * second argument: size of the data in bytes
+   * third argument: data
+   * fourth argument: specifies the graphics card how you want to manage the data
+   *   - GL_STREAM_DRAW: the data is set only once and used by the GPU at most a few times.
+   *   - GL_STATIC_DRAW: the data is set only once and used many times.
+   *   - GL_DYNAMIC_DRAW: the data is changed a lot and used many times.
+  */
+  glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(Vertex), mesh.vertices.data(), GL_STATIC_DRAW);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(), GL_STATIC_DRAW);
+
+  // Tells OpenGL the layout of out vertex data
+  /**
+   * first argument: location of the vertex attribute array we want to configure
+   * second argument: number of values in the vertex attribute
+   * third argument: data type
+   * forth argument: whether the values should be normalized
+   * fifth argument: the space between the start of two consecutive vertex attributes in the array in bytes (also known as stride)
+   * sixth argument: offset of where the position data begins (it has to be cast into a void pointer for some reason, idk why)
+  */
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, textureCoord));
+  glEnableVertexAttribArray(1);
+
+  return gpuMesh;
+}
+
+void destroyMesh(GpuMesh& mesh)
+{
+  glDeleteVertexArrays(1, &mesh.vao);
+  glDeleteBuffers(1, &mesh.vbo);
+  glDeleteBuffers(1, &mesh.ebo);
+  mesh = GpuMesh();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Layout of one vertex in the vertex buffer: x, y, z, u, v
+struct Vertex
+{
+  glm::vec3 position;
+  glm::vec2 textureCoord;
+};
+
+// An indexed triangle list on the CPU
+struct Mesh
+{
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+};
+
+// The same mesh uploaded to the GPU, ready for glDrawElements
+struct GpuMesh
+{
+  unsigned int vao = 0;
+  unsigned int vbo = 0;
+  unsigned int ebo = 0;
+  int indexCount = 0;
+};
+
+/**
+ * Turns a non-indexed triangle list (3 vertices per triangle) into an indexed one
+ * Vertices with exactly the same position and texture coordinate are welded into one,
+ * so the vertex shader runs once for them instead of once per triangle that uses them
+*/
+Mesh buildIndexedMesh(const Vertex* vertices, size_t vertexCount);
+
+/**
+ * Reorders triangles so vertices are reused while they are still in the GPU's post-transform vertex cache
+ * This is Tom Forsyth's "Linear-Speed Vertex Cache Optimisation", it does not depend on the exact cache size
+*/
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+
+/**
+ * Average cache miss ratio: vertex shader invocations per triangle, simulated with a FIFO cache of cacheSize entries
+ * 3.0 is the worst case (nothing reused, e.g. glDrawArrays), 0.5 is the best a large regular grid can get
+*/
+float computeACMR(const std::vector<unsigned int>& indices, size_t vertexCount, size_t cacheSize = 16);
+
+GpuMesh uploadMesh(const Mesh& mesh);
+void destroyMesh(GpuMesh& mesh);
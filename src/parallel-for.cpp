@@ -0,0 +1,145 @@
+#include "parallel-for.h"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// One call of parallelFor, lives on the caller's stack until every thread that joined it has left
+struct Job
+{
+  const std::function<void(int)>* body;
+  int count;
+  std::atomic<int> next { 0 };
+
+  // Pool threads that may still join, and the ones that did and have not left yet, guarded by the pool's mutex
+  int helpersWanted;
+  int helpers = 0;
+
+  void work()
+  {
+    for (int i = next++; i < count; i = next++) (*body)(i);
+  }
+};
+
+/**
+ * A thread per core but one, started on the first parallelFor and shared by every caller: the texture loader's decode
+ * threads all decoding large JPEGs at once queue their jobs here instead of each starting a thread per core
+*/
+class WorkerPool
+{
+public:
+  WorkerPool()
+  {
+    int threadCount = std::max(1, (int)std::thread::hardware_concurrency()) - 1;
+    for (int i = 0; i < threadCount; i++) threads.emplace_back(&WorkerPool::workerThread, this);
+  }
+
+  ~WorkerPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) thread.join();
+  }
+
+  int size() const { return (int)threads.size(); }
+
+  // Runs job on the calling thread and the pool threads that are free, returns once all of its calls are done
+  void run(Job& job)
+  {
+    if (job.helpersWanted > 0)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(&job);
+      }
+      for (int i = 0; i < job.helpersWanted; i++) wake.notify_one();
+    }
+
+    job.work();
+
+    // Every index is handed out, the job only waits for the calls still running on pool threads
+    std::unique_lock<std::mutex> lock(mutex);
+    std::erase(queue, &job);
+    finished.wait(lock, [&] { return job.helpers == 0; });
+  }
+
+private:
+  void workerThread()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+      wake.wait(lock, [&] { return stopping || !queue.empty(); });
+      if (stopping) return;
+
+      Job* job = queue.front();
+      if (++job->helpers == job->helpersWanted || job->next >= job->count) queue.pop_front();
+
+      lock.unlock();
+      job->work();
+      lock.lock();
+
+      std::erase(queue, job);
+      if (--job->helpers == 0) finished.notify_all();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable finished;
+  std::deque<Job*> queue;
+  bool stopping = false;
+
+  std::vector<std::thread> threads;
+};
+
+WorkerPool& workerPool()
+{
+  static WorkerPool pool;
+  return pool;
+}
+
+}
+
+void parallelFor(int count, const std::function<void(int)>& body, int threadCount)
+{
+  WorkerPool& pool = workerPool();
+  if (threadCount <= 0) threadCount = pool.size() + 1;
+
+  Job job;
+  job.body = &body;
+  job.count = count;
+  job.helpersWanted = std::min({ threadCount, count, pool.size() + 1 }) - 1;
+  pool.run(job);
+}
+
+// Threads per decode, stb_image hands a pointer to it back to imageParallelFor
+static int imageDecodeThreads = 0;
+
+static void imageParallelFor(void* user, int count, stbi_parallel_task* task, void* taskData)
+{
+  parallelFor(count, [&](int index) { task(taskData, index); }, *(int*)user);
+}
+
+void useParallelImageDecoding(int threadCount)
+{
+  imageDecodeThreads = threadCount;
+  stbi_set_parallel_for(imageParallelFor, &imageDecodeThreads);
+}
+
+void stopParallelImageDecoding()
+{
+  stbi_set_parallel_for(nullptr, nullptr);
+}
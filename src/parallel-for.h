@@ -0,0 +1,21 @@
+#pragma once
+
+#include <functional>
+
+/**
+ * Calls body(i) for every i in [0, count) on up to threadCount threads and returns once all calls are done
+ * The calling thread works too, with the threads of a pool of one per core but one that every caller shares,
+ * so calls from several threads at once split the cores between them instead of each starting its own threads
+ * Indices are handed out one at a time so tasks of uneven length still balance, threadCount 0 uses every core
+*/
+void parallelFor(int count, const std::function<void(int)>& body, int threadCount = 0);
+
+/**
+ * Lets stb_image split large JPEG decodes over parallelFor with threadCount threads per decode (see stbi_set_parallel_for)
+ * Only images decoded from memory or with stbi_load_mapped qualify, stb_image cannot seek ahead in a file it streams through a FILE*
+ * stb_image reads the setting without locking, so call this before any thread decodes images
+*/
+void useParallelImageDecoding(int threadCount = 0);
+
+// Back to decoding every image on the thread that loads it, likewise only while no thread decodes images
+void stopParallelImageDecoding();
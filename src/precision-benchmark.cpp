@@ -0,0 +1,298 @@
+#include "precision-benchmark.h"
+
+// A private copy of stb_image with internal linkage, so its static conversions can be called directly
+// main.cpp holds the copy the rest of the program uses
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#include "stb_image.h"
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+#undef STB_IMAGE_IMPLEMENTATION // benchmark-helpers.h includes it again, for the declarations only
+
+#include "benchmark-helpers.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+enum class Output
+{
+  Unorm16,
+  Half
+};
+
+struct SyntheticImage
+{
+  std::string name;
+  std::vector<unsigned char> bytes;
+  int channels = 0; // asked of stb_image, 0 keeps the file's
+  Output output = Output::Unorm16;
+};
+
+// Times are the fastest of all iterations, heap and pixels are from the last one
+struct DecodeResult
+{
+  double milliseconds = 1e30;
+  std::uint64_t peakBytes = 0;
+  std::vector<std::uint16_t> pixels;
+};
+
+// Smooth slopes with some noise, like a height map or the components of a normal map
+std::uint32_t syntheticSample(int x, int y, int channel, int depth, std::uint32_t& random)
+{
+  random = random * 1664525u + 1013904223u;
+  std::uint32_t slope = (std::uint32_t)(x * (channel + 3) * 37 + y * (5 - channel) * 29);
+  std::uint32_t value = depth == 16 ? slope * 3 + (random >> 26) : slope / 16 + (random >> 30);
+  return value & ((1u << depth) - 1);
+}
+
+// A synthetic PNG of 8 or 16 bit samples (colorType 0, 2, 4 or 6)
+std::vector<unsigned char> encodeSyntheticPng(int width, int height, int colorType, int depth)
+{
+  int channels = PngWriter::channelsOf(colorType);
+  int pixelBytes = channels * depth / 8;
+  PngWriter writer(width, height, colorType, depth);
+  std::vector<unsigned char> row((size_t)width * pixelBytes);
+  std::uint32_t random = 12345;
+  for (int y = 0; y < height; y++)
+  {
+    for (int x = 0; x < width; x++)
+    {
+      for (int c = 0; c < channels; c++)
+      {
+        std::uint32_t value = syntheticSample(x, y, c, depth, random);
+        unsigned char* sample = &row[(size_t)x * pixelBytes + c * depth / 8];
+        if (depth == 16) sample[0] = (unsigned char)(value >> 8), sample[1] = (unsigned char)value;
+        else sample[0] = (unsigned char)value;
+      }
+    }
+    writer.addRow(row.data());
+  }
+  return writer.finish();
+}
+
+/**
+ * A Radiance file with flat (not run length encoded) RGBE pixels, from about 2^-12 to 2^20
+ * so some values are half denormals and some too large for a half
+*/
+std::vector<unsigned char> encodeSyntheticHdr(int width, int height)
+{
+  std::string header = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " + std::to_string(height) + " +X " + std::to_string(width) + "\n";
+  std::vector<unsigned char> hdr(header.begin(), header.end());
+  std::uint32_t random = 54321;
+  for (int y = 0; y < height; y++)
+  {
+    for (int x = 0; x < width; x++)
+    {
+      for (int c = 0; c < 3; c++) hdr.push_back((unsigned char)(128 + syntheticSample(x, y, c, 8, random) / 2));
+      hdr.push_back((unsigned char)(116 + (x / 16 + y / 16) % 32));
+    }
+  }
+  return hdr;
+}
+
+/**
+ * Runs decode iterations times, decode returns the 16 bit samples in a block from heap or stb_image
+ * (both are freed with heap.release) and sets the sample count
+*/
+bool timeDecode(const SyntheticImage& image, int iterations, HeapTracker& heap, const std::function<std::uint16_t*(size_t&)>& decode,
+                DecodeResult& result)
+{
+  for (int i = 0; i < iterations; i++)
+  {
+    size_t count = 0;
+    heap.resetPeak();
+    std::uint64_t start = heap.live();
+    auto time = std::chrono::steady_clock::now();
+    std::uint16_t* pixels = decode(count);
+    result.milliseconds = std::min(result.milliseconds, millisecondsSince(time));
+    result.peakBytes = heap.peak() - start;
+    if (!pixels)
+    {
+      std::cerr << "Failed to decode " << image.name << ": " << stbi_failure_reason() << std::endl;
+      return false;
+    }
+    result.pixels.assign(pixels, pixels + count);
+    heap.release(pixels);
+  }
+  return true;
+}
+
+// Decoded at the file's own depth (and channels), then converted into a second block, one sample at a time
+std::uint16_t* decodeTwoPass(const SyntheticImage& image, HeapTracker& heap, size_t& count)
+{
+  const unsigned char* bytes = image.bytes.data();
+  int size = (int)image.bytes.size();
+  int width, height, channels;
+
+  if (image.output == Output::Half && stbi_is_hdr_from_memory(bytes, size))
+  {
+    float* linear = stbi_loadf_from_memory(bytes, size, &width, &height, &channels, image.channels);
+    if (!linear) return nullptr;
+    count = (size_t)width * height * (image.channels ? image.channels : channels);
+    std::uint16_t* halves = (std::uint16_t*)heap.allocate(count * 2);
+    for (size_t i = 0; i < count; i++) halves[i] = glm::packHalf1x16(linear[i]);
+    heap.release(linear);
+    return halves;
+  }
+
+  if (image.output == Output::Half)
+  {
+    std::uint16_t* wide = stbi_load_16_from_memory(bytes, size, &width, &height, &channels, image.channels);
+    if (!wide) return nullptr;
+    count = (size_t)width * height * (image.channels ? image.channels : channels);
+    std::uint16_t* halves = (std::uint16_t*)heap.allocate(count * 2);
+    for (size_t i = 0; i < count; i++) halves[i] = glm::packHalf1x16(glm::unpackUnorm1x16(wide[i]));
+    heap.release(wide);
+    return halves;
+  }
+
+  if (!stbi_is_16_bit_from_memory(bytes, size))
+  {
+    // What stbi_load_16 did with 8 bit files before: decode to bytes, widen into a new block
+    unsigned char* narrow = stbi_load_from_memory(bytes, size, &width, &height, &channels, image.channels);
+    if (!narrow) return nullptr;
+    count = (size_t)width * height * (image.channels ? image.channels : channels);
+    std::uint16_t* wide = (std::uint16_t*)heap.allocate(count * 2);
+    for (size_t i = 0; i < count; i++) wide[i] = (std::uint16_t)((narrow[i] << 8) + narrow[i]);
+    heap.release(narrow);
+    return wide;
+  }
+
+  // And with 16 bit files it was asked to convert: decode all channels, convert into a new block
+  std::uint16_t* wide = stbi_load_16_from_memory(bytes, size, &width, &height, &channels, 0);
+  if (!wide || !image.channels || image.channels == channels)
+  {
+    count = wide ? (size_t)width * height * channels : 0;
+    return wide;
+  }
+  count = (size_t)width * height * image.channels;
+  std::uint16_t* converted = (std::uint16_t*)heap.allocate(count * 2);
+  for (int y = 0; y < height; y++)
+  {
+    stbi__convert_row16(wide + (size_t)y * width * channels, channels, converted + (size_t)y * width * image.channels, image.channels, width);
+  }
+  heap.release(wide);
+  return converted;
+}
+
+std::uint16_t* decodeDirect(const SyntheticImage& image, size_t& count)
+{
+  int width, height, channels;
+  std::uint16_t* pixels = image.output == Output::Half
+                            ? stbi_load_half_from_memory(image.bytes.data(), (int)image.bytes.size(), &width, &height, &channels, image.channels)
+                            : stbi_load_16_from_memory(image.bytes.data(), (int)image.bytes.size(), &width, &height, &channels, image.channels);
+  if (pixels) count = (size_t)width * height * (image.channels ? image.channels : channels);
+  return pixels;
+}
+
+/**
+ * stb_image's batched half conversion against glm::packHalf1x16, one sample at a time
+ * Every 16 bit value through glm::unpackUnorm1x16, then every 61st float bit pattern (all exponents, NaNs and infinities)
+*/
+bool compareHalfConversions(int iterations)
+{
+  std::vector<std::uint16_t> unorm(65536), expected(65536);
+  for (int i = 0; i < 65536; i++)
+  {
+    unorm[i] = (std::uint16_t)i;
+    expected[i] = glm::packHalf1x16(glm::unpackUnorm1x16((std::uint16_t)i));
+  }
+  stbi__unorm16_to_half(unorm.data(), unorm.size());
+  size_t unormMismatches = 0;
+  for (int i = 0; i < 65536; i++) unormMismatches += unorm[i] != expected[i];
+
+  const std::uint32_t stride = 61;
+  const size_t count = (size_t)(0xffffffffu / stride) + 1;
+  std::vector<float> floats(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    std::uint32_t bits = (std::uint32_t)(i * stride);
+    std::memcpy(&floats[i], &bits, 4);
+  }
+
+  std::vector<std::uint16_t> packed(count), halves(count);
+  double glmMilliseconds = 1e30, stbMilliseconds = 1e30;
+  for (int i = 0; i < iterations; i++)
+  {
+    auto time = std::chrono::steady_clock::now();
+    for (size_t j = 0; j < count; j++) packed[j] = glm::packHalf1x16(floats[j]);
+    glmMilliseconds = std::min(glmMilliseconds, millisecondsSince(time));
+
+    time = std::chrono::steady_clock::now();
+    stbi__float_to_half_n((stbi_uc*)halves.data(), (const stbi_uc*)floats.data(), count);
+    stbMilliseconds = std::min(stbMilliseconds, millisecondsSince(time));
+  }
+  size_t floatMismatches = 0;
+  for (size_t i = 0; i < count; i++) floatMismatches += packed[i] != halves[i];
+
+  std::cout << std::endl << "float to half over " << count << " bit patterns: glm " << std::fixed << std::setprecision(3) << glmMilliseconds
+            << " ms, stb_image " << stbMilliseconds << " ms (" << std::setprecision(2) << glmMilliseconds / stbMilliseconds << "x), "
+            << floatMismatches << " differ" << std::endl;
+  std::cout << "16 bit to half over all 65536 values: " << unormMismatches << " differ" << std::endl;
+  std::cout.unsetf(std::ios::floatfield);
+  return unormMismatches == 0 && floatMismatches == 0;
+}
+
+}
+
+bool runPrecisionBenchmark(int iterations)
+{
+  const int size = 2048;
+  std::string suffix = " " + std::to_string(size) + "x" + std::to_string(size);
+  std::vector<SyntheticImage> images = {
+    { "16 bit gray height map to R16" + suffix, encodeSyntheticPng(size, size, 0, 16), 0, Output::Unorm16 },
+    { "16 bit RGB height map to R16" + suffix, encodeSyntheticPng(size, size, 2, 16), 1, Output::Unorm16 },
+    { "8 bit RG normal map to RG16" + suffix, encodeSyntheticPng(size, size, 4, 8), 0, Output::Unorm16 },
+    { "8 bit RGBA to RGBA16" + suffix, encodeSyntheticPng(size, size, 6, 8), 0, Output::Unorm16 },
+    { "16 bit gray height map to R16F" + suffix, encodeSyntheticPng(size, size, 0, 16), 0, Output::Half },
+    { "8 bit RGB to RGBA16F" + suffix, encodeSyntheticPng(size, size, 2, 8), 4, Output::Half },
+    { "Radiance HDR to RGB16F" + suffix, encodeSyntheticHdr(size, size), 0, Output::Half },
+  };
+
+  std::cout << std::left << std::setw(44) << "image" << std::right << std::setw(14) << "two pass ms" << std::setw(11) << "direct ms"
+            << std::setw(18) << "two pass peak KB" << std::setw(16) << "direct peak KB" << "   samples" << std::endl;
+
+  // Every allocation stb_image makes on this thread goes through heap until the images are done
+  HeapTracker heap;
+  stbi_set_allocator_thread(heap.allocator());
+
+  bool success = true;
+  for (const SyntheticImage& image : images)
+  {
+    DecodeResult twoPass, direct;
+    if (!timeDecode(image, iterations, heap, [&](size_t& count) { return decodeTwoPass(image, heap, count); }, twoPass)
+        || !timeDecode(image, iterations, heap, [&](size_t& count) { return decodeDirect(image, count); }, direct))
+    {
+      success = false;
+      break;
+    }
+
+    bool match = twoPass.pixels == direct.pixels;
+    success = match && success;
+
+    std::cout << std::left << std::setw(44) << image.name << std::right << std::fixed << std::setprecision(3) << std::setw(14)
+              << twoPass.milliseconds << std::setw(11) << direct.milliseconds << std::setw(18) << twoPass.peakBytes / 1024 << std::setw(16)
+              << direct.peakBytes / 1024 << "   " << (match ? "ok" : "MISMATCH") << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+  }
+  stbi_set_allocator_thread(nullptr);
+
+  return compareHalfConversions(iterations) && success;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+/**
+ * Decodes synthetic height and normal maps with 16 bits (stbi_load_16) and half floats (stbi_load_half) per channel,
+ * and compares the time and peak heap to decoding at the file's own depth and converting in a second pass
+ * (the 8 to 16 bit copy stb_image used to make, or glm::packHalf1x16 over every sample)
+ *
+ * Also runs stb_image's half conversion over every 16 bit value and a sweep of float bit patterns against glm
+ *
+ * Returns false if an image failed to decode or any value differs from the two pass result or from glm
+*/
+bool runPrecisionBenchmark(int iterations);
@@ -0,0 +1,230 @@
+#include "program-cache.h"
+#include "shader.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Every cache file starts with this header, followed by binaryLength bytes of program binary
+struct ProgramBinaryHeader
+{
+  char magic[4];
+  std::uint32_t version;
+  std::uint64_t key;
+  std::uint32_t binaryFormat;
+  std::uint32_t binaryLength;
+};
+
+static const char PROGRAM_BINARY_MAGIC[4] = { 'G', 'L', 'P', 'B' };
+static const std::uint32_t PROGRAM_BINARY_VERSION = 1;
+
+// 64 bit FNV-1a, fast and good enough to tell shader sources apart
+static std::uint64_t hashString(std::uint64_t hash, const std::string& text)
+{
+  for (unsigned char c : text)
+  {
+    hash ^= c;
+    hash *= 0x100000001b3ull;
+  }
+
+  // Hash a separator too so "ab" + "c" and "a" + "bc" give different keys
+  hash ^= 0xff;
+  hash *= 0x100000001b3ull;
+  return hash;
+}
+
+static std::string glString(GLenum name)
+{
+  const GLubyte* value = glGetString(name);
+  return value ? (const char*)value : "";
+}
+
+static fs::path entryPath(const ProgramCache& cache, std::uint64_t key)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+  return fs::path(cache.directory) / name;
+}
+
+// Returns 0 if there is no usable entry for this key
+static unsigned int loadCachedProgram(const fs::path& path, std::uint64_t key)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return 0;
+
+  ProgramBinaryHeader header;
+  if (!file.read((char*)&header, sizeof(header))
+      || memcmp(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic)) != 0
+      || header.version != PROGRAM_BINARY_VERSION
+      || header.key != key)
+  {
+    return 0;
+  }
+
+  std::vector<char> binary(header.binaryLength);
+  if (!file.read(binary.data(), binary.size())) return 0;
+
+  unsigned int program = glCreateProgram();
+  glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+
+  // The driver is free to reject a binary it produced earlier, this shows up as a failed link
+  int success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    glDeleteProgram(program);
+    return 0;
+  }
+
+  return program;
+}
+
+static void storeProgram(const ProgramCache& cache, const fs::path& path, std::uint64_t key, unsigned int program)
+{
+  int binaryLength = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+  if (binaryLength <= 0) return;
+
+  std::vector<char> binary(binaryLength);
+  GLenum binaryFormat;
+  glGetProgramBinary(program, binaryLength, &binaryLength, &binaryFormat, binary.data());
+
+  ProgramBinaryHeader header;
+  memcpy(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic));
+  header.version = PROGRAM_BINARY_VERSION;
+  header.key = key;
+  header.binaryFormat = binaryFormat;
+  header.binaryLength = (std::uint32_t)binaryLength;
+
+  std::error_code error;
+  fs::create_directories(cache.directory, error);
+
+  // Write to a temporary file first so a crash never leaves a half written entry behind
+  fs::path temporaryPath = path;
+  temporaryPath += ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary);
+    if (!file)
+    {
+      std::cerr << "Cannot write file: " << temporaryPath.string() << std::endl;
+      return;
+    }
+    file.write((const char*)&header, sizeof(header));
+    file.write(binary.data(), binaryLength);
+  }
+  fs::rename(temporaryPath, path, error);
+}
+
+static void evictEntries(const ProgramCache& cache)
+{
+  struct Entry
+  {
+    fs::path path;
+    fs::file_time_type lastUsed;
+    std::uintmax_t size;
+  };
+
+  std::error_code error;
+  std::vector<Entry> entries;
+  std::uintmax_t totalBytes = 0;
+  for (const fs::directory_entry& file : fs::directory_iterator(cache.directory, error))
+  {
+    if (file.path().extension() != ".bin") continue;
+    Entry entry = { file.path(), file.last_write_time(error), file.file_size(error) };
+    totalBytes += entry.size;
+    entries.push_back(entry);
+  }
+
+  // Oldest first
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.lastUsed < b.lastUsed; });
+
+  size_t count = entries.size();
+  for (const Entry& entry : entries)
+  {
+    if (count <= cache.maxEntries && totalBytes <= cache.maxBytes) break;
+    fs::remove(entry.path, error);
+    totalBytes -= entry.size;
+    count--;
+  }
+}
+
+// Shared by all program types: sources are only used for the key, compile builds the program on a cache miss
+template <typename CompileFunction>
+static ProgramLoadResult loadCachedOrCompile(const ProgramCache& cache, std::initializer_list<const std::string*> sources, const std::string& defines, CompileFunction compile)
+{
+  auto start = std::chrono::steady_clock::now();
+  ProgramLoadResult result;
+
+  // Caching needs at least one binary format, some drivers don't offer any
+  int binaryFormatCount = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormatCount);
+  bool useCache = cache.enabled && binaryFormatCount > 0;
+
+  std::uint64_t key = 0xcbf29ce484222325ull;
+  for (const std::string* source : sources) key = hashString(key, *source);
+  key = hashString(key, defines);
+  key = hashString(key, glString(GL_VENDOR));
+  key = hashString(key, glString(GL_RENDERER));
+  key = hashString(key, glString(GL_VERSION));
+  fs::path path = entryPath(cache, key);
+
+  if (useCache)
+  {
+    result.program = loadCachedProgram(path, key);
+    result.cacheHit = result.program != 0;
+
+    std::error_code error;
+    if (result.cacheHit)
+    {
+      // Mark the entry as recently used for eviction
+      fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+    }
+    else if (fs::exists(path, error))
+    {
+      std::cerr << "Program cache entry " << path.string() << " was rejected, compiling from source" << std::endl;
+      fs::remove(path, error);
+    }
+  }
+
+  if (!result.cacheHit)
+  {
+    result.program = compile();
+
+    if (useCache && result.program)
+    {
+      storeProgram(cache, path, key, result.program);
+      evictEntries(cache);
+    }
+  }
+
+  result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+ProgramLoadResult loadProgram(const ProgramCache& cache, const std::string& vertexSource, const std::string& fragmentSource, const std::string& defines)
+{
+  return loadCachedOrCompile(cache, { &vertexSource, &fragmentSource }, defines, [&]()
+  {
+    unsigned int vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource, defines);
+    unsigned int fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource, defines);
+    return createProgram(vertexShader, fragmentShader);
+  });
+}
+
+ProgramLoadResult loadComputeProgram(const ProgramCache& cache, const std::string& computeSource, const std::string& defines)
+{
+  return loadCachedOrCompile(cache, { &computeSource }, defines, [&]()
+  {
+    return createComputeProgram(compileShader(GL_COMPUTE_SHADER, computeSource, defines));
+  });
+}
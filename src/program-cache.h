@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/**
+ * On-disk cache of linked shader programs
+ * Compiling GLSL is slow, so after a program is linked once we store the driver's binary (glGetProgramBinary)
+ * and on the next launch hand it straight back with glProgramBinary
+ *
+ * Entries are keyed by a hash of the shader sources, the defines and the driver (GL_VENDOR, GL_RENDERER, GL_VERSION),
+ * so editing a shader or updating the driver never loads a stale binary
+ * The driver may still reject a binary (e.g. after an update that kept the version string), in which case we
+ * delete the entry and compile from source
+ *
+ * Eviction is least recently used: every hit refreshes the entry's modification time and when the cache grows past
+ * maxEntries or maxBytes the oldest entries are deleted
+*/
+struct ProgramCache
+{
+  std::string directory = "cache/programs";
+  size_t maxEntries = 64;
+  std::uintmax_t maxBytes = 64 * 1024 * 1024;
+  bool enabled = true;
+};
+
+struct ProgramLoadResult
+{
+  unsigned int program = 0;
+  bool cacheHit = false;
+  double milliseconds = 0;
+};
+
+// Loads a program from vertex + fragment shader source, through the cache when possible
+ProgramLoadResult loadProgram(const ProgramCache& cache, const std::string& vertexSource, const std::string& fragmentSource, const std::string& defines = "");
+
+// Loads a program from compute shader source, through the cache when possible
+ProgramLoadResult loadComputeProgram(const ProgramCache& cache, const std::string& computeSource, const std::string& defines = "");
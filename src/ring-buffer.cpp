@@ -0,0 +1,112 @@
+#include "ring-buffer.h"
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <iostream>
+
+bool StreamRingBuffer::create(std::uintptr_t size)
+{
+  if (!GLAD_GL_VERSION_4_4)
+  {
+    std::cerr << "Persistent mapped buffers need OpenGL 4.4" << std::endl;
+    return false;
+  }
+
+  // Keep every region start aligned for any binding (uniform offset alignment is at most 256 bytes)
+  regionSize = (size + 255) & ~(std::uintptr_t)255;
+
+  // Immutable storage that can stay mapped while the GPU reads from it, coherent so we never have to flush
+  GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glGenBuffers(1, &bufferId);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, bufferId);
+  glBufferStorage(GL_COPY_WRITE_BUFFER, regionSize * REGION_COUNT, NULL, flags);
+  mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, regionSize * REGION_COUNT, flags);
+
+  if (!mapped)
+  {
+    std::cerr << "Failed to map stream buffer" << std::endl;
+    destroy();
+    return false;
+  }
+
+  return true;
+}
+
+void StreamRingBuffer::destroy()
+{
+  for (void*& fence : fences)
+  {
+    if (fence) glDeleteSync((GLsync)fence);
+    fence = nullptr;
+  }
+
+  if (mapped)
+  {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, bufferId);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    mapped = nullptr;
+  }
+
+  glDeleteBuffers(1, &bufferId);
+  bufferId = 0;
+}
+
+void StreamRingBuffer::resetStats()
+{
+  counters = Stats();
+}
+
+void StreamRingBuffer::beginFrame()
+{
+  region = (region + 1) % REGION_COUNT;
+  regionUsed = 0;
+  counters.frames++;
+
+  GLsync fence = (GLsync)fences[region];
+  if (!fence) return;
+
+  // Most of the time the GPU finished this region frames ago and the first check returns right away
+  GLenum status = glClientWaitSync(fence, 0, 0);
+  if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+  {
+    auto start = std::chrono::steady_clock::now();
+    counters.waits++;
+
+    // Flush so the fence is guaranteed to be signaled eventually, then wait in 1 ms steps
+    GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    do
+    {
+      status = glClientWaitSync(fence, waitFlags, 1000000);
+      waitFlags = 0;
+    }
+    while (status == GL_TIMEOUT_EXPIRED);
+
+    counters.stallMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  glDeleteSync(fence);
+  fences[region] = nullptr;
+}
+
+void StreamRingBuffer::endFrame()
+{
+  fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void* StreamRingBuffer::allocate(std::uintptr_t size, std::uintptr_t alignment, std::uintptr_t& offset)
+{
+  std::uintptr_t start = (regionUsed + alignment - 1) & ~(alignment - 1);
+  if (start + size > regionSize)
+  {
+    counters.failedAllocations++;
+    return nullptr;
+  }
+
+  regionUsed = start + size;
+  counters.allocations++;
+  counters.bytesAllocated += size;
+
+  offset = region * regionSize + start;
+  return mapped + offset;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Streaming buffer for data that changes every frame (uniforms, instance data, dynamic vertices)
+ * The buffer is created once with glBufferStorage and stays mapped (GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT),
+ * so writing to it is a plain memcpy: no glBufferData reallocation and no driver synchronisation
+ *
+ * It is split into REGION_COUNT regions, one per frame in flight
+ * The CPU writes into one region while the GPU may still read the other ones,
+ * a fence placed at the end of each frame tells us when the GPU is done with a region so it can be reused
+*/
+class StreamRingBuffer
+{
+public:
+  static const int REGION_COUNT = 3;
+
+  // Counters to see how often and how long the CPU had to wait for the GPU
+  struct Stats
+  {
+    std::uint64_t frames = 0;
+    std::uint64_t waits = 0;
+    double stallMilliseconds = 0;
+    std::uint64_t allocations = 0;
+    std::uint64_t bytesAllocated = 0;
+    std::uint64_t failedAllocations = 0;
+  };
+
+  StreamRingBuffer() = default;
+  StreamRingBuffer(const StreamRingBuffer&) = delete;
+  StreamRingBuffer& operator=(const StreamRingBuffer&) = delete;
+
+  // Creates a buffer with regionSize bytes per frame, returns false without OpenGL 4.4 (glBufferStorage)
+  bool create(std::uintptr_t regionSize);
+  void destroy();
+
+  // Waits until the GPU is done with the next region, call before the first allocate of a frame
+  void beginFrame();
+
+  // Fences the current region, call after the last draw that reads from this frame's allocations
+  void endFrame();
+
+  /**
+   * Reserves size bytes in the current region, alignment must be a power of two
+   * (e.g. GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT for uniform blocks)
+   * Returns where to write, offset is the position inside buffer() to bind or draw from
+   * Returns nullptr when the region is full
+  */
+  void* allocate(std::uintptr_t size, std::uintptr_t alignment, std::uintptr_t& offset);
+
+  unsigned int buffer() const { return bufferId; }
+  const Stats& stats() const { return counters; }
+  void resetStats();
+
+private:
+  unsigned int bufferId = 0;
+  unsigned char* mapped = nullptr;
+  std::uintptr_t regionSize = 0;
+  std::uintptr_t regionUsed = 0;
+  int region = 0;
+
+  // GLsync of every region, nullptr if the GPU is not using it
+  void* fences[REGION_COUNT] = {};
+
+  Stats counters;
+};
@@ -0,0 +1,188 @@
+#include "shader.h"
+
+#include <glad/glad.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+std::string readFile(std::string path)
+{
+  std::ifstream inputFile(path);
+  if (!inputFile)
+  {
+    std::cerr << "Cannot read file: " << path << std::endl;
+    return "";
+  }
+  std::ostringstream buffer;
+  std::string line;
+  while (std::getline(inputFile, line))
+  {
+    buffer << line << std::endl;
+  }
+  return buffer.str();
+}
+
+unsigned int compileShader(unsigned int type, std::string source, const std::string& defines)
+{
+  // Defines have to come after #version, which must be the first statement of the shader
+  if (!defines.empty())
+  {
+    size_t versionLine = source.find("#version");
+    size_t insertAt = versionLine == std::string::npos ? 0 : source.find('\n', versionLine) + 1;
+    source.insert(insertAt, defines);
+  }
+
+  // Create a pointer to the first char of the shader string
+  const char* src = source.c_str();
+
+  // Create a shader object referenced by an id
+  unsigned int shader = glCreateShader(type);
+
+  // Set shader source and compile shader
+  glShaderSource(shader, 1, &src, NULL);
+  glCompileShader(shader);
+
+  int success;
+  char infoLog[512];
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (!success)
+  {
+    glGetShaderInfoLog(shader, 512, NULL, infoLog);
+    const char* stage = type == GL_VERTEX_SHADER ? "vertex" : type == GL_FRAGMENT_SHADER ? "fragment" : "compute";
+    std::cerr << "Failed to compile " << stage << " shader" << std::endl;
+    std::cerr << infoLog << std::endl;
+    return 0;
+  }
+
+  // return shader id
+  return shader;
+}
+
+unsigned int createProgram(unsigned int vertexShader, unsigned int fragmentShader)
+{
+    // Create shader program
+  /**
+   * A shader program links all the shaders together to help them communicate with each other
+  */
+  unsigned int shaderProgram = glCreateProgram();
+
+  // Link shaders together
+  glAttachShader(shaderProgram, vertexShader);
+  glAttachShader(shaderProgram, fragmentShader);
+
+  // Allow glGetProgramBinary on this program so it can be stored in the program cache
+  glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+  glLinkProgram(shaderProgram);
+
+  // Delete the shader objects since we no longer need them
+  glDeleteShader(vertexShader);
+  glDeleteShader(fragmentShader); 
+
+  int success;
+  char infoLog[512];
+  glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+  if(!success) {
+    glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+    std::cerr << "Failed to Link Program" << std::endl;
+    std::cerr << infoLog << std::endl;
+    return 0;
+  }
+
+  return shaderProgram;
+}
+
+unsigned int createComputeProgram(unsigned int computeShader)
+{
+  unsigned int computeProgram = glCreateProgram();
+  glAttachShader(computeProgram, computeShader);
+  glProgramParameteri(computeProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  glLinkProgram(computeProgram);
+  glDeleteShader(computeShader);
+
+  int success;
+  char infoLog[512];
+  glGetProgramiv(computeProgram, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    glGetProgramInfoLog(computeProgram, 512, NULL, infoLog);
+    std::cerr << "Failed to Link Compute Program" << std::endl;
+    std::cerr << infoLog << std::endl;
+    return 0;
+  }
+
+  return computeProgram;
+}
+
+int ShaderProgram::uniformLocation(const std::string& name) const
+{
+  auto uniform = uniforms.find(name);
+  return uniform == uniforms.end() ? -1 : uniform->second.location;
+}
+
+const ShaderUniformBlock* ShaderProgram::uniformBlock(const std::string& name) const
+{
+  auto block = uniformBlocks.find(name);
+  return block == uniformBlocks.end() ? nullptr : &block->second;
+}
+
+static std::string resourceName(unsigned int program, GLenum interface, int index, int nameLength)
+{
+  // nameLength includes the null terminator
+  std::string name(nameLength, '\0');
+  glGetProgramResourceName(program, interface, index, nameLength, NULL, name.data());
+  name.resize(nameLength > 0 ? nameLength - 1 : 0);
+  return name;
+}
+
+ShaderProgram reflectProgram(unsigned int program)
+{
+  ShaderProgram shaderProgram;
+  shaderProgram.id = program;
+  if (!program) return shaderProgram;
+
+  int uniformCount = 0;
+  glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniformCount);
+
+  const GLenum uniformProperties[] = { GL_NAME_LENGTH, GL_TYPE, GL_ARRAY_SIZE, GL_LOCATION, GL_BLOCK_INDEX, GL_OFFSET };
+  for (int i = 0; i < uniformCount; i++)
+  {
+    int values[6];
+    glGetProgramResourceiv(program, GL_UNIFORM, i, 6, uniformProperties, 6, NULL, values);
+
+    ShaderUniform uniform;
+    uniform.type = values[1];
+    uniform.arraySize = values[2];
+    uniform.location = values[3];
+    uniform.blockIndex = values[4];
+    uniform.blockOffset = values[5];
+
+    std::string name = resourceName(program, GL_UNIFORM, i, values[0]);
+    shaderProgram.uniforms[name] = uniform;
+
+    // Arrays are reported as "name[0]", make them reachable by their plain name too
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+    {
+      shaderProgram.uniforms[name.substr(0, name.size() - 3)] = uniform;
+    }
+  }
+
+  int blockCount = 0;
+  glGetProgramInterfaceiv(program, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES, &blockCount);
+
+  const GLenum blockProperties[] = { GL_NAME_LENGTH, GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+  for (int i = 0; i < blockCount; i++)
+  {
+    int values[3];
+    glGetProgramResourceiv(program, GL_UNIFORM_BLOCK, i, 3, blockProperties, 3, NULL, values);
+
+    ShaderUniformBlock block;
+    block.index = i;
+    block.binding = values[1];
+    block.dataSize = values[2];
+    shaderProgram.uniformBlocks[resourceName(program, GL_UNIFORM_BLOCK, i, values[0])] = block;
+  }
+
+  return shaderProgram;
+}
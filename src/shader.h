@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+std::string readFile(std::string path);
+
+/**
+ * Compiles a single shader stage
+ * defines is inserted right after the #version line, e.g. "#define USE_FOG 1\n"
+ * Returns the shader id, or 0 if compilation failed
+*/
+unsigned int compileShader(unsigned int type, std::string source, const std::string& defines = "");
+
+/**
+ * Links a vertex and a fragment shader into a program and deletes the shader objects
+ * Returns the program id, or 0 if linking failed
+*/
+unsigned int createProgram(unsigned int vertexShader, unsigned int fragmentShader);
+
+// Same as createProgram for a program with only a compute shader
+unsigned int createComputeProgram(unsigned int computeShader);
+
+struct ShaderUniform
+{
+  int location = -1;
+  unsigned int type = 0;
+  int arraySize = 1;
+
+  // Uniforms inside a uniform block have no location, only an index of their block and an offset into it
+  int blockIndex = -1;
+  int blockOffset = -1;
+};
+
+struct ShaderUniformBlock
+{
+  int index = -1;
+  int binding = 0;
+  int dataSize = 0;
+};
+
+/**
+ * A linked program together with everything it exposes
+ * Looking a uniform up by name (glGetUniformLocation) is a string search inside the driver,
+ * so we ask for all active uniforms and uniform blocks once after linking and keep their locations
+*/
+struct ShaderProgram
+{
+  unsigned int id = 0;
+  std::unordered_map<std::string, ShaderUniform> uniforms;
+  std::unordered_map<std::string, ShaderUniformBlock> uniformBlocks;
+
+  // -1 if the program has no active uniform with this name, like glGetUniformLocation
+  int uniformLocation(const std::string& name) const;
+
+  // nullptr if the program has no active uniform block with this name
+  const ShaderUniformBlock* uniformBlock(const std::string& name) const;
+};
+
+// Queries the active uniforms and uniform blocks of a linked program (glGetProgramResourceiv)
+ShaderProgram reflectProgram(unsigned int program);
@@ -0,0 +1,227 @@
+#include "stream-benchmark.h"
+
+#include "benchmark-helpers.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+struct SourceImage
+{
+  std::string name;
+  std::vector<unsigned char> bytes;
+};
+
+// Times are the fastest of all iterations, heap and hash are from the last one
+struct DecodeResult
+{
+  double milliseconds = 1e30;
+  std::uint64_t peakBytes = 0;
+  std::uint64_t hash = 0;
+  int width = 0;
+  int height = 0;
+};
+
+// A synthetic PNG of smooth gradients with some noise, the same for every run
+// With transparent, every 16th pixel on a diagonal pattern has the color of a tRNS chunk (gray or RGB only)
+std::vector<unsigned char> encodeSyntheticPng(int width, int height, int colorType, int depth, bool transparent = false)
+{
+  const std::uint16_t key[3] = { 0x1234, 0x5678, 0x9abc };
+  int channels = PngWriter::channelsOf(colorType);
+  int sampleBytes = depth / 8;
+
+  PngWriter writer(width, height, colorType, depth);
+  if (transparent) writer.transparentColor(key);
+
+  std::vector<unsigned char> row((size_t)width * channels * sampleBytes);
+  std::uint32_t random = 12345;
+  for (int y = 0; y < height; y++)
+  {
+    unsigned char* out = row.data();
+    for (int x = 0; x < width; x++)
+    {
+      for (int c = 0; c < channels; c++)
+      {
+        random = random * 1664525u + 1013904223u;
+        std::uint16_t sample = (std::uint16_t)((x * (c + 1) + y * (3 - c)) * 32 + (int)(random >> 21));
+        if (transparent && ((x ^ y) & 15) == 0) sample = key[c];
+        if (depth == 16) *out++ = (unsigned char)(sample >> 8);
+        *out++ = (unsigned char)(depth == 16 ? sample : sample >> 8);
+      }
+    }
+    writer.addRow(row.data());
+  }
+  return writer.finish();
+}
+
+std::vector<SourceImage> readImages(const std::string& directory)
+{
+  std::vector<SourceImage> images;
+  std::error_code error;
+  for (const fs::directory_entry& entry : fs::directory_iterator(directory, error))
+  {
+    if (!entry.is_regular_file() || entry.path().extension() != ".png") continue;
+
+    std::ifstream file(entry.path(), std::ios::binary);
+    images.push_back({ entry.path().generic_string(),
+                       std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()) });
+  }
+  std::sort(images.begin(), images.end(), [](const SourceImage& a, const SourceImage& b) { return a.name < b.name; });
+  return images;
+}
+
+// FNV-1a, fed one row at a time so both paths hash the same bytes in the same order
+std::uint64_t hashBytes(std::uint64_t hash, const unsigned char* data, size_t size)
+{
+  for (size_t i = 0; i < size; i++) hash = (hash ^ data[i]) * 1099511628211ull;
+  return hash;
+}
+
+const std::uint64_t HASH_SEED = 14695981039346656037ull;
+
+bool decodeWhole(const SourceImage& image, int channels, int iterations, HeapTracker& heap, DecodeResult& result)
+{
+  for (int i = 0; i < iterations; i++)
+  {
+    int channelsInFile;
+    heap.resetPeak();
+    std::uint64_t start = heap.live();
+    auto time = std::chrono::steady_clock::now();
+    unsigned char* pixels = stbi_load_from_memory(image.bytes.data(), (int)image.bytes.size(), &result.width, &result.height, &channelsInFile, channels);
+    if (!pixels)
+    {
+      std::cerr << "Failed to decode " << image.name << " to " << channels << " channels: " << stbi_failure_reason() << std::endl;
+      return false;
+    }
+    result.hash = hashBytes(HASH_SEED, pixels, (size_t)result.width * result.height * (channels ? channels : channelsInFile));
+    heap.release(pixels);
+    result.milliseconds = std::min(result.milliseconds, millisecondsSince(time));
+    result.peakBytes = heap.peak() - start;
+  }
+  return true;
+}
+
+// What the row callbacks see of an image, rows have to arrive top to bottom without gaps
+struct RowHash
+{
+  std::uint64_t hash = HASH_SEED;
+  size_t rowBytes = 0;
+  int nextRow = 0;
+};
+
+bool decodeRows(const SourceImage& image, int channels, int iterations, HeapTracker& heap, DecodeResult& result)
+{
+  stbi_row_callbacks callbacks;
+  callbacks.begin = [](void* user, int x, int, int, int channels)
+  {
+    ((RowHash*)user)->rowBytes = (size_t)x * channels;
+    return 1;
+  };
+  callbacks.row = [](void* user, int y, const stbi_uc* pixels)
+  {
+    RowHash& rows = *(RowHash*)user;
+    if (y != rows.nextRow++) return 0;
+    rows.hash = hashBytes(rows.hash, pixels, rows.rowBytes);
+    return 1;
+  };
+
+  for (int i = 0; i < iterations; i++)
+  {
+    RowHash rows;
+    callbacks.user = &rows;
+    int channelsInFile;
+    heap.resetPeak();
+    std::uint64_t start = heap.live();
+    auto time = std::chrono::steady_clock::now();
+    if (!stbi_load_rows_from_memory(image.bytes.data(), (int)image.bytes.size(), &callbacks, &result.width, &result.height, &channelsInFile, channels))
+    {
+      std::cerr << "Failed to decode " << image.name << " row by row to " << channels << " channels: " << stbi_failure_reason() << std::endl;
+      return false;
+    }
+    result.milliseconds = std::min(result.milliseconds, millisecondsSince(time));
+    result.peakBytes = heap.peak() - start;
+    result.hash = rows.hash;
+  }
+  return true;
+}
+
+}
+
+bool runStreamBenchmark(const std::string& directory, int iterations)
+{
+  // 256 MB of RGBA, large enough that the whole image paths need several times that and the row path does not notice
+  const int syntheticSize = 8192;
+
+  // 16 bit PNGs are narrowed to 8 bits on both paths and every color type converts to gray differently, so there is one
+  // of each, and RGB and gray with a transparent color
+  const int smallSize = 1024;
+  std::vector<SourceImage> images = readImages(directory);
+  images.push_back({ std::to_string(syntheticSize) + "x" + std::to_string(syntheticSize) + " rgba png", encodeSyntheticPng(syntheticSize, syntheticSize, 6, 8) });
+  images.push_back({ "rgb png", encodeSyntheticPng(smallSize, smallSize, 2, 8) });
+  images.push_back({ "rgb + tRNS png", encodeSyntheticPng(smallSize, smallSize, 2, 8, true) });
+  images.push_back({ "gray 16 png", encodeSyntheticPng(smallSize, smallSize, 0, 16) });
+  images.push_back({ "gray 16 + tRNS png", encodeSyntheticPng(smallSize, smallSize, 0, 16, true) });
+  images.push_back({ "gray + alpha 16 png", encodeSyntheticPng(smallSize, smallSize, 4, 16) });
+  images.push_back({ "rgb 16 png", encodeSyntheticPng(smallSize, smallSize, 2, 16) });
+  images.push_back({ "rgb 16 + tRNS png", encodeSyntheticPng(smallSize, smallSize, 2, 16, true) });
+  images.push_back({ "rgba 16 png", encodeSyntheticPng(smallSize, smallSize, 6, 16) });
+
+  std::cout << std::left << std::setw(40) << "image" << std::right << std::setw(12) << "load ms" << std::setw(12) << "rows ms"
+            << std::setw(14) << "load peak KB" << std::setw(14) << "rows peak KB" << "   pixels" << std::endl;
+
+  // Every allocation stb_image makes on this thread goes through heap until the end of the run
+  HeapTracker heap;
+  stbi_set_allocator_thread(heap.allocator());
+
+  bool success = true;
+  for (const SourceImage& image : images)
+  {
+    // Timed with 4 channels, every other channel count is decoded once on both paths and only compared
+    DecodeResult whole, rows;
+    int mismatch = -1;
+    bool decoded = true;
+    for (int channels = 4; channels >= 0 && decoded; channels--)
+    {
+      DecodeResult wholeOnce, rowsOnce;
+      DecodeResult& wholeResult = channels == 4 ? whole : wholeOnce;
+      DecodeResult& rowsResult = channels == 4 ? rows : rowsOnce;
+      int runs = channels == 4 ? iterations : 1;
+      decoded = decodeWhole(image, channels, runs, heap, wholeResult) && decodeRows(image, channels, runs, heap, rowsResult);
+      bool match = wholeResult.hash == rowsResult.hash && wholeResult.width == rowsResult.width && wholeResult.height == rowsResult.height;
+      if (!match && mismatch < 0) mismatch = channels;
+    }
+    if (!decoded)
+    {
+      success = false;
+      break;
+    }
+
+    // The row path holds a few rows, the zlib window and the input it reads ahead, never anything the size of the image
+    std::uint64_t rowBound = 1024 * 1024 + (std::uint64_t)rows.width * 4 * 2 * 8;
+    bool bounded = rows.peakBytes <= rowBound;
+    success = mismatch < 0 && bounded && success;
+
+    std::cout << std::left << std::setw(40) << image.name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(12) << whole.milliseconds << std::setw(12) << rows.milliseconds << std::setw(14) << whole.peakBytes / 1024
+              << std::setw(14) << rows.peakBytes / 1024 << "   ";
+    if (mismatch >= 0) std::cout << "MISMATCH at " << mismatch << " channels" << std::endl;
+    else std::cout << (bounded ? "ok" : "ROWS OVER BOUND") << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+  }
+
+  stbi_set_allocator_thread(nullptr);
+  return success;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+/**
+ * Decodes every PNG in directory, a large synthetic PNG and small synthetic ones of every 16 bit color type with
+ * stbi_load_from_memory and row by row with stbi_load_rows_from_memory, and prints the time and the peak heap
+ * stb_image used on each path with 4 channels. Both paths also decode each image once to 0 to 3 channels to compare
+ *
+ * The rows are hashed as they arrive instead of being kept, so the row path never holds the whole image
+ *
+ * Returns false if an image failed to decode, the two paths disagree, or the row path's peak heap grew with the image
+*/
+bool runStreamBenchmark(const std::string& directory, int iterations);
@@ -0,0 +1,286 @@
+#include "texture-catalog.h"
+
+#include "mapped-file.h"
+#include "parallel-for.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+
+namespace fs = std::filesystem;
+
+static const char TEXTURE_CATALOG_MAGIC[4] = { 'T', 'C', 'A', 'T' };
+static const std::uint32_t TEXTURE_CATALOG_VERSION = 1;
+static const char* TEXTURE_CATALOG_NAME = "catalog.index";
+
+// Cooked textures are outputs of the source images, not sources themselves
+static const char* COOKED_DIRECTORY_NAME = "cooked";
+
+struct TextureCatalogHeader
+{
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t entryCount;
+};
+
+// Followed by pathLength bytes of path
+struct TextureCatalogRecord
+{
+  std::int64_t modified;
+  std::uint64_t size;
+  std::uint64_t hash;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint8_t format;
+  std::uint8_t channels;
+  std::uint8_t bitsPerChannel;
+  std::uint8_t unused;
+  std::uint32_t pathLength;
+};
+
+// FNV-1a over 8 byte words with the high bits folded back in, a byte at a time would take longer than everything else
+static std::uint64_t hashBytes(const unsigned char* data, size_t size)
+{
+  const std::uint64_t prime = 1099511628211ull;
+  std::uint64_t hash = 14695981039346656037ull ^ size;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+  {
+    std::uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * prime;
+    hash ^= hash >> 32;
+  }
+  for (; i < size; i++) hash = (hash ^ data[i]) * prime;
+  return hash;
+}
+
+// Probing only touches the pages of the header, hashing reads the rest of the mapping once
+static void probeFile(const std::string& directory, TextureCatalogEntry& entry)
+{
+  MappedFile file;
+  if (!openMappedFile((fs::path(directory) / entry.path).string(), file)) return;
+
+  stbi_probe_info info;
+  if (stbi_probe_from_memory(file.data, (int)std::min(file.size, (size_t)INT_MAX), &info))
+  {
+    entry.format = info.format;
+    entry.width = info.x;
+    entry.height = info.y;
+    entry.channels = info.comp;
+    entry.bitsPerChannel = info.bits_per_channel;
+  }
+  entry.hash = hashBytes(file.data, file.size);
+  closeMappedFile(file);
+}
+
+const TextureCatalogEntry* TextureCatalog::find(const std::string& path) const
+{
+  auto found = std::lower_bound(entries.begin(), entries.end(), path, [](const TextureCatalogEntry& entry, const std::string& key) { return entry.path < key; });
+  return found != entries.end() && found->path == path ? &*found : nullptr;
+}
+
+int TextureCatalog::imageCount() const
+{
+  return (int)std::count_if(entries.begin(), entries.end(), [](const TextureCatalogEntry& entry) { return entry.format != STBI_FORMAT_UNKNOWN; });
+}
+
+std::uint64_t TextureCatalog::textureBytes() const
+{
+  std::uint64_t bytes = 0;
+  for (const TextureCatalogEntry& entry : entries)
+  {
+    if (entry.format == STBI_FORMAT_UNKNOWN) continue;
+    for (std::uint64_t width = entry.width, height = entry.height;; width = std::max<std::uint64_t>(1, width / 2), height = std::max<std::uint64_t>(1, height / 2))
+    {
+      bytes += width * height * entry.channels;
+      if (width == 1 && height == 1) break;
+    }
+  }
+  return bytes;
+}
+
+static const char* formatName(int format)
+{
+  static const char* names[] = { "unknown", "jpeg", "png", "gif", "bmp", "psd", "pic", "pnm", "hdr", "tga" };
+  return format >= 0 && format < (int)std::size(names) ? names[format] : names[0];
+}
+
+void printTextureCatalog(const TextureCatalog& catalog, std::ostream& stream)
+{
+  for (const TextureCatalogEntry& entry : catalog.entries)
+  {
+    if (entry.format == STBI_FORMAT_UNKNOWN) continue;
+    stream << std::left << std::setw(40) << entry.path << std::setw(6) << formatName(entry.format) << std::right << std::setw(6)
+           << entry.width << " x " << std::left << std::setw(6) << entry.height << entry.channels << " x " << entry.bitsPerChannel << " bit  "
+           << std::hex << std::setfill('0') << std::setw(16) << entry.hash << std::dec << std::setfill(' ') << std::endl;
+  }
+  stream << catalog.imageCount() << " images of " << catalog.entries.size() << " files, " << catalog.textureBytes() / (1024 * 1024)
+         << " MB of textures with mipmaps, " << catalog.probed << " probed, " << catalog.reused << " unchanged" << std::endl;
+}
+
+std::string textureCatalogPath(const std::string& directory)
+{
+  return (fs::path(directory) / TEXTURE_CATALOG_NAME).generic_string();
+}
+
+bool buildTextureCatalog(const std::string& directory, TextureCatalog& catalog, int threadCount)
+{
+  catalog = TextureCatalog();
+  catalog.directory = directory;
+
+  std::string indexPath = textureCatalogPath(directory);
+  std::vector<TextureCatalogEntry> saved;
+  loadTextureCatalog(indexPath, saved);
+
+  // Listing the directory gives the modification time and size without opening the files
+  std::error_code error;
+  fs::recursive_directory_iterator iterator(directory, error);
+  for (; !error && iterator != fs::recursive_directory_iterator(); iterator.increment(error))
+  {
+    const fs::directory_entry& file = *iterator;
+    if (file.is_directory() && file.path().filename() == COOKED_DIRECTORY_NAME)
+    {
+      iterator.disable_recursion_pending();
+      continue;
+    }
+    if (!file.is_regular_file()) continue;
+
+    // The index itself and the temporary file it is written through
+    std::string name = file.path().filename().string();
+    if (name.rfind(TEXTURE_CATALOG_NAME, 0) == 0) continue;
+
+    // A file that disappears while listing is left out
+    std::error_code fileError;
+    TextureCatalogEntry entry;
+    entry.path = file.path().lexically_relative(directory).generic_string();
+    entry.modified = file.last_write_time(fileError).time_since_epoch().count();
+    entry.size = file.file_size(fileError);
+    if (!fileError) catalog.entries.push_back(entry);
+  }
+
+  if (error)
+  {
+    std::cerr << "Cannot read directory: " << directory << std::endl;
+    return false;
+  }
+
+  std::sort(catalog.entries.begin(), catalog.entries.end(), [](const TextureCatalogEntry& a, const TextureCatalogEntry& b) { return a.path < b.path; });
+
+  // Both lists are sorted by path, so one pass over them pairs every file with its saved entry
+  std::vector<TextureCatalogEntry*> changed;
+  auto previous = saved.begin();
+  for (TextureCatalogEntry& entry : catalog.entries)
+  {
+    while (previous != saved.end() && previous->path < entry.path) ++previous;
+    if (previous != saved.end() && previous->path == entry.path && previous->modified == entry.modified && previous->size == entry.size)
+    {
+      entry = *previous;
+      catalog.reused++;
+    }
+    else changed.push_back(&entry);
+  }
+
+  parallelFor((int)changed.size(), [&](int index) { probeFile(directory, *changed[index]); }, threadCount);
+  catalog.probed = (int)changed.size();
+
+  // Deleted files change the index too
+  if (catalog.probed > 0 || saved.size() != catalog.entries.size())
+  {
+    if (!saveTextureCatalog(indexPath, catalog.entries)) std::cerr << "Cannot write file: " << indexPath << std::endl;
+  }
+
+  return true;
+}
+
+bool loadTextureCatalog(const std::string& path, std::vector<TextureCatalogEntry>& entries)
+{
+  entries.clear();
+
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return false;
+  std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  TextureCatalogHeader header;
+  if (bytes.size() < sizeof(header)) return false;
+  memcpy(&header, bytes.data(), sizeof(header));
+  if (memcmp(header.magic, TEXTURE_CATALOG_MAGIC, sizeof(header.magic)) != 0 || header.version != TEXTURE_CATALOG_VERSION) return false;
+
+  size_t offset = sizeof(header);
+  for (std::uint32_t i = 0; i < header.entryCount; i++)
+  {
+    TextureCatalogRecord record;
+    if (bytes.size() - offset < sizeof(record)) break;
+    memcpy(&record, bytes.data() + offset, sizeof(record));
+    offset += sizeof(record);
+    if (bytes.size() - offset < record.pathLength) break;
+
+    TextureCatalogEntry entry;
+    entry.path.assign(bytes.data() + offset, record.pathLength);
+    entry.modified = record.modified;
+    entry.size = record.size;
+    entry.hash = record.hash;
+    entry.format = record.format;
+    entry.width = (int)record.width;
+    entry.height = (int)record.height;
+    entry.channels = record.channels;
+    entry.bitsPerChannel = record.bitsPerChannel;
+    entries.push_back(entry);
+    offset += record.pathLength;
+  }
+
+  // A truncated index is treated as no index, every file is probed again
+  if (entries.size() != header.entryCount || !std::is_sorted(entries.begin(), entries.end(), [](const TextureCatalogEntry& a, const TextureCatalogEntry& b) { return a.path < b.path; }))
+  {
+    entries.clear();
+    return false;
+  }
+  return true;
+}
+
+bool saveTextureCatalog(const std::string& path, const std::vector<TextureCatalogEntry>& entries)
+{
+  std::vector<char> bytes(sizeof(TextureCatalogHeader));
+  TextureCatalogHeader header;
+  memcpy(header.magic, TEXTURE_CATALOG_MAGIC, sizeof(header.magic));
+  header.version = TEXTURE_CATALOG_VERSION;
+  header.entryCount = (std::uint32_t)entries.size();
+  memcpy(bytes.data(), &header, sizeof(header));
+
+  for (const TextureCatalogEntry& entry : entries)
+  {
+    TextureCatalogRecord record = {};
+    record.modified = entry.modified;
+    record.size = entry.size;
+    record.hash = entry.hash;
+    record.width = (std::uint32_t)entry.width;
+    record.height = (std::uint32_t)entry.height;
+    record.format = (std::uint8_t)entry.format;
+    record.channels = (std::uint8_t)entry.channels;
+    record.bitsPerChannel = (std::uint8_t)entry.bitsPerChannel;
+    record.pathLength = (std::uint32_t)entry.path.size();
+
+    const char* recordBytes = (const char*)&record;
+    bytes.insert(bytes.end(), recordBytes, recordBytes + sizeof(record));
+    bytes.insert(bytes.end(), entry.path.begin(), entry.path.end());
+  }
+
+  // Written to a temporary file and renamed over the index, so a crash never leaves half an index behind
+  std::string temporaryPath = path + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file.write(bytes.data(), (std::streamsize)bytes.size())) return false;
+  }
+
+  std::error_code error;
+  fs::rename(temporaryPath, path, error);
+  if (!error) return true;
+  fs::remove(temporaryPath, error);
+  return false;
+}
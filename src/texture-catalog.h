@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * An index of the images in a texture directory: format, size, channels and bit depth of every file,
+ * read from the image headers with stbi_probe, and a hash of the contents to tell identical files apart
+ *
+ * The index is saved next to the textures, so later runs only list the directory: a file whose modification time
+ * and size match its entry keeps the entry without being opened, only new and changed files are mapped and probed,
+ * spread over threads, and the index is written back only if something changed
+ *
+ * That way --texture-catalog knows how large every texture is without decoding any of them
+*/
+
+struct TextureCatalogEntry
+{
+  std::string path; // relative to the directory, with forward slashes
+  std::int64_t modified = 0; // std::filesystem::file_time_type ticks
+  std::uint64_t size = 0;
+  std::uint64_t hash = 0;
+
+  // STBI_FORMAT_UNKNOWN for files that are not images, they stay in the index so they are not probed again
+  int format = 0;
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  int bitsPerChannel = 0;
+};
+
+struct TextureCatalog
+{
+  std::string directory;
+  std::vector<TextureCatalogEntry> entries; // sorted by path
+
+  // Entries the last build had to probe and entries it took unchanged from the saved index
+  int probed = 0;
+  int reused = 0;
+
+  const TextureCatalogEntry* find(const std::string& path) const;
+  int imageCount() const;
+
+  // Video memory for every image with its full mip chain, as the 8 bit texels TextureLoader uploads
+  std::uint64_t textureBytes() const;
+};
+
+// Where the index of a directory is saved: textures -> textures/catalog.index
+std::string textureCatalogPath(const std::string& directory);
+
+// Lists directory and its subdirectories (except the cooked textures), reuses the unchanged entries of the saved index,
+// probes the other files on threadCount threads (0 picks one per core) and saves the index if anything changed
+// Returns false if the directory cannot be read, failing to save the index is only reported
+bool buildTextureCatalog(const std::string& directory, TextureCatalog& catalog, int threadCount = 0);
+
+// Reads the saved index, returns false if there is none or it is invalid
+bool loadTextureCatalog(const std::string& path, std::vector<TextureCatalogEntry>& entries);
+bool saveTextureCatalog(const std::string& path, const std::vector<TextureCatalogEntry>& entries);
+
+// One line per image with its format, size, channels, bit depth and hash, then the totals
+void printTextureCatalog(const TextureCatalog& catalog, std::ostream& stream);
@@ -0,0 +1,405 @@
+#include "texture-cooker.h"
+
+#include "image-arena.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+static const char COOKED_TEXTURE_MAGIC[4] = { 'C', 'T', 'E', 'X' };
+static const std::uint32_t COOKED_TEXTURE_VERSION = 1;
+
+// Level payloads start at multiples of this, so a mapped payload is as aligned as a malloc'd one
+static const std::uint64_t COOKED_TEXTURE_ALIGNMENT = 16;
+
+// More levels than a 2^31 texel wide texture can have means the file is corrupt
+static const std::uint32_t MAX_COOKED_LEVELS = 32;
+
+static int blockBytes(unsigned int format)
+{
+  return format == GL_COMPRESSED_RGB_S3TC_DXT1 ? 8 : 16;
+}
+
+static std::uint64_t levelBytes(unsigned int format, std::uint32_t width, std::uint32_t height)
+{
+  return (std::uint64_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+// An RGBA8 image, one level of the mip chain
+struct Image
+{
+  int width = 0;
+  int height = 0;
+  std::vector<unsigned char> pixels;
+};
+
+// Halves the size with a 2x2 box filter, the last row / column is repeated when a side is odd
+static Image downsample(const Image& source)
+{
+  Image result;
+  result.width = std::max(1, source.width / 2);
+  result.height = std::max(1, source.height / 2);
+  result.pixels.resize((size_t)result.width * result.height * 4);
+
+  for (int y = 0; y < result.height; y++)
+  {
+    int y0 = std::min(y * 2, source.height - 1);
+    int y1 = std::min(y * 2 + 1, source.height - 1);
+    for (int x = 0; x < result.width; x++)
+    {
+      int x0 = std::min(x * 2, source.width - 1);
+      int x1 = std::min(x * 2 + 1, source.width - 1);
+      for (int c = 0; c < 4; c++)
+      {
+        int sum = source.pixels[((size_t)y0 * source.width + x0) * 4 + c]
+                + source.pixels[((size_t)y0 * source.width + x1) * 4 + c]
+                + source.pixels[((size_t)y1 * source.width + x0) * 4 + c]
+                + source.pixels[((size_t)y1 * source.width + x1) * 4 + c];
+        result.pixels[((size_t)y * result.width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+      }
+    }
+  }
+
+  return result;
+}
+
+static std::uint16_t packColor565(const int color[3])
+{
+  return (std::uint16_t)(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+}
+
+static void unpackColor565(std::uint16_t packed, int color[3])
+{
+  int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+static void writeLittleEndian(unsigned char* destination, std::uint64_t value, int bytes)
+{
+  for (int i = 0; i < bytes; i++) destination[i] = (unsigned char)(value >> (i * 8));
+}
+
+/**
+ * BC1 color block: two RGB565 endpoints and a 2 bit index per texel into the endpoints and two colors between them
+ * The endpoints are the corners of the block's color bounding box (pulled in a little, the extremes are rarely worth it),
+ * with the diagonal picked to follow how the channels change together
+*/
+static void compressColorBlock(const unsigned char block[16][4], unsigned char* output)
+{
+  int minimum[3] = { 255, 255, 255 }, maximum[3] = { 0, 0, 0 }, mean[3] = { 0, 0, 0 };
+  for (int i = 0; i < 16; i++)
+  {
+    for (int c = 0; c < 3; c++)
+    {
+      minimum[c] = std::min(minimum[c], (int)block[i][c]);
+      maximum[c] = std::max(maximum[c], (int)block[i][c]);
+      mean[c] += block[i][c];
+    }
+  }
+  for (int c = 0; c < 3; c++) mean[c] /= 16;
+
+  // Channels that fall while the widest channel rises go from max to min instead of min to max
+  int widest = 0;
+  for (int c = 1; c < 3; c++)
+  {
+    if (maximum[c] - minimum[c] > maximum[widest] - minimum[widest]) widest = c;
+  }
+  for (int c = 0; c < 3; c++)
+  {
+    if (c == widest) continue;
+    int covariance = 0;
+    for (int i = 0; i < 16; i++) covariance += (block[i][widest] - mean[widest]) * (block[i][c] - mean[c]);
+    if (covariance < 0) std::swap(minimum[c], maximum[c]);
+  }
+
+  int start[3], end[3];
+  for (int c = 0; c < 3; c++)
+  {
+    int inset = (maximum[c] - minimum[c]) / 16;
+    start[c] = maximum[c] - inset;
+    end[c] = minimum[c] + inset;
+  }
+
+  std::uint16_t color0 = packColor565(start);
+  std::uint16_t color1 = packColor565(end);
+
+  // color0 > color1 selects the 4 color mode, the other order means 3 colors + transparent black
+  if (color0 < color1) std::swap(color0, color1);
+
+  int palette[4][3];
+  unpackColor565(color0, palette[0]);
+  unpackColor565(color1, palette[1]);
+  for (int c = 0; c < 3; c++)
+  {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+
+  std::uint32_t indices = 0;
+  if (color0 != color1)
+  {
+    for (int i = 0; i < 16; i++)
+    {
+      int best = 0, bestDistance = 1 << 30;
+      for (int p = 0; p < 4; p++)
+      {
+        int distance = 0;
+        for (int c = 0; c < 3; c++) distance += (block[i][c] - palette[p][c]) * (block[i][c] - palette[p][c]);
+        if (distance < bestDistance)
+        {
+          bestDistance = distance;
+          best = p;
+        }
+      }
+      indices |= (std::uint32_t)best << (i * 2);
+    }
+  }
+
+  writeLittleEndian(output, color0, 2);
+  writeLittleEndian(output + 2, color1, 2);
+  writeLittleEndian(output + 4, indices, 4);
+}
+
+// BC3 alpha block: two 8 bit endpoints and a 3 bit index per texel into the endpoints and six values between them
+static void compressAlphaBlock(const unsigned char block[16][4], unsigned char* output)
+{
+  int alpha0 = 0, alpha1 = 255;
+  for (int i = 0; i < 16; i++)
+  {
+    alpha0 = std::max(alpha0, (int)block[i][3]);
+    alpha1 = std::min(alpha1, (int)block[i][3]);
+  }
+
+  // alpha0 > alpha1 selects the 8 value mode
+  int palette[8] = { alpha0, alpha1 };
+  for (int p = 2; p < 8; p++) palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+
+  std::uint64_t indices = 0;
+  if (alpha0 != alpha1)
+  {
+    for (int i = 0; i < 16; i++)
+    {
+      int best = 0;
+      for (int p = 1; p < 8; p++)
+      {
+        if (std::abs(block[i][3] - palette[p]) < std::abs(block[i][3] - palette[best])) best = p;
+      }
+      indices |= (std::uint64_t)best << (i * 3);
+    }
+  }
+
+  output[0] = (unsigned char)alpha0;
+  output[1] = (unsigned char)alpha1;
+  writeLittleEndian(output + 2, indices, 6);
+}
+
+static std::vector<unsigned char> compressImage(const Image& image, unsigned int format)
+{
+  int blocksX = (image.width + 3) / 4;
+  int blocksY = (image.height + 3) / 4;
+  std::vector<unsigned char> output((size_t)blocksX * blocksY * blockBytes(format));
+  unsigned char* destination = output.data();
+
+  for (int by = 0; by < blocksY; by++)
+  {
+    for (int bx = 0; bx < blocksX; bx++)
+    {
+      // Blocks hanging over the edge repeat the last row / column
+      unsigned char block[16][4];
+      for (int i = 0; i < 16; i++)
+      {
+        int x = std::min(bx * 4 + i % 4, image.width - 1);
+        int y = std::min(by * 4 + i / 4, image.height - 1);
+        memcpy(block[i], &image.pixels[((size_t)y * image.width + x) * 4], 4);
+      }
+
+      if (format == GL_COMPRESSED_RGBA_S3TC_DXT5)
+      {
+        compressAlphaBlock(block, destination);
+        destination += 8;
+      }
+      compressColorBlock(block, destination);
+      destination += 8;
+    }
+  }
+
+  return output;
+}
+
+std::string cookedTexturePath(const std::string& sourcePath)
+{
+  fs::path path(sourcePath);
+  return (path.parent_path() / "cooked" / path.stem()).generic_string() + ".ctex";
+}
+
+bool isCookedTextureFresh(const std::string& sourcePath)
+{
+  std::error_code error;
+  fs::path cookedPath = cookedTexturePath(sourcePath);
+  if (!fs::exists(cookedPath, error)) return false;
+
+  // Without the source (e.g. a shipped build) the cooked texture is all there is
+  if (!fs::exists(sourcePath, error)) return true;
+  return fs::last_write_time(cookedPath, error) >= fs::last_write_time(sourcePath, error);
+}
+
+bool cookTexture(const std::string& sourcePath, const std::string& cookedPath, ImageArena* arena)
+{
+  ImageArena localArena;
+  if (!arena) arena = &localArena;
+
+  // Decode straight into the first level, the decoder's scratch memory comes from the arena
+  Image image;
+  int channels;
+  bool loaded = stbi_info(sourcePath.c_str(), &image.width, &image.height, &channels);
+  if (loaded)
+  {
+    image.pixels.resize((size_t)image.width * image.height * 4);
+    loaded = stbi_load_mapped_into(sourcePath.c_str(), image.pixels.data(), image.pixels.size(), 0, &image.width, &image.height,
+                                   &channels, 4, STBI_MAP_SEQUENTIAL, arena->allocator());
+  }
+  arena->reset();
+  if (!loaded)
+  {
+    std::cerr << "Failed to load texture " << sourcePath << ": " << stbi_failure_reason() << std::endl;
+    return false;
+  }
+
+  // BC1 has no useful alpha, only pay for BC3 when some texel is actually transparent
+  bool transparent = false;
+  for (size_t i = 3; i < image.pixels.size() && !transparent; i += 4) transparent = image.pixels[i] != 255;
+  unsigned int format = transparent ? GL_COMPRESSED_RGBA_S3TC_DXT5 : GL_COMPRESSED_RGB_S3TC_DXT1;
+
+  std::vector<std::vector<unsigned char>> payloads;
+  std::vector<CookedTextureLevel> levels;
+  while (true)
+  {
+    payloads.push_back(compressImage(image, format));
+    levels.push_back({ (std::uint32_t)image.width, (std::uint32_t)image.height, 0, payloads.back().size() });
+    if (image.width == 1 && image.height == 1) break;
+    image = downsample(image);
+  }
+
+  CookedTextureHeader header;
+  memcpy(header.magic, COOKED_TEXTURE_MAGIC, sizeof(header.magic));
+  header.version = COOKED_TEXTURE_VERSION;
+  header.format = format;
+  header.width = levels[0].width;
+  header.height = levels[0].height;
+  header.levelCount = (std::uint32_t)levels.size();
+
+  std::uint64_t offset = sizeof(header) + levels.size() * sizeof(CookedTextureLevel);
+  for (CookedTextureLevel& level : levels)
+  {
+    offset = (offset + COOKED_TEXTURE_ALIGNMENT - 1) & ~(COOKED_TEXTURE_ALIGNMENT - 1);
+    level.offset = offset;
+    offset += level.size;
+  }
+
+  std::error_code error;
+  fs::create_directories(fs::path(cookedPath).parent_path(), error);
+
+  // Write to a temporary file first so a crash never leaves a half written texture behind
+  std::string temporaryPath = cookedPath + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary);
+    if (!file)
+    {
+      std::cerr << "Cannot write file: " << temporaryPath << std::endl;
+      return false;
+    }
+
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)levels.data(), levels.size() * sizeof(CookedTextureLevel));
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+      static const char padding[COOKED_TEXTURE_ALIGNMENT] = {};
+      file.write(padding, levels[i].offset - (std::uint64_t)file.tellp());
+      file.write((const char*)payloads[i].data(), payloads[i].size());
+    }
+
+    if (!file)
+    {
+      std::cerr << "Cannot write file: " << temporaryPath << std::endl;
+      return false;
+    }
+  }
+  fs::rename(temporaryPath, cookedPath, error);
+
+  std::cout << "Cooked " << sourcePath << " -> " << cookedPath << ": " << header.width << "x" << header.height << ", "
+            << header.levelCount << " levels, " << (transparent ? "BC3" : "BC1") << ", " << offset << " bytes" << std::endl;
+  return !error;
+}
+
+int cookTextures(const std::string& directory)
+{
+  std::error_code error;
+  int cooked = 0;
+  bool failed = false;
+  ImageArena arena;
+
+  for (const fs::directory_entry& entry : fs::directory_iterator(directory, error))
+  {
+    if (entry.path().extension() != ".png") continue;
+
+    std::string sourcePath = entry.path().generic_string();
+    if (cookTexture(sourcePath, cookedTexturePath(sourcePath), &arena)) cooked++;
+    else failed = true;
+  }
+
+  if (error)
+  {
+    std::cerr << "Cannot read directory: " << directory << std::endl;
+    return -1;
+  }
+
+  return failed ? -1 : cooked;
+}
+
+bool readCookedTexture(const MappedFile& file, CookedTexture& texture)
+{
+  if (file.size < sizeof(CookedTextureHeader)) return false;
+
+  CookedTextureHeader header;
+  memcpy(&header, file.data, sizeof(header));
+  if (memcmp(header.magic, COOKED_TEXTURE_MAGIC, sizeof(header.magic)) != 0
+      || header.version != COOKED_TEXTURE_VERSION
+      || (header.format != GL_COMPRESSED_RGB_S3TC_DXT1 && header.format != GL_COMPRESSED_RGBA_S3TC_DXT5)
+      || header.levelCount == 0 || header.levelCount > MAX_COOKED_LEVELS
+      || file.size < sizeof(header) + header.levelCount * sizeof(CookedTextureLevel))
+  {
+    return false;
+  }
+
+  texture.format = header.format;
+  texture.width = (int)header.width;
+  texture.height = (int)header.height;
+  texture.data = file.data;
+  texture.levels.resize(header.levelCount);
+  memcpy(texture.levels.data(), file.data + sizeof(header), header.levelCount * sizeof(CookedTextureLevel));
+
+  // Every payload has to be inside the file and exactly as large as its blocks, glCompressedTexSubImage2D trusts us on that
+  std::uint32_t width = header.width, height = header.height;
+  for (const CookedTextureLevel& level : texture.levels)
+  {
+    if (level.width != width || level.height != height
+        || level.size != levelBytes(header.format, width, height)
+        || level.offset % COOKED_TEXTURE_ALIGNMENT != 0
+        || level.offset > file.size || level.size > file.size - level.offset)
+    {
+      return false;
+    }
+    width = std::max(1u, width / 2);
+    height = std::max(1u, height / 2);
+  }
+
+  return true;
+}
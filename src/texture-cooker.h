@@ -0,0 +1,68 @@
+#pragma once
+
+#include "mapped-file.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ImageArena;
+
+/**
+ * Cooked textures: mip chains that were generated and block compressed ahead of time
+ * Loading a PNG means inflating it, building the mipmaps and (inside the driver) storing 4 bytes per texel,
+ * a cooked texture is already in the format the GPU samples from, so loading it is a copy of 0.5 or 1 byte per texel
+ *
+ * The container is a header, one entry per mip level and the level payloads, every payload starts 16 byte aligned
+ * so it can be handed to glCompressedTexSubImage2D straight out of a memory mapping of the file
+ *
+ * Textures without transparency are stored as BC1 (DXT1, 8 bytes per 4x4 block), the others as BC3 (DXT5, 16 bytes)
+*/
+
+// S3TC formats come from EXT_texture_compression_s3tc, which our core profile loader does not define
+const unsigned int GL_COMPRESSED_RGB_S3TC_DXT1 = 0x83F0;
+const unsigned int GL_COMPRESSED_RGBA_S3TC_DXT5 = 0x83F3;
+
+struct CookedTextureHeader
+{
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t format;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t levelCount;
+};
+
+struct CookedTextureLevel
+{
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+// A cooked texture inside a mapped file, the pointers point into the mapping
+struct CookedTexture
+{
+  unsigned int format = 0;
+  int width = 0;
+  int height = 0;
+  std::vector<CookedTextureLevel> levels;
+  const unsigned char* data = nullptr;
+};
+
+// Where the cooked version of a source image lives: textures/crate.png -> textures/cooked/crate.ctex
+std::string cookedTexturePath(const std::string& sourcePath);
+
+// Whether there is a cooked texture at least as new as the source image
+bool isCookedTextureFresh(const std::string& sourcePath);
+
+// Builds the mip chain of one image, compresses it and writes the container, returns false on failure
+// The decoder allocates from arena if there is one, so cooking a directory reuses the same memory for every image
+bool cookTexture(const std::string& sourcePath, const std::string& cookedPath, ImageArena* arena = nullptr);
+
+// Cooks every .png in directory, returns the number of cooked textures or -1 if any of them failed
+int cookTextures(const std::string& directory);
+
+// Checks the header and level table of a mapped container, returns false if it is not a valid cooked texture
+bool readCookedTexture(const MappedFile& file, CookedTexture& texture);
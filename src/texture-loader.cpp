@@ -0,0 +1,590 @@
+#include "texture-loader.h"
+
+#include <glad/glad.h>
+
+#include "parallel-for.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+// Pixel format of an image with 1 to 4 channels
+static GLenum channelFormat(int channels)
+{
+  switch (channels)
+  {
+    case 1: return GL_RED;
+    case 2: return GL_RG;
+    case 3: return GL_RGB;
+    default: return GL_RGBA;
+  }
+}
+
+static GLint channelInternalFormat(int channels, TexturePrecision precision)
+{
+  static const GLint formats[3][4] = {
+    { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 },
+    { GL_R16, GL_RG16, GL_RGB16, GL_RGBA16 },
+    { GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F },
+  };
+  return formats[(int)precision][std::clamp(channels, 1, 4) - 1];
+}
+
+// Type of the decoded channels, stb_image gives 16 bit values and halves in native byte order
+static GLenum channelType(TexturePrecision precision)
+{
+  switch (precision)
+  {
+    case TexturePrecision::Unorm16: return GL_UNSIGNED_SHORT;
+    case TexturePrecision::Half: return GL_HALF_FLOAT;
+    default: return GL_UNSIGNED_BYTE;
+  }
+}
+
+static int channelBytes(TexturePrecision precision)
+{
+  return precision == TexturePrecision::Unorm8 ? 1 : 2;
+}
+
+bool TextureLoader::create(int threadCount)
+{
+  // Three frames worth of budget, so filling one region never waits for the GPU to finish reading another
+  if (!staging.create(UPLOAD_BUDGET)) return false;
+
+  // Darker than the clear color so the crates are still visible while their texture loads
+  unsigned char grey[4] = { 64, 64, 64, 255 };
+  glGenTextures(1, &placeholder);
+  glBindTexture(GL_TEXTURE_2D, placeholder);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  // The same for animations, a texture array can't be bound where a 2D texture was
+  glGenTextures(1, &placeholderArray);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, placeholderArray);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 1, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  // S3TC is an extension, cooked textures are only used if the driver lists both formats
+  int formatCount = 0;
+  glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &formatCount);
+  std::vector<int> formats(formatCount);
+  if (formatCount > 0) glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+  compressedFormatsSupported = std::count(formats.begin(), formats.end(), (int)GL_COMPRESSED_RGB_S3TC_DXT1) > 0
+                            && std::count(formats.begin(), formats.end(), (int)GL_COMPRESSED_RGBA_S3TC_DXT5) > 0;
+
+  // Leave a core for the render thread
+  if (threadCount <= 0) threadCount = std::clamp((int)std::thread::hardware_concurrency() - 1, 1, 4);
+
+  // A single large JPEG would otherwise keep one decode thread busy while the other cores idle
+  useParallelImageDecoding();
+
+  stopping = false;
+  for (int i = 0; i < threadCount; i++) threads.emplace_back(&TextureLoader::decodeThread, this);
+
+  return true;
+}
+
+void TextureLoader::destroy()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    jobs.clear();
+  }
+  wake.notify_all();
+  for (std::thread& thread : threads) thread.join();
+  threads.clear();
+  stopParallelImageDecoding();
+
+  for (DecodedImage& image : decoded) releaseImage(image);
+  for (DecodedImage& image : uploads) releaseImage(image);
+  decoded.clear();
+  uploads.clear();
+
+  for (Slot& slot : slots) glDeleteTextures(1, &slot.texture);
+  slots.clear();
+  glDeleteTextures(1, &placeholder);
+  glDeleteTextures(1, &placeholderArray);
+  placeholder = 0;
+  placeholderArray = 0;
+
+  staging.destroy();
+}
+
+int TextureLoader::load(const std::string& path, TexturePrecision precision)
+{
+  int handle = (int)slots.size();
+  Slot slot;
+  slot.path = path;
+  slot.queued = std::chrono::steady_clock::now();
+  slots.push_back(slot);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.push_back({ handle, path, false, precision });
+  }
+  wake.notify_one();
+
+  return handle;
+}
+
+int TextureLoader::loadAnimation(const std::string& path)
+{
+  int handle = (int)slots.size();
+  Slot slot;
+  slot.path = path;
+  slot.queued = std::chrono::steady_clock::now();
+  slot.animation = true;
+  slots.push_back(slot);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.push_back({ handle, path, true });
+  }
+  wake.notify_one();
+
+  return handle;
+}
+
+int TextureLoader::animationLayer(int handle, double milliseconds) const
+{
+  if (!ready(handle) || slots[handle].frameEnds.empty() || slots[handle].frameEnds.back() <= 0) return 0;
+
+  const std::vector<int>& frameEnds = slots[handle].frameEnds;
+  int time = (int)std::fmod(milliseconds, (double)frameEnds.back());
+  return (int)(std::upper_bound(frameEnds.begin(), frameEnds.end(), time) - frameEnds.begin());
+}
+
+void TextureLoader::decodeThread()
+{
+  while (true)
+  {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&]() { return stopping || !jobs.empty(); });
+      if (stopping) return;
+
+      job = jobs.front();
+      jobs.pop_front();
+    }
+
+    DecodedImage image;
+    image.handle = job.handle;
+    image.precision = job.precision;
+
+    if (job.animation)
+    {
+      decodeAnimation(job.path, image);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (stopping) return;
+      decoded.push_back(std::move(image));
+      continue;
+    }
+
+    // A cooked texture needs no decoding, start reading it in and check its header
+    if (compressedFormatsSupported && job.precision == TexturePrecision::Unorm8 && isCookedTextureFresh(job.path))
+    {
+      std::string cookedPath = cookedTexturePath(job.path);
+      if (openMappedFile(cookedPath, image.mappedFile) && readCookedTexture(image.mappedFile, image.cooked))
+      {
+        prefetchMappedFile(image.mappedFile);
+        image.width = image.cooked.width;
+        image.height = image.cooked.height;
+      }
+      else
+      {
+        std::cerr << "Cooked texture " << cookedPath << " is invalid, loading " << job.path << " instead" << std::endl;
+        closeMappedFile(image.mappedFile);
+        image.cooked = CookedTexture();
+      }
+    }
+
+    if (job.precision != TexturePrecision::Unorm8)
+    {
+      decodeWide(job.path, image);
+    }
+    else if (!image.cooked.format)
+    {
+      // Decoding from a mapping skips stb_image's small read buffer and lets large JPEGs use parallel decoding
+      image.pixels = stbi_load_mapped(job.path.c_str(), &image.width, &image.height, &image.channels, 0, STBI_MAP_SEQUENTIAL);
+
+      // stbi_failure_reason is per thread, so it has to be read here and not on the render thread
+      if (!image.pixels) image.error = stbi_failure_reason();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping)
+    {
+      releaseImage(image);
+      return;
+    }
+    decoded.push_back(std::move(image));
+  }
+}
+
+void TextureLoader::decodeAnimation(const std::string& path, DecodedImage& image)
+{
+  MappedFile file;
+  if (!openMappedFile(path, file))
+  {
+    image.error = "cannot open file";
+    return;
+  }
+
+  int frameCount = 0;
+  stbi_gif_frames* frames = stbi_gif_frames_open_memory(file.data, (int)std::min(file.size, (size_t)INT_MAX), &image.width, &image.height, &frameCount);
+  if (!frames)
+  {
+    image.error = stbi_failure_reason();
+    closeMappedFile(file);
+    return;
+  }
+  image.channels = 4;
+  image.frames.reserve(frameCount);
+
+  // The first frame is whole, the others are usually a small part of it
+  size_t rowBytes = (size_t)image.width * 4;
+  image.framePixels.reserve(rowBytes * image.height);
+
+  stbi_gif_frame frame;
+  int result;
+  while ((result = stbi_gif_frames_next(frames, &frame)) > 0)
+  {
+    AnimationFrame rectangle;
+    rectangle.x = frame.x0;
+    rectangle.y = frame.y0;
+    rectangle.width = frame.x1 - frame.x0;
+    rectangle.height = frame.y1 - frame.y0;
+    rectangle.delay = frame.delay;
+    rectangle.offset = image.framePixels.size();
+    image.frames.push_back(rectangle);
+
+    for (int y = frame.y0; y < frame.y1; y++)
+    {
+      const unsigned char* row = frame.pixels + y * rowBytes + frame.x0 * 4;
+      image.framePixels.insert(image.framePixels.end(), row, row + rectangle.width * 4);
+    }
+  }
+
+  // A corrupt frame ends the animation, like stbi_load_gif_from_memory does, unless there was none before it
+  if (result < 0 && image.frames.empty()) image.error = stbi_failure_reason();
+  else if (image.frames.empty()) image.error = "no frames";
+
+  stbi_gif_frames_close(frames);
+  closeMappedFile(file);
+}
+
+void TextureLoader::decodeWide(const std::string& path, DecodedImage& image)
+{
+  MappedFile file;
+  if (!openMappedFile(path, file))
+  {
+    image.error = "cannot open file";
+    return;
+  }
+
+  // Both convert the rows as they are decoded, there is no 8 bit copy of the image to widen afterwards
+  int size = (int)std::min(file.size, (size_t)INT_MAX);
+  stbi_us* pixels = image.precision == TexturePrecision::Half
+                      ? stbi_load_half_from_memory(file.data, size, &image.width, &image.height, &image.channels, 0)
+                      : stbi_load_16_from_memory(file.data, size, &image.width, &image.height, &image.channels, 0);
+  image.pixels = (unsigned char*)pixels;
+  if (!pixels) image.error = stbi_failure_reason();
+
+  closeMappedFile(file);
+}
+
+void TextureLoader::beginAnimationUpload(DecodedImage& image)
+{
+  Slot& slot = slots[image.handle];
+  glGenTextures(1, &slot.texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, slot.texture);
+
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  // Every layer at once, so adding a frame never reallocates the texture
+  int levels = 1;
+  while ((std::max(image.width, image.height) >> levels) > 0) levels++;
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, image.width, image.height, (GLsizei)image.frames.size());
+
+  int end = 0;
+  for (const AnimationFrame& frame : image.frames) slot.frameEnds.push_back(end += frame.delay);
+}
+
+void TextureLoader::beginUpload(DecodedImage& image)
+{
+  Slot& slot = slots[image.handle];
+  glGenTextures(1, &slot.texture);
+
+  // Bind first, glTexParameter changes whatever texture is bound
+  glBindTexture(GL_TEXTURE_2D, slot.texture);
+
+  // Clamp the texture so that anything outside the texture will be a user defined color
+  /**
+   * first argument: texture target (21d, 2d, 3d, etc...)
+   * second argument: which axis we are configuring (axes: s, t, r(if using 3d textures))
+   * third argument: texture wrapping mode we would like
+  */
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+  // Specify user defined border color
+  float borderColor[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+  glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+  // Specify the filtering mode
+  /**
+   * the filtering mode the color is at a point on the texture relative to the colors of the four texels that surround it
+   * nearest neighbour or point filtering returns the color of the nearest texel
+   * bilinear filtering linearly interpolates between the four colors to get a ratiod mix of the four
+   * minification also blends between the two closest mipmaps (trilinear filtering), glGenerateMipmap creates them once the image is complete
+  */
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  // Allocate the storage, the rows are filled in by uploadRows or the levels by uploadLevels
+  if (image.cooked.format)
+  {
+    glTexStorage2D(GL_TEXTURE_2D, (GLsizei)image.cooked.levels.size(), image.cooked.format, image.width, image.height);
+    return;
+  }
+  glTexImage2D(GL_TEXTURE_2D, 0, channelInternalFormat(image.channels, image.precision), image.width, image.height, 0,
+               channelFormat(image.channels), channelType(image.precision), NULL);
+}
+
+bool TextureLoader::uploadRows(DecodedImage& image, std::uintptr_t& budget)
+{
+  std::uintptr_t rowBytes = (std::uintptr_t)image.width * image.channels * channelBytes(image.precision);
+  GLenum format = channelFormat(image.channels);
+  GLenum type = channelType(image.precision);
+
+  glBindTexture(GL_TEXTURE_2D, slots[image.handle].texture);
+
+  // Rows of 1 and 3 channel images are not 4 byte aligned
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  if (rowBytes > UPLOAD_BUDGET)
+  {
+    // A single row does not fit into the staging buffer, let the driver copy the whole image from our memory
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, format, type, image.pixels);
+    image.rowsUploaded = image.height;
+    budget = 0;
+  }
+  else
+  {
+    int rows = (int)std::min<std::uintptr_t>(image.height - image.rowsUploaded, budget / rowBytes);
+
+    std::uintptr_t offset;
+    void* staged = rows > 0 ? staging.allocate(rows * rowBytes, 4, offset) : nullptr;
+    if (!staged)
+    {
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      return false;
+    }
+
+    memcpy(staged, image.pixels + image.rowsUploaded * rowBytes, rows * rowBytes);
+
+    // With a pixel unpack buffer bound the last argument is an offset into it instead of a pointer
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, image.rowsUploaded, image.width, rows, format, type, (void*)offset);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    image.rowsUploaded += rows;
+    budget -= rows * rowBytes;
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  return image.rowsUploaded == image.height;
+}
+
+bool TextureLoader::uploadLevels(DecodedImage& image, std::uintptr_t& budget)
+{
+  glBindTexture(GL_TEXTURE_2D, slots[image.handle].texture);
+
+  while (image.levelsUploaded < (int)image.cooked.levels.size())
+  {
+    const CookedTextureLevel& level = image.cooked.levels[image.levelsUploaded];
+    const unsigned char* payload = image.cooked.data + level.offset;
+
+    if (level.size > UPLOAD_BUDGET)
+    {
+      // Too large for the staging buffer, the driver copies it straight out of the mapping
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, image.levelsUploaded, 0, 0, level.width, level.height, image.cooked.format, (GLsizei)level.size, payload);
+      budget = 0;
+    }
+    else
+    {
+      // Compressed blocks can't be split by rows as easily, so whole levels wait for the next frame's budget
+      std::uintptr_t offset;
+      void* staged = level.size <= budget ? staging.allocate(level.size, 16, offset) : nullptr;
+      if (!staged) return false;
+
+      memcpy(staged, payload, level.size);
+
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer());
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, image.levelsUploaded, 0, 0, level.width, level.height, image.cooked.format, (GLsizei)level.size, (void*)offset);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      budget -= level.size;
+    }
+
+    image.levelsUploaded++;
+  }
+
+  return true;
+}
+
+bool TextureLoader::uploadFrames(DecodedImage& image, std::uintptr_t& budget)
+{
+  unsigned int texture = slots[image.handle].texture;
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+  while (image.framesUploaded < (int)image.frames.size())
+  {
+    const AnimationFrame& frame = image.frames[image.framesUploaded];
+    int layer = image.framesUploaded;
+
+    // Outside its rectangle a frame is the frame before, which the GPU copies over from the previous layer
+    if (image.rowsUploaded == 0 && layer > 0)
+    {
+      glCopyImageSubData(texture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer - 1, texture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, image.width, image.height, 1);
+    }
+
+    // GIFs are at most 65535 pixels wide, so a row always fits the budget of a frame
+    std::uintptr_t rowBytes = (std::uintptr_t)frame.width * 4;
+    int rows = rowBytes ? (int)std::min<std::uintptr_t>(frame.height - image.rowsUploaded, budget / rowBytes) : 0;
+    if (rows > 0)
+    {
+      std::uintptr_t offset;
+      void* staged = staging.allocate(rows * rowBytes, 4, offset);
+      if (!staged) return false;
+
+      memcpy(staged, image.framePixels.data() + frame.offset + image.rowsUploaded * rowBytes, rows * rowBytes);
+
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer());
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, frame.x, frame.y + image.rowsUploaded, layer, frame.width, rows, 1, GL_RGBA, GL_UNSIGNED_BYTE, (void*)offset);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+      image.rowsUploaded += rows;
+      budget -= rows * rowBytes;
+    }
+
+    // Out of budget in the middle of the frame, the rest of its rows go next frame without copying the layer again
+    if (image.rowsUploaded < frame.height) return false;
+
+    image.rowsUploaded = 0;
+    image.framesUploaded++;
+  }
+
+  return true;
+}
+
+void TextureLoader::releaseImage(DecodedImage& image)
+{
+  stbi_image_free(image.pixels);
+  image.pixels = nullptr;
+  closeMappedFile(image.mappedFile);
+  image.frames.clear();
+  image.framePixels.clear();
+}
+
+void TextureLoader::update()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    while (!decoded.empty())
+    {
+      uploads.push_back(std::move(decoded.front()));
+      decoded.pop_front();
+    }
+  }
+
+  if (uploads.empty()) return;
+
+  // Wait (rarely) until the GPU has finished reading the staging region we are about to overwrite
+  staging.beginFrame();
+
+  std::uintptr_t budget = UPLOAD_BUDGET;
+  while (!uploads.empty() && budget > 0)
+  {
+    DecodedImage& image = uploads.front();
+    Slot& slot = slots[image.handle];
+
+    if (!image.pixels && !image.cooked.format && image.frames.empty())
+    {
+      std::cerr << "Failed to load texture " << slot.path << ": " << image.error << std::endl;
+      slot.failed = true;
+      uploads.pop_front();
+      continue;
+    }
+
+    if (!slot.texture)
+    {
+      if (slot.animation) beginAnimationUpload(image);
+      else beginUpload(image);
+    }
+
+    // Cooked textures bring their mip levels along, decoded ones and animations get them generated
+    if (image.cooked.format)
+    {
+      if (!uploadLevels(image, budget)) break;
+    }
+    else if (slot.animation)
+    {
+      if (!uploadFrames(image, budget)) break;
+      glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+    else
+    {
+      if (!uploadRows(image, budget)) break;
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    slot.ready = true;
+    std::cout << "Loaded texture " << slot.path << (image.cooked.format ? " (cooked)" : slot.animation ? " (animated)" : " (decoded)") << " in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - slot.queued).count() << " ms" << std::endl;
+
+    releaseImage(image);
+    uploads.pop_front();
+  }
+
+  staging.endFrame();
+}
+
+void TextureLoader::waitAll()
+{
+  while (pending() > 0)
+  {
+    update();
+    if (uploads.empty()) std::this_thread::yield();
+  }
+}
+
+unsigned int TextureLoader::texture(int handle) const
+{
+  if (ready(handle)) return slots[handle].texture;
+  return handle >= 0 && handle < (int)slots.size() && slots[handle].animation ? placeholderArray : placeholder;
+}
+
+bool TextureLoader::ready(int handle) const
+{
+  return handle >= 0 && handle < (int)slots.size() && slots[handle].ready;
+}
+
+int TextureLoader::pending() const
+{
+  int count = 0;
+  for (const Slot& slot : slots)
+  {
+    if (!slot.ready && !slot.failed) count++;
+  }
+  return count;
+}
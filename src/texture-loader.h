@@ -0,0 +1,177 @@
+#pragma once
+
+#include "ring-buffer.h"
+#include "texture-cooker.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Loads textures without blocking the render loop
+ * Decoding a PNG takes far longer than a frame, so worker threads decode the files with stb_image
+ * and the render thread only copies the decoded pixels to the GPU, a budgeted number of rows per frame
+ *
+ * The copy goes through a persistent mapped pixel unpack buffer (GL_PIXEL_UNPACK_BUFFER):
+ * glTexSubImage2D then reads from GPU visible memory and returns right away instead of copying from our memory
+ *
+ * Until a texture is complete, texture() returns a 1x1 placeholder so drawing never has to wait for it
+ *
+ * If a fresh cooked version of the file exists (see texture-cooker.h) it is used instead of the PNG:
+ * the decode thread only maps the file and the render thread copies the compressed mip levels out of the mapping
+ *
+ * Animated GIFs (loadAnimation) become a GL_TEXTURE_2D_ARRAY with one layer per frame, allocated once for all frames
+ * The decode thread keeps only the rectangle that changed in each frame, and the render thread copies the previous
+ * layer on the GPU (glCopyImageSubData) and then uploads just that rectangle with glTexSubImage3D
+ *
+ * Height maps and normal maps can be loaded with 16 bits or half floats per channel (see TexturePrecision),
+ * stb_image then writes the decoded rows in that format right away and they are uploaded as they are
+*/
+
+// How the channels of a decoded texture are stored
+enum class TexturePrecision
+{
+  Unorm8,  // GL_R8 to GL_RGBA8, the only one a cooked texture can replace
+  Unorm16, // GL_R16 to GL_RGBA16, for height maps and normal maps that need more than 256 steps
+  Half     // GL_R16F to GL_RGBA16F, 0..1 like Unorm16, but HDR images keep their range
+};
+
+class TextureLoader
+{
+public:
+  // Bytes of pixel data uploaded per frame at most
+  static const std::uintptr_t UPLOAD_BUDGET = 4 * 1024 * 1024;
+
+  TextureLoader() = default;
+  TextureLoader(const TextureLoader&) = delete;
+  TextureLoader& operator=(const TextureLoader&) = delete;
+
+  // Starts threadCount decode threads (0 picks one per spare core), returns false if the upload buffer cannot be created
+  bool create(int threadCount = 0);
+
+  // Stops the threads and deletes every texture, needs the OpenGL context
+  void destroy();
+
+  // Queues a file for decoding and returns a handle for texture()
+  int load(const std::string& path, TexturePrecision precision = TexturePrecision::Unorm8);
+
+  // Same for an animated GIF, texture() is then a GL_TEXTURE_2D_ARRAY (a one layer placeholder until it is complete)
+  int loadAnimation(const std::string& path);
+
+  // The layer of an animation to show milliseconds after it started, looping, 0 for anything else
+  int animationLayer(int handle, double milliseconds) const;
+
+  // Uploads decoded images within the per frame budget, call once per frame on the thread that owns the context
+  void update();
+
+  // Calls update() until every queued texture is complete or failed
+  void waitAll();
+
+  // The texture to bind for a handle: the placeholder until it is complete (or if it failed to load)
+  unsigned int texture(int handle) const;
+  bool ready(int handle) const;
+
+  // Textures that are neither complete nor failed
+  int pending() const;
+
+private:
+  struct Slot
+  {
+    std::string path;
+    unsigned int texture = 0;
+    bool ready = false;
+    bool failed = false;
+    std::chrono::steady_clock::time_point queued;
+
+    // Animations only: when each frame ends, in milliseconds from the start of the first
+    bool animation = false;
+    std::vector<int> frameEnds;
+  };
+
+  struct Job
+  {
+    int handle = -1;
+    std::string path;
+    bool animation = false;
+    TexturePrecision precision = TexturePrecision::Unorm8;
+  };
+
+  // The part of an animation frame that differs from the frame before, its rows are packed in framePixels at offset
+  struct AnimationFrame
+  {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    int delay = 0;
+    size_t offset = 0;
+  };
+
+  // Output of a decode thread, pixels are owned by stb_image (stbi_image_free) and cooked points into mappedFile
+  struct DecodedImage
+  {
+    int handle = -1;
+    unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    TexturePrecision precision = TexturePrecision::Unorm8;
+    std::string error;
+
+    // Rows already copied to the texture, the image is uploaded over several frames if it exceeds the budget
+    int rowsUploaded = 0;
+
+    // Set instead of pixels when the texture was cooked, uploaded one mip level at a time
+    MappedFile mappedFile;
+    CookedTexture cooked;
+    int levelsUploaded = 0;
+
+    // Set instead of pixels for animations, uploaded one frame at a time, rowsUploaded counts the rows of the current one
+    std::vector<AnimationFrame> frames;
+    std::vector<unsigned char> framePixels;
+    int framesUploaded = 0;
+  };
+
+  void decodeThread();
+  void decodeAnimation(const std::string& path, DecodedImage& image);
+
+  // Decodes a file with 16 bits or half floats per channel, the pixels are then 2 bytes per channel
+  void decodeWide(const std::string& path, DecodedImage& image);
+  void beginUpload(DecodedImage& image);
+  void beginAnimationUpload(DecodedImage& image);
+
+  // Returns true once every row of image has been uploaded
+  bool uploadRows(DecodedImage& image, std::uintptr_t& budget);
+
+  // Same for the mip levels of a cooked texture
+  bool uploadLevels(DecodedImage& image, std::uintptr_t& budget);
+
+  // Same for the frames of an animation
+  bool uploadFrames(DecodedImage& image, std::uintptr_t& budget);
+
+  void releaseImage(DecodedImage& image);
+
+  // Only touched by the render thread
+  std::vector<Slot> slots;
+  std::deque<DecodedImage> uploads;
+  unsigned int placeholder = 0;
+  unsigned int placeholderArray = 0;
+  StreamRingBuffer staging;
+
+  // Written before the decode threads start, so they can read it without locking
+  bool compressedFormatsSupported = false;
+
+  // Shared with the decode threads, guarded by mutex
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<Job> jobs;
+  std::deque<DecodedImage> decoded;
+  bool stopping = false;
+
+  std::vector<std::thread> threads;
+};
@@ -0,0 +1,437 @@
+#include "transform-batch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <immintrin.h>
+
+// AVX2 and AVX-512 kernels are compiled with target attributes and only called after a run-time check,
+// so the rest of the program does not need -mavx2
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#include <intrin.h>
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+#endif
+
+// The compilers fuse a multiply and an add into an FMA when the target has one (AVX-512F does, and so does any build
+// with -mfma), which rounds once instead of twice and gives other results than glm's unfused sums, so the kernels
+// keep every multiply and add apart
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#define NO_FMA
+#elif defined(__GNUC__)
+#define NO_FMA __attribute__((optimize("fp-contract=off")))
+#else
+#define NO_FMA
+#endif
+
+SoaBuffer::SoaBuffer(int laneCount) : laneCount(laneCount)
+{
+}
+
+SoaBuffer::~SoaBuffer()
+{
+  if (data) ::operator delete(data, std::align_val_t(ALIGNMENT));
+}
+
+void SoaBuffer::resize(std::size_t newCount)
+{
+  if (newCount > capacity)
+  {
+    std::size_t newCapacity = std::max(newCount, capacity * 2);
+    newCapacity = (newCapacity + LANE_PADDING - 1) / LANE_PADDING * LANE_PADDING;
+
+    float* newData = (float*)::operator new(laneCount * newCapacity * sizeof(float), std::align_val_t(ALIGNMENT));
+    std::memset(newData, 0, laneCount * newCapacity * sizeof(float));
+    for (int i = 0; i < laneCount && count; i++) std::memcpy(newData + i * newCapacity, lane(i), count * sizeof(float));
+
+    if (data) ::operator delete(data, std::align_val_t(ALIGNMENT));
+    data = newData;
+    capacity = newCapacity;
+  }
+  else if (newCount > count)
+  {
+    for (int i = 0; i < laneCount; i++) std::memset(lane(i) + count, 0, (newCount - count) * sizeof(float));
+  }
+  count = newCount;
+}
+
+void MatrixBatch::set(std::size_t index, const glm::mat4& matrix)
+{
+  for (int column = 0; column < 4; column++)
+  {
+    for (int row = 0; row < 4; row++) element(column, row)[index] = matrix[column][row];
+  }
+}
+
+glm::mat4 MatrixBatch::get(std::size_t index) const
+{
+  glm::mat4 matrix;
+  for (int column = 0; column < 4; column++)
+  {
+    for (int row = 0; row < 4; row++) matrix[column][row] = element(column, row)[index];
+  }
+  return matrix;
+}
+
+void MatrixBatch::assign(const glm::mat4* matrices, std::size_t matrixCount)
+{
+  resize(matrixCount);
+  for (std::size_t i = 0; i < matrixCount; i++) set(i, matrices[i]);
+}
+
+void MatrixBatch::store(glm::mat4* destination) const
+{
+  for (std::size_t i = 0; i < size(); i++) destination[i] = get(i);
+}
+
+void PointBatch::set(std::size_t index, const glm::vec3& point)
+{
+  for (int i = 0; i < 3; i++) lane(i)[index] = point[i];
+}
+
+glm::vec3 PointBatch::get(std::size_t index) const
+{
+  return glm::vec3(lane(0)[index], lane(1)[index], lane(2)[index]);
+}
+
+void SphereBatch::set(std::size_t index, const glm::vec4& sphere)
+{
+  for (int i = 0; i < 4; i++) lane(i)[index] = sphere[i];
+}
+
+glm::vec4 SphereBatch::get(std::size_t index) const
+{
+  return glm::vec4(lane(0)[index], lane(1)[index], lane(2)[index], lane(3)[index]);
+}
+
+namespace
+{
+
+/**
+ * The kernels get the transform as 16 floats in column major order, the first lane of input and output and the
+ * floats between two lanes of each, and handle count objects, a multiple of SoaBuffer::LANE_PADDING
+ *
+ * A matrix product sums ((t0 * b0 + t1 * b1) + t2 * b2) + t3 * b3 and a point (t0 * x + t1 * y) + (t2 * z + t3)
+ * like glm's operator*, and every input of an object is loaded before its outputs are stored, so input may be output
+*/
+struct Lanes
+{
+  const float* input;
+  std::size_t inputStride;
+  float* output;
+  std::size_t outputStride;
+  std::size_t count;
+};
+
+NO_FMA void multiplyMatricesScalar(const float* transform, const Lanes& lanes)
+{
+  // A copy the compiler knows the output does not overwrite
+  float t[16];
+  std::memcpy(t, transform, sizeof(t));
+
+  for (int column = 0; column < 4; column++)
+  {
+    const float* b = lanes.input + column * 4 * lanes.inputStride;
+    float* out = lanes.output + column * 4 * lanes.outputStride;
+    for (std::size_t i = 0; i < lanes.count; i++)
+    {
+      float b0 = b[i], b1 = b[lanes.inputStride + i], b2 = b[2 * lanes.inputStride + i], b3 = b[3 * lanes.inputStride + i];
+      for (int row = 0; row < 4; row++) out[row * lanes.outputStride + i] = t[row] * b0 + t[4 + row] * b1 + t[8 + row] * b2 + t[12 + row] * b3;
+    }
+  }
+}
+
+NO_FMA void transformPointsScalar(const float* transform, const Lanes& lanes)
+{
+  float t[16];
+  std::memcpy(t, transform, sizeof(t));
+
+  for (std::size_t i = 0; i < lanes.count; i++)
+  {
+    float x = lanes.input[i], y = lanes.input[lanes.inputStride + i], z = lanes.input[2 * lanes.inputStride + i];
+    for (int row = 0; row < 3; row++) lanes.output[row * lanes.outputStride + i] = (t[row] * x + t[4 + row] * y) + (t[8 + row] * z + t[12 + row]);
+  }
+}
+
+void scaleRadiiScalar(float scale, const Lanes& lanes)
+{
+  const float* radius = lanes.input + 3 * lanes.inputStride;
+  float* out = lanes.output + 3 * lanes.outputStride;
+  for (std::size_t i = 0; i < lanes.count; i++) out[i] = radius[i] * scale;
+}
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+
+NO_FMA void multiplyMatricesSse(const float* t, const Lanes& lanes)
+{
+  __m128 columns[16];
+  for (int i = 0; i < 16; i++) columns[i] = _mm_set1_ps(t[i]);
+
+  for (int column = 0; column < 4; column++)
+  {
+    const float* b = lanes.input + column * 4 * lanes.inputStride;
+    float* out = lanes.output + column * 4 * lanes.outputStride;
+    for (std::size_t i = 0; i < lanes.count; i += 4)
+    {
+      __m128 b0 = _mm_load_ps(b + i);
+      __m128 b1 = _mm_load_ps(b + lanes.inputStride + i);
+      __m128 b2 = _mm_load_ps(b + 2 * lanes.inputStride + i);
+      __m128 b3 = _mm_load_ps(b + 3 * lanes.inputStride + i);
+      for (int row = 0; row < 4; row++)
+      {
+        __m128 sum = _mm_add_ps(_mm_mul_ps(columns[row], b0), _mm_mul_ps(columns[4 + row], b1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(columns[8 + row], b2));
+        sum = _mm_add_ps(sum, _mm_mul_ps(columns[12 + row], b3));
+        _mm_store_ps(out + row * lanes.outputStride + i, sum);
+      }
+    }
+  }
+}
+
+NO_FMA void transformPointsSse(const float* t, const Lanes& lanes)
+{
+  __m128 columns[16];
+  for (int i = 0; i < 16; i++) columns[i] = _mm_set1_ps(t[i]);
+
+  for (std::size_t i = 0; i < lanes.count; i += 4)
+  {
+    __m128 x = _mm_load_ps(lanes.input + i);
+    __m128 y = _mm_load_ps(lanes.input + lanes.inputStride + i);
+    __m128 z = _mm_load_ps(lanes.input + 2 * lanes.inputStride + i);
+    for (int row = 0; row < 3; row++)
+    {
+      __m128 xy = _mm_add_ps(_mm_mul_ps(columns[row], x), _mm_mul_ps(columns[4 + row], y));
+      __m128 zw = _mm_add_ps(_mm_mul_ps(columns[8 + row], z), columns[12 + row]);
+      _mm_store_ps(lanes.output + row * lanes.outputStride + i, _mm_add_ps(xy, zw));
+    }
+  }
+}
+
+void scaleRadiiSse(float scale, const Lanes& lanes)
+{
+  const float* radius = lanes.input + 3 * lanes.inputStride;
+  float* out = lanes.output + 3 * lanes.outputStride;
+  __m128 factor = _mm_set1_ps(scale);
+  for (std::size_t i = 0; i < lanes.count; i += 4) _mm_store_ps(out + i, _mm_mul_ps(_mm_load_ps(radius + i), factor));
+}
+
+TARGET_AVX2 NO_FMA void multiplyMatricesAvx2(const float* t, const Lanes& lanes)
+{
+  __m256 columns[16];
+  for (int i = 0; i < 16; i++) columns[i] = _mm256_set1_ps(t[i]);
+
+  for (int column = 0; column < 4; column++)
+  {
+    const float* b = lanes.input + column * 4 * lanes.inputStride;
+    float* out = lanes.output + column * 4 * lanes.outputStride;
+    for (std::size_t i = 0; i < lanes.count; i += 8)
+    {
+      __m256 b0 = _mm256_load_ps(b + i);
+      __m256 b1 = _mm256_load_ps(b + lanes.inputStride + i);
+      __m256 b2 = _mm256_load_ps(b + 2 * lanes.inputStride + i);
+      __m256 b3 = _mm256_load_ps(b + 3 * lanes.inputStride + i);
+      for (int row = 0; row < 4; row++)
+      {
+        __m256 sum = _mm256_add_ps(_mm256_mul_ps(columns[row], b0), _mm256_mul_ps(columns[4 + row], b1));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(columns[8 + row], b2));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(columns[12 + row], b3));
+        _mm256_store_ps(out + row * lanes.outputStride + i, sum);
+      }
+    }
+  }
+}
+
+TARGET_AVX2 NO_FMA void transformPointsAvx2(const float* t, const Lanes& lanes)
+{
+  __m256 columns[16];
+  for (int i = 0; i < 16; i++) columns[i] = _mm256_set1_ps(t[i]);
+
+  for (std::size_t i = 0; i < lanes.count; i += 8)
+  {
+    __m256 x = _mm256_load_ps(lanes.input + i);
+    __m256 y = _mm256_load_ps(lanes.input + lanes.inputStride + i);
+    __m256 z = _mm256_load_ps(lanes.input + 2 * lanes.inputStride + i);
+    for (int row = 0; row < 3; row++)
+    {
+      __m256 xy = _mm256_add_ps(_mm256_mul_ps(columns[row], x), _mm256_mul_ps(columns[4 + row], y));
+      __m256 zw = _mm256_add_ps(_mm256_mul_ps(columns[8 + row], z), columns[12 + row]);
+      _mm256_store_ps(lanes.output + row * lanes.outputStride + i, _mm256_add_ps(xy, zw));
+    }
+  }
+}
+
+TARGET_AVX2 void scaleRadiiAvx2(float scale, const Lanes& lanes)
+{
+  const float* radius = lanes.input + 3 * lanes.inputStride;
+  float* out = lanes.output + 3 * lanes.outputStride;
+  __m256 factor = _mm256_set1_ps(scale);
+  for (std::size_t i = 0; i < lanes.count; i += 8) _mm256_store_ps(out + i, _mm256_mul_ps(_mm256_load_ps(radius + i), factor));
+}
+
+TARGET_AVX512 NO_FMA void multiplyMatricesAvx512(const float* t, const Lanes& lanes)
+{
+  __m512 columns[16];
+  for (int i = 0; i < 16; i++) columns[i] = _mm512_set1_ps(t[i]);
+
+  for (int column = 0; column < 4; column++)
+  {
+    const float* b = lanes.input + column * 4 * lanes.inputStride;
+    float* out = lanes.output + column * 4 * lanes.outputStride;
+    for (std::size_t i = 0; i < lanes.count; i += 16)
+    {
+      __m512 b0 = _mm512_load_ps(b + i);
+      __m512 b1 = _mm512_load_ps(b + lanes.inputStride + i);
+      __m512 b2 = _mm512_load_ps(b + 2 * lanes.inputStride + i);
+      __m512 b3 = _mm512_load_ps(b + 3 * lanes.inputStride + i);
+      for (int row = 0; row < 4; row++)
+      {
+        __m512 sum = _mm512_add_ps(_mm512_mul_ps(columns[row], b0), _mm512_mul_ps(columns[4 + row], b1));
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(columns[8 + row], b2));
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(columns[12 + row], b3));
+        _mm512_store_ps(out + row * lanes.outputStride + i, sum);
+      }
+    }
+  }
+}
+
+TARGET_AVX512 NO_FMA void transformPointsAvx512(const float* t, const Lanes& lanes)
+{
+  __m512 columns[16];
+  for (int i = 0; i < 16; i++) columns[i] = _mm512_set1_ps(t[i]);
+
+  for (std::size_t i = 0; i < lanes.count; i += 16)
+  {
+    __m512 x = _mm512_load_ps(lanes.input + i);
+    __m512 y = _mm512_load_ps(lanes.input + lanes.inputStride + i);
+    __m512 z = _mm512_load_ps(lanes.input + 2 * lanes.inputStride + i);
+    for (int row = 0; row < 3; row++)
+    {
+      __m512 xy = _mm512_add_ps(_mm512_mul_ps(columns[row], x), _mm512_mul_ps(columns[4 + row], y));
+      __m512 zw = _mm512_add_ps(_mm512_mul_ps(columns[8 + row], z), columns[12 + row]);
+      _mm512_store_ps(lanes.output + row * lanes.outputStride + i, _mm512_add_ps(xy, zw));
+    }
+  }
+}
+
+TARGET_AVX512 void scaleRadiiAvx512(float scale, const Lanes& lanes)
+{
+  const float* radius = lanes.input + 3 * lanes.inputStride;
+  float* out = lanes.output + 3 * lanes.outputStride;
+  __m512 factor = _mm512_set1_ps(scale);
+  for (std::size_t i = 0; i < lanes.count; i += 16) _mm512_store_ps(out + i, _mm512_mul_ps(_mm512_load_ps(radius + i), factor));
+}
+
+// bit 0: AVX2, bit 1: AVX-512F (both including OS support for the wider registers)
+int cpuFeatures()
+{
+  int features = 0;
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) features |= 1;
+  if (__builtin_cpu_supports("avx512f")) features |= 2;
+#elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  // OSXSAVE + AVX, then which registers the OS saves: YMM, and opmask + ZMM for AVX-512
+  if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)))
+  {
+    unsigned long long enabled = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    if ((info[1] & (1 << 5)) && (enabled & 6) == 6) features |= 1;
+    if ((info[1] & (1 << 16)) && (enabled & 0xe6) == 0xe6) features |= 2;
+  }
+#endif
+  return features;
+}
+
+#endif
+
+struct Kernels
+{
+  void (*multiplyMatrices)(const float* t, const Lanes& lanes);
+  void (*transformPoints)(const float* t, const Lanes& lanes);
+  void (*scaleRadii)(float scale, const Lanes& lanes);
+};
+
+Kernels kernelsFor(TransformKernel kernel)
+{
+  if (!transformKernelSupported(kernel) || kernel == TransformKernel::Auto) kernel = bestTransformKernel();
+  switch (kernel)
+  {
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+  case TransformKernel::Sse: return { multiplyMatricesSse, transformPointsSse, scaleRadiiSse };
+  case TransformKernel::Avx2: return { multiplyMatricesAvx2, transformPointsAvx2, scaleRadiiAvx2 };
+  case TransformKernel::Avx512: return { multiplyMatricesAvx512, transformPointsAvx512, scaleRadiiAvx512 };
+#endif
+  default: return { multiplyMatricesScalar, transformPointsScalar, scaleRadiiScalar };
+  }
+}
+
+// The objects of input rounded up to whole AVX-512 registers, output is resized to fit first
+Lanes lanesOf(const SoaBuffer& input, SoaBuffer& output)
+{
+  output.resize(input.size());
+  std::size_t count = (input.size() + SoaBuffer::LANE_PADDING - 1) / SoaBuffer::LANE_PADDING * SoaBuffer::LANE_PADDING;
+  return { input.lane(0), input.stride(), output.lane(0), output.stride(), count };
+}
+
+}
+
+bool transformKernelSupported(TransformKernel kernel)
+{
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+  static const int features = cpuFeatures();
+  if (kernel == TransformKernel::Avx2) return features & 1;
+  if (kernel == TransformKernel::Avx512) return features & 2;
+  return true;
+#else
+  return kernel == TransformKernel::Auto || kernel == TransformKernel::Scalar;
+#endif
+}
+
+TransformKernel bestTransformKernel()
+{
+  if (transformKernelSupported(TransformKernel::Avx512)) return TransformKernel::Avx512;
+  if (transformKernelSupported(TransformKernel::Avx2)) return TransformKernel::Avx2;
+  if (transformKernelSupported(TransformKernel::Sse)) return TransformKernel::Sse;
+  return TransformKernel::Scalar;
+}
+
+const char* transformKernelName(TransformKernel kernel)
+{
+  switch (kernel)
+  {
+  case TransformKernel::Scalar: return "scalar";
+  case TransformKernel::Sse: return "SSE";
+  case TransformKernel::Avx2: return "AVX2";
+  case TransformKernel::Avx512: return "AVX-512";
+  default: return transformKernelName(bestTransformKernel());
+  }
+}
+
+void multiplyMatrices(const glm::mat4& transform, const MatrixBatch& input, MatrixBatch& output, TransformKernel kernel)
+{
+  kernelsFor(kernel).multiplyMatrices(&transform[0][0], lanesOf(input, output));
+}
+
+void transformPoints(const glm::mat4& transform, const PointBatch& input, PointBatch& output, TransformKernel kernel)
+{
+  kernelsFor(kernel).transformPoints(&transform[0][0], lanesOf(input, output));
+}
+
+void transformSpheres(const glm::mat4& transform, const SphereBatch& input, SphereBatch& output, TransformKernel kernel)
+{
+  float scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) });
+
+  Kernels kernels = kernelsFor(kernel);
+  Lanes lanes = lanesOf(input, output);
+  kernels.transformPoints(&transform[0][0], lanes);
+  kernels.scaleRadii(scale, lanes);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// Kernels of the batch transforms, Auto picks the widest one the CPU supports
+enum class TransformKernel
+{
+  Auto,
+  Scalar, // plain loops, also what runs on CPUs without SSE2
+  Sse,    // 4 objects per instruction
+  Avx2,   // 8 objects per instruction
+  Avx512  // 16 objects per instruction
+};
+
+/**
+ * Floats of count objects in structure of arrays layout: one lane per component (x, y, z, radius, a matrix element),
+ * each holding that component of every object, so one SIMD load brings the same component of 4, 8 or 16 objects
+ *
+ * Lanes start 64 byte aligned and have room for a multiple of LANE_PADDING objects, the kernels run over whole
+ * AVX-512 registers and never need a scalar tail
+ * The padding past size() holds zeros or whatever the last kernel wrote there
+*/
+class SoaBuffer
+{
+public:
+  static constexpr std::size_t ALIGNMENT = 64;
+  static constexpr std::size_t LANE_PADDING = 16;
+
+  explicit SoaBuffer(int laneCount);
+  SoaBuffer(const SoaBuffer&) = delete;
+  SoaBuffer& operator=(const SoaBuffer&) = delete;
+  ~SoaBuffer();
+
+  // Keeps the first objects, objects added are all zeros
+  void resize(std::size_t count);
+
+  std::size_t size() const { return count; }
+  int lanes() const { return laneCount; }
+
+  // Floats from the start of one lane to the next, a multiple of LANE_PADDING
+  std::size_t stride() const { return capacity; }
+
+  float* lane(int index) { return data + index * capacity; }
+  const float* lane(int index) const { return data + index * capacity; }
+
+private:
+  float* data = nullptr;
+  std::size_t count = 0;
+  std::size_t capacity = 0;
+  int laneCount;
+};
+
+// Matrices in glm's column major order: lane column * 4 + row holds element [column][row] of every matrix
+class MatrixBatch : public SoaBuffer
+{
+public:
+  MatrixBatch() : SoaBuffer(16) {}
+
+  void set(std::size_t index, const glm::mat4& matrix);
+  glm::mat4 get(std::size_t index) const;
+
+  // Replaces the contents with count matrices
+  void assign(const glm::mat4* matrices, std::size_t count);
+
+  // Writes all size() matrices to destination, e.g. a mapped instance buffer
+  void store(glm::mat4* destination) const;
+
+  float* element(int column, int row) { return lane(column * 4 + row); }
+  const float* element(int column, int row) const { return lane(column * 4 + row); }
+};
+
+// Lanes x, y, z
+class PointBatch : public SoaBuffer
+{
+public:
+  PointBatch() : SoaBuffer(3) {}
+
+  void set(std::size_t index, const glm::vec3& point);
+  glm::vec3 get(std::size_t index) const;
+};
+
+// Lanes x, y, z of the centers and the radius, set and get take (center, radius)
+class SphereBatch : public SoaBuffer
+{
+public:
+  SphereBatch() : SoaBuffer(4) {}
+
+  void set(std::size_t index, const glm::vec4& sphere);
+  glm::vec4 get(std::size_t index) const;
+};
+
+bool transformKernelSupported(TransformKernel kernel);
+TransformKernel bestTransformKernel();
+const char* transformKernelName(TransformKernel kernel);
+
+/**
+ * output[i] = transform * input[i], e.g. world matrices from the parent's world matrix and the local matrices
+ * Every kernel sums the products in the order glm's operator* does and rounds every multiply and add (no FMA, even in
+ * builds with -mfma), so the results are bit identical to glm's as long as the compiler does not fuse glm's own
+ * multiplies and adds; builds with FMA enabled may, and then the two differ by a few units in the last place
+ * output is resized to input.size() and may be input, kernels the CPU does not support fall back to the best one it does
+*/
+void multiplyMatrices(const glm::mat4& transform, const MatrixBatch& input, MatrixBatch& output, TransformKernel kernel = TransformKernel::Auto);
+
+// output[i] = transform * vec4(input[i], 1) without the w, like multiplyMatrices bit identical to glm
+void transformPoints(const glm::mat4& transform, const PointBatch& input, PointBatch& output, TransformKernel kernel = TransformKernel::Auto);
+
+/**
+ * Centers like transformPoints, radii scaled by the largest scale of transform's axes
+ * so the spheres still contain what they bounded (as setCullingInstances computes them)
+*/
+void transformSpheres(const glm::mat4& transform, const SphereBatch& input, SphereBatch& output, TransformKernel kernel = TransformKernel::Auto);
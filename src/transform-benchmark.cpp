@@ -0,0 +1,232 @@
+#include "transform-benchmark.h"
+
+#include "transform-batch.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <glm/simd/matrix.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const TransformKernel KERNELS[] = { TransformKernel::Scalar, TransformKernel::Sse, TransformKernel::Avx2, TransformKernel::Avx512 };
+
+struct Rng
+{
+  std::uint32_t state = 12345;
+  std::uint32_t next() { return state = state * 1664525u + 1013904223u; }
+
+  // In [low, high)
+  float uniform(float low, float high) { return low + (high - low) * (next() >> 8) * (1.f / (1 << 24)); }
+};
+
+// Fastest of iterations runs of body, each one calling it repeat times, in nanoseconds per object
+template <typename Body>
+double timeObjects(int iterations, int repeat, std::size_t count, Body body)
+{
+  double best = 1e30;
+  for (int i = 0; i < iterations; i++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++) body();
+    double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    best = std::min(best, nanoseconds / repeat / count);
+  }
+  return best;
+}
+
+#if defined(__FMA__)
+// This build lets the compiler fuse glm's multiplies and adds and the kernels never fuse theirs, so the two round
+// differently: each float may be off by a few units in the last place of the largest float of its object
+const float TOLERANCE = 8 * std::numeric_limits<float>::epsilon();
+#else
+const float TOLERANCE = 0;
+#endif
+
+// Whether count objects of size floats each match, bit for bit unless TOLERANCE says otherwise
+bool sameResults(const float* a, const float* b, std::size_t count, std::size_t size)
+{
+  if (TOLERANCE == 0) return std::memcmp(a, b, count * size * sizeof(float)) == 0;
+  for (std::size_t i = 0; i < count * size; i += size)
+  {
+    float largest = 0;
+    for (std::size_t k = i; k < i + size; k++) largest = std::max(largest, std::abs(b[k]));
+    for (std::size_t k = i; k < i + size; k++)
+    {
+      if (!(std::abs(a[k] - b[k]) <= TOLERANCE * largest)) return false;
+    }
+  }
+  return true;
+}
+
+// Nanoseconds per object of each column, negative for columns that were not run
+struct Row
+{
+  std::string name;
+  double glm = -1;
+  double aos = -1;
+  double kernels[4] = { -1, -1, -1, -1 };
+  bool match = true;
+};
+
+void printHeader()
+{
+  std::cout << std::left << std::setw(20) << "objects" << std::right << std::setw(9) << "glm" << std::setw(9) << "AoS SSE";
+  for (const char* kernel : { "SoA C", "SoA SSE", "SoA AVX2", "SoA 512" }) std::cout << std::setw(9) << kernel;
+  std::cout << std::setw(9) << "best x" << "   output (ns per object)" << std::endl;
+}
+
+void printRow(const Row& row)
+{
+  std::cout << std::left << std::setw(20) << row.name << std::right << std::fixed << std::setprecision(2);
+  double best = row.glm;
+  for (double column : { row.glm, row.aos, row.kernels[0], row.kernels[1], row.kernels[2], row.kernels[3] })
+  {
+    if (column < 0) std::cout << std::setw(9) << "-";
+    else std::cout << std::setw(9) << column;
+    if (column > 0) best = std::min(best, column);
+  }
+  std::cout << std::setw(8) << row.glm / best << "x   " << (row.match ? "ok" : "MISMATCH") << std::endl;
+  std::cout.unsetf(std::ios::floatfield);
+}
+
+Row benchmarkMatrices(const glm::mat4& parent, std::size_t count, int iterations, int repeat, Rng& rng)
+{
+  std::vector<glm::mat4> local(count), world(count), expected(count);
+  for (glm::mat4& matrix : local)
+  {
+    glm::vec3 position(rng.uniform(-100, 100), rng.uniform(-100, 100), rng.uniform(-100, 100));
+    glm::vec3 axis = glm::normalize(glm::vec3(rng.uniform(-1, 1), rng.uniform(-1, 1), rng.uniform(.1f, 1)));
+    matrix = glm::scale(glm::rotate(glm::translate(glm::mat4(1), position), rng.uniform(0, 6.28f), axis), glm::vec3(rng.uniform(.5f, 2)));
+  }
+
+  Row row;
+  row.name = "matrices " + std::to_string(count);
+  row.glm = timeObjects(iterations, repeat, count, [&] { for (std::size_t i = 0; i < count; i++) world[i] = parent * local[i]; });
+  expected = world;
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+  // glm's own SIMD product sums in another order, it is timed for reference and not compared
+  row.aos = timeObjects(iterations, repeat, count, [&]
+  {
+    for (std::size_t i = 0; i < count; i++)
+    {
+      glm_mat4_mul(*(glm_vec4 const(*)[4])&parent[0], *(glm_vec4 const(*)[4])&local[i][0], *(glm_vec4(*)[4])&world[i][0]);
+    }
+  });
+#endif
+
+  MatrixBatch input, output;
+  input.assign(local.data(), count);
+  for (int k = 0; k < 4; k++)
+  {
+    if (!transformKernelSupported(KERNELS[k])) continue;
+    row.kernels[k] = timeObjects(iterations, repeat, count, [&] { multiplyMatrices(parent, input, output, KERNELS[k]); });
+    output.store(world.data());
+    row.match = sameResults(&world[0][0][0], &expected[0][0][0], count, 16) && row.match;
+  }
+  return row;
+}
+
+Row benchmarkPoints(const glm::mat4& transform, std::size_t count, int iterations, int repeat, Rng& rng)
+{
+  std::vector<glm::vec3> points(count), transformed(count);
+  for (glm::vec3& point : points) point = glm::vec3(rng.uniform(-100, 100), rng.uniform(-100, 100), rng.uniform(-100, 100));
+
+  Row row;
+  row.name = "points " + std::to_string(count);
+  row.glm = timeObjects(iterations, repeat, count, [&]
+  {
+    for (std::size_t i = 0; i < count; i++) transformed[i] = glm::vec3(transform * glm::vec4(points[i], 1));
+  });
+
+  PointBatch input, output;
+  input.resize(count);
+  for (std::size_t i = 0; i < count; i++) input.set(i, points[i]);
+  for (int k = 0; k < 4; k++)
+  {
+    if (!transformKernelSupported(KERNELS[k])) continue;
+    row.kernels[k] = timeObjects(iterations, repeat, count, [&] { transformPoints(transform, input, output, KERNELS[k]); });
+    for (std::size_t i = 0; i < count; i++)
+    {
+      glm::vec3 point = output.get(i);
+      row.match = sameResults(&point[0], &transformed[i][0], 1, 3) && row.match;
+    }
+  }
+  return row;
+}
+
+Row benchmarkSpheres(const glm::mat4& transform, std::size_t count, int iterations, int repeat, Rng& rng)
+{
+  std::vector<glm::vec4> spheres(count), transformed(count);
+  for (glm::vec4& sphere : spheres) sphere = glm::vec4(rng.uniform(-100, 100), rng.uniform(-100, 100), rng.uniform(-100, 100), rng.uniform(.1f, 5));
+
+  Row row;
+  row.name = "spheres " + std::to_string(count);
+  row.glm = timeObjects(iterations, repeat, count, [&]
+  {
+    float scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) });
+    for (std::size_t i = 0; i < count; i++)
+    {
+      transformed[i] = glm::vec4(glm::vec3(transform * glm::vec4(glm::vec3(spheres[i]), 1)), spheres[i].w * scale);
+    }
+  });
+
+  SphereBatch input, output;
+  input.resize(count);
+  for (std::size_t i = 0; i < count; i++) input.set(i, spheres[i]);
+  for (int k = 0; k < 4; k++)
+  {
+    if (!transformKernelSupported(KERNELS[k])) continue;
+    row.kernels[k] = timeObjects(iterations, repeat, count, [&] { transformSpheres(transform, input, output, KERNELS[k]); });
+    for (std::size_t i = 0; i < count; i++)
+    {
+      glm::vec4 sphere = output.get(i);
+      row.match = sameResults(&sphere[0], &transformed[i][0], 1, 4) && row.match;
+    }
+  }
+  return row;
+}
+
+}
+
+bool runTransformBenchmark(int iterations)
+{
+  glm::mat4 transform = glm::translate(glm::mat4(1), glm::vec3(3, -2, 10));
+  transform = glm::rotate(transform, .7f, glm::normalize(glm::vec3(.5f, 1, .25f)));
+  transform = glm::scale(transform, glm::vec3(1.5f, 1.5f, 2));
+
+  std::cout << "Batch kernel: " << transformKernelName(TransformKernel::Auto) << std::endl;
+  printHeader();
+
+  bool success = true;
+  Rng rng;
+  for (std::size_t count : { 1000, 10000, 100000, 1000000 })
+  {
+    // About 4M objects per timed run, so small batches are not lost in the clock's resolution
+    int repeat = (int)std::max<std::size_t>(1, 4000000 / count);
+    Row rows[] = {
+      benchmarkMatrices(transform, count, iterations, repeat, rng),
+      benchmarkPoints(transform, count, iterations, repeat, rng),
+      benchmarkSpheres(transform, count, iterations, repeat, rng),
+    };
+    for (const Row& row : rows)
+    {
+      printRow(row);
+      success = row.match && success;
+    }
+  }
+  return success;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+/**
+ * Times the batch transforms of transform-batch.h (matrices, points and bounding spheres by one matrix) with every
+ * kernel the CPU supports, against a loop of glm's scalar operator* over arrays of glm::mat4 / glm::vec3,
+ * and for matrices also against glm_mat4_mul one matrix at a time, for 1k to 1M objects
+ *
+ * Returns false if any kernel's result is not bit identical to glm's, or in builds with FMA enabled (where the compiler
+ * may fuse glm's multiplies and adds but not the kernels') more than a few units in the last place off
+*/
+bool runTransformBenchmark(int iterations);